@@ -0,0 +1,131 @@
+/**
+ * @file crc_test.cpp
+ * @brief UT of crc32i and crc_16: check values, every alignment and length
+ * against a bitwise reference, split updates, and the rate in MB/s.
+ *
+ * @copyright Copyright (c) 2021-2024 Tuya Inc. All Rights Reserved.
+ *
+ */
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <vector>
+
+#include "crc_16.h"
+
+// crc32i.h carries no extern "C"
+extern "C" {
+#include "crc32i.h"
+}
+
+#define UT_LARGE_SIZE  (64 * 1024)
+#define UT_BENCH_BYTES (64 * 1024 * 1024)
+
+#if defined(ENABLE_CRC_SLICE_BY_8) && (ENABLE_CRC_SLICE_BY_8 == 1)
+#define UT_CRC_METHOD "slice-by-8"
+#else
+#define UT_CRC_METHOD "byte table"
+#endif
+
+// CRC-32/ISO-HDLC a bit per step, without the final xor
+static uint32_t ut_crc32_ref(uint32_t crc, const uint8_t *data, size_t size)
+{
+    while (size--) {
+        crc ^= *data++;
+        for (int i = 0; i < 8; i++) {
+            crc = (crc >> 1) ^ (0xEDB88320u & -(crc & 1));
+        }
+    }
+    return crc;
+}
+
+// CRC-16/MODBUS a bit per step
+static uint16_t ut_crc16_ref(const uint8_t *data, size_t size)
+{
+    uint16_t crc = 0xffff;
+
+    while (size--) {
+        crc ^= *data++;
+        for (int i = 0; i < 8; i++) {
+            crc = (crc >> 1) ^ (0xA001 & -(crc & 1));
+        }
+    }
+    return crc;
+}
+
+class CrcTest : public ::testing::Test {
+protected:
+    std::vector<uint8_t> data;
+
+    void SetUp() override
+    {
+        data.resize(UT_LARGE_SIZE + 8);
+        for (size_t i = 0; i < data.size(); i++) {
+            data[i] = (uint8_t)((i * 2654435761u) >> 13);
+        }
+    }
+};
+
+TEST_F(CrcTest, check)
+{
+    const char *check = "123456789";
+
+    EXPECT_EQ(0xCBF43926u, hash_crc32i_total(check, 9));
+    EXPECT_EQ(0x4B37, get_crc_16((unsigned char *)check, 9));
+    EXPECT_EQ(0u, hash_crc32i_total(check, 0));
+    EXPECT_EQ(0xffff, get_crc_16((unsigned char *)check, 0));
+}
+
+// the 8 byte steps start at any alignment and leave any tail
+TEST_F(CrcTest, offset_length)
+{
+    for (size_t off = 0; off < 8; off++) {
+        for (size_t len = 0; len < 300; len++) {
+            const uint8_t *p = data.data() + off;
+            ASSERT_EQ(~ut_crc32_ref(0xffffffff, p, len), hash_crc32i_total(p, len)) << off << " " << len;
+            ASSERT_EQ(ut_crc16_ref(p, len), get_crc_16((unsigned char *)p, len)) << off << " " << len;
+        }
+    }
+}
+
+// updates in two pieces give the crc of the whole
+TEST_F(CrcTest, split)
+{
+    uint32_t total = hash_crc32i_total(data.data(), 300);
+
+    for (size_t cut = 0; cut <= 300; cut++) {
+        uint32_t hash = hash_crc32i_init();
+        hash = hash_crc32i_update(hash, data.data(), cut);
+        hash = hash_crc32i_update(hash, data.data() + cut, 300 - cut);
+        ASSERT_EQ(total, hash_crc32i_finish(hash)) << cut;
+    }
+}
+
+TEST_F(CrcTest, large)
+{
+    EXPECT_EQ(~ut_crc32_ref(0xffffffff, data.data(), UT_LARGE_SIZE), hash_crc32i_total(data.data(), UT_LARGE_SIZE));
+    EXPECT_EQ(ut_crc16_ref(data.data() + 1, 0xffff), get_crc_16(data.data() + 1, 0xffff));
+}
+
+/**
+ * UT_BENCH_BYTES through each crc in 64KB calls, compare the two methods by
+ * running both ut_common and ut_common_slice8
+ */
+TEST_F(CrcTest, bench)
+{
+    auto t0 = std::chrono::steady_clock::now();
+    for (size_t n = 0; n < UT_BENCH_BYTES; n += UT_LARGE_SIZE) {
+        hash_crc32i_total(data.data(), UT_LARGE_SIZE);
+    }
+    double crc32_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    t0 = std::chrono::steady_clock::now();
+    for (size_t n = 0; n < UT_BENCH_BYTES; n += 0xffff) {
+        get_crc_16(data.data(), 0xffff);
+    }
+    double crc16_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    printf("[ BENCH    ] %s: crc32 %7.1f MB/s, crc16 %7.1f MB/s\n", UT_CRC_METHOD,
+           UT_BENCH_BYTES / crc32_s / (1024 * 1024), UT_BENCH_BYTES / crc16_s / (1024 * 1024));
+}
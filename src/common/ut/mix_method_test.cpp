@@ -0,0 +1,33 @@
+/**
+ * @file mix_method_test.cpp
+ * @brief UT of the mix_method hashes: FNV-1a check values, and mm_hash equal
+ * to mm_str_hash over the bytes of a string.
+ *
+ * @copyright Copyright (c) 2021-2024 Tuya Inc. All Rights Reserved.
+ *
+ */
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "mix_method.h"
+
+TEST(MixMethodTest, hash_check)
+{
+    EXPECT_EQ(0x811C9DC5u, mm_hash("", 0));
+    EXPECT_EQ(0xE40C292Cu, mm_hash("a", 1));
+    EXPECT_EQ(0xBF9CF968u, mm_hash("foobar", 6));
+    EXPECT_EQ(0u, mm_hash(NULL, 4));
+    EXPECT_EQ(0u, mm_str_hash(NULL));
+}
+
+TEST(MixMethodTest, hash_str)
+{
+    std::string str;
+
+    for (int i = 0; i < 300; i++) {
+        EXPECT_EQ(mm_str_hash(str.c_str()), mm_hash(str.data(), str.size())) << i;
+        str += (char)(1 + i % 255);
+    }
+}
@@ -272,6 +272,53 @@ char *mm_strdup(const char *str)
     return tmp;
 }
 
+/**
+ * @brief Calculates the FNV-1a hash of a string.
+ *
+ * @param str The input string.
+ * @return The 32-bit hash value, or 0 if the input string is NULL.
+ */
+uint32_t mm_str_hash(const char *str)
+{
+    uint32_t hash = 2166136261UL;
+
+    if ((void *)0 == str) {
+        return 0;
+    }
+
+    while (*str) {
+        hash ^= (uint8_t)(*str++);
+        hash *= 16777619UL;
+    }
+
+    return hash;
+}
+
+/**
+ * @brief Calculates the FNV-1a hash of a buffer.
+ *
+ * @param buf The input buffer.
+ * @param len The length of the buffer.
+ * @return The 32-bit hash value, the same as mm_str_hash for the bytes of a
+ * string, or 0 if the input buffer is NULL.
+ */
+uint32_t mm_hash(const void *buf, size_t len)
+{
+    const uint8_t *p = (const uint8_t *)buf;
+    uint32_t hash = 2166136261UL;
+
+    if ((void *)0 == buf) {
+        return 0;
+    }
+
+    while (len--) {
+        hash ^= *p++;
+        hash *= 16777619UL;
+    }
+
+    return hash;
+}
+
 /**
  * @brief Checks if a version string is valid.
  *
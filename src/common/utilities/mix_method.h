@@ -120,6 +120,24 @@ void byte_sort(unsigned char is_ascend, unsigned char *buf, int buf_cnt);
  */
 char *mm_strdup(const char *str);
 
+/**
+ * @brief calculate FNV-1a hash of a string, used for fast name lookup
+ *
+ * @param[in] str the input string
+ * @return the 32-bit hash value, 0 on str is NULL
+ */
+uint32_t mm_str_hash(const char *str);
+
+/**
+ * @brief calculate FNV-1a hash of a buffer, equal to mm_str_hash of a string
+ * with the same bytes
+ *
+ * @param[in] buf the input buffer
+ * @param[in] len the length of buf
+ * @return the 32-bit hash value, 0 on buf is NULL
+ */
+uint32_t mm_hash(const void *buf, size_t len);
+
 /**
  * @brief check the version input is valid
  *
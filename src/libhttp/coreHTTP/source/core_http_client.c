@@ -2726,7 +2726,13 @@ HTTPStatus_t HTTPClient_Request( const TransportInterface_t * pTransport,
                 LogError( ( "Failed to receive HTTP data: Transport recv() "
                             "returned error: TransportStatus=%ld",
                             ( long int ) currentReceived ) );
-                return HTTPNetworkError;
+                /* a transport error or timeout, else the peer closed before or in the response */
+                if (currentReceived < 0) {
+                    returnStatus = HTTPNetworkError;
+                } else {
+                    returnStatus = (0 == totalReceived) ? HTTPNoResponse : HTTPPartialResponse;
+                }
+                goto __exit;
             }
             totalReceived += currentReceived;
             pResponse->pBuffer[totalReceived] = 0;
@@ -2812,7 +2818,8 @@ HTTPStatus_t HTTPClient_Request( const TransportInterface_t * pTransport,
                 LogError( ( "Failed to receive HTTP data: Transport recv() "
                             "returned error: TransportStatus=%ld",
                             ( long int ) currentReceived ) );
-                return HTTPNetworkError;
+                returnStatus = HTTPPartialResponse;
+                goto __exit;
             }
             chunkLen = currentReceived;
             parsingContext.recvState = HTTP_PARSE_CHUNK;
@@ -2844,7 +2851,8 @@ HTTPStatus_t HTTPClient_Request( const TransportInterface_t * pTransport,
                 LogError( ( "Failed to receive HTTP data: Transport recv() "
                             "returned error: TransportStatus=%ld",
                             ( long int ) currentReceived ) );
-                return HTTPNetworkError;
+                returnStatus = HTTPPartialResponse;
+                goto __exit;
             }
             bodyLen += currentReceived;
             if (pResponse->contentLength == bodyLen) {
@@ -2880,10 +2888,12 @@ __exit:
 
     if (pResponse->pBuffer) {
         HTTP_FREE(pResponse->pBuffer);
+        pResponse->pBuffer = NULL;
     }
 
     if (pResponse->pBody) {
         HTTP_FREE(pResponse->pBody);
+        pResponse->pBody = NULL;
     }
 
     return returnStatus;
@@ -31,6 +31,8 @@ typedef struct http_client_request {
     const uint8_t *body;
     size_t body_length;
     uint32_t timeout_ms;
+    bool keep_alive; // reuse the idle connection to the same host, and keep this one for the next request,
+                     // ignored without ENABLE_HTTP_KEEPALIVE
 } http_client_request_t;
 
 typedef struct http_client_response {
@@ -64,4 +66,10 @@ http_client_status_t http_client_request(const http_client_request_t *request, h
 
 int http_client_free(http_client_response_t *response);
 
+/**
+ * @brief close all idle keep-alive connections, e.g. when network is down
+ *
+ */
+void http_client_keepalive_flush(void);
+
 #endif /* ifndef HTTP_CLIENT_INTERFACE_H */
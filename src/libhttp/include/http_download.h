@@ -15,6 +15,9 @@ typedef enum {
     DL_EVENT_ON_DATA,
     DL_EVENT_FINISH,
     DL_EVENT_FAULT,
+    DL_EVENT_ON_RESUME,     // a checkpoint is found, event.offset/data is the saved one, set event.offset to 0 to reject it
+    DL_EVENT_ON_CHECKPOINT, // data before event.offset is consumed, event.data/data_len can carry a blob saved with it,
+                            // set event.offset to 0 to save no checkpoint
 } http_download_event_id_t;
 
 typedef struct {
@@ -37,6 +40,9 @@ typedef struct {
     size_t file_size;
     void *user_data;
     http_download_event_cb_t event_handler;
+    bool pipeline;          // receive the next range while DL_EVENT_ON_DATA of the previous one runs in a writer thread
+    const char *resume_key; // kv key of the download checkpoint, NULL means download from the beginning
+    size_t checkpoint_size; // save a checkpoint every checkpoint_size bytes, 0 means the default
 } http_download_config_t;
 
 int http_file_download(http_download_config_t *config);
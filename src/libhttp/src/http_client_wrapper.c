@@ -4,6 +4,10 @@
 #include "core_http_client.h"
 #include "tuya_tls.h"
 #include "tal_log.h"
+#include "tal_api.h"
+#include "tal_network.h"
+#include "mix_method.h"
+#include "mbedtls/ssl.h"
 
 #define log_debug PR_DEBUG
 #define log_error PR_ERR
@@ -11,6 +15,46 @@
 #define HEADER_BUFFER_LENGTH (255)
 #define DEFAULT_HTTP_PORT    (80)
 #define DEFAULT_HTTPS_PORT   (443)
+
+/* the connection of one request, and what it saw, to decide on a retry */
+typedef struct {
+    NetworkContext_t network; // first, the transport interface passes this struct as the NetworkContext_t
+    size_t sent;
+    size_t received;
+    BOOL_T peer_closed;
+} http_transport_t;
+
+#if defined(ENABLE_HTTP_KEEPALIVE) && (ENABLE_HTTP_KEEPALIVE == 1)
+#ifndef HTTP_KEEPALIVE_POOL_SIZE
+#define HTTP_KEEPALIVE_POOL_SIZE (1)
+#endif
+
+#ifndef HTTP_KEEPALIVE_IDLE_MS
+#define HTTP_KEEPALIVE_IDLE_MS (30000)
+#endif
+
+#define HTTP_KEEPALIVE_HOST_LEN (64)
+
+/* idle connection kept for the next request to the same host */
+typedef struct {
+    NetworkContext_t network; // NULL if the slot is empty
+    char host[HTTP_KEEPALIVE_HOST_LEN + 1];
+    uint16_t port;
+    size_t cacert_len; // 0 for tcp connection
+    uint32_t cacert_hash;
+    SYS_TIME_T idle_since;
+} http_keepalive_conn_t;
+
+typedef struct {
+    BOOL_T inited;
+    MUTEX_HANDLE mutex;
+    TIMER_ID timer;
+    http_keepalive_conn_t conn[HTTP_KEEPALIVE_POOL_SIZE];
+} http_keepalive_pool_t;
+
+static http_keepalive_pool_t s_http_pool = {0};
+#endif
+
 static http_client_status_t core_http_request_send(const TransportInterface_t *pTransportInterface,
                                                    const HTTPRequestInfo_t *requestInfo, http_client_header_t *headers,
                                                    uint8_t headers_count, const uint8_t *pRequestBodyBuf,
@@ -74,16 +118,219 @@ static http_client_status_t core_http_request_send(const TransportInterface_t *p
     return HTTP_CLIENT_SUCCESS;
 }
 
-http_client_status_t http_client_request(const http_client_request_t *request, http_client_response_t *response)
+/* closed or reset by the peer, as opposed to a timeout or another error */
+static BOOL_T http_transport_peer_closed(int result)
+{
+    if (0 == result || MBEDTLS_ERR_SSL_CONN_EOF == result || MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY == result) {
+        return TRUE;
+    }
+
+    return (result < 0) && (OPRT_RESOURCE_NOT_READY != result) && (UNW_ECONNRESET == tal_net_get_errno());
+}
+
+static int http_transport_send(NetworkContext_t *pNetwork, const unsigned char *pMsg, size_t len)
+{
+    http_transport_t *transport = (http_transport_t *)pNetwork;
+    int result = tuya_transporter_write(transport->network, (uint8_t *)pMsg, len, 0);
+
+    if (result > 0) {
+        transport->sent += result;
+    } else if (http_transport_peer_closed(result)) {
+        transport->peer_closed = TRUE;
+    }
+
+    return result;
+}
+
+/* unlike NetworkTransportRecv, a timeout is returned as OPRT_RESOURCE_NOT_READY, not as 0 */
+static int http_transport_recv(NetworkContext_t *pNetwork, unsigned char *pMsg, size_t len)
+{
+    http_transport_t *transport = (http_transport_t *)pNetwork;
+    tuya_tls_config_t *tls_config = NULL;
+
+    tuya_transporter_ctrl(transport->network, TUYA_TRANSPORTER_GET_TLS_CONFIG, &tls_config);
+
+    int result = tuya_transporter_read(transport->network, (uint8_t *)pMsg, len, tls_config ? tls_config->timeout : 5000);
+    if (result > 0) {
+        transport->received += result;
+    } else if (http_transport_peer_closed(result)) {
+        transport->peer_closed = TRUE;
+    }
+
+    return result;
+}
+
+static void http_connection_release(NetworkContext_t network)
+{
+    tuya_transporter_close(network);
+    tuya_transporter_destroy(network);
+}
+
+#if defined(ENABLE_HTTP_KEEPALIVE) && (ENABLE_HTTP_KEEPALIVE == 1)
+static void http_keepalive_timeout_cb(TIMER_ID timer_id, void *arg)
+{
+    NetworkContext_t expired[HTTP_KEEPALIVE_POOL_SIZE] = {0};
+    SYS_TIME_T next = 0;
+    SYS_TIME_T now = tal_system_get_millisecond();
+    int i;
+
+    tal_mutex_lock(s_http_pool.mutex);
+    for (i = 0; i < HTTP_KEEPALIVE_POOL_SIZE; i++) {
+        http_keepalive_conn_t *conn = &s_http_pool.conn[i];
+        if (NULL == conn->network) {
+            continue;
+        }
+        if (now - conn->idle_since >= HTTP_KEEPALIVE_IDLE_MS) {
+            expired[i] = conn->network;
+            conn->network = NULL;
+        } else if (0 == next || HTTP_KEEPALIVE_IDLE_MS - (now - conn->idle_since) < next) {
+            next = HTTP_KEEPALIVE_IDLE_MS - (now - conn->idle_since);
+        }
+    }
+    // check again when the next idle connection expires
+    if (next) {
+        tal_sw_timer_start(s_http_pool.timer, next, TAL_TIMER_ONCE);
+    }
+    tal_mutex_unlock(s_http_pool.mutex);
+
+    // close out of lock, tls close may send close notify
+    for (i = 0; i < HTTP_KEEPALIVE_POOL_SIZE; i++) {
+        if (expired[i]) {
+            log_debug("http keepalive %d idle timeout", i);
+            http_connection_release(expired[i]);
+        }
+    }
+}
+
+static int http_keepalive_pool_init(void)
+{
+    OPERATE_RET rt = OPRT_OK;
+
+    if (s_http_pool.inited) {
+        return OPRT_OK;
+    }
+
+    TUYA_CALL_ERR_RETURN(tal_mutex_create_init(&s_http_pool.mutex));
+    rt = tal_sw_timer_create(http_keepalive_timeout_cb, NULL, &s_http_pool.timer);
+    if (OPRT_OK != rt) {
+        tal_mutex_release(s_http_pool.mutex);
+        s_http_pool.mutex = NULL;
+        return rt;
+    }
+    s_http_pool.inited = TRUE;
+
+    return OPRT_OK;
+}
+
+static BOOL_T http_keepalive_match(const http_keepalive_conn_t *conn, const http_client_request_t *request,
+                                   uint16_t port)
+{
+    return conn->network && conn->port == port && 0 == strcmp(conn->host, request->host) &&
+           conn->cacert_len == ((request->cacert == NULL) ? 0 : request->cacert_len) &&
+           (conn->cacert_len == 0 || conn->cacert_hash == mm_hash(request->cacert, request->cacert_len));
+}
+
+/* take an idle connection to the request host out of the pool, NULL if none */
+static NetworkContext_t http_keepalive_take(const http_client_request_t *request, uint16_t port)
+{
+    NetworkContext_t network = NULL;
+    SYS_TIME_T now = tal_system_get_millisecond();
+    int i;
+
+    if (OPRT_OK != http_keepalive_pool_init()) {
+        return NULL;
+    }
+
+    tal_mutex_lock(s_http_pool.mutex);
+    for (i = 0; i < HTTP_KEEPALIVE_POOL_SIZE; i++) {
+        http_keepalive_conn_t *conn = &s_http_pool.conn[i];
+        if (http_keepalive_match(conn, request, port) && now - conn->idle_since < HTTP_KEEPALIVE_IDLE_MS) {
+            network = conn->network;
+            conn->network = NULL;
+            break;
+        }
+    }
+    tal_mutex_unlock(s_http_pool.mutex);
+
+    if (NULL == network) {
+        return NULL;
+    }
+
+    // nothing is expected on an idle connection, readable means the server
+    // has closed it (or sent garbage), drop it. Probe with 1ms, a 0 timeout
+    // makes tal_net_select block until the socket is readable
+    if (0 != tuya_transporter_poll_read(network, 1)) {
+        log_debug("http keepalive closed by peer");
+        http_connection_release(network);
+        return NULL;
+    }
+
+    return network;
+}
+
+/* park the connection in the pool, the oldest idle one is evicted if full */
+static void http_keepalive_put(const http_client_request_t *request, uint16_t port, NetworkContext_t network)
+{
+    NetworkContext_t evict = NULL;
+    http_keepalive_conn_t *slot = NULL;
+    int i;
+
+    if (strlen(request->host) > HTTP_KEEPALIVE_HOST_LEN || OPRT_OK != http_keepalive_pool_init()) {
+        http_connection_release(network);
+        return;
+    }
+
+    tal_mutex_lock(s_http_pool.mutex);
+    for (i = 0; i < HTTP_KEEPALIVE_POOL_SIZE; i++) {
+        http_keepalive_conn_t *conn = &s_http_pool.conn[i];
+        if (NULL == conn->network) {
+            slot = conn;
+            break;
+        }
+        if (NULL == slot || conn->idle_since < slot->idle_since) {
+            slot = conn;
+        }
+    }
+    evict = slot->network;
+
+    strcpy(slot->host, request->host);
+    slot->port = port;
+    slot->cacert_len = (request->cacert == NULL) ? 0 : request->cacert_len;
+    slot->cacert_hash = mm_hash(request->cacert, slot->cacert_len);
+    slot->idle_since = tal_system_get_millisecond();
+    slot->network = network;
+
+    if (!tal_sw_timer_is_running(s_http_pool.timer)) {
+        tal_sw_timer_start(s_http_pool.timer, HTTP_KEEPALIVE_IDLE_MS, TAL_TIMER_ONCE);
+    }
+    tal_mutex_unlock(s_http_pool.mutex);
+
+    if (evict) {
+        http_connection_release(evict);
+    }
+}
+
+#else
+static NetworkContext_t http_keepalive_take(const http_client_request_t *request, uint16_t port)
+{
+    return NULL;
+}
+
+static void http_keepalive_put(const http_client_request_t *request, uint16_t port, NetworkContext_t network)
+{
+    http_connection_release(network);
+}
+#endif
+
+static http_client_status_t http_connection_open(const http_client_request_t *request, uint16_t port,
+                                                 NetworkContext_t *network)
 {
-    http_client_status_t rt = HTTP_CLIENT_SUCCESS;
     int ret = OPRT_OK;
 
     /* TLS pre init */
-    NetworkContext_t network;
     TUYA_TRANSPORT_TYPE_E transport_type = (request->cacert == NULL) ? TRANSPORT_TYPE_TCP : TRANSPORT_TYPE_TLS;
-    network = tuya_transporter_create(transport_type, NULL);
-    if (NULL == network) {
+    *network = tuya_transporter_create(transport_type, NULL);
+    if (NULL == *network) {
         return HTTP_CLIENT_MALLOC_FAULT;
     }
 
@@ -92,39 +339,73 @@ http_client_status_t http_client_request(const http_client_request_t *request, h
             .ca_cert = (char *)request->cacert,
             .ca_cert_size = request->cacert_len,
             .hostname = (char *)request->host,
-            .port = (request->port == 0) ? DEFAULT_HTTPS_PORT : request->port,
+            .port = port,
             .timeout = request->timeout_ms,
             .mode = TUYA_TLS_SERVER_CERT_MODE,
             .verify = true,
         };
 
-        ret = tuya_transporter_ctrl(network, TUYA_TRANSPORTER_SET_TLS_CONFIG, &tls_config);
+        ret = tuya_transporter_ctrl(*network, TUYA_TRANSPORTER_SET_TLS_CONFIG, &tls_config);
         if (OPRT_OK != ret) {
             log_error("network_tls_init fail:%d", ret);
-            return ret;
-        }
-
-        ret = tuya_transporter_connect(network, tls_config.hostname, tls_config.port, tls_config.timeout);
-        if (OPRT_OK != ret) {
-            tuya_transporter_close(network);
-            tuya_transporter_destroy(network);
+            tuya_transporter_destroy(*network);
+            *network = NULL;
             return HTTP_CLIENT_SEND_FAULT;
         }
+    }
+
+    ret = tuya_transporter_connect(*network, request->host, port, request->timeout_ms);
+    if (OPRT_OK != ret) {
+        http_connection_release(*network);
+        *network = NULL;
+        return HTTP_CLIENT_SEND_FAULT;
+    }
 
-        log_debug("tls connencted!");
+    log_debug("%s connencted!", (transport_type == TRANSPORT_TYPE_TLS) ? "tls" : "tcp");
+
+    return HTTP_CLIENT_SUCCESS;
+}
+
+http_client_status_t http_client_request(const http_client_request_t *request, http_client_response_t *response)
+{
+    http_client_status_t rt = HTTP_CLIENT_SUCCESS;
+    http_transport_t transport = {0};
+    uint16_t port = request->port;
+#if defined(ENABLE_HTTP_KEEPALIVE) && (ENABLE_HTTP_KEEPALIVE == 1)
+    BOOL_T keep_alive = request->keep_alive;
+#else
+    BOOL_T keep_alive = FALSE;
+#endif
+
+    if (port == 0) {
+        port = (request->cacert == NULL) ? DEFAULT_HTTP_PORT : DEFAULT_HTTPS_PORT;
+    }
+
+    /* reuse the idle connection, skip the tcp connect and tls handshake */
+    if (keep_alive) {
+        transport.network = http_keepalive_take(request, port);
+    }
+    BOOL_T reused = (transport.network != NULL);
+
+    if (reused) {
+        // connection created by other request, follow the timeout of this one
+        tuya_tls_config_t *tls_config = NULL;
+        tuya_transporter_ctrl(transport.network, TUYA_TRANSPORTER_GET_TLS_CONFIG, &tls_config);
+        if (tls_config) {
+            tls_config->timeout = request->timeout_ms;
+        }
+        log_debug("http keepalive reuse %s:%d", request->host, port);
     } else {
-        ret = tuya_transporter_connect(network, request->host, (request->port == 0) ? DEFAULT_HTTP_PORT : request->port,
-                                       request->timeout_ms);
-        if (OPRT_OK != ret) {
-            tuya_transporter_close(network);
-            tuya_transporter_destroy(network);
-            return HTTP_CLIENT_SEND_FAULT;
+        rt = http_connection_open(request, port, &transport.network);
+        if (HTTP_CLIENT_SUCCESS != rt) {
+            return rt;
         }
     }
+
     /* http client TransportInterface */
-    TransportInterface_t pTransportInterface = {.pNetworkContext = (NetworkContext_t *)&network,
-                                                .recv = (TransportRecv_t)NetworkTransportRecv,
-                                                .send = (TransportSend_t)NetworkTransportSend};
+    TransportInterface_t pTransportInterface = {.pNetworkContext = (NetworkContext_t *)&transport,
+                                                .recv = (TransportRecv_t)http_transport_recv,
+                                                .send = (TransportSend_t)http_transport_send};
 
     /* http client request object make */
     HTTPRequestInfo_t requestInfo = {
@@ -134,6 +415,7 @@ http_client_status_t http_client_request(const http_client_request_t *request, h
         .hostLen = strlen(request->host),
         .pPath = request->path,
         .pathLen = strlen(request->path),
+        .reqFlags = keep_alive ? HTTP_REQUEST_KEEP_ALIVE_FLAG : 0,
     };
 
     HTTPResponse_t http_response = {0};
@@ -144,11 +426,35 @@ http_client_status_t http_client_request(const http_client_request_t *request, h
                                 (const HTTPRequestInfo_t *)&requestInfo, request->headers, request->headers_count,
                                 (const uint8_t *)request->body, request->body_length, &http_response);
 
-    /* tls disconnect */
-    tuya_transporter_close(network);
-    tuya_transporter_destroy(network);
+    /*
+     * the server may close the idle connection at any time, retry once on a new one.
+     * only when no byte of the request got out, or the peer closed or reset the
+     * connection before a byte came back. After a timeout the server may have
+     * handled the request and a POST would be applied twice
+     */
+    if (HTTP_CLIENT_SUCCESS != rt && reused && (0 == transport.sent || (transport.peer_closed && 0 == transport.received))) {
+        log_debug("http keepalive connection broken, reconnect");
+        http_connection_release(transport.network);
+        memset(&transport, 0, sizeof(transport));
+        rt = http_connection_open(request, port, &transport.network);
+        if (HTTP_CLIENT_SUCCESS != rt) {
+            return rt;
+        }
+        memset(&http_response, 0, sizeof(http_response));
+        rt = core_http_request_send((const TransportInterface_t *)&pTransportInterface,
+                                    (const HTTPRequestInfo_t *)&requestInfo, request->headers, request->headers_count,
+                                    (const uint8_t *)request->body, request->body_length, &http_response);
+    }
 
-    if (OPRT_OK != rt) {
+    /* keep the connection if both side agree, otherwise disconnect */
+    if (HTTP_CLIENT_SUCCESS == rt && keep_alive &&
+        !(http_response.respFlags & HTTP_RESPONSE_CONNECTION_CLOSE_FLAG)) {
+        http_keepalive_put(request, port, transport.network);
+    } else {
+        http_connection_release(transport.network);
+    }
+
+    if (HTTP_CLIENT_SUCCESS != rt) {
         log_error("http_request_send error:%d", rt);
         return rt;
     }
@@ -165,6 +471,30 @@ http_client_status_t http_client_request(const http_client_request_t *request, h
     return HTTP_CLIENT_SUCCESS;
 }
 
+void http_client_keepalive_flush(void)
+{
+#if defined(ENABLE_HTTP_KEEPALIVE) && (ENABLE_HTTP_KEEPALIVE == 1)
+    NetworkContext_t network = NULL;
+    int i;
+
+    if (!s_http_pool.inited) {
+        return;
+    }
+
+    for (i = 0; i < HTTP_KEEPALIVE_POOL_SIZE; i++) {
+        tal_mutex_lock(s_http_pool.mutex);
+        network = s_http_pool.conn[i].network;
+        s_http_pool.conn[i].network = NULL;
+        tal_mutex_unlock(s_http_pool.mutex);
+
+        if (network) {
+            http_connection_release(network);
+        }
+    }
+    tal_sw_timer_stop(s_http_pool.timer);
+#endif
+}
+
 int http_client_free(http_client_response_t *response)
 {
     if (NULL == response) {
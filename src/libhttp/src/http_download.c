@@ -33,8 +33,33 @@ typedef struct {
     size_t offset;
     uint8_t state;
     uint8_t *buffer;
+    bool size_notified;
+    uint32_t retry_delay;
+    size_t checkpoint_offset;
+    /* pipeline: the network fills one slot while the writer thread consumes the other */
+    THREAD_HANDLE writer;
+    SEM_HANDLE sem_free;
+    SEM_HANDLE sem_full;
+    uint8_t *slot_buf[2];
+    size_t slot_len[2];
+    size_t slot_offset[2];
+    size_t slot_fill;
+    uint8_t slot_idx;
+    bool slot_held;
+    int writer_err;
+    /* bytes left by the handler, merged with the head of the next slot */
+    uint8_t *carry;
+    size_t carry_len;
+    size_t carry_offset;
 } http_download_t;
 
+typedef struct {
+    uint32_t magic;
+    uint32_t file_size;
+    uint32_t offset;
+    uint32_t user_len;
+} http_download_checkpoint_t;
+
 #define MAX_RETRY_TIMES (8u)
 /*-----------------------------------------------------------*/
 /**
@@ -69,6 +94,17 @@ typedef struct {
 //! timeout sec
 #define HTTP_DOWNLOAD_TIMEOUT 180
 
+//! reconnect backoff, doubled on each failure and reset once data arrives
+#define HTTP_DOWNLOAD_RETRY_DELAY_MIN 100
+#define HTTP_DOWNLOAD_RETRY_DELAY_MAX 3000
+
+#define HTTP_DOWNLOAD_CHECKPOINT_MAGIC        0x444c4350
+#define HTTP_DOWNLOAD_CHECKPOINT_SIZE_DEFAULT (64 * 1024)
+
+#ifndef HTTP_DOWNLOAD_WRITER_STACK_SIZE
+#define HTTP_DOWNLOAD_WRITER_STACK_SIZE 4096
+#endif
+
 /*-----------------------------------------------------------*/
 static int http_download_filesize_get(http_download_t *ctx)
 {
@@ -108,6 +144,9 @@ static int http_download_filesize_get(http_download_t *ctx)
     if (ctx->response.pBuffer) {
         tal_free(ctx->response.pBuffer);
     }
+    if (ctx->response.pBody) {
+        tal_free(ctx->response.pBody);
+    }
     memset(&ctx->response, 0, sizeof(ctx->response));
 __exit:
     return rt;
@@ -118,6 +157,14 @@ static int http_download_range_request(http_download_t *ctx, uint32_t range_star
     int rt = OPRT_OK;
 
     PR_DEBUG("Downloading bytes %d-%d, from %s...: ", range_start, range_end, ctx->host);
+    //! drop the response of the previous connection
+    if (ctx->response.pBuffer) {
+        tal_free(ctx->response.pBuffer);
+    }
+    if (ctx->response.pBody) {
+        tal_free(ctx->response.pBody);
+    }
+    memset(&ctx->response, 0, sizeof(ctx->response));
     TUYA_CALL_ERR_GOTO(HTTPClient_InitializeRequestHeaders(&ctx->requestHeaders, &ctx->requestInfo), __exit);
     TUYA_CALL_ERR_GOTO(HTTPClient_AddRangeHeader(&ctx->requestHeaders, range_start, range_end), __exit);
     PR_TRACE("Request Headers:\n%.*s", (int32_t)ctx->requestHeaders.headersLen, (char *)ctx->requestHeaders.pBuffer);
@@ -130,6 +177,239 @@ __exit:
     return rt;
 }
 
+/*-----------------------------------------------------------*/
+static void http_download_checkpoint_save(http_download_t *ctx, size_t offset)
+{
+    if (NULL == ctx->config.resume_key || offset < ctx->checkpoint_offset + ctx->config.checkpoint_size ||
+        offset >= ctx->file_size) {
+        return;
+    }
+
+    http_download_event_t event = {0};
+    event.offset = offset;
+    event.file_size = ctx->file_size;
+    event.user_data = ctx->config.user_data;
+    if (ctx->config.event_handler) {
+        ctx->config.event_handler(DL_EVENT_ON_CHECKPOINT, &event);
+    }
+    if (0 == event.offset) {
+        //! asked again after the next checkpoint_size bytes
+        ctx->checkpoint_offset = offset;
+        return;
+    }
+
+    size_t len = sizeof(http_download_checkpoint_t) + (event.data ? event.data_len : 0);
+    http_download_checkpoint_t *record = tal_malloc(len);
+    if (NULL == record) {
+        return;
+    }
+    record->magic = HTTP_DOWNLOAD_CHECKPOINT_MAGIC;
+    record->file_size = ctx->file_size;
+    record->offset = offset;
+    record->user_len = len - sizeof(http_download_checkpoint_t);
+    if (record->user_len) {
+        memcpy(record + 1, event.data, record->user_len);
+    }
+    if (OPRT_OK == tal_kv_set(ctx->config.resume_key, (const uint8_t *)record, len)) {
+        ctx->checkpoint_offset = offset;
+        PR_DEBUG("download checkpoint %d/%d", (int32_t)offset, (int32_t)ctx->file_size);
+    }
+    tal_free(record);
+}
+
+static void http_download_checkpoint_load(http_download_t *ctx)
+{
+    uint8_t *value = NULL;
+    size_t len = 0;
+
+    if (NULL == ctx->config.resume_key || OPRT_OK != tal_kv_get(ctx->config.resume_key, &value, &len)) {
+        return;
+    }
+
+    http_download_checkpoint_t *record = (http_download_checkpoint_t *)value;
+    http_download_event_t event = {0};
+    if (len < sizeof(http_download_checkpoint_t) || record->magic != HTTP_DOWNLOAD_CHECKPOINT_MAGIC ||
+        len != sizeof(http_download_checkpoint_t) + record->user_len || 0 == record->offset ||
+        record->offset >= record->file_size || (ctx->file_size && ctx->file_size != record->file_size)) {
+        PR_DEBUG("download checkpoint invalid");
+        goto __exit;
+    }
+
+    event.offset = record->offset;
+    event.file_size = record->file_size;
+    event.data = record->user_len ? (void *)(record + 1) : NULL;
+    event.data_len = record->user_len;
+    event.user_data = ctx->config.user_data;
+    if (ctx->config.event_handler) {
+        ctx->config.event_handler(DL_EVENT_ON_RESUME, &event);
+    }
+    if (event.offset != record->offset) {
+        PR_DEBUG("download checkpoint rejected");
+        goto __exit;
+    }
+
+    PR_INFO("download resume from %d/%d", (int32_t)record->offset, (int32_t)record->file_size);
+    ctx->file_size = record->file_size;
+    ctx->received_size = record->offset;
+    ctx->checkpoint_offset = record->offset;
+    tal_kv_free(value);
+    return;
+
+__exit:
+    tal_kv_free(value);
+    tal_kv_del(ctx->config.resume_key);
+}
+
+/*-----------------------------------------------------------*/
+static size_t http_download_data_deliver(http_download_t *ctx, uint8_t *data, size_t len, size_t offset,
+                                         size_t remain_len)
+{
+    size_t remain = 0;
+
+    if (ctx->config.event_handler) {
+        ctx->event.data = data;
+        ctx->event.data_len = len;
+        ctx->event.offset = offset;
+        ctx->event.remain_len = remain_len;
+        ctx->config.event_handler(DL_EVENT_ON_DATA, &ctx->event);
+        remain = ctx->event.remain_len > len ? len : ctx->event.remain_len;
+    }
+    http_download_checkpoint_save(ctx, offset + len - remain);
+
+    return remain;
+}
+
+static int http_download_slot_process(http_download_t *ctx, uint8_t *data, size_t len, size_t offset)
+{
+    size_t copy_len = 0, prev_len = 0, remain = 0;
+
+    while (len > 0) {
+        if (0 == ctx->carry_len) {
+            remain = http_download_data_deliver(ctx, data, len, offset, 0);
+            memcpy(ctx->carry, data + len - remain, remain);
+            ctx->carry_len = remain;
+            ctx->carry_offset = offset + len - remain;
+            break;
+        }
+
+        /* top up what the handler left last time and hand it over again */
+        copy_len = ctx->config.range_length - ctx->carry_len;
+        copy_len = copy_len < len ? copy_len : len;
+        memcpy(ctx->carry + ctx->carry_len, data, copy_len);
+        prev_len = ctx->carry_len;
+        ctx->carry_len += copy_len;
+        data += copy_len;
+        offset += copy_len;
+        len -= copy_len;
+
+        remain = http_download_data_deliver(ctx, ctx->carry, ctx->carry_len, ctx->carry_offset, prev_len);
+        if (remain == ctx->config.range_length) {
+            PR_ERR("download handler consumed nothing of a full range");
+            return OPRT_COM_ERROR;
+        }
+        memmove(ctx->carry, ctx->carry + ctx->carry_len - remain, remain);
+        ctx->carry_offset += ctx->carry_len - remain;
+        ctx->carry_len = remain;
+    }
+
+    return OPRT_OK;
+}
+
+static void http_download_writer_task(void *args)
+{
+    http_download_t *ctx = (http_download_t *)args;
+    uint8_t idx = 0;
+
+    for (;;) {
+        tal_semaphore_wait(ctx->sem_full, SEM_WAIT_FOREVER);
+        if (0 == ctx->slot_len[idx]) {
+            break;
+        }
+        //! keep draining after an error so the network side never blocks on a free slot
+        if (OPRT_OK == ctx->writer_err) {
+            ctx->writer_err = http_download_slot_process(ctx, ctx->slot_buf[idx], ctx->slot_len[idx],
+                                                         ctx->slot_offset[idx]);
+        }
+        tal_semaphore_post(ctx->sem_free);
+        idx ^= 1;
+    }
+}
+
+static int http_download_pipeline_start(http_download_t *ctx)
+{
+    int rt = OPRT_OK;
+
+    ctx->slot_buf[0] = tal_malloc(ctx->config.range_length);
+    ctx->slot_buf[1] = tal_malloc(ctx->config.range_length);
+    ctx->carry = tal_malloc(ctx->config.range_length);
+    if (NULL == ctx->slot_buf[0] || NULL == ctx->slot_buf[1] || NULL == ctx->carry) {
+        return OPRT_MALLOC_FAILED;
+    }
+    TUYA_CALL_ERR_RETURN(tal_semaphore_create_init(&ctx->sem_free, 2, 2));
+    TUYA_CALL_ERR_RETURN(tal_semaphore_create_init(&ctx->sem_full, 0, 2));
+
+    THREAD_CFG_T thrd_param;
+    thrd_param.priority = THREAD_PRIO_3;
+    thrd_param.stackDepth = HTTP_DOWNLOAD_WRITER_STACK_SIZE;
+    thrd_param.thrdname = "http_dl_writer";
+    TUYA_CALL_ERR_RETURN(
+        tal_thread_create_and_start(&ctx->writer, NULL, NULL, http_download_writer_task, ctx, &thrd_param));
+
+    return rt;
+}
+
+static int http_download_pipeline_put(http_download_t *ctx)
+{
+    ctx->slot_len[ctx->slot_idx] = ctx->slot_fill;
+    ctx->slot_offset[ctx->slot_idx] = ctx->received_size - ctx->slot_fill;
+    ctx->slot_fill = 0;
+    ctx->slot_held = false;
+    ctx->slot_idx ^= 1;
+    tal_semaphore_post(ctx->sem_full);
+
+    return ctx->writer_err;
+}
+
+static uint8_t *http_download_pipeline_get(http_download_t *ctx)
+{
+    if (!ctx->slot_held) {
+        tal_semaphore_wait(ctx->sem_free, SEM_WAIT_FOREVER);
+        ctx->slot_held = true;
+    }
+
+    return ctx->slot_buf[ctx->slot_idx];
+}
+
+static int http_download_pipeline_stop(http_download_t *ctx)
+{
+    uint32_t count = 1;
+
+    if (ctx->writer) {
+        //! zero length slot tells the writer to quit after what is already queued
+        http_download_pipeline_get(ctx);
+        ctx->slot_fill = 0;
+        http_download_pipeline_put(ctx);
+        tal_thread_delete(ctx->writer);
+        while (THREAD_STATE_DELETE != tal_thread_get_state(ctx->writer)) {
+            tal_system_sleep(10);
+            if ((count++) % 500 == 0) {
+                PR_NOTICE("%p still running", ctx->writer);
+            }
+        }
+        ctx->writer = NULL;
+    }
+    if (ctx->sem_free) {
+        tal_semaphore_release(ctx->sem_free);
+        ctx->sem_free = NULL;
+    }
+    if (ctx->sem_full) {
+        tal_semaphore_release(ctx->sem_full);
+        ctx->sem_full = NULL;
+    }
+
+    return ctx->writer_err;
+}
+
 /*-----------------------------------------------------------*/
 static int http_file_download_init(http_download_t *ctx, http_download_config_t *config)
 {
@@ -145,6 +425,10 @@ static int http_file_download_init(http_download_t *ctx, http_download_config_t
     if (config->range_length == 0) {
         ctx->config.range_length = RANGE_REQUEST_LENGTH_DEFAULT;
     }
+    if (config->checkpoint_size == 0) {
+        ctx->config.checkpoint_size = HTTP_DOWNLOAD_CHECKPOINT_SIZE_DEFAULT;
+    }
+    ctx->retry_delay = HTTP_DOWNLOAD_RETRY_DELAY_MIN;
     ctx->event.user_data = ctx->config.user_data;
 
     /* url parse to host port path */
@@ -184,8 +468,10 @@ static int http_file_download_init(http_download_t *ctx, http_download_config_t
     memcpy(ctx->path, p_path, path_len);
     ctx->path[path_len] = 0;
 
-    ctx->buffer = tal_malloc(ctx->config.range_length + 1);
-    TUYA_CHECK_NULL_RETURN(ctx->buffer, OPRT_MALLOC_FAILED);
+    if (!ctx->config.pipeline) {
+        ctx->buffer = tal_malloc(ctx->config.range_length + 1);
+        TUYA_CHECK_NULL_RETURN(ctx->buffer, OPRT_MALLOC_FAILED);
+    }
 
     HTTPRequestInfo_t *requestInfo = &ctx->requestInfo;
     requestInfo->pHost = ctx->host;
@@ -237,12 +523,20 @@ int http_file_download(http_download_config_t *config)
     TIME_T download_time = tal_time_get_posix();
 
     bool is_completed = false;
+    bool is_aborted = false;
 
     int32_t read_size = 0;
+    uint8_t *read_buf = NULL;
+    size_t data_len = 0;
 
     if (ctx->config.event_handler) {
         ctx->config.event_handler(DL_EVENT_START, &ctx->event);
     }
+    http_download_checkpoint_load(ctx);
+    if (ctx->config.pipeline && OPRT_OK != (rt = http_download_pipeline_start(ctx))) {
+        tuya_transporter_destroy(network);
+        goto __exit;
+    }
 
     do {
 
@@ -265,10 +559,12 @@ int http_file_download(http_download_config_t *config)
                 ctx->state = DL_STATE_NETWORK_RECONNECT;
                 break;
             }
-            if (ctx->config.event_handler) {
+            //! notify only once, a reconnect must not restart the consumer
+            if (ctx->config.event_handler && !ctx->size_notified) {
                 ctx->event.file_size = ctx->file_size;
                 ctx->config.event_handler(DL_EVENT_ON_FILESIZE, &ctx->event);
             }
+            ctx->size_notified = true;
             ctx->state = DL_STATE_RANGE_REQUEST;
             break;
 
@@ -281,29 +577,47 @@ int http_file_download(http_download_config_t *config)
             ctx->state = DL_STATE_DATE_GET;
 
         case DL_STATE_DATE_GET: {
-            read_size = HTTPClient_Recv(&ctx->transport, &ctx->response, ctx->buffer + ctx->remain_len,
-                                        ctx->config.range_length - ctx->remain_len);
+            if (ctx->config.pipeline) {
+                read_buf = http_download_pipeline_get(ctx);
+                read_size = HTTPClient_Recv(&ctx->transport, &ctx->response, read_buf + ctx->slot_fill,
+                                            ctx->config.range_length - ctx->slot_fill);
+            } else {
+                read_size = HTTPClient_Recv(&ctx->transport, &ctx->response, ctx->buffer + ctx->remain_len,
+                                            ctx->config.range_length - ctx->remain_len);
+            }
 
             if (read_size <= 0) {
                 PR_WARN("file download range get error:%d, goto retry", rt);
+                //! hand over the partial slot, the range request restarts at received_size
+                if (ctx->config.pipeline && ctx->slot_fill && OPRT_OK != http_download_pipeline_put(ctx)) {
+                    is_aborted = true;
+                }
                 ctx->state = DL_STATE_NETWORK_RECONNECT;
                 break;
             }
-            if (ctx->config.event_handler) {
-                ctx->event.data = (uint8_t *)ctx->buffer;
-                ctx->event.data_len = read_size + ctx->remain_len;
-                ctx->event.offset = ctx->received_size - ctx->remain_len;
-                ctx->event.remain_len = ctx->remain_len;
-                ctx->config.event_handler(DL_EVENT_ON_DATA, &ctx->event);
-                if (ctx->event.remain_len) {
-                    memmove(ctx->buffer, ctx->buffer + (ctx->event.data_len - ctx->event.remain_len),
-                            ctx->event.remain_len);
+            ctx->received_size += read_size;
+            if (ctx->config.pipeline) {
+                //! fill the whole slot, the writer consumes it while the next one is received
+                ctx->slot_fill += read_size;
+                if ((ctx->slot_fill == ctx->config.range_length || ctx->received_size >= ctx->file_size) &&
+                    OPRT_OK != http_download_pipeline_put(ctx)) {
+                    is_aborted = true;
+                }
+            } else {
+                data_len = read_size + ctx->remain_len;
+                ctx->remain_len = http_download_data_deliver(ctx, ctx->buffer, data_len,
+                                                             ctx->received_size - data_len, ctx->remain_len);
+                if (ctx->remain_len) {
+                    memmove(ctx->buffer, ctx->buffer + (data_len - ctx->remain_len), ctx->remain_len);
+                }
+                if (ctx->remain_len == ctx->config.range_length) {
+                    PR_ERR("download handler consumed nothing of a full range");
+                    is_aborted = true;
                 }
-                ctx->remain_len = ctx->event.remain_len;
-                ctx->received_size += read_size;
             }
             //! reset time
             download_time = tal_time_get_posix();
+            ctx->retry_delay = HTTP_DOWNLOAD_RETRY_DELAY_MIN;
             /* File download complete? */
             if (ctx->received_size >= ctx->file_size) {
                 ctx->state = DL_STATE_COMPLETE;
@@ -313,22 +627,33 @@ int http_file_download(http_download_config_t *config)
 
         case DL_STATE_NETWORK_RECONNECT:
             tuya_transporter_close(network);
-            tal_system_sleep(3000);
+            tal_system_sleep(ctx->retry_delay);
+            ctx->retry_delay = ctx->retry_delay * 2 > HTTP_DOWNLOAD_RETRY_DELAY_MAX ? HTTP_DOWNLOAD_RETRY_DELAY_MAX
+                                                                                   : ctx->retry_delay * 2;
             ctx->state = DL_STATE_NETWORK_CONNECT;
             break;
 
         case DL_STATE_COMPLETE:
             PR_INFO("Download Complete!");
+            //! the queued data must be consumed before the file is finished
+            if (OPRT_OK != http_download_pipeline_stop(ctx)) {
+                is_aborted = true;
+                break;
+            }
+            if (ctx->config.resume_key) {
+                tal_kv_del(ctx->config.resume_key);
+            }
             is_completed = true;
             if (ctx->config.event_handler) {
                 ctx->config.event_handler(DL_EVENT_FINISH, &ctx->event);
             }
             break;
         }
-    } while (((tal_time_get_posix() - download_time) < HTTP_DOWNLOAD_TIMEOUT) && !is_completed);
+    } while (((tal_time_get_posix() - download_time) < HTTP_DOWNLOAD_TIMEOUT) && !is_completed && !is_aborted);
 
     tuya_transporter_close(network);
     tuya_transporter_destroy(network);
+    http_download_pipeline_stop(ctx);
 
     if (!is_completed) {
         if (ctx->config.event_handler) {
@@ -350,6 +675,19 @@ __exit:
         if (ctx->response.pBuffer) {
             tal_free(ctx->response.pBuffer);
         }
+        http_download_pipeline_stop(ctx);
+        if (ctx->buffer) {
+            tal_free(ctx->buffer);
+        }
+        if (ctx->slot_buf[0]) {
+            tal_free(ctx->slot_buf[0]);
+        }
+        if (ctx->slot_buf[1]) {
+            tal_free(ctx->slot_buf[1]);
+        }
+        if (ctx->carry) {
+            tal_free(ctx->carry);
+        }
 
         tal_free(ctx);
     }
@@ -0,0 +1,147 @@
+/**
+ * @file http_client_test.cpp
+ * @brief UT of http_client_request: keep-alive reuse and the retry on a
+ * reused connection.
+ *
+ * @copyright Copyright (c) 2021-2024 Tuya Inc. All Rights Reserved.
+ *
+ */
+
+#include <gtest/gtest.h>
+
+#include "tal_api.h"
+#include "ut_fake_transporter.h"
+
+// the libhttp headers carry no extern "C"
+extern "C" {
+#include "http_client_interface.h"
+}
+
+class HttpClientTest : public ::testing::Test {
+protected:
+    http_client_request_t request = {0};
+    http_client_response_t response = {0};
+
+    static void SetUpTestSuite()
+    {
+        ASSERT_EQ(OPRT_OK, tal_sw_timer_init());
+    }
+
+    void SetUp() override
+    {
+        request.host = "ut.tuya.com";
+        request.path = "/d.json";
+        request.method = "POST";
+        request.body = (const uint8_t *)"{}";
+        request.body_length = 2;
+        request.timeout_ms = 1000;
+        request.keep_alive = true;
+    }
+
+    void TearDown() override
+    {
+        http_client_keepalive_flush();
+        EXPECT_EQ(0, ut_server_open());
+    }
+
+    // one request on a fresh connection, which is then parked for reuse
+    void prime()
+    {
+        ut_server_set([](const std::string &) {
+            UtReply reply;
+            reply.data = ut_http_ok("ok");
+            return reply;
+        });
+        ASSERT_EQ(HTTP_CLIENT_SUCCESS, http_client_request(&request, &response));
+        http_client_free(&response);
+    }
+};
+
+TEST_F(HttpClientTest, keepalive_reuse)
+{
+    prime();
+    for (int i = 0; i < 3; i++) {
+        ASSERT_EQ(HTTP_CLIENT_SUCCESS, http_client_request(&request, &response));
+        EXPECT_EQ(200, response.status_code);
+        EXPECT_EQ(std::string("ok"), std::string((const char *)response.body, response.body_length));
+        http_client_free(&response);
+    }
+    EXPECT_EQ(1, ut_server_connects());
+    EXPECT_EQ(4, ut_server_requests());
+}
+
+// the idle connection was closed before the request got out, send it again
+TEST_F(HttpClientTest, retry_send_fail)
+{
+    prime();
+    int n = 0;
+    ut_server_set([&n](const std::string &) {
+        UtReply reply;
+        reply.send_fail = (0 == n++);
+        reply.data = ut_http_ok("ok");
+        return reply;
+    });
+    ASSERT_EQ(HTTP_CLIENT_SUCCESS, http_client_request(&request, &response));
+    http_client_free(&response);
+    EXPECT_EQ(1, ut_server_connects());
+    EXPECT_EQ(1, ut_server_requests());
+}
+
+// closed without a byte of response, the server did not handle it
+TEST_F(HttpClientTest, retry_no_response)
+{
+    prime();
+    int n = 0;
+    ut_server_set([&n](const std::string &) {
+        UtReply reply;
+        if (0 == n++) {
+            reply.close = true;
+        } else {
+            reply.data = ut_http_ok("ok");
+        }
+        return reply;
+    });
+    ASSERT_EQ(HTTP_CLIENT_SUCCESS, http_client_request(&request, &response));
+    http_client_free(&response);
+    EXPECT_EQ(1, ut_server_connects());
+    EXPECT_EQ(2, ut_server_requests());
+}
+
+// part of a response came back, the POST was handled and must not be sent twice
+TEST_F(HttpClientTest, no_retry_partial_response)
+{
+    prime();
+    ut_server_set([](const std::string &) {
+        UtReply reply;
+        reply.data = "HTTP/1.1 200 OK\r\nContent-Len";
+        reply.close = true;
+        return reply;
+    });
+    EXPECT_NE(HTTP_CLIENT_SUCCESS, http_client_request(&request, &response));
+    EXPECT_EQ(0, ut_server_connects());
+    EXPECT_EQ(1, ut_server_requests());
+}
+
+// a fresh connection is never retried
+TEST_F(HttpClientTest, no_retry_fresh)
+{
+    ut_server_set([](const std::string &) {
+        UtReply reply;
+        reply.close = true;
+        return reply;
+    });
+    EXPECT_NE(HTTP_CLIENT_SUCCESS, http_client_request(&request, &response));
+    EXPECT_EQ(1, ut_server_connects());
+    EXPECT_EQ(1, ut_server_requests());
+}
+
+// no answer in time, the server may still handle the POST, it is not sent again
+TEST_F(HttpClientTest, no_retry_timeout)
+{
+    prime();
+    ut_server_set([](const std::string &) { return UtReply(); });
+    request.timeout_ms = 10;
+    EXPECT_NE(HTTP_CLIENT_SUCCESS, http_client_request(&request, &response));
+    EXPECT_EQ(0, ut_server_connects());
+    EXPECT_EQ(1, ut_server_requests());
+}
@@ -0,0 +1,234 @@
+/**
+ * @file http_download_test.cpp
+ * @brief UT of http_file_download: data and offsets seen by the handler,
+ * reconnect in the middle of the body, and the download rate with and
+ * without the pipeline.
+ *
+ * @copyright Copyright (c) 2021-2024 Tuya Inc. All Rights Reserved.
+ *
+ */
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <thread>
+
+#include "tal_api.h"
+#include "http_download.h"
+#include "tal_kv.h"
+#include "ut_fake_transporter.h"
+
+#define UT_FILE_SIZE  (512 * 1024)
+#define UT_BENCH_RATE (2 * 1024 * 1024)
+#define UT_RESUME_KEY "ut_ckpt"
+
+struct UtDownload {
+    const std::string *file;
+    size_t flash_rate; // bytes per second the handler writes, 0 means no delay
+    size_t next;       // offset the next data must start at
+    size_t file_size;
+    bool mismatch;
+    bool finished;
+    bool fault;
+    bool skip_checkpoint; // the handler refuses every checkpoint
+    int checkpoints;      // DL_EVENT_ON_CHECKPOINT events
+    int saved;            // data events that found a checkpoint saved
+};
+
+static bool ut_checkpoint_saved(void)
+{
+    uint8_t *value = NULL;
+    size_t len = 0;
+
+    if (OPRT_OK != tal_kv_get(UT_RESUME_KEY, &value, &len)) {
+        return false;
+    }
+    tal_kv_free(value);
+    return true;
+}
+
+static void ut_download_cb(http_download_event_id_t id, http_download_event_t *event)
+{
+    UtDownload *dl = (UtDownload *)event->user_data;
+
+    switch (id) {
+    case DL_EVENT_ON_FILESIZE:
+        dl->file_size = event->file_size;
+        break;
+    case DL_EVENT_ON_DATA:
+        if (event->offset != dl->next || event->offset + event->data_len > dl->file->size() ||
+            0 != memcmp(event->data, dl->file->data() + event->offset, event->data_len)) {
+            dl->mismatch = true;
+        }
+        dl->next = event->offset + event->data_len;
+        event->remain_len = 0;
+        if (ut_checkpoint_saved()) {
+            dl->saved++;
+        }
+        if (dl->flash_rate) {
+            std::this_thread::sleep_for(std::chrono::microseconds((uint64_t)event->data_len * 1000000 / dl->flash_rate));
+        }
+        break;
+    case DL_EVENT_ON_CHECKPOINT:
+        dl->checkpoints++;
+        if (dl->skip_checkpoint) {
+            event->offset = 0;
+        }
+        break;
+    case DL_EVENT_FINISH:
+        dl->finished = true;
+        break;
+    case DL_EVENT_FAULT:
+        dl->fault = true;
+        break;
+    default:
+        break;
+    }
+}
+
+class HttpDownloadTest : public ::testing::Test {
+protected:
+    std::string file;
+    UtDownload dl = {0};
+    http_download_config_t config = {0};
+
+    static void SetUpTestSuite()
+    {
+        ASSERT_EQ(OPRT_OK, tal_sw_timer_init());
+    }
+
+    void SetUp() override
+    {
+        file.resize(UT_FILE_SIZE);
+        for (size_t i = 0; i < file.size(); i++) {
+            file[i] = (char)(i * 31 + (i >> 9));
+        }
+        dl.file = &file;
+        config.url = "http://ut.tuya.com/fw.bin";
+        config.timeout_ms = 1000;
+        config.user_data = &dl;
+        config.event_handler = ut_download_cb;
+    }
+
+    void TearDown() override
+    {
+        EXPECT_EQ(0, ut_server_open());
+    }
+
+    void serve()
+    {
+        ut_server_set([this](const std::string &request) {
+            UtReply reply;
+            reply.data = ut_http_range(request, file);
+            return reply;
+        });
+    }
+
+    void expect_done()
+    {
+        EXPECT_TRUE(dl.finished);
+        EXPECT_FALSE(dl.fault);
+        EXPECT_FALSE(dl.mismatch);
+        EXPECT_EQ(file.size(), dl.file_size);
+        EXPECT_EQ(file.size(), dl.next);
+    }
+};
+
+TEST_F(HttpDownloadTest, sequential)
+{
+    serve();
+    EXPECT_EQ(OPRT_OK, http_file_download(&config));
+    expect_done();
+    EXPECT_EQ(1, ut_server_connects());
+}
+
+TEST_F(HttpDownloadTest, pipeline)
+{
+    serve();
+    config.pipeline = true;
+    EXPECT_EQ(OPRT_OK, http_file_download(&config));
+    expect_done();
+    EXPECT_EQ(1, ut_server_connects());
+}
+
+// the connection breaks in the middle of the body, the range request restarts where it stopped
+TEST_F(HttpDownloadTest, reconnect)
+{
+    for (bool pipeline : {false, true}) {
+        int n = 0;
+        ut_server_set([this, &n](const std::string &request) {
+            UtReply reply;
+            reply.data = ut_http_range(request, file);
+            if (2 == ++n) {
+                reply.data.resize(reply.data.size() / 2);
+                reply.close = true;
+            }
+            return reply;
+        });
+        dl = {0};
+        dl.file = &file;
+        config.pipeline = pipeline;
+        EXPECT_EQ(OPRT_OK, http_file_download(&config));
+        expect_done();
+        EXPECT_EQ(2, ut_server_connects());
+    }
+}
+
+// every 64 KB a checkpoint is saved, unless the handler refuses it
+TEST_F(HttpDownloadTest, checkpoint)
+{
+    for (bool skip : {false, true}) {
+        serve();
+        dl = {0};
+        dl.file = &file;
+        dl.skip_checkpoint = skip;
+        config.resume_key = UT_RESUME_KEY;
+        config.checkpoint_size = 64 * 1024;
+        EXPECT_EQ(OPRT_OK, http_file_download(&config));
+        expect_done();
+        EXPECT_EQ(UT_FILE_SIZE / (64 * 1024) - 1, dl.checkpoints);
+        EXPECT_EQ(!skip, dl.saved > 0);
+        EXPECT_FALSE(ut_checkpoint_saved());
+    }
+}
+
+/**
+ * a 512 KB file over a link of UT_BENCH_RATE bytes/s into a handler that
+ * writes UT_BENCH_RATE bytes/s, and with no delay at all. Sequential
+ * download waits for each write, the pipeline overlaps them
+ */
+TEST_F(HttpDownloadTest, bench)
+{
+    static const size_t rates[] = {0, UT_BENCH_RATE};
+    static const size_t ranges[] = {4096, 8192, 16384};
+    double mbps[2][2] = {0};
+
+    for (int r = 0; r < 2; r++) {
+        for (size_t range : ranges) {
+            double ratio[2];
+            for (int pipeline = 0; pipeline < 2; pipeline++) {
+                serve();
+                ut_server_rate(rates[r]);
+                dl = {0};
+                dl.file = &file;
+                dl.flash_rate = rates[r];
+                config.pipeline = pipeline;
+                config.range_length = range;
+
+                auto t0 = std::chrono::steady_clock::now();
+                EXPECT_EQ(OPRT_OK, http_file_download(&config));
+                double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+                expect_done();
+                ratio[pipeline] = file.size() / s / (1024 * 1024);
+            }
+            printf("[ BENCH    ] %s, range %5zu: sequential %7.2f MB/s, pipeline %7.2f MB/s\n",
+                   rates[r] ? "link and flash 2 MB/s" : "no delay             ", range, ratio[0], ratio[1]);
+            mbps[r][0] = ratio[0];
+            mbps[r][1] = ratio[1];
+        }
+    }
+    ut_server_rate(0);
+
+    // network and flash overlap, close to 2 MB/s instead of 1 MB/s
+    EXPECT_GT(mbps[1][1], mbps[1][0] * 1.4);
+}
@@ -0,0 +1,58 @@
+/**
+ * @file ut_fake_kv.cpp
+ * @brief In-memory tal_kv for the libhttp UT, the download checkpoints are
+ * kept in a map.
+ *
+ * @copyright Copyright (c) 2021-2024 Tuya Inc. All Rights Reserved.
+ *
+ */
+
+#include <string.h>
+
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "tal_api.h"
+#include "tal_kv.h"
+
+static std::mutex s_kv_mutex;
+static std::map<std::string, std::string> s_kv;
+
+int tal_kv_set(const char *key, const uint8_t *value, size_t length)
+{
+    std::lock_guard<std::mutex> lock(s_kv_mutex);
+    s_kv[key] = std::string((const char *)value, length);
+    return OPRT_OK;
+}
+
+int tal_kv_get(const char *key, uint8_t **value, size_t *length)
+{
+    std::lock_guard<std::mutex> lock(s_kv_mutex);
+    auto it = s_kv.find(key);
+
+    if (it == s_kv.end()) {
+        return OPRT_NOT_FOUND;
+    }
+    *value = (uint8_t *)tal_malloc(it->second.size() + 1);
+    if (NULL == *value) {
+        return OPRT_MALLOC_FAILED;
+    }
+    memcpy(*value, it->second.data(), it->second.size());
+    *length = it->second.size();
+
+    return OPRT_OK;
+}
+
+int tal_kv_free(uint8_t *value)
+{
+    tal_free(value);
+    return OPRT_OK;
+}
+
+int tal_kv_del(const char *key)
+{
+    std::lock_guard<std::mutex> lock(s_kv_mutex);
+    s_kv.erase(key);
+    return OPRT_OK;
+}
@@ -0,0 +1,178 @@
+/**
+ * @file ut_fake_transporter.cpp
+ * @brief In-memory tuya_transporter for the libhttp UT.
+ *
+ * @copyright Copyright (c) 2021-2024 Tuya Inc. All Rights Reserved.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "tal_network.h"
+#include "tuya_transporter.h"
+#include "tuya_tls.h"
+#include "ut_fake_transporter.h"
+
+// stands in for the transporter, handles are cast to it
+struct UtConn {
+    std::string rx; // bytes of the server not read yet
+    size_t rx_off = 0;
+    bool eof = false;    // closed by the server, read returns 0 once rx is drained
+    bool broken = false; // write fails with a reset
+};
+
+static UT_SERVER_CB s_server;
+static std::atomic<int> s_connects;
+static std::atomic<int> s_requests;
+static std::atomic<int> s_open;
+static size_t s_rate;
+static TUYA_ERRNO s_errno;
+
+void ut_server_set(UT_SERVER_CB cb)
+{
+    s_server = cb;
+    s_connects = 0;
+    s_requests = 0;
+    s_rate = 0;
+}
+
+void ut_server_rate(size_t bytes_per_s)
+{
+    s_rate = bytes_per_s;
+}
+
+int ut_server_connects(void)
+{
+    return s_connects;
+}
+
+int ut_server_requests(void)
+{
+    return s_requests;
+}
+
+int ut_server_open(void)
+{
+    return s_open;
+}
+
+std::string ut_http_ok(const std::string &body)
+{
+    return "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+}
+
+std::string ut_http_range(const std::string &request, const std::string &file)
+{
+    unsigned long start = 0, end = file.size() - 1;
+    size_t pos = request.find("Range: bytes=");
+
+    if (std::string::npos != pos) {
+        sscanf(request.c_str() + pos, "Range: bytes=%lu-%lu", &start, &end);
+    }
+    end = std::min(end, (unsigned long)file.size() - 1);
+
+    return "HTTP/1.1 206 Partial Content\r\nContent-Length: " + std::to_string(end + 1 - start) +
+           "\r\nContent-Range: bytes " + std::to_string(start) + "-" + std::to_string(end) + "/" +
+           std::to_string(file.size()) + "\r\n\r\n" + file.substr(start, end + 1 - start);
+}
+
+tuya_transporter_t tuya_transporter_create(TUYA_TRANSPORT_TYPE_E transport_type, tuya_transporter_t dependency)
+{
+    s_open++;
+    return (tuya_transporter_t) new UtConn;
+}
+
+OPERATE_RET tuya_transporter_destroy(tuya_transporter_t transporter)
+{
+    s_open--;
+    delete (UtConn *)transporter;
+    return OPRT_OK;
+}
+
+OPERATE_RET tuya_transporter_connect(tuya_transporter_t transporter, const char *host, int port, int timeout_ms)
+{
+    *(UtConn *)transporter = UtConn();
+    s_connects++;
+    return OPRT_OK;
+}
+
+OPERATE_RET tuya_transporter_close(tuya_transporter_t transporter)
+{
+    ((UtConn *)transporter)->eof = true;
+    ((UtConn *)transporter)->broken = true;
+    return OPRT_OK;
+}
+
+OPERATE_RET tuya_transporter_read(tuya_transporter_t transporter, uint8_t *buf, int len, int timeout_ms)
+{
+    UtConn *conn = (UtConn *)transporter;
+    size_t left = conn->rx.size() - conn->rx_off;
+
+    if (0 == left) {
+        // as tcp, 0 for the FIN of the server, a timeout if it just says nothing
+        return conn->eof ? 0 : OPRT_RESOURCE_NOT_READY;
+    }
+    len = (int)std::min(left, (size_t)len);
+    if (s_rate) {
+        std::this_thread::sleep_for(std::chrono::microseconds((uint64_t)len * 1000000 / s_rate));
+    }
+    memcpy(buf, conn->rx.data() + conn->rx_off, len);
+    conn->rx_off += len;
+
+    return len;
+}
+
+OPERATE_RET tuya_transporter_write(tuya_transporter_t transporter, uint8_t *buf, int len, int timeout_ms)
+{
+    UtConn *conn = (UtConn *)transporter;
+    std::string data((const char *)buf, len);
+
+    if (conn->broken) {
+        s_errno = UNW_ECONNRESET;
+        return -1;
+    }
+    // the body follows the header in its own write, only the header is a new request
+    if (std::string::npos == data.find(" HTTP/1.1\r\n")) {
+        return len;
+    }
+
+    UtReply reply = s_server(data);
+    if (reply.send_fail) {
+        conn->eof = true;
+        conn->broken = true;
+        s_errno = UNW_ECONNRESET;
+        return -1;
+    }
+    s_requests++;
+    conn->rx.erase(0, conn->rx_off);
+    conn->rx_off = 0;
+    conn->rx += reply.data;
+    conn->eof = reply.close;
+
+    return len;
+}
+
+OPERATE_RET tuya_transporter_poll_read(tuya_transporter_t transporter, int timeout_ms)
+{
+    // an idle connection closed by the server is only seen when the next request fails
+    return 0;
+}
+
+OPERATE_RET tuya_transporter_ctrl(tuya_transporter_t transporter, uint32_t cmd, void *args)
+{
+    if (TUYA_TRANSPORTER_GET_TLS_CONFIG == cmd) {
+        *(tuya_tls_config_t **)args = NULL;
+    }
+    return OPRT_OK;
+}
+
+TUYA_ERRNO tal_net_get_errno(void)
+{
+    return s_errno;
+}
@@ -0,0 +1,75 @@
+/**
+ * @file ut_fake_transporter.h
+ * @brief In-memory tuya_transporter for the libhttp UT, a handler plays the
+ * server and answers each request.
+ *
+ * @copyright Copyright (c) 2021-2024 Tuya Inc. All Rights Reserved.
+ *
+ */
+
+#ifndef __UT_FAKE_TRANSPORTER_H__
+#define __UT_FAKE_TRANSPORTER_H__
+
+#include <functional>
+#include <string>
+
+/**
+ * @brief what the server does with one request
+ *
+ */
+struct UtReply {
+    bool send_fail = false; // the request write fails, nothing reaches the server
+    std::string data;       // bytes sent back
+    bool close = false;     // the connection is closed after data
+};
+
+/**
+ * @brief the server, called with the request header of every request
+ *
+ */
+typedef std::function<UtReply(const std::string &request)> UT_SERVER_CB;
+
+/**
+ * @brief reset the counters and install the server
+ *
+ */
+void ut_server_set(UT_SERVER_CB cb);
+
+/**
+ * @brief limit the bytes per second the server sends, 0 means no limit
+ *
+ */
+void ut_server_rate(size_t bytes_per_s);
+
+/**
+ * @brief number of connections opened since ut_server_set
+ *
+ */
+int ut_server_connects(void);
+
+/**
+ * @brief number of requests that reached the server since ut_server_set
+ *
+ */
+int ut_server_requests(void);
+
+/**
+ * @brief number of transporters not destroyed yet
+ *
+ */
+int ut_server_open(void);
+
+/**
+ * @brief a 200 response with body
+ *
+ */
+std::string ut_http_ok(const std::string &body);
+
+/**
+ * @brief a 206 response with the requested range of file, or the whole file
+ * without a Range header
+ *
+ */
+std::string ut_http_range(const std::string &request, const std::string &file);
+
+#endif /* __UT_FAKE_TRANSPORTER_H__ */
@@ -73,10 +73,31 @@ mqtt_client_status_t mqtt_client_disconnect(void *client);
 
 mqtt_client_status_t mqtt_client_yield(void *client);
 
+/**
+ * @brief Event driven mqtt_client_yield: sleeps on the socket for at most
+ * timeout_ms, less if the keepalive is due, then handles every packet that has
+ * arrived without waiting for more.
+ */
+mqtt_client_status_t mqtt_client_yield_wait(void *client, uint32_t timeout_ms);
+
 uint16_t mqtt_client_subscribe(void *client, const char *topic, uint8_t qos);
 
 uint16_t mqtt_client_unsubscribe(void *client, const char *topic, uint8_t qos);
 
 uint16_t mqtt_client_publish(void *client, const char *topic, const uint8_t *payload, size_t length, uint8_t qos);
 
+/**
+ * @brief Takes the packet id of a publish before it is sent, so that its
+ * PUBACK can be expected before mqtt_client_publish_with_id returns.
+ */
+uint16_t mqtt_client_packet_id(void *client);
+
+/**
+ * @brief mqtt_client_publish with a packet id from mqtt_client_packet_id.
+ *
+ * @return msgid on success, 0 if the packet was not sent.
+ */
+uint16_t mqtt_client_publish_with_id(void *client, uint16_t msgid, const char *topic, const uint8_t *payload,
+                                     size_t length, uint8_t qos);
+
 #endif /* ifndef MQTT_CLIENT_INTERFACE_H */
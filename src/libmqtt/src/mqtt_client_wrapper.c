@@ -9,14 +9,32 @@
 #include "tal_log.h"
 #include "tal_system.h"
 #include "tal_memory.h"
+#include "tal_mutex.h"
 
 #define log_debug PR_DEBUG
 #define log_error PR_ERR
 
+/* how long mqtt_client_yield_wait looks for the next packet once it has handled one */
+#define MQTT_RX_PROBE_MS 1
+
+/* where the next byte read falls in the incoming packet */
+typedef enum {
+    MQTT_RX_TYPE = 0,
+    MQTT_RX_LENGTH,
+    MQTT_RX_BODY,
+} mqtt_rx_state_t;
+
+/* coreMQTT is not thread safe: the loop and the publishing threads call it
+ * under the client mutex, which is released only while waiting for a packet */
 typedef struct {
     mqtt_client_config_t config;
+    MUTEX_HANDLE mutex;
     MQTTContext_t mqclient;
     tuya_transporter_t network;
+    mqtt_rx_state_t rx_state;
+    size_t rx_remaining;
+    size_t rx_multiplier;
+    bool rx_nowait;
     uint8_t mqttbuffer[CORE_MQTT_BUFFER_SIZE];
 } mqtt_client_context_t;
 
@@ -98,25 +116,124 @@ static int network_write(NetworkContext_t *pNetwork, const unsigned char *pMsg,
     return tuya_transporter_write(transporter, (uint8_t *)pMsg, len, 0);
 }
 
+static bool network_readable(tuya_transporter_t transporter, uint32_t timeout_ms)
+{
+    BOOL_T pending = FALSE;
+
+    tuya_transporter_ctrl(transporter, TUYA_TRANSPORTER_GET_READ_PENDING, &pending);
+    if (pending) {
+        return true;
+    }
+
+    /* a socket error is readable too, the read reports it */
+    return tuya_transporter_poll_read(transporter, timeout_ms) != 0;
+}
+
+/* between packets coreMQTT keeps no state on the stack, so others may use the client while we wait */
+static bool network_wait(mqtt_client_context_t *context, uint32_t timeout_ms)
+{
+    bool readable = false;
+
+    tal_mutex_unlock(context->mutex);
+    readable = network_readable(context->network, timeout_ms);
+    tal_mutex_lock(context->mutex);
+
+    return readable;
+}
+
+/* coreMQTT reads the fixed header a byte at a time and then exactly the rest */
+static void network_rx_track(mqtt_client_context_t *context, const unsigned char *data, size_t len)
+{
+    switch (context->rx_state) {
+    case MQTT_RX_TYPE:
+        context->rx_state = MQTT_RX_LENGTH;
+        context->rx_remaining = 0;
+        context->rx_multiplier = 1;
+        break;
+
+    case MQTT_RX_LENGTH:
+        context->rx_remaining += (data[0] & 0x7f) * context->rx_multiplier;
+        context->rx_multiplier *= 128;
+        if ((data[0] & 0x80) == 0) {
+            context->rx_state = context->rx_remaining ? MQTT_RX_BODY : MQTT_RX_TYPE;
+        }
+        break;
+
+    case MQTT_RX_BODY:
+        context->rx_remaining -= (len < context->rx_remaining) ? len : context->rx_remaining;
+        if (context->rx_remaining == 0) {
+            context->rx_state = MQTT_RX_TYPE;
+        }
+        break;
+    }
+}
+
 static int network_read(NetworkContext_t *pNetwork, unsigned char *pMsg, size_t len)
 {
+    mqtt_client_context_t *context =
+        (mqtt_client_context_t *)((uint8_t *)pNetwork - offsetof(mqtt_client_context_t, network));
     tuya_transporter_t transporter = *pNetwork;
-
     tuya_tls_config_t *tls_config = NULL;
 
     tuya_transporter_ctrl(transporter, TUYA_TRANSPORTER_GET_TLS_CONFIG, &tls_config);
 
     int timeout = tls_config ? tls_config->timeout : 5000;
 
-    int result = tuya_transporter_read(transporter, (uint8_t *)pMsg, len, timeout);
+    /* mqtt_client_yield_wait: only the start of a packet may find nothing to read,
+     * the short wait lets MQTT_ProcessLoop(0) see the time pass instead of spinning */
+    bool probe = context->rx_nowait && context->rx_state == MQTT_RX_TYPE;
+    if (context->rx_state == MQTT_RX_TYPE && !network_wait(context, probe ? MQTT_RX_PROBE_MS : timeout)) {
+        return 0;
+    }
+
+    int total = 0;
+    int result = 0;
+    do {
+        result = tuya_transporter_read(transporter, (uint8_t *)pMsg + total, len - total, timeout);
+        if (result <= 0) {
+            break;
+        }
+        network_rx_track(context, pMsg + total, result);
+        total += result;
+        /* MQTT_ProcessLoop(0) gives coreMQTT no time to ask again for the rest of a body */
+    } while (context->rx_nowait && total < (int)len);
+
+    if (total > 0) {
+        return total;
+    }
 
     if (result == OPRT_RESOURCE_NOT_READY) {
         return 0;
     }
 
+    if (probe && result == 0) {
+        /* readable but empty, the peer closed the connection */
+        return OPRT_COM_ERROR;
+    }
+
     return result;
 }
 
+static uint32_t keepalive_wait_ms(const MQTTContext_t *mqclient)
+{
+    uint32_t now = tal_system_get_millisecond();
+    uint32_t keepalive_ms = 1000U * mqclient->keepAliveIntervalSec;
+    uint32_t idle = now - mqclient->lastPacketTime;
+
+    if (keepalive_ms == 0) {
+        return UINT32_MAX;
+    }
+    /* MQTT_ProcessLoop acts once the idle time is over the interval */
+    if (idle <= keepalive_ms) {
+        return keepalive_ms - idle + 1;
+    }
+    if (mqclient->waitingForPingResp) {
+        uint32_t waited = now - mqclient->pingReqSendTimeMs;
+        return (waited <= MQTT_PINGRESP_TIMEOUT_MS) ? MQTT_PINGRESP_TIMEOUT_MS - waited + 1 : 0;
+    }
+    return 0;
+}
+
 mqtt_client_status_t mqtt_client_init(void *client, const mqtt_client_config_t *config)
 {
     mqtt_client_context_t *context = (mqtt_client_context_t *)client;
@@ -163,6 +280,11 @@ mqtt_client_status_t mqtt_client_init(void *client, const mqtt_client_config_t *
     network_buffer.size = CORE_MQTT_BUFFER_SIZE;
     network_buffer.pBuffer = context->mqttbuffer;
 
+    if (OPRT_OK != tal_mutex_create_init(&context->mutex)) {
+        tuya_transporter_destroy(context->network);
+        return MQTT_STATUS_NETWORK_INIT_FAILED;
+    }
+
     /* Initialize MQTT library. */
     mqtt_status = MQTT_Init(&context->mqclient, &transport, (MQTTGetCurrentTimeFunc_t)tal_system_get_millisecond,
                             core_mqtt_library_callback, &network_buffer, context);
@@ -171,6 +293,7 @@ mqtt_client_status_t mqtt_client_init(void *client, const mqtt_client_config_t *
         log_error("MQTT init failed: Status = %s.", MQTT_Status_strerror(mqtt_status));
         tuya_transporter_close(context->network);
         tuya_transporter_destroy(context->network);
+        tal_mutex_release(context->mutex);
         return OPRT_COM_ERROR;
     }
 
@@ -183,6 +306,8 @@ mqtt_client_status_t mqtt_client_deinit(void *client)
 
     tuya_transporter_close(context->network);
     tuya_transporter_destroy(context->network);
+    tal_mutex_release(context->mutex);
+    context->mutex = NULL;
     return MQTT_STATUS_SUCCESS;
 }
 
@@ -191,6 +316,7 @@ mqtt_client_status_t mqtt_client_connect(void *client)
     mqtt_client_context_t *context = (mqtt_client_context_t *)client;
     MQTTStatus_t mqtt_status;
 
+    context->rx_state = MQTT_RX_TYPE;
     int ret = tuya_transporter_connect(context->network, context->config.host, context->config.port,
                                        context->config.timeout_ms);
     if (OPRT_OK != ret) {
@@ -201,6 +327,7 @@ mqtt_client_status_t mqtt_client_connect(void *client)
     bool pSessionPresent = false;
 
     /* Send MQTT CONNECT packet to broker. */
+    tal_mutex_lock(context->mutex);
     mqtt_status = MQTT_Connect(&context->mqclient,
                                &(const MQTTConnectInfo_t){.cleanSession = true,
                                                           .keepAliveSeconds = context->config.keepalive,
@@ -211,6 +338,7 @@ mqtt_client_status_t mqtt_client_connect(void *client)
                                                           .pPassword = context->config.password,
                                                           .passwordLength = strlen(context->config.password)},
                                NULL, context->config.timeout_ms, &pSessionPresent);
+    tal_mutex_unlock(context->mutex);
     if (MQTTSuccess != mqtt_status) {
         log_error("mqtt connect err: %s(%d)", MQTT_Status_strerror(mqtt_status), mqtt_status);
         tuya_transporter_close(context->network);
@@ -232,7 +360,9 @@ mqtt_client_status_t mqtt_client_disconnect(void *client)
     mqtt_client_context_t *context = (mqtt_client_context_t *)client;
     MQTTStatus_t mqtt_status;
 
+    tal_mutex_lock(context->mutex);
     mqtt_status = MQTT_Disconnect(&context->mqclient);
+    tal_mutex_unlock(context->mutex);
     if (MQTTSuccess != mqtt_status) {
         log_error("mqtt disconnect err: %s(%d)", MQTT_Status_strerror(mqtt_status), mqtt_status);
     }
@@ -251,11 +381,13 @@ uint16_t mqtt_client_subscribe(void *client, const char *topic, uint8_t qos)
     mqtt_client_context_t *context = (mqtt_client_context_t *)client;
     MQTTStatus_t mqtt_status;
 
+    tal_mutex_lock(context->mutex);
     uint16_t msgid = MQTT_GetPacketId(&context->mqclient);
 
     mqtt_status = MQTT_Subscribe(
         &context->mqclient,
         &(const MQTTSubscribeInfo_t){.qos = qos, .pTopicFilter = topic, .topicFilterLength = strlen(topic)}, 1, msgid);
+    tal_mutex_unlock(context->mutex);
 
     if (mqtt_status != MQTTSuccess) {
         log_error("Failed to send SUBSCRIBE packet to broker with error = %s.", MQTT_Status_strerror(mqtt_status));
@@ -270,11 +402,13 @@ uint16_t mqtt_client_unsubscribe(void *client, const char *topic, uint8_t qos)
     mqtt_client_context_t *context = (mqtt_client_context_t *)client;
     MQTTStatus_t mqtt_status;
 
+    tal_mutex_lock(context->mutex);
     uint16_t msgid = MQTT_GetPacketId(&context->mqclient);
 
     mqtt_status = MQTT_Unsubscribe(
         &context->mqclient,
         &(const MQTTSubscribeInfo_t){.qos = qos, .pTopicFilter = topic, .topicFilterLength = strlen(topic)}, 1, msgid);
+    tal_mutex_unlock(context->mutex);
 
     if (mqtt_status != MQTTSuccess) {
         log_error("Failed to send SUBSCRIBE packet to broker with error = %s.", MQTT_Status_strerror(mqtt_status));
@@ -285,12 +419,28 @@ uint16_t mqtt_client_unsubscribe(void *client, const char *topic, uint8_t qos)
 }
 
 uint16_t mqtt_client_publish(void *client, const char *topic, const uint8_t *payload, size_t length, uint8_t qos)
+{
+    return mqtt_client_publish_with_id(client, mqtt_client_packet_id(client), topic, payload, length, qos);
+}
+
+uint16_t mqtt_client_packet_id(void *client)
 {
     mqtt_client_context_t *context = (mqtt_client_context_t *)client;
-    MQTTStatus_t mqtt_status;
 
+    tal_mutex_lock(context->mutex);
     uint16_t msgid = MQTT_GetPacketId(&context->mqclient);
+    tal_mutex_unlock(context->mutex);
+
+    return msgid;
+}
+
+uint16_t mqtt_client_publish_with_id(void *client, uint16_t msgid, const char *topic, const uint8_t *payload,
+                                     size_t length, uint8_t qos)
+{
+    mqtt_client_context_t *context = (mqtt_client_context_t *)client;
+    MQTTStatus_t mqtt_status;
 
+    tal_mutex_lock(context->mutex);
     mqtt_status = MQTT_Publish(&context->mqclient,
                                &(const MQTTPublishInfo_t){.qos = qos,
                                                           .pTopicName = topic,
@@ -298,6 +448,7 @@ uint16_t mqtt_client_publish(void *client, const char *topic, const uint8_t *pay
                                                           .pPayload = payload,
                                                           .payloadLength = length},
                                msgid);
+    tal_mutex_unlock(context->mutex);
 
     if (MQTTSuccess != mqtt_status) {
         return 0;
@@ -310,7 +461,36 @@ mqtt_client_status_t mqtt_client_yield(void *client)
     mqtt_client_context_t *context = (mqtt_client_context_t *)client;
     MQTTStatus_t mqtt_status;
 
+    tal_mutex_lock(context->mutex);
     mqtt_status = MQTT_ProcessLoop(&context->mqclient, context->config.timeout_ms);
+    tal_mutex_unlock(context->mutex);
+    if (mqtt_status != MQTTSuccess) {
+        log_error("MQTT_ProcessLoop returned with status = %s.", MQTT_Status_strerror(mqtt_status));
+        mqtt_client_disconnect(context);
+        return MQTT_STATUS_NETWORK_TIMEOUT;
+    }
+    return MQTT_STATUS_SUCCESS;
+}
+
+mqtt_client_status_t mqtt_client_yield_wait(void *client, uint32_t timeout_ms)
+{
+    mqtt_client_context_t *context = (mqtt_client_context_t *)client;
+    MQTTStatus_t mqtt_status;
+
+    tal_mutex_lock(context->mutex);
+    uint32_t keepalive_ms = keepalive_wait_ms(&context->mqclient);
+    if (keepalive_ms < timeout_ms) {
+        timeout_ms = keepalive_ms;
+    }
+    if (timeout_ms) {
+        network_wait(context, timeout_ms);
+    }
+
+    /* handles what has arrived and the keepalive, reads never wait for a new packet */
+    context->rx_nowait = true;
+    mqtt_status = MQTT_ProcessLoop(&context->mqclient, 0);
+    context->rx_nowait = false;
+    tal_mutex_unlock(context->mutex);
     if (mqtt_status != MQTTSuccess) {
         log_error("MQTT_ProcessLoop returned with status = %s.", MQTT_Status_strerror(mqtt_status));
         mqtt_client_disconnect(context);
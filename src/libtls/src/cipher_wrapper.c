@@ -136,6 +136,48 @@ EXIT:
     return (ret);
 }
 
+int mbedtls_cipher_auth_decrypt_inplace_wrapper(const cipher_params_t *input, size_t *olen, size_t tag_len)
+{
+    if (input == NULL || input->data == NULL || olen == NULL) {
+        return OPRT_INVALID_PARM;
+    }
+
+    int ret = OPRT_OK;
+    const mbedtls_cipher_info_t *cipher_info;
+    mbedtls_cipher_context_t cipher_ctx;
+
+    mbedtls_cipher_init(&cipher_ctx);
+
+    cipher_info = mbedtls_cipher_info_from_type(input->cipher_type);
+    if (cipher_info == NULL) {
+        PR_ERR("Cipher not found\n");
+        ret = OPRT_INVALID_PARM;
+        goto EXIT;
+    }
+
+    if ((ret = mbedtls_cipher_setup(&cipher_ctx, cipher_info)) != 0) {
+        PR_ERR("mbedtls_cipher_setup failed\n");
+        goto EXIT;
+    }
+
+    if ((ret = mbedtls_cipher_setkey(&cipher_ctx, input->key, mbedtls_cipher_info_get_key_bitlen(cipher_info),
+                                     MBEDTLS_DECRYPT)) != 0) {
+        PR_ERR("mbedtls_cipher_setkey() returned error\n");
+        goto EXIT;
+    }
+
+    /*
+     * Ciphertext and tag are already contiguous, so no temporary buffer is
+     * needed. AEAD modes allow the output to be the same as the input.
+     */
+    ret = mbedtls_cipher_auth_decrypt_ext(&cipher_ctx, input->nonce, input->nonce_len, input->ad, input->ad_len,
+                                          input->data, input->data_len + tag_len, input->data, input->data_len, olen,
+                                          tag_len);
+EXIT:
+    mbedtls_cipher_free(&cipher_ctx);
+    return (ret);
+}
+
 int mbedtls_message_digest(mbedtls_md_type_t md_type, const uint8_t *input, size_t ilen, uint8_t *digest)
 {
     if (input == NULL || ilen == 0 || digest == NULL) {
@@ -60,6 +60,8 @@ typedef struct {
     char key[TAL_LV_KEY_LEN + 1];
 } tal_kv_cfg_t;
 
+typedef void *KV_BATCH_HANDLE;
+
 /**
  * @brief Initializes the TAL Key-Value (KV) module.
  *
@@ -125,6 +127,68 @@ int tal_kv_free(uint8_t *value);
  */
 int tal_kv_del(const char *key);
 
+/**
+ * @brief Writes the key-value records buffered in RAM to flash.
+ *
+ * Only does something with ENABLE_KV_LOG and a KV_LOG_WB_SIZE buffer, call it
+ * before a planned reset or power off.
+ *
+ * @return OPRT_OK on success, or an error code if the write failed.
+ */
+int tal_kv_flush(void);
+
+/**
+ * @brief Starts a batch of key-value changes applied all or nothing.
+ *
+ * The kv lock is held until tal_kv_batch_commit or tal_kv_batch_abort, other
+ * threads calling tal_kv wait for it, keep the batch short. tal_kv_get from
+ * the thread of the batch returns the values before the batch, several gets
+ * between begin and abort read a consistent snapshot.
+ *
+ * @param batch Receives the batch handle.
+ * @return OPRT_OK on success, or an error code on failure.
+ */
+int tal_kv_batch_begin(KV_BATCH_HANDLE *batch);
+
+/**
+ * @brief Sets a key in the batch, the later change of the same key wins.
+ *
+ * @param batch The batch handle.
+ * @param key The key, at most 255 bytes.
+ * @param value The value, copied.
+ * @param length The length of the value in bytes.
+ * @return OPRT_OK on success, or an error code on failure.
+ */
+int tal_kv_batch_put(KV_BATCH_HANDLE batch, const char *key, const uint8_t *value, size_t length);
+
+/**
+ * @brief Deletes a key in the batch, the later change of the same key wins.
+ *
+ * @param batch The batch handle.
+ * @param key The key, at most 255 bytes.
+ * @return OPRT_OK on success, or an error code on failure.
+ */
+int tal_kv_batch_del(KV_BATCH_HANDLE batch, const char *key);
+
+/**
+ * @brief Writes all changes of the batch and releases it.
+ *
+ * With ENABLE_KV_LOG the batch is a single commit to flash. Otherwise it is
+ * first saved in a journal, a batch cut by a power loss is finished by the
+ * next tal_kv_init.
+ *
+ * @param batch The batch handle, invalid after the call.
+ * @return OPRT_OK if every change was written, or an error code on failure.
+ */
+int tal_kv_batch_commit(KV_BATCH_HANDLE batch);
+
+/**
+ * @brief Drops all changes of the batch and releases it.
+ *
+ * @param batch The batch handle, invalid after the call.
+ */
+void tal_kv_batch_abort(KV_BATCH_HANDLE batch);
+
 /**
  * @brief Serializes and sets the value of a key in the key-value database.
  *
@@ -0,0 +1,235 @@
+/**
+ * @file kv_cache.c
+ * @brief RAM cache of decrypted tal_kv values.
+ *
+ * Keeps the last KV_CACHE_NUM keys read or written, with their decrypted
+ * value if it is not longer than KV_CACHE_VALUE_MAX, so repeated tal_kv_get
+ * of the same key skip the flash read and the decryption. Keys found missing
+ * are cached too, they are not looked up in flash again until written.
+ *
+ * The least recently used entry is replaced when the cache is full. tal_kv
+ * updates the cache after every set and del, the cache never holds a value
+ * that differs from flash.
+ *
+ * All functions expect the tal_kv mutex to be held.
+ *
+ * @copyright Copyright (c) 2021-2024 Tuya Inc. All Rights Reserved.
+ *
+ */
+
+#include "tal_api.h"
+#include "tal_kv.h"
+#include "mix_method.h"
+
+#if defined(ENABLE_KV_CACHE) && (ENABLE_KV_CACHE == 1)
+
+#ifndef KV_CACHE_NUM
+#define KV_CACHE_NUM 8
+#endif
+
+#ifndef KV_CACHE_VALUE_MAX
+#define KV_CACHE_VALUE_MAX 128
+#endif
+
+typedef struct {
+    char *key;
+    uint32_t hash;
+    uint8_t *value; // NULL if the key does not exist
+    size_t len;
+    uint32_t used; // tick of the last access
+} kv_cache_entry_t;
+
+typedef struct {
+    kv_cache_entry_t entry[KV_CACHE_NUM];
+    uint32_t tick;
+    uint32_t hit;
+    uint32_t absent_hit;
+    uint32_t miss;
+} kv_cache_t;
+
+static kv_cache_t s_kv_cache;
+
+static kv_cache_entry_t *kv_cache_find(const char *key)
+{
+    uint32_t hash = mm_str_hash(key);
+    uint32_t i;
+
+    for (i = 0; i < KV_CACHE_NUM; i++) {
+        kv_cache_entry_t *entry = &s_kv_cache.entry[i];
+        if (entry->key && entry->hash == hash && 0 == strcmp(entry->key, key)) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static void kv_cache_entry_free(kv_cache_entry_t *entry)
+{
+    if (entry->key) {
+        tal_free(entry->key);
+    }
+    if (entry->value) {
+        tal_free(entry->value);
+    }
+    memset(entry, 0, sizeof(kv_cache_entry_t));
+}
+
+/* the entry of key, or the least recently used one emptied for it */
+static kv_cache_entry_t *kv_cache_slot(const char *key)
+{
+    kv_cache_entry_t *entry = kv_cache_find(key);
+    uint32_t i;
+
+    if (entry) {
+        if (entry->value) {
+            tal_free(entry->value);
+            entry->value = NULL;
+        }
+        entry->len = 0;
+        return entry;
+    }
+
+    entry = &s_kv_cache.entry[0];
+    for (i = 0; i < KV_CACHE_NUM && entry->key; i++) {
+        if (NULL == s_kv_cache.entry[i].key || s_kv_cache.entry[i].used < entry->used) {
+            entry = &s_kv_cache.entry[i];
+        }
+    }
+    kv_cache_entry_free(entry);
+
+    entry->key = tal_malloc(strlen(key) + 1);
+    if (NULL == entry->key) {
+        return NULL;
+    }
+    strcpy(entry->key, key);
+    entry->hash = mm_str_hash(key);
+
+    return entry;
+}
+
+/**
+ * @brief Looks up the value of key.
+ *
+ * @param key The key.
+ * @param value Receives a copy of the value to free with tal_free, NULL if the
+ * key is known not to exist.
+ * @param length Receives the length of value.
+ *
+ * @return OPRT_OK if the cache knows key, OPRT_NOT_FOUND if flash must be read.
+ */
+int kv_cache_get(const char *key, uint8_t **value, size_t *length)
+{
+    kv_cache_entry_t *entry = kv_cache_find(key);
+
+    if (NULL == entry) {
+        s_kv_cache.miss++;
+        return OPRT_NOT_FOUND;
+    }
+
+    *value = NULL;
+    *length = 0;
+    if (entry->value) {
+        *value = tal_malloc(entry->len + 1);
+        if (NULL == *value) {
+            return OPRT_NOT_FOUND;
+        }
+        memcpy(*value, entry->value, entry->len + 1);
+        *length = entry->len;
+        s_kv_cache.hit++;
+    } else {
+        s_kv_cache.absent_hit++;
+    }
+    entry->used = ++s_kv_cache.tick;
+
+    return OPRT_OK;
+}
+
+/**
+ * @brief Drops key from the cache.
+ *
+ * @param key The key.
+ */
+void kv_cache_del(const char *key)
+{
+    kv_cache_entry_t *entry = kv_cache_find(key);
+
+    if (entry) {
+        kv_cache_entry_free(entry);
+    }
+}
+
+/**
+ * @brief Caches the value of key, a value too long is not cached.
+ *
+ * @param key The key.
+ * @param value The decrypted value.
+ * @param length The length of value.
+ */
+void kv_cache_put(const char *key, const uint8_t *value, size_t length)
+{
+    kv_cache_entry_t *entry;
+
+    if (length > KV_CACHE_VALUE_MAX) {
+        kv_cache_del(key);
+        return;
+    }
+
+    entry = kv_cache_slot(key);
+    if (NULL == entry) {
+        return;
+    }
+    entry->value = tal_malloc(length + 1);
+    if (NULL == entry->value) {
+        kv_cache_entry_free(entry);
+        return;
+    }
+    memcpy(entry->value, value, length);
+    entry->value[length] = 0;
+    entry->len = length;
+    entry->used = ++s_kv_cache.tick;
+}
+
+/**
+ * @brief Caches that key does not exist.
+ *
+ * @param key The key.
+ */
+void kv_cache_put_absent(const char *key)
+{
+    kv_cache_entry_t *entry = kv_cache_slot(key);
+
+    if (entry) {
+        entry->used = ++s_kv_cache.tick;
+    }
+}
+
+/**
+ * @brief Drops every key from the cache.
+ */
+void kv_cache_clear(void)
+{
+    uint32_t i;
+
+    for (i = 0; i < KV_CACHE_NUM; i++) {
+        kv_cache_entry_free(&s_kv_cache.entry[i]);
+    }
+}
+
+/**
+ * @brief Dumps the cache counters and keys.
+ */
+void kv_cache_dump(void)
+{
+    uint32_t i;
+
+    PR_DEBUG("kv cache: hit %d, absent hit %d, miss %d", s_kv_cache.hit, s_kv_cache.absent_hit, s_kv_cache.miss);
+    for (i = 0; i < KV_CACHE_NUM; i++) {
+        kv_cache_entry_t *entry = &s_kv_cache.entry[i];
+        if (entry->key) {
+            PR_DEBUG_RAW("%s%s  ", entry->key, entry->value ? "" : "(absent)");
+        }
+    }
+    PR_DEBUG_RAW("\r\n");
+}
+
+#endif
@@ -0,0 +1,816 @@
+/**
+ * @file kv_log.c
+ * @brief Log structured backend of tal_kv on littlefs.
+ *
+ * With ENABLE_KV_LOG every tal_kv_set/tal_kv_del appends a record to one
+ * littlefs file instead of truncating and rewriting a file per key. A RAM
+ * index maps every key to its latest value in the log. Once most of the log
+ * is stale records it is copied into a new file in the background, which
+ * then replaces the log with lfs_rename.
+ *
+ * Records can be buffered in RAM (KV_LOG_WB_SIZE) and written with a single
+ * commit at most KV_LOG_FLUSH_MS later, call tal_kv_flush before a reset as a
+ * power loss drops the buffered records.
+ *
+ * Log layout (little endian):
+ *   header: magic "TKVL", version
+ *   record: magic, type, key_len, reserved, val_len, crc32 of key and value,
+ *           key, value (the value encrypted by tal_kv)
+ *
+ * A record failing its crc ends the log, it is cut there when loaded.
+ *
+ * The records of a tal_kv batch are flagged and followed by a commit record,
+ * they are only loaded if the commit record made it to flash.
+ *
+ * All functions expect the tal_kv mutex to be held, the background work
+ * takes it itself.
+ *
+ * @copyright Copyright (c) 2021-2024 Tuya Inc. All Rights Reserved.
+ *
+ */
+
+#include "tal_api.h"
+#include "tal_kv.h"
+#include "crc32i.h"
+#include "mix_method.h"
+
+#if defined(ENABLE_KV_LOG) && (ENABLE_KV_LOG == 1)
+
+#ifndef KV_LOG_WB_SIZE
+#define KV_LOG_WB_SIZE 0
+#endif
+
+#ifndef KV_LOG_FLUSH_MS
+#define KV_LOG_FLUSH_MS 1000
+#endif
+
+#define KV_LOG_FILE        "tal_kv.log"
+#define KV_LOG_FILE_TMP    "tal_kv.log.tmp"
+#define KV_LOG_MAGIC       "TKVL"
+#define KV_LOG_VERSION     1
+#define KV_LOG_HEAD_LEN    8
+#define KV_LOG_REC_MAGIC   0xA5
+#define KV_LOG_REC_SET     1
+#define KV_LOG_REC_DEL     2
+#define KV_LOG_REC_COMMIT  3
+#define KV_LOG_REC_BATCH   0x01 // flag of the records of a batch
+#define KV_LOG_REC_LEN     12
+#define KV_LOG_INDEX_STEP  8
+// compact once the log is this big and more than half of it is stale
+#define KV_LOG_COMPACT_MIN (8 * 1024)
+
+typedef struct {
+    char *key;
+    uint32_t hash;
+    uint32_t off; // offset of the value in the log
+    uint32_t len; // length of the value
+} kv_log_entry_t;
+
+typedef struct {
+    lfs_t *lfs;
+    MUTEX_HANDLE mutex;
+    lfs_file_t file;
+    BOOL_T opened;
+    uint32_t size; // bytes in the log file, the buffered records follow them
+    uint32_t live; // bytes of the records still indexed
+    kv_log_entry_t *index;
+    uint32_t cnt;
+    uint32_t cap;
+    DELAYED_WORK_HANDLE work;
+    BOOL_T work_pending;
+    BOOL_T batch;         // records are written without commit until kv_log_batch_end
+    uint32_t batch_start; // size of the log when the batch began
+#if KV_LOG_WB_SIZE > 0
+    uint32_t wb_len;
+    uint8_t wb[KV_LOG_WB_SIZE];
+#endif
+} kv_log_t;
+
+static kv_log_t s_kv_log;
+
+static uint32_t kv_log_wb_len(void)
+{
+#if KV_LOG_WB_SIZE > 0
+    return s_kv_log.wb_len;
+#else
+    return 0;
+#endif
+}
+
+static void kv_log_put_le32(uint8_t *p, uint32_t v)
+{
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+    p[2] = (v >> 16) & 0xff;
+    p[3] = (v >> 24) & 0xff;
+}
+
+static uint32_t kv_log_get_le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static kv_log_entry_t *kv_log_find(const char *key, uint32_t hash)
+{
+    uint32_t i;
+    for (i = 0; i < s_kv_log.cnt; i++) {
+        if (s_kv_log.index[i].hash == hash && 0 == strcmp(s_kv_log.index[i].key, key)) {
+            return &s_kv_log.index[i];
+        }
+    }
+    return NULL;
+}
+
+static uint32_t kv_log_rec_size(const kv_log_entry_t *entry)
+{
+    return KV_LOG_REC_LEN + strlen(entry->key) + entry->len;
+}
+
+static int kv_log_index_put(const char *key, uint32_t off, uint32_t len)
+{
+    uint32_t hash = mm_str_hash(key);
+    kv_log_entry_t *entry = kv_log_find(key, hash);
+
+    if (entry) {
+        s_kv_log.live -= kv_log_rec_size(entry);
+    } else {
+        if (s_kv_log.cnt == s_kv_log.cap) {
+            kv_log_entry_t *index =
+                tal_realloc(s_kv_log.index, (s_kv_log.cap + KV_LOG_INDEX_STEP) * sizeof(kv_log_entry_t));
+            if (NULL == index) {
+                return OPRT_MALLOC_FAILED;
+            }
+            s_kv_log.index = index;
+            s_kv_log.cap += KV_LOG_INDEX_STEP;
+        }
+        entry = &s_kv_log.index[s_kv_log.cnt];
+        entry->key = tal_malloc(strlen(key) + 1);
+        if (NULL == entry->key) {
+            return OPRT_MALLOC_FAILED;
+        }
+        strcpy(entry->key, key);
+        entry->hash = hash;
+        s_kv_log.cnt++;
+    }
+    entry->off = off;
+    entry->len = len;
+    s_kv_log.live += kv_log_rec_size(entry);
+
+    return OPRT_OK;
+}
+
+static BOOL_T kv_log_index_del(const char *key)
+{
+    kv_log_entry_t *entry = kv_log_find(key, mm_str_hash(key));
+
+    if (NULL == entry) {
+        return FALSE;
+    }
+    s_kv_log.live -= kv_log_rec_size(entry);
+    tal_free(entry->key);
+    *entry = s_kv_log.index[--s_kv_log.cnt];
+
+    return TRUE;
+}
+
+static void kv_log_index_free(void)
+{
+    uint32_t i;
+    for (i = 0; i < s_kv_log.cnt; i++) {
+        tal_free(s_kv_log.index[i].key);
+    }
+    if (s_kv_log.index) {
+        tal_free(s_kv_log.index);
+    }
+    s_kv_log.index = NULL;
+    s_kv_log.cnt = 0;
+    s_kv_log.cap = 0;
+    s_kv_log.live = 0;
+}
+
+static void kv_log_rec_head(uint8_t *head, uint8_t type, const char *key, uint32_t key_len, const uint8_t *val,
+                            uint32_t val_len)
+{
+    uint32_t crc = hash_crc32i_init();
+    crc = hash_crc32i_update(crc, key, key_len);
+    if (val_len) {
+        crc = hash_crc32i_update(crc, val, val_len);
+    }
+    crc = hash_crc32i_finish(crc);
+
+    head[0] = KV_LOG_REC_MAGIC;
+    head[1] = type;
+    head[2] = (uint8_t)key_len;
+    head[3] = 0;
+    kv_log_put_le32(head + 4, val_len);
+    kv_log_put_le32(head + 8, crc);
+}
+
+static int kv_log_read_at(lfs_file_t *file, uint32_t off, void *buf, uint32_t len)
+{
+    if (lfs_file_seek(s_kv_log.lfs, file, off, LFS_SEEK_SET) < 0) {
+        return OPRT_KVS_RD_FAIL;
+    }
+    if (lfs_file_read(s_kv_log.lfs, file, buf, len) != (lfs_ssize_t)len) {
+        return OPRT_KVS_RD_FAIL;
+    }
+    return OPRT_OK;
+}
+
+static int kv_log_write_to(lfs_file_t *file, const void *buf, uint32_t len)
+{
+    if (0 == len) {
+        return OPRT_OK;
+    }
+    if (lfs_file_write(s_kv_log.lfs, file, buf, len) != (lfs_ssize_t)len) {
+        return OPRT_KVS_WR_FAIL;
+    }
+    return OPRT_OK;
+}
+
+static int kv_log_write_head(lfs_file_t *file)
+{
+    uint8_t head[KV_LOG_HEAD_LEN];
+
+    memcpy(head, KV_LOG_MAGIC, 4);
+    kv_log_put_le32(head + 4, KV_LOG_VERSION);
+
+    return kv_log_write_to(file, head, KV_LOG_HEAD_LEN);
+}
+
+/* check the record at off, returns its size or 0 if the log ends there */
+static uint32_t kv_log_check_rec(uint32_t off, uint32_t fsize, uint8_t *head, char *key)
+{
+    uint8_t chunk[64];
+    uint32_t key_len, val_len, rec_len, crc, pos, n;
+
+    if (off + KV_LOG_REC_LEN > fsize || OPRT_OK != kv_log_read_at(&s_kv_log.file, off, head, KV_LOG_REC_LEN)) {
+        return 0;
+    }
+    key_len = head[2];
+    val_len = kv_log_get_le32(head + 4);
+    rec_len = KV_LOG_REC_LEN + key_len + val_len;
+    if (KV_LOG_REC_MAGIC != head[0] || val_len > fsize || off + rec_len > fsize) {
+        return 0;
+    }
+    if (KV_LOG_REC_COMMIT == head[1] ? (0 != key_len || !(head[3] & KV_LOG_REC_BATCH))
+                                     : (0 == key_len || (KV_LOG_REC_SET != head[1] && KV_LOG_REC_DEL != head[1]))) {
+        return 0;
+    }
+    if (OPRT_OK != kv_log_read_at(&s_kv_log.file, off + KV_LOG_REC_LEN, key, key_len)) {
+        return 0;
+    }
+    key[key_len] = 0;
+
+    crc = hash_crc32i_update(hash_crc32i_init(), key, key_len);
+    for (pos = 0; pos < val_len; pos += n) {
+        n = (val_len - pos < sizeof(chunk)) ? val_len - pos : sizeof(chunk);
+        if (lfs_file_read(s_kv_log.lfs, &s_kv_log.file, chunk, n) != (lfs_ssize_t)n) {
+            return 0;
+        }
+        crc = hash_crc32i_update(crc, chunk, n);
+    }
+    if (hash_crc32i_finish(crc) != kv_log_get_le32(head + 8)) {
+        return 0;
+    }
+
+    return rec_len;
+}
+
+/* load the record at off into the index, returns its size or 0 if the log ends there */
+static uint32_t kv_log_load_rec(uint32_t off, uint32_t fsize)
+{
+    uint8_t head[KV_LOG_REC_LEN];
+    char key[256];
+    uint32_t rec_len = kv_log_check_rec(off, fsize, head, key);
+
+    if (0 == rec_len) {
+        return 0;
+    }
+    if (KV_LOG_REC_SET == head[1]) {
+        if (OPRT_OK != kv_log_index_put(key, off + KV_LOG_REC_LEN + head[2], kv_log_get_le32(head + 4))) {
+            return 0;
+        }
+    } else if (KV_LOG_REC_DEL == head[1]) {
+        kv_log_index_del(key);
+    }
+
+    return rec_len;
+}
+
+/* load the batch starting at off, returns its size or 0 if it was not committed */
+static uint32_t kv_log_load_batch(uint32_t off, uint32_t fsize)
+{
+    uint8_t head[KV_LOG_REC_LEN];
+    char key[256];
+    uint32_t end = off, rec_len;
+
+    while ((rec_len = kv_log_check_rec(end, fsize, head, key)) > 0 && (head[3] & KV_LOG_REC_BATCH)) {
+        end += rec_len;
+        if (KV_LOG_REC_COMMIT == head[1]) {
+            break;
+        }
+    }
+    if (0 == rec_len || KV_LOG_REC_COMMIT != head[1]) {
+        PR_ERR("kv log batch at %d not committed", off);
+        return 0;
+    }
+
+    for (rec_len = 0; off + rec_len < end;) {
+        uint32_t n = kv_log_load_rec(off + rec_len, fsize);
+        if (0 == n) {
+            return 0;
+        }
+        rec_len += n;
+    }
+
+    return rec_len;
+}
+
+/* open the log and rebuild the index from it, buffered records are dropped */
+static int kv_log_load(void)
+{
+    uint8_t head[KV_LOG_HEAD_LEN];
+    uint32_t fsize, off, rec_len;
+    int ret;
+
+    kv_log_index_free();
+#if KV_LOG_WB_SIZE > 0
+    s_kv_log.wb_len = 0;
+#endif
+    if (s_kv_log.opened) {
+        lfs_file_close(s_kv_log.lfs, &s_kv_log.file);
+        s_kv_log.opened = FALSE;
+    }
+
+    ret = lfs_file_open(s_kv_log.lfs, &s_kv_log.file, KV_LOG_FILE, LFS_O_RDWR | LFS_O_CREAT | LFS_O_APPEND);
+    if (LFS_ERR_OK != ret) {
+        PR_ERR("kv log open err %d", ret);
+        return ret;
+    }
+    s_kv_log.opened = TRUE;
+
+    fsize = lfs_file_size(s_kv_log.lfs, &s_kv_log.file);
+    if (fsize < KV_LOG_HEAD_LEN || OPRT_OK != kv_log_read_at(&s_kv_log.file, 0, head, KV_LOG_HEAD_LEN) ||
+        memcmp(head, KV_LOG_MAGIC, 4) || KV_LOG_VERSION != kv_log_get_le32(head + 4)) {
+        if (fsize) {
+            PR_ERR("kv log head invalid, reset it");
+        }
+        lfs_file_truncate(s_kv_log.lfs, &s_kv_log.file, 0);
+        ret = kv_log_write_head(&s_kv_log.file);
+        if (OPRT_OK != ret || LFS_ERR_OK != lfs_file_sync(s_kv_log.lfs, &s_kv_log.file)) {
+            return OPRT_KVS_WR_FAIL;
+        }
+        s_kv_log.size = KV_LOG_HEAD_LEN;
+        return OPRT_OK;
+    }
+
+    off = KV_LOG_HEAD_LEN;
+    while (off + KV_LOG_REC_LEN <= fsize && OPRT_OK == kv_log_read_at(&s_kv_log.file, off, head, 4)) {
+        rec_len = (head[3] & KV_LOG_REC_BATCH) ? kv_log_load_batch(off, fsize) : kv_log_load_rec(off, fsize);
+        if (0 == rec_len) {
+            break;
+        }
+        off += rec_len;
+    }
+    if (off != fsize) {
+        PR_ERR("kv log cut at %d of %d", off, fsize);
+        lfs_file_truncate(s_kv_log.lfs, &s_kv_log.file, off);
+        lfs_file_sync(s_kv_log.lfs, &s_kv_log.file);
+    }
+    s_kv_log.size = off;
+    PR_DEBUG("kv log %d keys, %d of %d bytes live", s_kv_log.cnt, s_kv_log.live, s_kv_log.size);
+
+    return OPRT_OK;
+}
+
+/**
+ * @brief Writes the buffered records and commits the log.
+ *
+ * @return OPRT_OK on success, the log is reloaded from flash on failure.
+ */
+int kv_log_flush(void)
+{
+    int ret = OPRT_OK;
+
+    if (!s_kv_log.opened) {
+        return OPRT_KVS_WR_FAIL;
+    }
+
+#if KV_LOG_WB_SIZE > 0
+    if (0 == s_kv_log.wb_len) {
+        return OPRT_OK;
+    }
+    ret = kv_log_write_to(&s_kv_log.file, s_kv_log.wb, s_kv_log.wb_len);
+    if (OPRT_OK == ret) {
+        s_kv_log.size += s_kv_log.wb_len;
+        s_kv_log.wb_len = 0;
+    }
+#endif
+    if (OPRT_OK == ret && LFS_ERR_OK != lfs_file_sync(s_kv_log.lfs, &s_kv_log.file)) {
+        ret = OPRT_KVS_WR_FAIL;
+    }
+    if (OPRT_OK != ret) {
+        PR_ERR("kv log write err, reload");
+        kv_log_load();
+    }
+
+    return ret;
+}
+
+static BOOL_T kv_log_compact_needed(void)
+{
+    uint32_t total = s_kv_log.size + kv_log_wb_len();
+    return total >= KV_LOG_COMPACT_MIN && total - KV_LOG_HEAD_LEN > 2 * s_kv_log.live;
+}
+
+/* copy the live records into a new log and replace the old one with it */
+static int kv_log_compact(void)
+{
+    lfs_file_t tmp;
+    uint8_t head[KV_LOG_REC_LEN];
+    uint32_t *new_off = NULL;
+    uint8_t *val = NULL;
+    uint32_t off = KV_LOG_HEAD_LEN;
+    uint32_t i, key_len;
+    int ret;
+
+    ret = kv_log_flush();
+    if (OPRT_OK != ret) {
+        return ret;
+    }
+
+    new_off = tal_malloc((s_kv_log.cnt + 1) * sizeof(uint32_t));
+    if (NULL == new_off) {
+        return OPRT_MALLOC_FAILED;
+    }
+    ret = lfs_file_open(s_kv_log.lfs, &tmp, KV_LOG_FILE_TMP, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC);
+    if (LFS_ERR_OK != ret) {
+        tal_free(new_off);
+        return OPRT_KVS_WR_FAIL;
+    }
+
+    ret = kv_log_write_head(&tmp);
+    for (i = 0; OPRT_OK == ret && i < s_kv_log.cnt; i++) {
+        kv_log_entry_t *entry = &s_kv_log.index[i];
+        val = tal_malloc(entry->len + 1);
+        if (NULL == val) {
+            ret = OPRT_MALLOC_FAILED;
+            break;
+        }
+        key_len = strlen(entry->key);
+        ret = kv_log_read_at(&s_kv_log.file, entry->off, val, entry->len);
+        if (OPRT_OK == ret) {
+            kv_log_rec_head(head, KV_LOG_REC_SET, entry->key, key_len, val, entry->len);
+            ret = kv_log_write_to(&tmp, head, KV_LOG_REC_LEN);
+            ret |= kv_log_write_to(&tmp, entry->key, key_len);
+            ret |= kv_log_write_to(&tmp, val, entry->len);
+        }
+        tal_free(val);
+        new_off[i] = off + KV_LOG_REC_LEN + key_len;
+        off += KV_LOG_REC_LEN + key_len + entry->len;
+    }
+    if (LFS_ERR_OK != lfs_file_close(s_kv_log.lfs, &tmp)) {
+        ret = OPRT_KVS_WR_FAIL;
+    }
+    if (OPRT_OK != ret) {
+        PR_ERR("kv log compact err %d", ret);
+        lfs_remove(s_kv_log.lfs, KV_LOG_FILE_TMP);
+        tal_free(new_off);
+        return ret;
+    }
+
+    lfs_file_close(s_kv_log.lfs, &s_kv_log.file);
+    s_kv_log.opened = FALSE;
+    ret = lfs_rename(s_kv_log.lfs, KV_LOG_FILE_TMP, KV_LOG_FILE);
+    if (LFS_ERR_OK != ret) {
+        PR_ERR("kv log rename err %d", ret);
+        tal_free(new_off);
+        return kv_log_load();
+    }
+    ret = lfs_file_open(s_kv_log.lfs, &s_kv_log.file, KV_LOG_FILE, LFS_O_RDWR | LFS_O_CREAT | LFS_O_APPEND);
+    if (LFS_ERR_OK != ret) {
+        PR_ERR("kv log open err %d", ret);
+        tal_free(new_off);
+        return ret;
+    }
+    s_kv_log.opened = TRUE;
+
+    PR_DEBUG("kv log compacted %d -> %d", s_kv_log.size, off);
+    for (i = 0; i < s_kv_log.cnt; i++) {
+        s_kv_log.index[i].off = new_off[i];
+    }
+    s_kv_log.size = off;
+    tal_free(new_off);
+
+    return OPRT_OK;
+}
+
+static void kv_log_work_cb(void *data)
+{
+    tal_mutex_lock(s_kv_log.mutex);
+    s_kv_log.work_pending = FALSE;
+    kv_log_flush();
+    if (kv_log_compact_needed()) {
+        kv_log_compact();
+    }
+    tal_mutex_unlock(s_kv_log.mutex);
+}
+
+/* flush and compact from the system workqueue, FALSE if it is not running */
+static BOOL_T kv_log_schedule(TIME_MS delay)
+{
+    if (s_kv_log.work_pending) {
+        return TRUE;
+    }
+    if (NULL == s_kv_log.work &&
+        OPRT_OK != tal_workq_init_delayed(WORKQ_SYSTEM, kv_log_work_cb, NULL, &s_kv_log.work)) {
+        s_kv_log.work = NULL;
+        return FALSE;
+    }
+    if (OPRT_OK != tal_workq_start_delayed(s_kv_log.work, delay, LOOP_ONCE)) {
+        return FALSE;
+    }
+    s_kv_log.work_pending = TRUE;
+
+    return TRUE;
+}
+
+static int kv_log_append(uint8_t type, const char *key, const uint8_t *val, uint32_t val_len, uint32_t *val_off)
+{
+    uint8_t head[KV_LOG_REC_LEN];
+    uint32_t key_len = strlen(key);
+    uint32_t rec_len = KV_LOG_REC_LEN + key_len + val_len;
+    int ret;
+
+    if (!s_kv_log.opened) {
+        return OPRT_KVS_WR_FAIL;
+    }
+    kv_log_rec_head(head, type, key, key_len, val, val_len);
+
+    if (s_kv_log.batch) {
+        // committed by kv_log_batch_end
+        head[3] = KV_LOG_REC_BATCH;
+        *val_off = s_kv_log.size + KV_LOG_REC_LEN + key_len;
+        ret = kv_log_write_to(&s_kv_log.file, head, KV_LOG_REC_LEN);
+        ret |= kv_log_write_to(&s_kv_log.file, key, key_len);
+        ret |= kv_log_write_to(&s_kv_log.file, val, val_len);
+        if (OPRT_OK != ret) {
+            return OPRT_KVS_WR_FAIL;
+        }
+        s_kv_log.size += rec_len;
+        return OPRT_OK;
+    }
+
+#if KV_LOG_WB_SIZE > 0
+    if (s_kv_log.wb_len + rec_len > KV_LOG_WB_SIZE) {
+        ret = kv_log_flush();
+        if (OPRT_OK != ret) {
+            return ret;
+        }
+    }
+    if (rec_len <= KV_LOG_WB_SIZE) {
+        *val_off = s_kv_log.size + s_kv_log.wb_len + KV_LOG_REC_LEN + key_len;
+        memcpy(s_kv_log.wb + s_kv_log.wb_len, head, KV_LOG_REC_LEN);
+        memcpy(s_kv_log.wb + s_kv_log.wb_len + KV_LOG_REC_LEN, key, key_len);
+        if (val_len) {
+            memcpy(s_kv_log.wb + s_kv_log.wb_len + KV_LOG_REC_LEN + key_len, val, val_len);
+        }
+        s_kv_log.wb_len += rec_len;
+        return kv_log_schedule(KV_LOG_FLUSH_MS) ? OPRT_OK : kv_log_flush();
+    }
+#endif
+
+    *val_off = s_kv_log.size + KV_LOG_REC_LEN + key_len;
+    ret = kv_log_write_to(&s_kv_log.file, head, KV_LOG_REC_LEN);
+    ret |= kv_log_write_to(&s_kv_log.file, key, key_len);
+    ret |= kv_log_write_to(&s_kv_log.file, val, val_len);
+    if (OPRT_OK != ret || LFS_ERR_OK != lfs_file_sync(s_kv_log.lfs, &s_kv_log.file)) {
+        PR_ERR("kv log write err, reload");
+        kv_log_load();
+        return OPRT_KVS_WR_FAIL;
+    }
+    s_kv_log.size += rec_len;
+
+    return OPRT_OK;
+}
+
+/**
+ * @brief Opens the log on the mounted littlefs and loads its index.
+ *
+ * @param lfs The littlefs of tal_kv.
+ * @param mutex The tal_kv mutex, taken by the background work.
+ *
+ * @return OPRT_OK on success, others on failure.
+ */
+int kv_log_init(lfs_t *lfs, MUTEX_HANDLE mutex)
+{
+    int ret;
+
+    s_kv_log.lfs = lfs;
+    s_kv_log.mutex = mutex;
+    // the records of a batch open before are dropped by the load
+    s_kv_log.batch = FALSE;
+
+    ret = kv_log_load();
+    if (OPRT_OK == ret && kv_log_compact_needed()) {
+        kv_log_compact();
+    }
+
+    return ret;
+}
+
+/**
+ * @brief Appends the value of key to the log.
+ *
+ * @param key The key, at most 255 bytes.
+ * @param value The encrypted value.
+ * @param length The length of value.
+ *
+ * @return OPRT_OK on success, others on failure.
+ */
+int kv_log_set(const char *key, const uint8_t *value, size_t length)
+{
+    uint32_t off = 0;
+    BOOL_T is_new = (NULL == kv_log_find(key, mm_str_hash(key)));
+    int ret;
+
+    if (strlen(key) > 255) {
+        return OPRT_INVALID_PARM;
+    }
+
+    ret = kv_log_append(KV_LOG_REC_SET, key, value, length, &off);
+    if (OPRT_OK != ret) {
+        return ret;
+    }
+    ret = kv_log_index_put(key, off, length);
+    if (OPRT_OK != ret) {
+        return ret;
+    }
+    if (s_kv_log.batch) {
+        return OPRT_OK;
+    }
+    if (is_new) {
+        // the key may still have the file written before the log was enabled
+        lfs_remove(s_kv_log.lfs, key);
+    }
+    if (kv_log_compact_needed() && !kv_log_schedule(0)) {
+        kv_log_compact();
+    }
+
+    return OPRT_OK;
+}
+
+/**
+ * @brief Reads the value of key from the log.
+ *
+ * @param key The key.
+ * @param value Receives the encrypted value, free it with tal_free.
+ * @param length Receives the length of value.
+ *
+ * @return OPRT_OK on success, OPRT_NOT_FOUND if the log has no value of key.
+ */
+int kv_log_get(const char *key, uint8_t **value, size_t *length)
+{
+    kv_log_entry_t *entry = kv_log_find(key, mm_str_hash(key));
+    uint8_t *buf = NULL;
+
+    if (NULL == entry) {
+        return OPRT_NOT_FOUND;
+    }
+
+    buf = tal_malloc(entry->len + 1);
+    if (NULL == buf) {
+        return OPRT_MALLOC_FAILED;
+    }
+#if KV_LOG_WB_SIZE > 0
+    if (entry->off >= s_kv_log.size) {
+        // still in the write back buffer
+        memcpy(buf, s_kv_log.wb + (entry->off - s_kv_log.size), entry->len);
+        *value = buf;
+        *length = entry->len;
+        return OPRT_OK;
+    }
+#endif
+    if (OPRT_OK != kv_log_read_at(&s_kv_log.file, entry->off, buf, entry->len)) {
+        tal_free(buf);
+        return OPRT_KVS_RD_FAIL;
+    }
+
+    *value = buf;
+    *length = entry->len;
+
+    return OPRT_OK;
+}
+
+/**
+ * @brief Deletes key from the log.
+ *
+ * @param key The key.
+ *
+ * @return OPRT_OK if key was deleted, OPRT_NOT_FOUND if it did not exist.
+ */
+int kv_log_del(const char *key)
+{
+    uint32_t off = 0;
+    BOOL_T found = FALSE;
+    int ret;
+
+    if (kv_log_find(key, mm_str_hash(key))) {
+        ret = kv_log_append(KV_LOG_REC_DEL, key, NULL, 0, &off);
+        if (OPRT_OK != ret) {
+            return ret;
+        }
+        found = kv_log_index_del(key);
+    }
+    if (s_kv_log.batch) {
+        return found ? OPRT_OK : OPRT_NOT_FOUND;
+    }
+    if (LFS_ERR_OK == lfs_remove(s_kv_log.lfs, key)) {
+        found = TRUE;
+    }
+    if (kv_log_compact_needed() && !kv_log_schedule(0)) {
+        kv_log_compact();
+    }
+
+    return found ? OPRT_OK : OPRT_NOT_FOUND;
+}
+
+/**
+ * @brief Starts a batch, kv_log_set and kv_log_del only take effect on flash
+ * together with kv_log_batch_end.
+ *
+ * The files of keys written before the log was enabled are left, the caller
+ * removes them after the batch is committed.
+ *
+ * @return OPRT_OK on success, others if the buffered records failed to write.
+ */
+int kv_log_batch_begin(void)
+{
+    int ret = kv_log_wb_len() ? kv_log_flush() : OPRT_OK;
+
+    if (OPRT_OK != ret) {
+        return ret;
+    }
+    s_kv_log.batch = TRUE;
+    s_kv_log.batch_start = s_kv_log.size;
+
+    return OPRT_OK;
+}
+
+/**
+ * @brief Ends a batch, commits its records or drops them.
+ *
+ * @param commit TRUE to commit the batch, FALSE to drop it.
+ *
+ * @return OPRT_OK if the batch was committed, others if it was dropped.
+ */
+int kv_log_batch_end(BOOL_T commit)
+{
+    uint8_t head[KV_LOG_REC_LEN];
+    int ret = OPRT_KVS_WR_FAIL;
+
+    s_kv_log.batch = FALSE;
+    if (commit && s_kv_log.size == s_kv_log.batch_start) {
+        return OPRT_OK;
+    }
+    if (commit) {
+        kv_log_rec_head(head, KV_LOG_REC_COMMIT, "", 0, NULL, 0);
+        head[3] = KV_LOG_REC_BATCH;
+        ret = kv_log_write_to(&s_kv_log.file, head, KV_LOG_REC_LEN);
+        if (OPRT_OK == ret && LFS_ERR_OK != lfs_file_sync(s_kv_log.lfs, &s_kv_log.file)) {
+            ret = OPRT_KVS_WR_FAIL;
+        }
+    }
+    if (OPRT_OK != ret) {
+        // records without their commit record are ignored when loaded
+        PR_ERR("kv log batch dropped");
+        lfs_file_truncate(s_kv_log.lfs, &s_kv_log.file, s_kv_log.batch_start);
+        lfs_file_sync(s_kv_log.lfs, &s_kv_log.file);
+        kv_log_load();
+        return OPRT_KVS_WR_FAIL;
+    }
+    s_kv_log.size += KV_LOG_REC_LEN;
+    if (kv_log_compact_needed() && !kv_log_schedule(0)) {
+        kv_log_compact();
+    }
+
+    return OPRT_OK;
+}
+
+/**
+ * @brief Dumps the log state.
+ */
+void kv_log_dump(void)
+{
+    uint32_t i;
+
+    PR_DEBUG("kv log: keys %d, live %d, size %d, buffered %d", s_kv_log.cnt, s_kv_log.live, s_kv_log.size,
+             kv_log_wb_len());
+    for (i = 0; i < s_kv_log.cnt; i++) {
+        PR_DEBUG_RAW("%s  ", s_kv_log.index[i].key);
+    }
+    PR_DEBUG_RAW("\r\n");
+}
+
+#endif
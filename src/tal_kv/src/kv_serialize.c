@@ -15,6 +15,15 @@
  * includes optimizations for memory usage and processing time, making it
  * suitable for resource-constrained environments.
  *
+ * With ENABLE_KV_SERIALIZE_BIN the pairs are written in a compact binary
+ * format instead, raw data is stored as is rather than base64 encoded:
+ *   head:   magic 0xB5, version, count (u16)
+ *   item:   key_len (u8), key, type (u8), len (u16), value
+ *   tail:   crc32 of head and items
+ * All numbers are little endian, strings are stored without the terminating
+ * zero and an empty string or raw value has a len of 0. kv_deserialize reads
+ * both formats.
+ *
  * @copyright Copyright (c) 2021-2024 Tuya Inc. All Rights Reserved.
  *
  */
@@ -24,10 +33,284 @@
 #include "tal_api.h"
 #include "cJSON.h"
 #include "mix_method.h"
+#include "crc32i.h"
+
+#define KV_BIN_MAGIC    0xB5
+#define KV_BIN_VERSION  1
+#define KV_BIN_HEAD_LEN 4
+#define KV_BIN_CRC_LEN  4
+
+static uint32_t __kv_bin_get_le(const uint8_t *p, uint32_t n)
+{
+    uint32_t i, v = 0;
+    for (i = 0; i < n; i++) {
+        v |= (uint32_t)p[i] << (8 * i);
+    }
+    return v;
+}
+
+#if defined(ENABLE_KV_SERIALIZE_BIN) && (ENABLE_KV_SERIALIZE_BIN == 1)
+static uint32_t __kv_bin_value_len(const kv_db_t *db)
+{
+    switch (db->tp) {
+    case KV_CHAR:
+    case KV_BYTE:
+    case KV_BOOL:
+        return 1;
+    case KV_SHORT:
+    case KV_USHORT:
+        return 2;
+    case KV_INT:
+        return 4;
+    case KV_STRING:
+        return strlen((char *)db->val);
+    default:
+        return db->len;
+    }
+}
+
+static void __kv_bin_put_le(uint8_t *p, uint32_t v, uint32_t n)
+{
+    uint32_t i;
+    for (i = 0; i < n; i++) {
+        p[i] = (v >> (8 * i)) & 0xff;
+    }
+}
+
+/* serialize the pairs in the binary format */
+static int kv_serialize_bin(const kv_db_t *db, const uint32_t dbcnt, char **out, uint32_t *out_len)
+{
+    uint32_t i, len = KV_BIN_HEAD_LEN + KV_BIN_CRC_LEN;
+
+    for (i = 0; i < dbcnt; i++) {
+        uint32_t key_len = strlen(db[i].key);
+        uint32_t val_len = __kv_bin_value_len(&db[i]);
+        if (db[i].tp > KV_RAW || key_len > 0xff || val_len > 0xffff) {
+            PR_ERR("kv %s invalid %d", db[i].key, db[i].tp);
+            return OPRT_COM_ERROR;
+        }
+        len += 1 + key_len + 3 + val_len;
+    }
+
+    uint8_t *buf = tal_malloc(len);
+    if (NULL == buf) {
+        PR_ERR("maloc fails %d", len);
+        return OPRT_MALLOC_FAILED;
+    }
+    uint8_t *p = buf;
+
+    p[0] = KV_BIN_MAGIC;
+    p[1] = KV_BIN_VERSION;
+    __kv_bin_put_le(p + 2, dbcnt, 2);
+    p += KV_BIN_HEAD_LEN;
+
+    for (i = 0; i < dbcnt; i++) {
+        uint32_t key_len = strlen(db[i].key);
+        uint32_t val_len = __kv_bin_value_len(&db[i]);
+
+        *p++ = key_len;
+        memcpy(p, db[i].key, key_len);
+        p += key_len;
+        p[0] = db[i].tp;
+        __kv_bin_put_le(p + 1, val_len, 2);
+        p += 3;
+
+        switch (db[i].tp) {
+        case KV_CHAR:
+            *p = *((char *)db[i].val);
+            break;
+        case KV_BYTE:
+            *p = *((uint8_t *)db[i].val);
+            break;
+        case KV_SHORT:
+            __kv_bin_put_le(p, *((int16_t *)db[i].val), 2);
+            break;
+        case KV_USHORT:
+            __kv_bin_put_le(p, *((uint16_t *)db[i].val), 2);
+            break;
+        case KV_INT:
+            __kv_bin_put_le(p, *((int32_t *)db[i].val), 4);
+            break;
+        case KV_BOOL:
+            *p = (FALSE == *((BOOL_T *)db[i].val)) ? 0 : 1;
+            break;
+        default:
+            memcpy(p, db[i].val, val_len);
+            break;
+        }
+        p += val_len;
+    }
+    __kv_bin_put_le(p, hash_crc32i_total(buf, p - buf), KV_BIN_CRC_LEN);
+
+    *out = (char *)buf;
+    *out_len = len;
+
+    return OPRT_OK;
+}
+#endif
+
+/* the item of key in a checked binary blob, NULL if there is none */
+static const uint8_t *__kv_bin_find(const uint8_t *in, const char *key)
+{
+    uint32_t key_len = strlen(key);
+    uint32_t cnt = __kv_bin_get_le(in + 2, 2);
+    const uint8_t *p = in + KV_BIN_HEAD_LEN;
+
+    while (cnt--) {
+        if (p[0] == key_len && 0 == memcmp(p + 1, key, key_len)) {
+            return p + 1 + p[0];
+        }
+        p += 1 + p[0];
+        p += 3 + __kv_bin_get_le(p + 1, 2);
+    }
+    return NULL;
+}
+
+/* check the length, items and crc of a binary blob */
+static int __kv_bin_check(const uint8_t *in, uint32_t in_len)
+{
+    uint32_t cnt, off = KV_BIN_HEAD_LEN;
+
+    if (in_len < KV_BIN_HEAD_LEN + KV_BIN_CRC_LEN || KV_BIN_VERSION != in[1]) {
+        return OPRT_COM_ERROR;
+    }
+    in_len -= KV_BIN_CRC_LEN;
+    if (hash_crc32i_total((uint8_t *)in, in_len) != __kv_bin_get_le(in + in_len, KV_BIN_CRC_LEN)) {
+        return OPRT_COM_ERROR;
+    }
+    for (cnt = __kv_bin_get_le(in + 2, 2); cnt; cnt--) {
+        if (off + 1 > in_len || off + 1 + in[off] + 3 > in_len) {
+            return OPRT_COM_ERROR;
+        }
+        off += 1 + in[off];
+        off += 3 + __kv_bin_get_le(in + off + 1, 2);
+        if (off > in_len) {
+            return OPRT_COM_ERROR;
+        }
+    }
+
+    return OPRT_OK;
+}
+
+/* deserialize a binary blob, same rules as the json one */
+static int kv_deserialize_bin(const uint8_t *in, uint32_t in_len, kv_db_t *db, const uint32_t dbcnt)
+{
+    int op_ret = __kv_bin_check(in, in_len);
+    uint32_t i;
+
+    if (OPRT_OK != op_ret) {
+        PR_ERR("kv bin invalid, len %d", in_len);
+        return op_ret;
+    }
+
+    for (i = 0; i < dbcnt; i++) {
+        const uint8_t *item = __kv_bin_find(in, db[i].key);
+        if (NULL == item) { // default set zero
+            memset(db[i].val, 0, db[i].len);
+            continue;
+        }
+
+        kv_tp_t tp = item[0];
+        uint32_t len = __kv_bin_get_le(item + 1, 2);
+        const uint8_t *val = item + 3;
+        int32_t num = 0;
+
+        if (db[i].tp <= KV_INT) {
+            if (tp > KV_INT || len != ((tp <= KV_BYTE) ? 1 : (tp <= KV_USHORT) ? 2 : 4)) {
+                op_ret = OPRT_CJSON_GET_ERR;
+                goto ERR_EXIT;
+            }
+            num = (KV_CHAR == tp)    ? (char)val[0]
+                  : (KV_SHORT == tp) ? (int16_t)__kv_bin_get_le(val, 2)
+                                     : (int32_t)__kv_bin_get_le(val, len);
+        } else if (db[i].tp == KV_BOOL && (tp != KV_BOOL || len != 1)) {
+            op_ret = OPRT_CJSON_GET_ERR;
+            goto ERR_EXIT;
+        } else if ((db[i].tp == KV_STRING || db[i].tp == KV_RAW) && tp != KV_STRING && tp != KV_RAW) {
+            op_ret = OPRT_CJSON_GET_ERR;
+            goto ERR_EXIT;
+        }
+
+        switch (db[i].tp) {
+        case KV_CHAR: {
+            if (num < -128 || num > 127) {
+                op_ret = OPRT_COM_ERROR;
+                goto ERR_EXIT;
+            }
+            *((char *)db[i].val) = num;
+        } break;
+
+        case KV_BYTE: {
+            if (num < 0 || num > 255) {
+                op_ret = OPRT_COM_ERROR;
+                goto ERR_EXIT;
+            }
+            *((uint8_t *)db[i].val) = num;
+        } break;
+
+        case KV_SHORT: {
+            if (num < -32768 || num > 32767) {
+                op_ret = OPRT_COM_ERROR;
+                goto ERR_EXIT;
+            }
+            *((int16_t *)db[i].val) = num;
+        } break;
+
+        case KV_USHORT: {
+            if (num < 0 || num > 65535) {
+                op_ret = OPRT_COM_ERROR;
+                goto ERR_EXIT;
+            }
+            *((uint16_t *)db[i].val) = num;
+        } break;
+
+        case KV_INT: {
+            *((int *)db[i].val) = num;
+        } break;
+
+        case KV_BOOL: {
+            *((BOOL_T *)db[i].val) = val[0] ? 1 : 0;
+        } break;
+
+        case KV_STRING: {
+            if (db[i].len < len + 1) {
+                op_ret = OPRT_COM_ERROR;
+                goto ERR_EXIT;
+            }
+            memcpy(db[i].val, val, len);
+            ((char *)db[i].val)[len] = 0;
+        } break;
+
+        case KV_RAW: {
+            if (0 == len) {
+                db[i].len = 0;
+            } else if (db[i].len < len) {
+                op_ret = OPRT_COM_ERROR;
+                goto ERR_EXIT;
+            } else {
+                memcpy(db[i].val, val, len);
+            }
+        } break;
+
+        default: {
+            PR_ERR("type invalid %d", db[i].tp);
+            op_ret = OPRT_COM_ERROR;
+            goto ERR_EXIT;
+        }
+        }
+    }
+
+    return OPRT_OK;
+
+ERR_EXIT:
+    PR_ERR("deserial fails %d", op_ret);
+
+    return op_ret;
+}
 
 /**
  * Serializes the key-value pairs in the given database into a JSON-formatted
- * string.
+ * string, or a binary blob with ENABLE_KV_SERIALIZE_BIN.
  *
  * @param db The pointer to the database containing the key-value pairs.
  * @param dbcnt The number of key-value pairs in the database.
@@ -38,6 +321,9 @@
  */
 int kv_serialize(const kv_db_t *db, const uint32_t dbcnt, char **out, uint32_t *out_len)
 {
+#if defined(ENABLE_KV_SERIALIZE_BIN) && (ENABLE_KV_SERIALIZE_BIN == 1)
+    return kv_serialize_bin(db, dbcnt, out, out_len);
+#else
     int i = 0;
     // conut need buf size
     uint32_t len = 0;
@@ -147,6 +433,7 @@ int kv_serialize(const kv_db_t *db, const uint32_t dbcnt, char **out, uint32_t *
     *out_len = offset;
 
     return OPRT_OK;
+#endif
 }
 
 /**
@@ -158,14 +445,22 @@ int kv_serialize(const kv_db_t *db, const uint32_t dbcnt, char **out, uint32_t *
  * number of elements in the `kv_db_t` array is specified by the `dbcnt`
  * parameter.
  *
- * @param[in] in The input JSON string to deserialize.
+ * A blob written in the binary format is recognized by its first byte and
+ * decoded without building a cJSON tree.
+ *
+ * @param[in] in The input JSON string or binary blob to deserialize.
+ * @param[in] in_len The length of in, a JSON string is also zero terminated.
  * @param[in,out] db The key-value database to populate.
  * @param[in] dbcnt The number of elements in the key-value database.
  * @return Returns OPRT_OK if the deserialization is successful. Otherwise, it
  * returns an error code indicating the failure reason.
  */
-int kv_deserialize(const char *in, kv_db_t *db, const uint32_t dbcnt)
+int kv_deserialize(const char *in, uint32_t in_len, kv_db_t *db, const uint32_t dbcnt)
 {
+    if (in_len > 0 && KV_BIN_MAGIC == (uint8_t)in[0]) {
+        return kv_deserialize_bin((const uint8_t *)in, in_len, db, dbcnt);
+    }
+
     cJSON *root = cJSON_Parse(in);
     if (NULL == root) {
         PR_ERR("json parse fails %s", in);
@@ -30,6 +30,26 @@
 #include "tal_api.h"
 #include "tal_security.h"
 
+#define KV_BATCH_FILE     "tal_kv.batch"
+#define KV_BATCH_FILE_TMP "tal_kv.batch.tmp"
+#define KV_BATCH_MAGIC    "TKVB"
+#define KV_BATCH_SET      1
+#define KV_BATCH_DEL      2
+#define KV_BATCH_REC_LEN  6 // type, key_len, value length
+
+typedef struct kv_batch_op {
+    struct kv_batch_op *next;
+    char *key;
+    uint8_t *value; // NULL to delete the key
+    size_t length;
+    uint8_t *ec_data;
+    uint32_t ec_len;
+} kv_batch_op_t;
+
+typedef struct {
+    kv_batch_op_t *ops;
+} kv_batch_t;
+
 // variables used by the filesystem
 static lfs_t lfs;
 static lfs_size_t lfs_flash_addr;
@@ -37,7 +57,28 @@ static tal_kv_cfg_t lfs_kv_cfg;
 static MUTEX_HANDLE lfs_mutex;
 
 extern int kv_serialize(const kv_db_t *db, const uint32_t dbcnt, char **out, uint32_t *out_len);
-extern int kv_deserialize(const char *in, kv_db_t *db, const uint32_t dbcnt);
+extern int kv_deserialize(const char *in, uint32_t in_len, kv_db_t *db, const uint32_t dbcnt);
+static void __kv_batch_replay(void);
+
+#if defined(ENABLE_KV_LOG) && (ENABLE_KV_LOG == 1)
+extern int kv_log_init(lfs_t *lfs, MUTEX_HANDLE mutex);
+extern int kv_log_set(const char *key, const uint8_t *value, size_t length);
+extern int kv_log_get(const char *key, uint8_t **value, size_t *length);
+extern int kv_log_del(const char *key);
+extern int kv_log_flush(void);
+extern int kv_log_batch_begin(void);
+extern int kv_log_batch_end(BOOL_T commit);
+extern void kv_log_dump(void);
+#endif
+
+#if defined(ENABLE_KV_CACHE) && (ENABLE_KV_CACHE == 1)
+extern int kv_cache_get(const char *key, uint8_t **value, size_t *length);
+extern void kv_cache_put(const char *key, const uint8_t *value, size_t length);
+extern void kv_cache_put_absent(const char *key);
+extern void kv_cache_del(const char *key);
+extern void kv_cache_clear(void);
+extern void kv_cache_dump(void);
+#endif
 
 /**
  * Reads data from a user-provided block device.
@@ -147,6 +188,10 @@ int tal_kv_init(tal_kv_cfg_t *kv_cfg)
     memcpy(lfs_kv_cfg.key, sha256_ret, TAL_LV_KEY_LEN);
 
     tal_mutex_create_init(&lfs_mutex);
+#if defined(ENABLE_KV_CACHE) && (ENABLE_KV_CACHE == 1)
+    // the values cached before mounting again may differ from this flash
+    kv_cache_clear();
+#endif
 
     TUYA_FLASH_BASE_INFO_T info;
     tkl_flash_get_one_type_info(TUYA_FLASH_TYPE_UF, &info);
@@ -178,9 +223,74 @@ int tal_kv_init(tal_kv_cfg_t *kv_cfg)
         err = lfs_mount(&lfs, &lfs_cfg);
     }
 
+#if defined(ENABLE_KV_LOG) && (ENABLE_KV_LOG == 1)
+    if (LFS_ERR_OK == err) {
+        tal_mutex_lock(lfs_mutex);
+        err = kv_log_init(&lfs, lfs_mutex);
+        tal_mutex_unlock(lfs_mutex);
+    }
+#endif
+    if (LFS_ERR_OK == err) {
+        tal_mutex_lock(lfs_mutex);
+        __kv_batch_replay();
+        tal_mutex_unlock(lfs_mutex);
+    }
+
     return err;
 }
 
+/* write the encrypted value of key, in the log or in its own file */
+static int __kv_write(const char *key, const uint8_t *ec_data, uint32_t ec_len)
+{
+    int result;
+
+#if defined(ENABLE_KV_LOG) && (ENABLE_KV_LOG == 1)
+    result = kv_log_set(key, ec_data, ec_len);
+    if (OPRT_OK != result) {
+        PR_ERR("kv write fail %d", result);
+        return OPRT_KVS_WR_FAIL;
+    }
+#else
+    lfs_file_t file;
+
+    result = lfs_file_open(&lfs, &file, key, LFS_O_RDWR | LFS_O_CREAT | LFS_O_TRUNC);
+    if (LFS_ERR_OK != result) {
+        PR_ERR("lfs open %s err", key);
+        return result;
+    }
+    result = lfs_file_write(&lfs, &file, ec_data, ec_len);
+    lfs_file_close(&lfs, &file);
+    if (result != ec_len) {
+        PR_ERR("kv write fail %d", result);
+        return OPRT_KVS_WR_FAIL;
+    }
+#endif
+
+    return OPRT_OK;
+}
+
+/* delete key, LFS_ERR_OK if it existed */
+static int __kv_remove(const char *key)
+{
+#if defined(ENABLE_KV_LOG) && (ENABLE_KV_LOG == 1)
+    return kv_log_del(key);
+#else
+    return lfs_remove(&lfs, key);
+#endif
+}
+
+/* keep the cache equal to flash after a write of key, the value is unknown if it failed */
+static void __kv_cache_update(const char *key, const uint8_t *value, size_t length, BOOL_T written)
+{
+#if defined(ENABLE_KV_CACHE) && (ENABLE_KV_CACHE == 1)
+    if (written) {
+        kv_cache_put(key, value, length);
+    } else {
+        kv_cache_del(key);
+    }
+#endif
+}
+
 /**
  * @brief Sets a key-value pair in the key-value store.
  *
@@ -197,7 +307,6 @@ int tal_kv_init(tal_kv_cfg_t *kv_cfg)
 int tal_kv_set(const char *key, const uint8_t *value, size_t length)
 {
     int result;
-    lfs_file_t file;
 
     PR_DEBUG("key:%s, len %d", key, length);
 
@@ -205,13 +314,6 @@ int tal_kv_set(const char *key, const uint8_t *value, size_t length)
         return OPRT_INVALID_PARM;
     }
 
-    tal_mutex_lock(lfs_mutex);
-    result = lfs_file_open(&lfs, &file, key, LFS_O_RDWR | LFS_O_CREAT | LFS_O_TRUNC);
-    if (LFS_ERR_OK != result) {
-        tal_mutex_unlock(lfs_mutex);
-        PR_ERR("lfs open %s err", key);
-        return result;
-    }
     uint8_t *ec_data = NULL;
     uint32_t ec_len = 0;
     uint8_t iv[16];
@@ -220,20 +322,48 @@ int tal_kv_set(const char *key, const uint8_t *value, size_t length)
     result =
         tal_aes128_cbc_encode((uint8_t *)value, length, (uint8_t *)lfs_kv_cfg.key, iv, &ec_data, (uint32_t *)&ec_len);
     if (OPRT_OK != result) {
-        lfs_file_close(&lfs, &file);
-        tal_mutex_unlock(lfs_mutex);
         PR_DEBUG("key %s encrypt failed", key);
         return result;
     }
-    lfs_file_rewind(&lfs, &file);
-    result = lfs_file_write(&lfs, &file, ec_data, ec_len);
-    lfs_file_close(&lfs, &file);
-    tal_aes_free_data(ec_data);
+
+    tal_mutex_lock(lfs_mutex);
+    result = __kv_write(key, ec_data, ec_len);
+    __kv_cache_update(key, value, length, OPRT_OK == result);
     tal_mutex_unlock(lfs_mutex);
-    if (result != ec_len) {
-        PR_ERR("kv write fail %d", result);
-        return OPRT_KVS_WR_FAIL;
+    tal_aes_free_data(ec_data);
+
+    return result;
+}
+
+/* read the encrypted value of key from its own file */
+static int __kv_file_read(const char *key, uint8_t **ec_data, size_t *ec_len)
+{
+    int result;
+    lfs_file_t file;
+
+    result = lfs_file_open(&lfs, &file, key, LFS_O_RDONLY);
+    if (LFS_ERR_NOENT == result) {
+        PR_DEBUG("key %s not exist", key);
+        return result;
+    } else if (LFS_ERR_OK != result) {
+        PR_ERR("lfs open %s %d err", key, result);
+        return result;
     }
+    uint32_t len = lfs_file_size(&lfs, &file);
+    uint8_t *data = tal_malloc(len + 1);
+    if (NULL == data) {
+        lfs_file_close(&lfs, &file);
+        return OPRT_MALLOC_FAILED;
+    }
+    result = lfs_file_read(&lfs, &file, data, len);
+    lfs_file_close(&lfs, &file);
+    if (result <= 0) {
+        tal_free(data);
+        PR_ERR("kv read error %d", result);
+        return OPRT_KVS_RD_FAIL;
+    }
+    *ec_data = data;
+    *ec_len = len;
 
     return OPRT_OK;
 }
@@ -257,38 +387,44 @@ int tal_kv_set(const char *key, const uint8_t *value, size_t length)
 int tal_kv_get(const char *key, uint8_t **value, size_t *length)
 {
     int result;
-    lfs_file_t file;
+    uint8_t *ec_data = NULL;
+    size_t ec_len = 0;
 
     if (NULL == key || NULL == value || NULL == length) {
         return OPRT_INVALID_PARM;
     }
 
     tal_mutex_lock(lfs_mutex);
-    result = lfs_file_open(&lfs, &file, key, LFS_O_RDONLY);
-    if (LFS_ERR_OK != result) {
-        PR_ERR("lfs open %s %d err", key, result);
+#if defined(ENABLE_KV_CACHE) && (ENABLE_KV_CACHE == 1)
+    if (OPRT_OK == kv_cache_get(key, value, length)) {
         tal_mutex_unlock(lfs_mutex);
-        return result;
+        return (NULL == *value) ? LFS_ERR_NOENT : OPRT_OK;
     }
-    uint8_t *ec_data = NULL;
-    uint32_t ec_len = lfs_file_size(&lfs, &file);
-
-    ec_data = tal_malloc(ec_len + 1);
-    if (NULL == ec_data) {
-        result = OPRT_MALLOC_FAILED;
+#endif
+#if defined(ENABLE_KV_LOG) && (ENABLE_KV_LOG == 1)
+    result = kv_log_get(key, &ec_data, &ec_len);
+    if (OPRT_NOT_FOUND == result) {
+        // written before the log was enabled, move it into the log
+        result = __kv_file_read(key, &ec_data, &ec_len);
+        if (OPRT_OK == result && OPRT_OK != kv_log_set(key, ec_data, ec_len)) {
+            PR_ERR("key %s move to log failed", key);
+        }
+    }
+#else
+    result = __kv_file_read(key, &ec_data, &ec_len);
+#endif
+    if (OPRT_OK != result) {
+#if defined(ENABLE_KV_CACHE) && (ENABLE_KV_CACHE == 1)
+        if (LFS_ERR_NOENT == result) {
+            kv_cache_put_absent(key);
+        }
+#endif
         tal_mutex_unlock(lfs_mutex);
+        *length = 0;
         return result;
     }
     PR_DEBUG("key:%s, len:%d", key, ec_len);
-    result = lfs_file_read(&lfs, &file, ec_data, ec_len);
-    lfs_file_close(&lfs, &file);
-    tal_mutex_unlock(lfs_mutex);
-    if (result <= 0) {
-        *length = 0;
-        tal_free(ec_data);
-        PR_ERR("kv read error %d", result);
-        return OPRT_KVS_RD_FAIL;
-    }
+
     uint8_t *dec_data = NULL;
     uint32_t dec_len = 0;
     uint8_t iv[16];
@@ -298,12 +434,18 @@ int tal_kv_get(const char *key, uint8_t **value, size_t *length)
     dec_len = tal_aes_get_actual_length(dec_data, dec_len);
     tal_free(ec_data);
     if (OPRT_OK != result || dec_len > ec_len) {
+        tal_mutex_unlock(lfs_mutex);
         PR_ERR("key %s decrypt failed %d, %d-%d", key, result, dec_len, ec_len);
         return OPRT_BUFFER_NOT_ENOUGH;
     }
+    dec_data[dec_len] = 0;
+#if defined(ENABLE_KV_CACHE) && (ENABLE_KV_CACHE == 1)
+    kv_cache_put(key, dec_data, dec_len);
+#endif
+    // decrypted in the lock, a set in between can not leave a stale value cached
+    tal_mutex_unlock(lfs_mutex);
     *value = dec_data;
     *length = (size_t)dec_len;
-    dec_data[dec_len] = 0;
 
     return OPRT_OK;
 }
@@ -322,7 +464,14 @@ int tal_kv_del(const char *key)
     PR_DEBUG("key:%s", key);
 
     tal_mutex_lock(lfs_mutex);
-    int result = lfs_remove(&lfs, key);
+    int result = __kv_remove(key);
+#if defined(ENABLE_KV_CACHE) && (ENABLE_KV_CACHE == 1)
+    if (LFS_ERR_OK == result || LFS_ERR_NOENT == result || OPRT_NOT_FOUND == result) {
+        kv_cache_put_absent(key);
+    } else {
+        kv_cache_del(key);
+    }
+#endif
     tal_mutex_unlock(lfs_mutex);
     if (LFS_ERR_OK == result) {
         PR_DEBUG("Deleted successfully");
@@ -334,6 +483,406 @@ int tal_kv_del(const char *key)
     return OPRT_COM_ERROR;
 }
 
+/**
+ * @brief Writes the key-value records buffered in RAM to flash.
+ *
+ * Only does something with ENABLE_KV_LOG and a KV_LOG_WB_SIZE buffer, call it
+ * before a planned reset or power off.
+ *
+ * @return OPRT_OK on success, or an error code if the write failed.
+ */
+int tal_kv_flush(void)
+{
+#if defined(ENABLE_KV_LOG) && (ENABLE_KV_LOG == 1)
+    tal_mutex_lock(lfs_mutex);
+    int result = kv_log_flush();
+    tal_mutex_unlock(lfs_mutex);
+
+    return result;
+#else
+    return OPRT_OK;
+#endif
+}
+
+/* encrypt the values of the batch and pack all its changes in one buffer */
+static int __kv_batch_pack(kv_batch_t *batch, uint8_t **buf, uint32_t *len)
+{
+    kv_batch_op_t *op;
+    uint32_t total = sizeof(KV_BATCH_MAGIC) - 1;
+    uint8_t iv[16];
+    uint8_t *p;
+    int result;
+
+    for (op = batch->ops; op; op = op->next) {
+        if (op->value) {
+            memcpy(iv, lfs_kv_cfg.seed, 16);
+            result = tal_aes128_cbc_encode(op->value, op->length, (uint8_t *)lfs_kv_cfg.key, iv, &op->ec_data,
+                                           &op->ec_len);
+            if (OPRT_OK != result) {
+                PR_ERR("key %s encrypt failed", op->key);
+                return result;
+            }
+        }
+        total += KV_BATCH_REC_LEN + strlen(op->key) + op->ec_len;
+    }
+
+    p = tal_malloc(total);
+    if (NULL == p) {
+        return OPRT_MALLOC_FAILED;
+    }
+    *buf = p;
+    *len = total;
+
+    memcpy(p, KV_BATCH_MAGIC, sizeof(KV_BATCH_MAGIC) - 1);
+    p += sizeof(KV_BATCH_MAGIC) - 1;
+    for (op = batch->ops; op; op = op->next) {
+        uint32_t key_len = strlen(op->key);
+        p[0] = op->value ? KV_BATCH_SET : KV_BATCH_DEL;
+        p[1] = (uint8_t)key_len;
+        p[2] = op->ec_len & 0xff;
+        p[3] = (op->ec_len >> 8) & 0xff;
+        p[4] = (op->ec_len >> 16) & 0xff;
+        p[5] = (op->ec_len >> 24) & 0xff;
+        memcpy(p + KV_BATCH_REC_LEN, op->key, key_len);
+        if (op->ec_len) {
+            memcpy(p + KV_BATCH_REC_LEN + key_len, op->ec_data, op->ec_len);
+        }
+        p += KV_BATCH_REC_LEN + key_len + op->ec_len;
+    }
+
+    return OPRT_OK;
+}
+
+/* apply the changes packed by __kv_batch_pack */
+static int __kv_batch_apply(const uint8_t *buf, uint32_t len)
+{
+    uint32_t off = sizeof(KV_BATCH_MAGIC) - 1;
+    char key[256];
+    int result;
+
+    if (len < off || memcmp(buf, KV_BATCH_MAGIC, off)) {
+        return OPRT_KVS_RD_FAIL;
+    }
+    while (off + KV_BATCH_REC_LEN <= len) {
+        const uint8_t *p = buf + off;
+        uint32_t key_len = p[1];
+        uint32_t val_len = p[2] | (p[3] << 8) | (p[4] << 16) | ((uint32_t)p[5] << 24);
+
+        if (val_len > len || off + KV_BATCH_REC_LEN + key_len + val_len > len) {
+            return OPRT_KVS_RD_FAIL;
+        }
+        memcpy(key, p + KV_BATCH_REC_LEN, key_len);
+        key[key_len] = 0;
+        if (KV_BATCH_SET == p[0]) {
+            result = __kv_write(key, p + KV_BATCH_REC_LEN + key_len, val_len);
+            if (OPRT_OK != result) {
+                return result;
+            }
+        } else {
+            __kv_remove(key);
+        }
+        off += KV_BATCH_REC_LEN + key_len + val_len;
+    }
+
+    return OPRT_OK;
+}
+
+/* write the packed changes at once, the log commits them with a single sync */
+static int __kv_batch_write(const uint8_t *buf, uint32_t len)
+{
+#if defined(ENABLE_KV_LOG) && (ENABLE_KV_LOG == 1)
+    int result = kv_log_batch_begin();
+    if (OPRT_OK != result) {
+        return result;
+    }
+    result = __kv_batch_apply(buf, len);
+    if (OPRT_OK != result) {
+        kv_log_batch_end(FALSE);
+        return result;
+    }
+    return kv_log_batch_end(TRUE);
+#else
+    return __kv_batch_apply(buf, len);
+#endif
+}
+
+/* finish the batch interrupted by a power loss, it is in the journal */
+static void __kv_batch_replay(void)
+{
+    lfs_file_t file;
+    uint8_t *buf = NULL;
+    uint32_t len;
+
+    lfs_remove(&lfs, KV_BATCH_FILE_TMP);
+    if (LFS_ERR_OK != lfs_file_open(&lfs, &file, KV_BATCH_FILE, LFS_O_RDONLY)) {
+        return;
+    }
+    len = lfs_file_size(&lfs, &file);
+    buf = tal_malloc(len + 1);
+    if (NULL == buf) {
+        lfs_file_close(&lfs, &file);
+        return;
+    }
+    if (lfs_file_read(&lfs, &file, buf, len) != (lfs_ssize_t)len) {
+        len = 0;
+    }
+    lfs_file_close(&lfs, &file);
+
+    PR_DEBUG("kv batch replay %d", len);
+    if (OPRT_OK == __kv_batch_write(buf, len) || 0 == len) {
+        lfs_remove(&lfs, KV_BATCH_FILE);
+    }
+    tal_free(buf);
+}
+
+#if !defined(ENABLE_KV_LOG) || (ENABLE_KV_LOG == 0)
+/* save the packed changes before touching any key, replayed at init if the batch is cut */
+static int __kv_batch_journal(const uint8_t *buf, uint32_t len)
+{
+    lfs_file_t file;
+    int result;
+
+    result = lfs_file_open(&lfs, &file, KV_BATCH_FILE_TMP, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC);
+    if (LFS_ERR_OK != result) {
+        PR_ERR("lfs open %s err %d", KV_BATCH_FILE_TMP, result);
+        return OPRT_KVS_WR_FAIL;
+    }
+    result = lfs_file_write(&lfs, &file, buf, len);
+    if (LFS_ERR_OK != lfs_file_close(&lfs, &file) || result != (lfs_ssize_t)len ||
+        LFS_ERR_OK != lfs_rename(&lfs, KV_BATCH_FILE_TMP, KV_BATCH_FILE)) {
+        PR_ERR("kv batch journal write fail %d", result);
+        lfs_remove(&lfs, KV_BATCH_FILE_TMP);
+        return OPRT_KVS_WR_FAIL;
+    }
+
+    return OPRT_OK;
+}
+#endif
+
+static void __kv_batch_free(kv_batch_t *batch)
+{
+    kv_batch_op_t *op;
+
+    while ((op = batch->ops) != NULL) {
+        batch->ops = op->next;
+        if (op->value) {
+            tal_free(op->value);
+        }
+        if (op->ec_data) {
+            tal_aes_free_data(op->ec_data);
+        }
+        tal_free(op->key);
+        tal_free(op);
+    }
+    tal_free(batch);
+}
+
+/* the change of key in the batch, a new one if it has none yet */
+static kv_batch_op_t *__kv_batch_op(kv_batch_t *batch, const char *key)
+{
+    kv_batch_op_t *op;
+
+    for (op = batch->ops; op; op = op->next) {
+        if (0 == strcmp(op->key, key)) {
+            return op;
+        }
+    }
+
+    op = tal_malloc(sizeof(kv_batch_op_t));
+    if (NULL == op) {
+        return NULL;
+    }
+    memset(op, 0, sizeof(kv_batch_op_t));
+    op->key = tal_malloc(strlen(key) + 1);
+    if (NULL == op->key) {
+        tal_free(op);
+        return NULL;
+    }
+    strcpy(op->key, key);
+    op->next = batch->ops;
+    batch->ops = op;
+
+    return op;
+}
+
+/**
+ * @brief Starts a batch of key-value changes applied all or nothing.
+ *
+ * The kv lock is held until tal_kv_batch_commit or tal_kv_batch_abort, other
+ * threads calling tal_kv wait for it, keep the batch short. tal_kv_get from
+ * the thread of the batch returns the values before the batch, several gets
+ * between begin and abort read a consistent snapshot.
+ *
+ * @param batch Receives the batch handle.
+ * @return OPRT_OK on success, or an error code on failure.
+ */
+int tal_kv_batch_begin(KV_BATCH_HANDLE *batch)
+{
+    kv_batch_t *b;
+
+    if (NULL == batch) {
+        return OPRT_INVALID_PARM;
+    }
+
+    b = tal_malloc(sizeof(kv_batch_t));
+    if (NULL == b) {
+        return OPRT_MALLOC_FAILED;
+    }
+    memset(b, 0, sizeof(kv_batch_t));
+    tal_mutex_lock(lfs_mutex);
+    *batch = b;
+
+    return OPRT_OK;
+}
+
+/**
+ * @brief Sets a key in the batch, the later change of the same key wins.
+ *
+ * @param batch The batch handle.
+ * @param key The key, at most 255 bytes.
+ * @param value The value, copied.
+ * @param length The length of the value in bytes.
+ * @return OPRT_OK on success, or an error code on failure.
+ */
+int tal_kv_batch_put(KV_BATCH_HANDLE batch, const char *key, const uint8_t *value, size_t length)
+{
+    kv_batch_op_t *op;
+    uint8_t *copy;
+
+    if (NULL == batch || NULL == key || strlen(key) > 255 || NULL == value || 0 == length) {
+        return OPRT_INVALID_PARM;
+    }
+
+    // copy first, a failed put leaves the earlier change of key as it was
+    copy = tal_malloc(length + 1);
+    if (NULL == copy) {
+        return OPRT_MALLOC_FAILED;
+    }
+    memcpy(copy, value, length);
+    op = __kv_batch_op((kv_batch_t *)batch, key);
+    if (NULL == op) {
+        tal_free(copy);
+        return OPRT_MALLOC_FAILED;
+    }
+    if (op->value) {
+        tal_free(op->value);
+    }
+    op->value = copy;
+    op->length = length;
+
+    return OPRT_OK;
+}
+
+/**
+ * @brief Deletes a key in the batch, the later change of the same key wins.
+ *
+ * @param batch The batch handle.
+ * @param key The key, at most 255 bytes.
+ * @return OPRT_OK on success, or an error code on failure.
+ */
+int tal_kv_batch_del(KV_BATCH_HANDLE batch, const char *key)
+{
+    kv_batch_op_t *op;
+
+    if (NULL == batch || NULL == key || strlen(key) > 255) {
+        return OPRT_INVALID_PARM;
+    }
+
+    op = __kv_batch_op((kv_batch_t *)batch, key);
+    if (NULL == op) {
+        return OPRT_MALLOC_FAILED;
+    }
+    if (op->value) {
+        tal_free(op->value);
+        op->value = NULL;
+    }
+    op->length = 0;
+
+    return OPRT_OK;
+}
+
+/**
+ * @brief Writes all changes of the batch and releases it.
+ *
+ * With ENABLE_KV_LOG the batch is a single commit to flash. Otherwise it is
+ * first saved in a journal, a batch cut by a power loss is finished by the
+ * next tal_kv_init.
+ *
+ * @param batch The batch handle, invalid after the call.
+ * @return OPRT_OK if every change was written, or an error code on failure.
+ */
+int tal_kv_batch_commit(KV_BATCH_HANDLE batch)
+{
+    kv_batch_t *b = (kv_batch_t *)batch;
+    kv_batch_op_t *op;
+    uint8_t *buf = NULL;
+    uint32_t len = 0;
+    int result;
+
+    if (NULL == b) {
+        return OPRT_INVALID_PARM;
+    }
+    if (NULL == b->ops) {
+        tal_kv_batch_abort(batch);
+        return OPRT_OK;
+    }
+
+    result = __kv_batch_pack(b, &buf, &len);
+    if (OPRT_OK == result) {
+#if defined(ENABLE_KV_LOG) && (ENABLE_KV_LOG == 1)
+        result = __kv_batch_write(buf, len);
+#else
+        result = __kv_batch_journal(buf, len);
+        if (OPRT_OK == result) {
+            result = __kv_batch_write(buf, len);
+            if (OPRT_OK == result) {
+                lfs_remove(&lfs, KV_BATCH_FILE);
+            } else {
+                PR_ERR("kv batch write fail %d, finished at next init", result);
+            }
+        }
+#endif
+    }
+
+    for (op = b->ops; op; op = op->next) {
+#if defined(ENABLE_KV_LOG) && (ENABLE_KV_LOG == 1)
+        if (OPRT_OK == result) {
+            // the key may still have the file written before the log was enabled
+            lfs_remove(&lfs, op->key);
+        }
+#endif
+#if defined(ENABLE_KV_CACHE) && (ENABLE_KV_CACHE == 1)
+        if (OPRT_OK != result) {
+            kv_cache_del(op->key);
+        } else if (op->value) {
+            kv_cache_put(op->key, op->value, op->length);
+        } else {
+            kv_cache_put_absent(op->key);
+        }
+#endif
+    }
+    if (buf) {
+        tal_free(buf);
+    }
+    tal_kv_batch_abort(batch);
+
+    return result;
+}
+
+/**
+ * @brief Drops all changes of the batch and releases it.
+ *
+ * @param batch The batch handle, invalid after the call.
+ */
+void tal_kv_batch_abort(KV_BATCH_HANDLE batch)
+{
+    if (NULL == batch) {
+        return;
+    }
+    __kv_batch_free((kv_batch_t *)batch);
+    tal_mutex_unlock(lfs_mutex);
+}
+
 /**
  * @brief Frees the memory allocated for a value in the TAL Key-Value store.
  *
@@ -365,6 +914,22 @@ int tal_kv_free(uint8_t *value)
  */
 void tal_kv_cmd(int argc, char *argv[])
 {
+#if defined(ENABLE_KV_LOG) && (ENABLE_KV_LOG == 1)
+    if (argc >= 2 && 0 == strcmp("log", argv[1])) {
+        tal_mutex_lock(lfs_mutex);
+        kv_log_dump();
+        tal_mutex_unlock(lfs_mutex);
+        return;
+    }
+#endif
+#if defined(ENABLE_KV_CACHE) && (ENABLE_KV_CACHE == 1)
+    if (argc >= 2 && 0 == strcmp("cache", argv[1])) {
+        tal_mutex_lock(lfs_mutex);
+        kv_cache_dump();
+        tal_mutex_unlock(lfs_mutex);
+        return;
+    }
+#endif
     if (argc < 3) {
         return;
     }
@@ -419,7 +984,7 @@ int tal_kv_serialize_set(const char *key, kv_db_t *db, size_t dbcnt)
         PR_ERR("kv_serialize  fail. %d", ret);
         return ret;
     }
-    PR_TRACE("write buf:%s", buf);
+    PR_TRACE("write buf len:%d", len);
     ret = tal_kv_set(key, (const uint8_t *)buf, len);
     tal_free(buf);
     if (OPRT_OK != ret) {
@@ -458,7 +1023,7 @@ int tal_kv_serialize_get(const char *key, kv_db_t *db, size_t dbcnt)
         PR_ERR("kv_get fails %s %d", key, ret);
         return ret;
     }
-    ret = kv_deserialize((char *)buf, db, dbcnt);
+    ret = kv_deserialize((char *)buf, len, db, dbcnt);
     tal_free(buf);
     if (OPRT_OK != ret) {
         PR_ERR("kv_deserialize fail. %d", ret);
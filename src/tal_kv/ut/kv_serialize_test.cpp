@@ -0,0 +1,204 @@
+/**
+ * @file kv_serialize_test.cpp
+ * @brief UT of kv_serialize: values read back from the format written, json
+ * of older firmware still read, and the size and speed of the format
+ * written against json.
+ *
+ * @copyright Copyright (c) 2021-2024 Tuya Inc. All Rights Reserved.
+ *
+ */
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <string>
+
+#include "tal_kv.h"
+
+extern "C" {
+#include "tal_api.h"
+#include "mix_method.h"
+
+int kv_serialize(const kv_db_t *db, const uint32_t dbcnt, char **out, uint32_t *out_len);
+int kv_deserialize(const char *in, uint32_t in_len, kv_db_t *db, const uint32_t dbcnt);
+}
+
+#define UT_BENCH_ROUNDS 10000
+
+#if defined(ENABLE_KV_SERIALIZE_BIN) && (ENABLE_KV_SERIALIZE_BIN == 1)
+#define UT_KV_FORMAT "bin "
+#else
+#define UT_KV_FORMAT "json"
+#endif
+
+// a device config as products save it with tal_kv_serialize_set
+struct UtConfig {
+    char ch;
+    uint8_t bright;
+    int16_t temp;
+    uint16_t count;
+    int32_t seq;
+    BOOL_T on;
+    char name[32];
+    uint8_t mac[48];
+};
+
+#define UT_DB_CNT 8
+
+static void ut_db(UtConfig *cfg, kv_db_t db[UT_DB_CNT])
+{
+    db[0] = {(char *)"ch", KV_CHAR, &cfg->ch, sizeof(cfg->ch)};
+    db[1] = {(char *)"bright", KV_BYTE, &cfg->bright, sizeof(cfg->bright)};
+    db[2] = {(char *)"temp", KV_SHORT, &cfg->temp, sizeof(cfg->temp)};
+    db[3] = {(char *)"count", KV_USHORT, &cfg->count, sizeof(cfg->count)};
+    db[4] = {(char *)"seq", KV_INT, &cfg->seq, sizeof(cfg->seq)};
+    db[5] = {(char *)"switch", KV_BOOL, &cfg->on, sizeof(cfg->on)};
+    db[6] = {(char *)"name", KV_STRING, cfg->name, sizeof(cfg->name)};
+    db[7] = {(char *)"mac", KV_RAW, cfg->mac, sizeof(cfg->mac)};
+}
+
+static void ut_config(UtConfig *cfg)
+{
+    memset(cfg, 0, sizeof(UtConfig));
+    cfg->ch = -5;
+    cfg->bright = 200;
+    cfg->temp = -1234;
+    cfg->count = 60000;
+    cfg->seq = -123456789;
+    cfg->on = TRUE;
+    strcpy(cfg->name, "ut_device");
+    for (size_t i = 0; i < sizeof(cfg->mac); i++) {
+        cfg->mac[i] = (uint8_t)(i * 7);
+    }
+}
+
+static void ut_expect_config(const UtConfig &expect, const UtConfig &cfg)
+{
+    EXPECT_EQ(expect.ch, cfg.ch);
+    EXPECT_EQ(expect.bright, cfg.bright);
+    EXPECT_EQ(expect.temp, cfg.temp);
+    EXPECT_EQ(expect.count, cfg.count);
+    EXPECT_EQ(expect.seq, cfg.seq);
+    EXPECT_EQ(expect.on, cfg.on);
+    EXPECT_STREQ(expect.name, cfg.name);
+    EXPECT_EQ(0, memcmp(expect.mac, cfg.mac, sizeof(cfg.mac)));
+}
+
+// the json kv_serialize writes without ENABLE_KV_SERIALIZE_BIN
+static std::string ut_json(UtConfig *cfg)
+{
+    char base64[sizeof(cfg->mac) / 3 * 4 + 5] = {0};
+
+    tuya_base64_encode(cfg->mac, base64, sizeof(cfg->mac));
+    return "{\"ch\":" + std::to_string(cfg->ch) + ",\"bright\":" + std::to_string(cfg->bright) +
+           ",\"temp\":" + std::to_string(cfg->temp) + ",\"count\":" + std::to_string(cfg->count) +
+           ",\"seq\":" + std::to_string(cfg->seq) + ",\"switch\":" + (cfg->on ? "true" : "false") + ",\"name\":\"" +
+           cfg->name + "\",\"mac\":\"" + base64 + "\" }";
+}
+
+static std::string ut_serialize(UtConfig *cfg)
+{
+    kv_db_t db[UT_DB_CNT];
+    char *out = NULL;
+    uint32_t len = 0;
+
+    ut_db(cfg, db);
+    if (OPRT_OK != kv_serialize(db, UT_DB_CNT, &out, &len)) {
+        return "";
+    }
+    std::string blob(out, len);
+    tal_free(out);
+    return blob;
+}
+
+static int ut_deserialize(const std::string &blob, UtConfig *cfg)
+{
+    kv_db_t db[UT_DB_CNT];
+
+    memset(cfg, 0, sizeof(UtConfig));
+    ut_db(cfg, db);
+    return kv_deserialize(blob.c_str(), blob.size(), db, UT_DB_CNT);
+}
+
+TEST(KvSerializeTest, round_trip)
+{
+    UtConfig cfg, out;
+
+    ut_config(&cfg);
+    std::string blob = ut_serialize(&cfg);
+#if defined(ENABLE_KV_SERIALIZE_BIN) && (ENABLE_KV_SERIALIZE_BIN == 1)
+    EXPECT_EQ(0xB5, (uint8_t)blob[0]);
+#else
+    EXPECT_EQ(ut_json(&cfg), blob);
+#endif
+    EXPECT_EQ(OPRT_OK, ut_deserialize(blob, &out));
+    ut_expect_config(cfg, out);
+}
+
+// values written by firmware that only has json
+TEST(KvSerializeTest, read_json)
+{
+    UtConfig cfg, out;
+
+    ut_config(&cfg);
+    EXPECT_EQ(OPRT_OK, ut_deserialize(ut_json(&cfg), &out));
+    ut_expect_config(cfg, out);
+}
+
+#if defined(ENABLE_KV_SERIALIZE_BIN) && (ENABLE_KV_SERIALIZE_BIN == 1)
+// every corrupted byte and every truncation is caught by the crc or the length checks
+TEST(KvSerializeTest, corrupt)
+{
+    UtConfig cfg, out;
+
+    ut_config(&cfg);
+    std::string blob = ut_serialize(&cfg);
+    for (size_t i = 1; i < blob.size(); i++) {
+        std::string bad = blob;
+        bad[i] ^= 0x10;
+        EXPECT_NE(OPRT_OK, ut_deserialize(bad, &out)) << i;
+        EXPECT_NE(OPRT_OK, ut_deserialize(blob.substr(0, i), &out)) << i;
+    }
+}
+#endif
+
+/**
+ * size of the config in the format kv_serialize writes and in json, and the
+ * time to write it and to read both back
+ */
+TEST(KvSerializeTest, bench)
+{
+    UtConfig cfg, out;
+    std::string blob, json;
+
+    ut_config(&cfg);
+    json = ut_json(&cfg);
+
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < UT_BENCH_ROUNDS; i++) {
+        blob = ut_serialize(&cfg);
+    }
+    double ser_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+
+    t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < UT_BENCH_ROUNDS; i++) {
+        ut_deserialize(blob, &out);
+    }
+    double de_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+    ut_expect_config(cfg, out);
+
+    t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < UT_BENCH_ROUNDS; i++) {
+        ut_deserialize(json, &out);
+    }
+    double json_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+    ut_expect_config(cfg, out);
+
+    printf("[ BENCH    ] kv_serialize %s: %3zu bytes, serialize %5.2f us, deserialize %5.2f us; json %3zu bytes, "
+           "deserialize %5.2f us\n",
+           UT_KV_FORMAT, blob.size(), ser_us / UT_BENCH_ROUNDS, de_us / UT_BENCH_ROUNDS, json.size(),
+           json_us / UT_BENCH_ROUNDS);
+#if defined(ENABLE_KV_SERIALIZE_BIN) && (ENABLE_KV_SERIALIZE_BIN == 1)
+    EXPECT_LT(blob.size(), json.size());
+#endif
+}
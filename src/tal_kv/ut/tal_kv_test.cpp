@@ -0,0 +1,519 @@
+/**
+ * @file tal_kv_test.cpp
+ * @brief UT of tal_kv on littlefs over a RAM flash: values read back after
+ * set, del, a batch and a remount, batches cut by a power loss, the write
+ * back buffer of the kv log, the values of the RAM cache, and the erases and
+ * latency of repeated sets.
+ *
+ * @copyright Copyright (c) 2021-2024 Tuya Inc. All Rights Reserved.
+ *
+ */
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <string>
+
+#include "tal_kv.h"
+#include "ut_flash_sim.h"
+#include "ut_workq_fake.h"
+
+// tal_workq_service.h carries no extern "C"
+extern "C" {
+#include "tal_api.h"
+
+#if defined(ENABLE_KV_LOG) && (ENABLE_KV_LOG == 1)
+int kv_log_get(const char *key, uint8_t **value, size_t *length);
+int kv_log_set(const char *key, const uint8_t *value, size_t length);
+int kv_log_flush(void);
+int kv_log_batch_begin(void);
+#endif
+#if defined(ENABLE_KV_CACHE) && (ENABLE_KV_CACHE == 1)
+int kv_cache_get(const char *key, uint8_t **value, size_t *length);
+#endif
+}
+
+#define UT_FLASH_SIZE  (64 * UT_FLASH_BLOCK)
+#define UT_BENCH_KEYS  16
+#define UT_BENCH_SETS  2000
+#define UT_BENCH_VALUE 32
+
+#if defined(KV_LOG_WB_SIZE) && (KV_LOG_WB_SIZE > 0)
+#define UT_KV_ENGINE "kv log wb   "
+#elif defined(ENABLE_KV_LOG) && (ENABLE_KV_LOG == 1)
+#define UT_KV_ENGINE "kv log      "
+#elif defined(ENABLE_KV_CACHE) && (ENABLE_KV_CACHE == 1)
+#define UT_KV_ENGINE "kv cache    "
+#else
+#define UT_KV_ENGINE "file per key"
+#endif
+
+static std::string ut_value(int key, int round, size_t len)
+{
+    std::string value(len, 0);
+
+    for (size_t i = 0; i < len; i++) {
+        value[i] = (char)(key * 131 + round * 17 + i);
+    }
+    return value;
+}
+
+static int ut_kv_init(void)
+{
+    tal_kv_cfg_t cfg;
+
+    memset(&cfg, 0, sizeof(cfg));
+    strcpy(cfg.seed, "vmlkasdh93dlvlcy");
+    strcpy(cfg.key, "dflfuap134ddlduq");
+    return tal_kv_init(&cfg);
+}
+
+class TalKvTest : public ::testing::Test {
+protected:
+    void SetUp() override
+    {
+        ut_flash_format(UT_FLASH_SIZE);
+        ASSERT_EQ(OPRT_OK, ut_kv_init());
+    }
+
+    void set(const std::string &key, const std::string &value)
+    {
+        EXPECT_EQ(OPRT_OK, tal_kv_set(key.c_str(), (const uint8_t *)value.data(), value.size())) << key;
+    }
+
+    // the value of key, "<none>" if it can not be read
+    std::string get(const std::string &key)
+    {
+        uint8_t *value = NULL;
+        size_t len = 0;
+
+        if (OPRT_OK != tal_kv_get(key.c_str(), &value, &len)) {
+            return "<none>";
+        }
+        std::string out((const char *)value, len);
+        tal_kv_free(value);
+        return out;
+    }
+};
+
+TEST_F(TalKvTest, set_get)
+{
+    for (size_t len : {1, 15, 16, 17, 100, 1000, 3000}) {
+        std::string value = ut_value(1, (int)len, len);
+        set("ut_key", value);
+        EXPECT_TRUE(value == get("ut_key")) << len;
+    }
+    EXPECT_EQ("<none>", get("ut_missing"));
+    EXPECT_EQ(0u, ut_flash_overwrites());
+}
+
+TEST_F(TalKvTest, del)
+{
+    set("ut_a", "a");
+    set("ut_b", "b");
+    EXPECT_EQ(OPRT_OK, tal_kv_del("ut_a"));
+    EXPECT_EQ("<none>", get("ut_a"));
+    EXPECT_EQ("b", get("ut_b"));
+    EXPECT_NE(OPRT_OK, tal_kv_del("ut_a"));
+}
+
+// the values written before a reboot are read after mounting again
+TEST_F(TalKvTest, remount)
+{
+    for (int round = 0; round < 5; round++) {
+        for (int key = 0; key < 40; key++) {
+            set("ut_" + std::to_string(key), ut_value(key, round, 10 + key * 7));
+        }
+    }
+    for (int key = 0; key < 40; key += 3) {
+        EXPECT_EQ(OPRT_OK, tal_kv_del(("ut_" + std::to_string(key)).c_str()));
+    }
+    EXPECT_EQ(OPRT_OK, tal_kv_flush());
+
+    ASSERT_EQ(OPRT_OK, ut_kv_init());
+    for (int key = 0; key < 40; key++) {
+        std::string expect = key % 3 ? ut_value(key, 4, 10 + key * 7) : "<none>";
+        EXPECT_TRUE(expect == get("ut_" + std::to_string(key))) << key;
+    }
+    EXPECT_EQ(0u, ut_flash_overwrites());
+}
+
+// a batch is seen by nobody until committed, and not at all if aborted
+TEST_F(TalKvTest, batch)
+{
+    KV_BATCH_HANDLE batch;
+
+    set("ut_a", "a");
+    set("ut_b", "b");
+
+    ASSERT_EQ(OPRT_OK, tal_kv_batch_begin(&batch));
+    EXPECT_EQ(OPRT_OK, tal_kv_batch_put(batch, "ut_a", (const uint8_t *)"x", 1));
+    EXPECT_EQ(OPRT_OK, tal_kv_batch_del(batch, "ut_b"));
+    EXPECT_EQ(OPRT_OK, tal_kv_batch_put(batch, "ut_c", (const uint8_t *)"x", 1));
+    EXPECT_EQ("a", get("ut_a"));
+    EXPECT_EQ("b", get("ut_b"));
+    EXPECT_EQ("<none>", get("ut_c"));
+    tal_kv_batch_abort(batch);
+    EXPECT_EQ("a", get("ut_a"));
+    EXPECT_EQ("b", get("ut_b"));
+    EXPECT_EQ("<none>", get("ut_c"));
+
+    // the later change of a key wins
+    ASSERT_EQ(OPRT_OK, tal_kv_batch_begin(&batch));
+    EXPECT_EQ(OPRT_OK, tal_kv_batch_put(batch, "ut_a", (const uint8_t *)"x", 1));
+    EXPECT_EQ(OPRT_OK, tal_kv_batch_put(batch, "ut_a", (const uint8_t *)"a2", 2));
+    EXPECT_EQ(OPRT_OK, tal_kv_batch_put(batch, "ut_b", (const uint8_t *)"x", 1));
+    EXPECT_EQ(OPRT_OK, tal_kv_batch_del(batch, "ut_b"));
+    EXPECT_EQ(OPRT_OK, tal_kv_batch_del(batch, "ut_c"));
+    EXPECT_EQ(OPRT_OK, tal_kv_batch_put(batch, "ut_c", (const uint8_t *)"c2", 2));
+    EXPECT_EQ("a", get("ut_a"));
+    EXPECT_EQ(OPRT_OK, tal_kv_batch_commit(batch));
+    EXPECT_EQ("a2", get("ut_a"));
+    EXPECT_EQ("<none>", get("ut_b"));
+    EXPECT_EQ("c2", get("ut_c"));
+
+    ASSERT_EQ(OPRT_OK, ut_kv_init());
+    EXPECT_EQ("a2", get("ut_a"));
+    EXPECT_EQ("<none>", get("ut_b"));
+    EXPECT_EQ("c2", get("ut_c"));
+}
+
+/**
+ * the power is cut after every amount of bytes the commit writes, the flash
+ * kept as it is mounted again. The batch is then all there or not at all,
+ * without the kv log the journal finishes the batch cut after it was saved
+ */
+TEST_F(TalKvTest, batch_power_cut)
+{
+    int replayed = 0;
+    int result = OPRT_COM_ERROR;
+
+    for (uint32_t cut = 0; OPRT_OK != result; cut += 256) {
+        KV_BATCH_HANDLE batch;
+
+        ASSERT_LT(cut, (uint32_t)UT_FLASH_SIZE) << "the commit never ends";
+        ut_flash_format(UT_FLASH_SIZE);
+        ASSERT_EQ(OPRT_OK, ut_kv_init());
+        set("ut_a", "a");
+        set("ut_b", "b");
+
+        ut_flash_power_cut(cut);
+        ASSERT_EQ(OPRT_OK, tal_kv_batch_begin(&batch));
+        EXPECT_EQ(OPRT_OK, tal_kv_batch_put(batch, "ut_a", (const uint8_t *)"a2", 2));
+        EXPECT_EQ(OPRT_OK, tal_kv_batch_del(batch, "ut_b"));
+        EXPECT_EQ(OPRT_OK, tal_kv_batch_put(batch, "ut_c", (const uint8_t *)"c2", 2));
+        result = tal_kv_batch_commit(batch);
+        ut_flash_power_cut(UINT32_MAX);
+
+        ASSERT_EQ(OPRT_OK, ut_kv_init()) << cut;
+        std::string a = get("ut_a"), b = get("ut_b"), c = get("ut_c");
+        if ("a2" == a) {
+            EXPECT_EQ("<none>", b) << cut;
+            EXPECT_EQ("c2", c) << cut;
+            replayed += OPRT_OK != result;
+        } else {
+            EXPECT_NE(OPRT_OK, result) << cut;
+            EXPECT_EQ("a", a) << cut;
+            EXPECT_EQ("b", b) << cut;
+            EXPECT_EQ("<none>", c) << cut;
+        }
+    }
+#if !defined(ENABLE_KV_LOG) || (ENABLE_KV_LOG == 0)
+    EXPECT_LT(0, replayed);
+#endif
+}
+
+#if defined(ENABLE_KV_LOG) && (ENABLE_KV_LOG == 1) && !(defined(KV_LOG_WB_SIZE) && (KV_LOG_WB_SIZE > 0))
+// batch records synced without their commit record are dropped by the next load
+TEST_F(TalKvTest, batch_log_uncommitted)
+{
+    uint8_t *ec_data = NULL;
+    size_t ec_len = 0;
+
+    set("ut_a", "new");
+    ASSERT_EQ(OPRT_OK, kv_log_get("ut_a", &ec_data, &ec_len));
+    std::string ec_new((const char *)ec_data, ec_len);
+    tal_free(ec_data);
+    set("ut_a", "old");
+
+    // kv_log_flush syncs the records of the open batch without a write back buffer
+    ASSERT_EQ(OPRT_OK, kv_log_batch_begin());
+    EXPECT_EQ(OPRT_OK, kv_log_set("ut_a", (const uint8_t *)ec_new.data(), ec_new.size()));
+    EXPECT_EQ(OPRT_OK, kv_log_set("ut_b", (const uint8_t *)ec_new.data(), ec_new.size()));
+    EXPECT_EQ(OPRT_OK, kv_log_flush());
+    EXPECT_EQ("new", get("ut_b"));
+
+    ASSERT_EQ(OPRT_OK, ut_kv_init());
+    EXPECT_EQ("old", get("ut_a"));
+    EXPECT_EQ("<none>", get("ut_b"));
+
+    // the log goes on after the dropped records
+    set("ut_c", "c");
+    ASSERT_EQ(OPRT_OK, ut_kv_init());
+    EXPECT_EQ("old", get("ut_a"));
+    EXPECT_EQ("<none>", get("ut_b"));
+    EXPECT_EQ("c", get("ut_c"));
+}
+#endif
+
+/**
+ * UT_BENCH_SETS sets of UT_BENCH_KEYS keys in turn, then as many gets. The
+ * erases are what wears the flash, compare the two engines by running both
+ * ut_tal_kv and ut_tal_kv_log
+ */
+TEST_F(TalKvTest, bench)
+{
+    std::string values[UT_BENCH_KEYS];
+
+#if defined(KV_LOG_WB_SIZE) && (KV_LOG_WB_SIZE > 0)
+    // the buffer is written when full or by the workqueue, as on a device
+    ut_workq_enable(true);
+#endif
+    ut_flash_reset_count();
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < UT_BENCH_SETS; i++) {
+        int key = i % UT_BENCH_KEYS;
+        values[key] = ut_value(key, i, UT_BENCH_VALUE);
+        set("ut_bench_" + std::to_string(key), values[key]);
+    }
+    double set_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+    uint32_t erases = ut_flash_erases();
+
+    t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < UT_BENCH_SETS; i++) {
+        int key = i % UT_BENCH_KEYS;
+        EXPECT_TRUE(values[key] == get("ut_bench_" + std::to_string(key)));
+    }
+    double get_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+
+    printf("[ BENCH    ] %s: %d sets, %5u erases (%3u max per block), %7u KB written, set %7.1f us, get %6.1f "
+           "us\n",
+           UT_KV_ENGINE, UT_BENCH_SETS, erases, ut_flash_max_block_erases(), ut_flash_prog_bytes() / 1024,
+           set_us / UT_BENCH_SETS, get_us / UT_BENCH_SETS);
+    EXPECT_EQ(0u, ut_flash_overwrites());
+#if defined(KV_LOG_WB_SIZE) && (KV_LOG_WB_SIZE > 0)
+    ut_workq_enable(false);
+#endif
+}
+
+#if defined(KV_LOG_WB_SIZE) && (KV_LOG_WB_SIZE > 0)
+// the kv log with its write back buffer written by a running workqueue
+class TalKvWbTest : public TalKvTest {
+protected:
+    void SetUp() override
+    {
+        ut_flash_format(UT_FLASH_SIZE);
+        ut_workq_enable(true);
+        ASSERT_EQ(OPRT_OK, ut_kv_init());
+    }
+
+    void TearDown() override
+    {
+        ut_workq_enable(false);
+    }
+
+    lfs_soff_t log_size(void)
+    {
+        struct lfs_info info;
+
+        if (LFS_ERR_OK != lfs_stat(tal_lfs_get(), "tal_kv.log", &info)) {
+            return -1;
+        }
+        return info.size;
+    }
+};
+
+// a value still in the buffer is read back before it reaches the flash
+TEST_F(TalKvWbTest, read_buffer)
+{
+    ut_workq_hold(true);
+    ut_flash_reset_count();
+    set("ut_a", "buffered");
+    set("ut_b", "too");
+    EXPECT_EQ(0u, ut_flash_prog_bytes());
+    EXPECT_EQ("buffered", get("ut_a"));
+    EXPECT_EQ("too", get("ut_b"));
+    EXPECT_EQ(0, ut_workq_runs());
+}
+
+// the workqueue writes the buffer KV_LOG_FLUSH_MS after the set, without tal_kv_flush
+TEST_F(TalKvWbTest, flush_timer)
+{
+    ut_flash_reset_count();
+    auto t0 = std::chrono::steady_clock::now();
+    set("ut_a", "flushed");
+    ASSERT_TRUE(ut_workq_wait(KV_LOG_FLUSH_MS * 20));
+    double wait_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    EXPECT_GE(wait_ms, KV_LOG_FLUSH_MS);
+    EXPECT_EQ(1, ut_workq_runs());
+    EXPECT_LT(0u, ut_flash_prog_bytes());
+
+    ASSERT_EQ(OPRT_OK, ut_kv_init());
+    EXPECT_EQ("flushed", get("ut_a"));
+}
+
+// a reset before the flush loses what is in the buffer, and only that
+TEST_F(TalKvWbTest, lost_on_remount)
+{
+    set("ut_a", "v1");
+    EXPECT_EQ(OPRT_OK, tal_kv_flush());
+    ut_workq_hold(true);
+    set("ut_a", "v2");
+    set("ut_new", "new");
+    EXPECT_EQ("v2", get("ut_a"));
+
+    ASSERT_EQ(OPRT_OK, ut_kv_init());
+    EXPECT_EQ("v1", get("ut_a"));
+    EXPECT_EQ("<none>", get("ut_new"));
+    EXPECT_EQ(0, ut_workq_runs());
+}
+
+// sets leave the compaction to the workqueue, which shrinks the log
+TEST_F(TalKvWbTest, background_compact)
+{
+    std::string values[4];
+    int i = 0;
+
+    ut_workq_hold(true);
+    while (log_size() < 16 * 1024) {
+        int key = i % 4;
+        values[key] = ut_value(key, i++, 100);
+        set("ut_" + std::to_string(key), values[key]);
+        ASSERT_LT(i, 10000);
+    }
+    lfs_soff_t size = log_size();
+    EXPECT_EQ(0, ut_workq_runs());
+
+    ut_workq_hold(false);
+    ASSERT_TRUE(ut_workq_wait(1000));
+    EXPECT_EQ(1, ut_workq_runs());
+    EXPECT_LT(log_size(), size / 4);
+    for (int key = 0; key < 4; key++) {
+        EXPECT_TRUE(values[key] == get("ut_" + std::to_string(key))) << key;
+    }
+
+    ASSERT_EQ(OPRT_OK, ut_kv_init());
+    for (int key = 0; key < 4; key++) {
+        EXPECT_TRUE(values[key] == get("ut_" + std::to_string(key))) << key;
+    }
+    EXPECT_EQ(0u, ut_flash_overwrites());
+}
+#endif
+
+#if defined(ENABLE_KV_CACHE) && (ENABLE_KV_CACHE == 1)
+// every value the cache holds is the one on flash
+class TalKvCacheTest : public TalKvTest {
+protected:
+    // the value of key in the cache, "<none>" if cached absent and "<miss>" if not cached
+    std::string cached(const std::string &key)
+    {
+        uint8_t *value = NULL;
+        size_t len = 0;
+
+        if (OPRT_OK != kv_cache_get(key.c_str(), &value, &len)) {
+            return "<miss>";
+        }
+        if (NULL == value) {
+            return "<none>";
+        }
+        std::string out((const char *)value, len);
+        tal_free(value);
+        return out;
+    }
+
+    // the value of key read from flash after mounting again, which empties the cache
+    std::string flash(const std::string &key)
+    {
+        EXPECT_EQ(OPRT_OK, ut_kv_init());
+        EXPECT_EQ("<miss>", cached(key));
+        return get(key);
+    }
+};
+
+TEST_F(TalKvCacheTest, set)
+{
+    set("ut_a", "1");
+    EXPECT_EQ("1", cached("ut_a"));
+    set("ut_a", "2");
+    EXPECT_EQ("2", cached("ut_a"));
+    EXPECT_EQ("2", get("ut_a"));
+    EXPECT_EQ("2", flash("ut_a"));
+    EXPECT_EQ("2", cached("ut_a"));
+
+    // too long to cache, the shorter value before is dropped
+    std::string value = ut_value(1, 1, KV_CACHE_VALUE_MAX + 1);
+    set("ut_a", value);
+    EXPECT_EQ("<miss>", cached("ut_a"));
+    EXPECT_TRUE(value == get("ut_a"));
+    EXPECT_TRUE(value == flash("ut_a"));
+}
+
+TEST_F(TalKvCacheTest, del)
+{
+    set("ut_a", "a");
+    EXPECT_EQ(OPRT_OK, tal_kv_del("ut_a"));
+    EXPECT_EQ("<none>", cached("ut_a"));
+    EXPECT_EQ("<none>", get("ut_a"));
+    EXPECT_NE(OPRT_OK, tal_kv_del("ut_a"));
+    EXPECT_EQ("<none>", cached("ut_a"));
+    EXPECT_EQ("<none>", flash("ut_a"));
+}
+
+// a key read as missing is cached absent until it is written
+TEST_F(TalKvCacheTest, absent)
+{
+    EXPECT_EQ("<none>", get("ut_a"));
+    EXPECT_EQ("<none>", cached("ut_a"));
+    set("ut_a", "a");
+    EXPECT_EQ("a", cached("ut_a"));
+    EXPECT_EQ("a", get("ut_a"));
+    EXPECT_EQ("a", flash("ut_a"));
+}
+
+// a committed batch updates the cache, an aborted one leaves it as it was
+TEST_F(TalKvCacheTest, batch)
+{
+    KV_BATCH_HANDLE batch;
+
+    set("ut_a", "a");
+    set("ut_b", "b");
+    EXPECT_EQ("<none>", get("ut_c"));
+
+    ASSERT_EQ(OPRT_OK, tal_kv_batch_begin(&batch));
+    EXPECT_EQ(OPRT_OK, tal_kv_batch_put(batch, "ut_a", (const uint8_t *)"x", 1));
+    EXPECT_EQ(OPRT_OK, tal_kv_batch_del(batch, "ut_b"));
+    EXPECT_EQ(OPRT_OK, tal_kv_batch_put(batch, "ut_c", (const uint8_t *)"x", 1));
+    tal_kv_batch_abort(batch);
+    EXPECT_EQ("a", cached("ut_a"));
+    EXPECT_EQ("b", cached("ut_b"));
+    EXPECT_EQ("<none>", cached("ut_c"));
+
+    ASSERT_EQ(OPRT_OK, tal_kv_batch_begin(&batch));
+    EXPECT_EQ(OPRT_OK, tal_kv_batch_put(batch, "ut_a", (const uint8_t *)"a2", 2));
+    EXPECT_EQ(OPRT_OK, tal_kv_batch_del(batch, "ut_b"));
+    EXPECT_EQ(OPRT_OK, tal_kv_batch_put(batch, "ut_c", (const uint8_t *)"c2", 2));
+    EXPECT_EQ("a", get("ut_a"));
+    EXPECT_EQ(OPRT_OK, tal_kv_batch_commit(batch));
+    EXPECT_EQ("a2", cached("ut_a"));
+    EXPECT_EQ("<none>", cached("ut_b"));
+    EXPECT_EQ("c2", cached("ut_c"));
+
+    EXPECT_EQ("a2", flash("ut_a"));
+    EXPECT_EQ("<none>", flash("ut_b"));
+    EXPECT_EQ("c2", flash("ut_c"));
+}
+
+// the least recently used key leaves a full cache
+TEST_F(TalKvCacheTest, evict)
+{
+    for (int key = 0; key < KV_CACHE_NUM; key++) {
+        set("ut_" + std::to_string(key), std::to_string(key));
+    }
+    EXPECT_EQ("0", get("ut_0"));
+    set("ut_new", "new");
+    EXPECT_EQ("0", cached("ut_0"));
+    EXPECT_EQ("<miss>", cached("ut_1"));
+    EXPECT_EQ("1", get("ut_1"));
+    EXPECT_EQ("1", cached("ut_1"));
+}
+#endif
@@ -0,0 +1,130 @@
+/**
+ * @file ut_flash_sim.cpp
+ * @brief RAM NOR flash for the tal_kv UT. As on NOR flash, erase sets a
+ * block to 0xff and write can only clear bits.
+ *
+ * @copyright Copyright (c) 2021-2024 Tuya Inc. All Rights Reserved.
+ *
+ */
+
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "tkl_flash.h"
+#include "ut_flash_sim.h"
+
+static std::vector<uint8_t> s_flash;
+static std::vector<uint32_t> s_block_erases;
+static uint32_t s_erases;
+static uint32_t s_prog_bytes;
+static uint32_t s_overwrites;
+static uint32_t s_power_left = UINT32_MAX;
+
+void ut_flash_format(uint32_t size)
+{
+    s_flash.assign(size, 0xff);
+    s_block_erases.assign(size / UT_FLASH_BLOCK, 0);
+    s_power_left = UINT32_MAX;
+    ut_flash_reset_count();
+}
+
+void ut_flash_reset_count(void)
+{
+    std::fill(s_block_erases.begin(), s_block_erases.end(), 0);
+    s_erases = 0;
+    s_prog_bytes = 0;
+    s_overwrites = 0;
+}
+
+uint32_t ut_flash_erases(void)
+{
+    return s_erases;
+}
+
+uint32_t ut_flash_max_block_erases(void)
+{
+    return s_block_erases.empty() ? 0 : *std::max_element(s_block_erases.begin(), s_block_erases.end());
+}
+
+uint32_t ut_flash_prog_bytes(void)
+{
+    return s_prog_bytes;
+}
+
+uint32_t ut_flash_overwrites(void)
+{
+    return s_overwrites;
+}
+
+void ut_flash_power_cut(uint32_t prog_bytes)
+{
+    s_power_left = prog_bytes;
+}
+
+static bool ut_flash_in_range(uint32_t addr, uint32_t size)
+{
+    return addr >= UT_FLASH_ADDR && addr - UT_FLASH_ADDR + (uint64_t)size <= s_flash.size();
+}
+
+OPERATE_RET tkl_flash_get_one_type_info(TUYA_FLASH_TYPE_E type, TUYA_FLASH_BASE_INFO_T *info)
+{
+    if (TUYA_FLASH_TYPE_UF != type) {
+        return OPRT_NOT_SUPPORTED;
+    }
+    memset(info, 0, sizeof(TUYA_FLASH_BASE_INFO_T));
+    info->partition_num = 1;
+    info->partition[0].block_size = UT_FLASH_BLOCK;
+    info->partition[0].start_addr = UT_FLASH_ADDR;
+    info->partition[0].size = s_flash.size();
+    return OPRT_OK;
+}
+
+OPERATE_RET tkl_flash_read(uint32_t addr, uint8_t *dst, uint32_t size)
+{
+    if (!ut_flash_in_range(addr, size)) {
+        return OPRT_INVALID_PARM;
+    }
+    memcpy(dst, s_flash.data() + addr - UT_FLASH_ADDR, size);
+    return OPRT_OK;
+}
+
+OPERATE_RET tkl_flash_write(uint32_t addr, const uint8_t *src, uint32_t size)
+{
+    if (!ut_flash_in_range(addr, size)) {
+        return OPRT_INVALID_PARM;
+    }
+    if (UINT32_MAX != s_power_left) {
+        if (s_power_left < size) {
+            s_power_left = 0;
+            return OPRT_COM_ERROR;
+        }
+        s_power_left -= size;
+    }
+    uint8_t *dst = s_flash.data() + addr - UT_FLASH_ADDR;
+    for (uint32_t i = 0; i < size; i++) {
+        if (0xff != dst[i]) {
+            s_overwrites++;
+        }
+        dst[i] &= src[i];
+    }
+    s_prog_bytes += size;
+    return OPRT_OK;
+}
+
+OPERATE_RET tkl_flash_erase(uint32_t addr, uint32_t size)
+{
+    if (!ut_flash_in_range(addr, size) || (addr - UT_FLASH_ADDR) % UT_FLASH_BLOCK || size % UT_FLASH_BLOCK) {
+        return OPRT_INVALID_PARM;
+    }
+    if (0 == s_power_left) {
+        return OPRT_COM_ERROR;
+    }
+    memset(s_flash.data() + addr - UT_FLASH_ADDR, 0xff, size);
+    for (uint32_t block = (addr - UT_FLASH_ADDR) / UT_FLASH_BLOCK; size; block++, size -= UT_FLASH_BLOCK) {
+        s_block_erases[block]++;
+        s_erases++;
+    }
+    return OPRT_OK;
+}
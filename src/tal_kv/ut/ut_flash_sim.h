@@ -0,0 +1,66 @@
+/**
+ * @file ut_flash_sim.h
+ * @brief RAM NOR flash for the tal_kv UT, the TUYA_FLASH_TYPE_UF partition
+ * read, written and erased by tal_kv through tkl_flash_*.
+ *
+ * @copyright Copyright (c) 2021-2024 Tuya Inc. All Rights Reserved.
+ *
+ */
+
+#ifndef __UT_FLASH_SIM_H__
+#define __UT_FLASH_SIM_H__
+
+#include <stdint.h>
+
+#define UT_FLASH_ADDR  0x1f0000
+#define UT_FLASH_BLOCK 4096
+
+/**
+ * @brief erase the whole partition and reset the counters
+ *
+ * @param[in] size size of the partition, a multiple of UT_FLASH_BLOCK
+ *
+ */
+void ut_flash_format(uint32_t size);
+
+/**
+ * @brief reset the counters, the content is kept
+ *
+ */
+void ut_flash_reset_count(void);
+
+/**
+ * @brief number of blocks erased since the last reset
+ *
+ */
+uint32_t ut_flash_erases(void);
+
+/**
+ * @brief the most times a single block was erased since the last reset
+ *
+ */
+uint32_t ut_flash_max_block_erases(void);
+
+/**
+ * @brief number of bytes written since the last reset
+ *
+ */
+uint32_t ut_flash_prog_bytes(void);
+
+/**
+ * @brief number of writes to bytes that were not erased since the last reset
+ *
+ */
+uint32_t ut_flash_overwrites(void);
+
+/**
+ * @brief cut the power once prog_bytes more bytes are written, every later
+ * write and erase fails and leaves the flash as it is
+ *
+ * @param[in] prog_bytes bytes written before the cut, UINT32_MAX to power on
+ * again
+ *
+ */
+void ut_flash_power_cut(uint32_t prog_bytes);
+
+#endif /* __UT_FLASH_SIM_H__ */
@@ -0,0 +1,145 @@
+/**
+ * @file ut_workq_fake.cpp
+ * @brief Delayed work of the system workqueue for the tal_kv UT, a thread
+ * runs each work once it is due.
+ *
+ * @copyright Copyright (c) 2021-2024 Tuya Inc. All Rights Reserved.
+ *
+ */
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "ut_workq_fake.h"
+
+// tal_workq_service.h carries no extern "C"
+extern "C" {
+#include "tal_api.h"
+}
+
+struct UtWork {
+    WORKQUEUE_CB cb;
+    void *data;
+    bool pending;
+    std::chrono::steady_clock::time_point due;
+};
+
+static std::mutex s_mutex;
+static std::condition_variable s_cond;
+static std::vector<std::unique_ptr<UtWork>> s_works; // never freed, as the kv log keeps its handle
+static std::thread s_thread;
+static bool s_enabled;
+static bool s_hold;
+static int s_runs;
+
+static bool ut_workq_pending(void)
+{
+    for (auto &work : s_works) {
+        if (work->pending) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// run the due work out of the lock, the work takes the tal_kv mutex
+static void ut_workq_loop(void)
+{
+    std::unique_lock<std::mutex> lock(s_mutex);
+
+    while (s_enabled || ut_workq_pending()) {
+        UtWork *due = NULL;
+        auto now = std::chrono::steady_clock::now();
+        for (auto &work : s_works) {
+            if (work->pending && (!s_enabled || (!s_hold && work->due <= now))) {
+                due = work.get();
+                break;
+            }
+        }
+        if (NULL == due) {
+            s_cond.wait_for(lock, std::chrono::milliseconds(5));
+            continue;
+        }
+        due->pending = false;
+        lock.unlock();
+        due->cb(due->data);
+        lock.lock();
+        s_runs++;
+        s_cond.notify_all();
+    }
+}
+
+void ut_workq_enable(bool enable)
+{
+    std::unique_lock<std::mutex> lock(s_mutex);
+
+    if (enable == s_enabled) {
+        return;
+    }
+    s_enabled = enable;
+    if (enable) {
+        s_runs = 0;
+        s_thread = std::thread(ut_workq_loop);
+        return;
+    }
+    s_hold = false;
+    s_cond.notify_all();
+    lock.unlock();
+    s_thread.join();
+}
+
+void ut_workq_hold(bool hold)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+
+    s_hold = hold;
+    s_cond.notify_all();
+}
+
+int ut_workq_runs(void)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+
+    return s_runs;
+}
+
+bool ut_workq_wait(int timeout_ms)
+{
+    std::unique_lock<std::mutex> lock(s_mutex);
+
+    return s_cond.wait_for(lock, std::chrono::milliseconds(timeout_ms), [] { return !ut_workq_pending(); });
+}
+
+extern "C" {
+
+OPERATE_RET tal_workq_init_delayed(WORKQ_SERVICE_E service, WORKQUEUE_CB cb, void *data,
+                                   DELAYED_WORK_HANDLE *delayed_work)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+
+    if (!s_enabled) {
+        return OPRT_NOT_SUPPORTED;
+    }
+    s_works.emplace_back(new UtWork{cb, data, false, {}});
+    *delayed_work = s_works.back().get();
+    return OPRT_OK;
+}
+
+OPERATE_RET tal_workq_start_delayed(DELAYED_WORK_HANDLE delayed_work, TIME_MS interval, LOOP_TYPE type)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    UtWork *work = (UtWork *)delayed_work;
+
+    if (!s_enabled || LOOP_ONCE != type) {
+        return OPRT_NOT_SUPPORTED;
+    }
+    work->pending = true;
+    work->due = std::chrono::steady_clock::now() + std::chrono::milliseconds(interval);
+    s_cond.notify_all();
+    return OPRT_OK;
+}
+}
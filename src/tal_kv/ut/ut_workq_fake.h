@@ -0,0 +1,45 @@
+/**
+ * @file ut_workq_fake.h
+ * @brief Delayed work of the system workqueue for the tal_kv UT, run by a
+ * thread of the UT once due. Off until ut_workq_enable, the kv log then
+ * flushes and compacts in the caller.
+ *
+ * @copyright Copyright (c) 2021-2024 Tuya Inc. All Rights Reserved.
+ *
+ */
+
+#ifndef __UT_WORKQ_FAKE_H__
+#define __UT_WORKQ_FAKE_H__
+
+/**
+ * @brief start or stop running delayed work, the pending work runs before it
+ * stops. Work can not be started while off
+ *
+ * @param[in] enable true to start
+ *
+ */
+void ut_workq_enable(bool enable);
+
+/**
+ * @brief keep due work pending until released, as a busy workqueue does
+ *
+ * @param[in] hold true to hold, false to release
+ *
+ */
+void ut_workq_hold(bool hold);
+
+/**
+ * @brief number of delayed work run since enabled
+ *
+ */
+int ut_workq_runs(void);
+
+/**
+ * @brief wait for the work pending now to run, false on a timeout
+ *
+ * @param[in] timeout_ms the longest wait
+ *
+ */
+bool ut_workq_wait(int timeout_ms);
+
+#endif /* __UT_WORKQ_FAKE_H__ */
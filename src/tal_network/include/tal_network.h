@@ -124,6 +124,80 @@ OPERATE_RET tal_net_fd_zero(TUYA_FD_SET_T *fds);
 int tal_net_select(const int maxfd, TUYA_FD_SET_T *readfds, TUYA_FD_SET_T *writefds, TUYA_FD_SET_T *errorfds,
                    const uint32_t ms_timeout);
 
+/* readiness reported by tal_net_poller_wait */
+#define TAL_NET_POLL_IN  0x01 // readable, or the peer has closed
+#define TAL_NET_POLL_ERR 0x02 // error pending on the socket
+
+typedef void *NET_POLLER_HANDLE;
+
+typedef struct {
+    int fd;
+    uint32_t events; // TAL_NET_POLL_IN | TAL_NET_POLL_ERR
+    void *ctx;       // the ctx given to tal_net_poller_add
+} TUYA_NET_POLL_EVENT_T;
+
+/**
+ * @brief Create a poller watching a set of file descriptors for readiness
+ *
+ * @param[out] poller: the poller handle
+ * @param[in] max_fds: max count of file descriptors watched at once
+ *
+ * @note The set is kept between waits, on linux it is backed by epoll, on
+ * other platforms tal_net_select is called on the set.
+ *
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_net_poller_create(NET_POLLER_HANDLE *poller, const uint32_t max_fds);
+
+/**
+ * @brief Watch a file descriptor for read and error readiness
+ *
+ * @param[in] poller: the poller handle
+ * @param[in] fd: file descriptor
+ * @param[in] ctx: user data reported with the events of fd
+ *
+ * @note Adding a watched fd again updates its ctx.
+ *
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_net_poller_add(NET_POLLER_HANDLE poller, const int fd, void *ctx);
+
+/**
+ * @brief Stop watching a file descriptor
+ *
+ * @param[in] poller: the poller handle
+ * @param[in] fd: file descriptor
+ *
+ * @note Call it before closing fd.
+ *
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_net_poller_del(NET_POLLER_HANDLE poller, const int fd);
+
+/**
+ * @brief Wait for watched file descriptors to become ready
+ *
+ * @param[in] poller: the poller handle
+ * @param[out] events: the ready file descriptors
+ * @param[in] max_events: size of events
+ * @param[in] ms_timeout: time out, 0 returns at once
+ *
+ * @return the count of ready file descriptors in events, 0 on timeout, <0
+ * error.
+ */
+int tal_net_poller_wait(NET_POLLER_HANDLE poller, TUYA_NET_POLL_EVENT_T *events, const uint32_t max_events,
+                        const uint32_t ms_timeout);
+
+/**
+ * @brief Release a poller, the watched file descriptors are not closed
+ *
+ * @param[in] poller: the poller handle
+ */
+void tal_net_poller_destroy(NET_POLLER_HANDLE poller);
+
 /**
  * @brief Get no block file descriptors
  *
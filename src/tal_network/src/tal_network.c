@@ -31,6 +31,7 @@
  */
 #include "tuya_iot_config.h"
 #include "tal_api.h"
+#include "tal_network.h"
 
 #if 100 == OPERATING_SYSTEM
 #include <unistd.h>
@@ -45,8 +46,10 @@
 #include <sys/time.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <sys/epoll.h>
 
 #define ENABLE_BIND_INTERFACE 1
+#define NET_USING_EPOLL       1
 
 #elif defined(ENABLE_LIBLWIP) && (ENABLE_LIBLWIP == 1)
 #include "lwip/netdb.h"
@@ -270,6 +273,291 @@ int tal_net_select(const int maxfd, TUYA_FD_SET_T *readfds, TUYA_FD_SET_T *write
     return ret;
 }
 
+typedef struct {
+    int fd;
+    void *ctx;
+} NET_POLL_ITEM_T;
+
+typedef struct {
+    uint32_t max_fds;
+    NET_POLL_ITEM_T *items;
+#if NET_USING_EPOLL
+    int epfd;
+    struct epoll_event *ep_events;
+#else
+    TUYA_FD_SET_T rfds;
+    TUYA_FD_SET_T efds;
+#endif
+} NET_POLLER_T;
+
+static NET_POLL_ITEM_T *__net_poller_find(NET_POLLER_T *p, int fd)
+{
+    uint32_t idx;
+    for (idx = 0; idx < p->max_fds; idx++) {
+        if (p->items[idx].fd == fd) {
+            return &p->items[idx];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Create a poller watching a set of file descriptors for readiness
+ *
+ * @param[out] poller: the poller handle
+ * @param[in] max_fds: max count of file descriptors watched at once
+ *
+ * @note The set is kept between waits, on linux it is backed by epoll, on
+ * other platforms tal_net_select is called on the set.
+ *
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_net_poller_create(NET_POLLER_HANDLE *poller, const uint32_t max_fds)
+{
+    NET_POLLER_T *p = NULL;
+    uint32_t idx;
+
+    if (NULL == poller || 0 == max_fds) {
+        return OPRT_INVALID_PARM;
+    }
+
+    p = tal_malloc(sizeof(NET_POLLER_T));
+    if (NULL == p) {
+        return OPRT_MALLOC_FAILED;
+    }
+    memset(p, 0, sizeof(NET_POLLER_T));
+    p->max_fds = max_fds;
+#if NET_USING_EPOLL
+    p->epfd = -1;
+#endif
+
+    p->items = tal_malloc(max_fds * sizeof(NET_POLL_ITEM_T));
+    if (NULL == p->items) {
+        goto __exit;
+    }
+    for (idx = 0; idx < max_fds; idx++) {
+        p->items[idx].fd = -1;
+        p->items[idx].ctx = NULL;
+    }
+
+#if NET_USING_EPOLL
+    p->ep_events = tal_malloc(max_fds * sizeof(struct epoll_event));
+    if (NULL == p->ep_events) {
+        goto __exit;
+    }
+    p->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (p->epfd < 0) {
+        tal_net_poller_destroy(p);
+        return OPRT_COM_ERROR;
+    }
+#endif
+
+    *poller = p;
+    return OPRT_OK;
+
+__exit:
+    tal_net_poller_destroy(p);
+    return OPRT_MALLOC_FAILED;
+}
+
+/**
+ * @brief Watch a file descriptor for read and error readiness
+ *
+ * @param[in] poller: the poller handle
+ * @param[in] fd: file descriptor
+ * @param[in] ctx: user data reported with the events of fd
+ *
+ * @note Adding a watched fd again updates its ctx.
+ *
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_net_poller_add(NET_POLLER_HANDLE poller, const int fd, void *ctx)
+{
+    NET_POLLER_T *p = (NET_POLLER_T *)poller;
+    NET_POLL_ITEM_T *item = NULL;
+
+    if (NULL == p || fd < 0) {
+        return OPRT_INVALID_PARM;
+    }
+
+    item = __net_poller_find(p, fd);
+    if (item) {
+        item->ctx = ctx;
+        return OPRT_OK;
+    }
+
+    item = __net_poller_find(p, -1);
+    if (NULL == item) {
+        return OPRT_EXCEED_UPPER_LIMIT;
+    }
+
+#if NET_USING_EPOLL
+    struct epoll_event ev = {0};
+    ev.events = EPOLLIN;
+    ev.data.ptr = item;
+    if (epoll_ctl(p->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        return OPRT_COM_ERROR;
+    }
+#endif
+
+    item->fd = fd;
+    item->ctx = ctx;
+    return OPRT_OK;
+}
+
+/**
+ * @brief Stop watching a file descriptor
+ *
+ * @param[in] poller: the poller handle
+ * @param[in] fd: file descriptor
+ *
+ * @note Call it before closing fd.
+ *
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_net_poller_del(NET_POLLER_HANDLE poller, const int fd)
+{
+    NET_POLLER_T *p = (NET_POLLER_T *)poller;
+    NET_POLL_ITEM_T *item = NULL;
+
+    if (NULL == p || fd < 0) {
+        return OPRT_INVALID_PARM;
+    }
+
+    item = __net_poller_find(p, fd);
+    if (NULL == item) {
+        return OPRT_NOT_FOUND;
+    }
+
+#if NET_USING_EPOLL
+    // fails if fd was closed already, the kernel has dropped it then
+    epoll_ctl(p->epfd, EPOLL_CTL_DEL, fd, NULL);
+#endif
+
+    item->fd = -1;
+    item->ctx = NULL;
+    return OPRT_OK;
+}
+
+/**
+ * @brief Wait for watched file descriptors to become ready
+ *
+ * @param[in] poller: the poller handle
+ * @param[out] events: the ready file descriptors
+ * @param[in] max_events: size of events
+ * @param[in] ms_timeout: time out, 0 returns at once
+ *
+ * @return the count of ready file descriptors in events, 0 on timeout, <0
+ * error.
+ */
+int tal_net_poller_wait(NET_POLLER_HANDLE poller, TUYA_NET_POLL_EVENT_T *events, const uint32_t max_events,
+                        const uint32_t ms_timeout)
+{
+    NET_POLLER_T *p = (NET_POLLER_T *)poller;
+    int cnt = 0;
+    int ret = 0;
+
+    if (NULL == p || NULL == events || 0 == max_events) {
+        return OPRT_INVALID_PARM;
+    }
+
+#if NET_USING_EPOLL
+    int idx;
+    ret = epoll_wait(p->epfd, p->ep_events, (max_events < p->max_fds) ? max_events : p->max_fds, ms_timeout);
+    for (idx = 0; idx < ret; idx++) {
+        NET_POLL_ITEM_T *item = p->ep_events[idx].data.ptr;
+        uint32_t ep = p->ep_events[idx].events;
+        events[cnt].fd = item->fd;
+        events[cnt].ctx = item->ctx;
+        events[cnt].events = 0;
+        // like select, a pending error or a hang up also makes fd readable
+        if (ep & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+            events[cnt].events |= TAL_NET_POLL_IN;
+        }
+        if (ep & EPOLLERR) {
+            events[cnt].events |= TAL_NET_POLL_ERR;
+        }
+        cnt++;
+    }
+#else
+    uint32_t idx;
+    int maxfd = -1;
+
+    tal_net_fd_zero(&p->rfds);
+    tal_net_fd_zero(&p->efds);
+    for (idx = 0; idx < p->max_fds; idx++) {
+        if (p->items[idx].fd >= 0) {
+            tal_net_fd_set(p->items[idx].fd, &p->rfds);
+            tal_net_fd_set(p->items[idx].fd, &p->efds);
+            if (p->items[idx].fd > maxfd) {
+                maxfd = p->items[idx].fd;
+            }
+        }
+    }
+    if (maxfd < 0) {
+        return 0;
+    }
+
+#if NET_USING_POSIX
+    // tal_net_select waits forever on a 0 timeout
+    struct timeval timeout = {ms_timeout / 1000, (ms_timeout % 1000) * 1000};
+    ret = select(maxfd + 1, TAL_TO_SYS_FD_SET(&p->rfds), NULL, TAL_TO_SYS_FD_SET(&p->efds), &timeout);
+#else
+    ret = tkl_net_select(maxfd + 1, &p->rfds, NULL, &p->efds, ms_timeout);
+#endif
+
+    for (idx = 0; idx < p->max_fds && ret > 0 && (uint32_t)cnt < max_events; idx++) {
+        if (p->items[idx].fd < 0) {
+            continue;
+        }
+        events[cnt].events = 0;
+        if (tal_net_fd_isset(p->items[idx].fd, &p->rfds)) {
+            events[cnt].events |= TAL_NET_POLL_IN;
+        }
+        if (tal_net_fd_isset(p->items[idx].fd, &p->efds)) {
+            events[cnt].events |= TAL_NET_POLL_ERR;
+        }
+        if (events[cnt].events) {
+            events[cnt].fd = p->items[idx].fd;
+            events[cnt].ctx = p->items[idx].ctx;
+            cnt++;
+        }
+    }
+#endif
+
+    return (ret < 0) ? ret : cnt;
+}
+
+/**
+ * @brief Release a poller, the watched file descriptors are not closed
+ *
+ * @param[in] poller: the poller handle
+ */
+void tal_net_poller_destroy(NET_POLLER_HANDLE poller)
+{
+    NET_POLLER_T *p = (NET_POLLER_T *)poller;
+
+    if (NULL == p) {
+        return;
+    }
+
+#if NET_USING_EPOLL
+    if (p->epfd >= 0) {
+        close(p->epfd);
+    }
+    if (p->ep_events) {
+        tal_free(p->ep_events);
+    }
+#endif
+    if (p->items) {
+        tal_free(p->items);
+    }
+    tal_free(p);
+}
+
 /**
  * @brief Get no block file descriptors
  *
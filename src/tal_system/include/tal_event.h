@@ -90,15 +90,52 @@ typedef struct {
 } SUBSCRIBE_NODE_T;
 
 /**
- * @brief the event node
+ * @brief number of buckets of the event name hash table
+ *
+ */
+#define EVENT_HASH_BUCKET_NUM (32)
+
+/**
+ * @brief the interned event id, see tal_event_get_id
+ *
+ */
+typedef uint16_t EVENT_ID_T;
+
+/**
+ * @brief the subscriber entry kept in a subscriber set
  *
  */
 typedef struct {
-    MUTEX_HANDLE mutex; // mutex, protection the event publish and subscribe
+    EVENT_SUBSCRIBE_CB cb;             // the subscribe callback function
+    SUBSCRIBE_TYPE_E type;             // the subscribe type
+    char desc[EVENT_DESC_MAX_LEN + 1]; // description, used to record the subscribe info
+} SUBSCRIBER_T;
 
-    char name[EVENT_NAME_MAX_LEN + 1];    // name, the event name
-    struct tuya_list_head node;           // list node, used to attach to the event manage module
-    struct tuya_list_head subscribe_root; // subscibe root, used to manage the subscriber
+/**
+ * @brief the subscriber set, never changed after published to the event node,
+ * subscribe and unsubscribe build a new set and replace the old one
+ *
+ */
+typedef struct {
+    uint16_t ref_cnt;     // one for the event node while current, one for each dispatching publisher
+    uint16_t num;         // subscriber number
+    uint16_t onetime_num; // one-time subscriber number
+    SUBSCRIBER_T subs[0]; // subscribers in dispatch order
+} SUBSCRIBE_SET_T;
+
+/**
+ * @brief the event node
+ *
+ */
+typedef struct {
+    MUTEX_HANDLE mutex; // mutex, protection the subscriber set switch, not hold when dispatch
+
+    char name[EVENT_NAME_MAX_LEN + 1]; // name, the event name
+    uint32_t hash;                     // hash of the name
+    EVENT_ID_T id;                     // the interned id
+    struct tuya_list_head node;        // list node, used to attach to the event manage module
+    struct tuya_list_head hash_node;   // list node, used to attach to the hash bucket
+    SUBSCRIBE_SET_T *subs;             // current subscriber set, NULL if no subscriber
 } EVENT_NODE_T;
 
 /**
@@ -107,11 +144,14 @@ typedef struct {
  */
 typedef struct {
     int inited;
-    MUTEX_HANDLE mutex;                        // mutex, used to protection event manage node
-    int event_cnt;                             // current event number
-    struct tuya_list_head event_root;          // event root, used to manage the event
-    struct tuya_list_head free_subscribe_root; // free subscriber list, used to manage the
-                                               // subscribe which not found the event
+    MUTEX_HANDLE mutex;                                  // mutex, used to protection event manage node
+    int event_cnt;                                       // current event number
+    struct tuya_list_head event_root;                    // event root, used to manage the event
+    struct tuya_list_head bucket[EVENT_HASH_BUCKET_NUM]; // event hash table, indexed by name hash
+    EVENT_NODE_T **id_table;                             // event table, indexed by event id
+    uint16_t id_cap;                                     // capacity of the event table
+    struct tuya_list_head free_subscribe_root;           // free subscriber list, used to manage the
+                                                         // subscribe which not found the event
 } EVENT_MANAGE_T;
 
 /**
@@ -132,6 +172,26 @@ OPERATE_RET tal_event_init(void);
  */
 OPERATE_RET tal_event_publish(const char *name, void *data);
 
+/**
+ * @brief: get the interned id of event, the event is created if not existed
+ *
+ * @param[in] name: event name
+ * @param[out] id: event id, can be used to publish without name lookup
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_event_get_id(const char *name, EVENT_ID_T *id);
+
+/**
+ * @brief: publish event by interned id
+ *
+ * @param[in] id: event id, got from tal_event_get_id
+ * @param[in] data: event data
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_event_publish_by_id(EVENT_ID_T id, void *data);
+
 /**
  * @brief: subscribe event
  *
@@ -147,6 +207,10 @@ OPERATE_RET tal_event_subscribe(const char *name, const char *desc, const EVENT_
 /**
  * @brief: unsubscribe event
  *
+ * @note a publisher that took the subscriber set before the unsubscribe keeps
+ * dispatching from it, so cb can still be called once more after this returns.
+ * cb and the data it uses must stay valid until such publishes are done.
+ *
  * @param[in] name: event name
  * @param[in] desc: subscribe description
  * @param[in] cb: subscribe callback function
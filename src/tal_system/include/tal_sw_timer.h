@@ -145,6 +145,22 @@ OPERATE_RET tal_sw_timer_remain_time_get(TIMER_ID timer_id, uint32_t *remain_tim
  */
 OPERATE_RET tal_sw_timer_start(TIMER_ID timer_id, TIME_MS time_ms, TIMER_TYPE timer_type);
 
+/**
+ * @brief Start the software timer with a slack
+ *
+ * @param[in] timer_id: timer id
+ * @param[in] time_ms: timer running cycle
+ * @param[in] slack_ms: how late the timer may fire, 0 for exact expiry
+ * @param[in] timer_type: timer type
+ *
+ * @note Timers with slack are aligned so that those due close together fire
+ * in one wakeup of the timer thread. tal_sw_timer_start keeps the slack.
+ *
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_sw_timer_start_with_slack(TIMER_ID timer_id, TIME_MS time_ms, TIME_MS slack_ms, TIMER_TYPE timer_type);
+
 /**
  * @brief Trigger the software timer
  *
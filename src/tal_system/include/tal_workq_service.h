@@ -78,6 +78,39 @@ OPERATE_RET tal_workq_schedule(WORKQ_SERVICE_E service, WORKQUEUE_CB cb, void *d
  */
 OPERATE_RET tal_workq_schedule_instant(WORKQ_SERVICE_E service, WORKQUEUE_CB cb, void *data);
 
+/**
+ * @brief put work task in workqueue with a priority class and a deadline
+ *
+ * @param[in] service the workqueue service
+ * @param[in] prio the priority class, higher classes are dequeued first
+ * @param[in] deadline_ms once this many ms have passed the work runs ahead of
+ * all classes, 0 for no deadline
+ * @param[in] cb the work callback
+ * @param[in] data the work data
+ *
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_workq_schedule_prio(WORKQ_SERVICE_E service, WORK_PRIO_E prio, TIME_MS deadline_ms, WORKQUEUE_CB cb,
+                                    void *data);
+
+/**
+ * @brief put work task in workqueue, work with the same key runs serially and
+ * in order within its priority class, even when the service has several
+ * workers
+ *
+ * @param[in] service the workqueue service
+ * @param[in] prio the priority class, higher classes are dequeued first
+ * @param[in] key the serialization key
+ * @param[in] cb the work callback
+ * @param[in] data the work data
+ *
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_workq_schedule_key(WORKQ_SERVICE_E service, WORK_PRIO_E prio, uint32_t key, WORKQUEUE_CB cb,
+                                   void *data);
+
 /**
  * @brief cancel work task in workqueue
  *
@@ -101,6 +134,17 @@ OPERATE_RET tal_workq_cancel(WORKQ_SERVICE_E service, WORKQUEUE_CB cb, void *dat
  */
 uint16_t tal_workq_get_num(WORKQ_SERVICE_E service);
 
+/**
+ * @brief get the scheduling statistics of the workqueue service
+ *
+ * @param[in] service the workqueue service
+ * @param[out] stats the statistics, see WORKQUEUE_STATS_T
+ *
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_workq_get_stats(WORKQ_SERVICE_E service, WORKQUEUE_STATS_T *stats);
+
 /**
  * @brief dump all work in work queue.
  *
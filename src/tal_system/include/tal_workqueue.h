@@ -39,6 +39,30 @@ typedef struct {
 } WORK_ITEM_T;
 typedef BOOL_T (*WORKQUEUE_TRAVERSE_CB)(WORK_ITEM_T *item, void *ctx);
 
+/**
+ * @brief priority classes of work, higher classes are dequeued first
+ */
+typedef enum {
+    WORK_PRIO_LOW = 0,
+    WORK_PRIO_NORMAL, // tal_workqueue_schedule and tal_workqueue_schedule_instant
+    WORK_PRIO_HIGH,
+    WORK_PRIO_NUM,
+} WORK_PRIO_E;
+
+typedef struct {
+    uint32_t scheduled;
+    uint32_t executed;
+    uint32_t deadline_miss; // work started after its deadline
+    uint32_t delay_p50;     // queue delay percentiles in ms
+    uint32_t delay_p90;
+    uint32_t delay_p99;
+    uint32_t delay_max;
+    uint32_t exec_max; // longest callback in ms
+} WORKQUEUE_STATS_T;
+
+typedef void (*WORKQUEUE_TRACE_CB)(const WORK_ITEM_T *item, SYS_TIME_T enqueue_ms, SYS_TIME_T start_ms,
+                                   SYS_TIME_T finish_ms);
+
 /**
  * @brief create and initialize a workqueue which runs in thread context
  *
@@ -52,6 +76,25 @@ typedef BOOL_T (*WORKQUEUE_TRAVERSE_CB)(WORK_ITEM_T *item, void *ctx);
  */
 OPERATE_RET tal_workqueue_create(const uint16_t queue_len, THREAD_CFG_T *thread_cfg, WORKQUEUE_HANDLE *handle);
 
+/**
+ * @brief create a workqueue served by a pool of worker threads
+ *
+ * @param[in] queue_len the maximum number of items that the workqueue can
+ * contain
+ * @param[in] worker_num the number of worker threads, 1 behaves like
+ * tal_workqueue_create
+ * @param[in] thread_cfg thread param, shared by all workers
+ * @param[out] handle the workqueue handle
+ *
+ * @note work scheduled on a pool may run concurrently and out of order, use
+ * tal_workqueue_schedule_key for work that must stay serial
+ *
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_workqueue_create_pool(const uint16_t queue_len, const uint8_t worker_num, THREAD_CFG_T *thread_cfg,
+                                      WORKQUEUE_HANDLE *handle);
+
 /**
  * @brief put work task in workqueue
  *
@@ -76,6 +119,38 @@ OPERATE_RET tal_workqueue_schedule(WORKQUEUE_HANDLE handle, WORKQUEUE_CB cb, voi
  */
 OPERATE_RET tal_workqueue_schedule_instant(WORKQUEUE_HANDLE handle, WORKQUEUE_CB cb, void *data);
 
+/**
+ * @brief put work task in workqueue with a priority class and a deadline
+ *
+ * @param[in] handle the workqueue handle
+ * @param[in] prio the priority class, higher classes are dequeued first
+ * @param[in] deadline_ms once this many ms have passed the work runs ahead of
+ * all classes, 0 for no deadline
+ * @param[in] cb the work callback
+ * @param[in] data the work data
+ *
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_workqueue_schedule_prio(WORKQUEUE_HANDLE handle, WORK_PRIO_E prio, TIME_MS deadline_ms,
+                                        WORKQUEUE_CB cb, void *data);
+
+/**
+ * @brief put work task in workqueue, work with the same key runs serially and
+ * in order within its priority class
+ *
+ * @param[in] handle the workqueue handle
+ * @param[in] prio the priority class, higher classes are dequeued first
+ * @param[in] key the serialization key
+ * @param[in] cb the work callback
+ * @param[in] data the work data
+ *
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_workqueue_schedule_key(WORKQUEUE_HANDLE handle, WORK_PRIO_E prio, uint32_t key, WORKQUEUE_CB cb,
+                                       void *data);
+
 /**
  * @brief cancel work task in workqueue
  *
@@ -109,6 +184,38 @@ OPERATE_RET tal_workqueue_traverse(WORKQUEUE_HANDLE handle, WORKQUEUE_TRAVERSE_C
  */
 uint16_t tal_workqueue_get_num(WORKQUEUE_HANDLE handle);
 
+/**
+ * @brief get the scheduling statistics of the workqueue
+ *
+ * @param[in] handle the workqueue handle
+ * @param[out] stats the statistics since creation or the last reset
+ *
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_workqueue_get_stats(WORKQUEUE_HANDLE handle, WORKQUEUE_STATS_T *stats);
+
+/**
+ * @brief reset the scheduling statistics of the workqueue
+ *
+ * @param[in] handle the workqueue handle
+ *
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_workqueue_reset_stats(WORKQUEUE_HANDLE handle);
+
+/**
+ * @brief set a callback that receives the timestamps of every executed work
+ *
+ * @param[in] handle the workqueue handle
+ * @param[in] cb the trace callback, NULL to disable, runs in the worker thread
+ *
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_workqueue_set_trace(WORKQUEUE_HANDLE handle, WORKQUEUE_TRACE_CB cb);
+
 /**
  * @brief release the workqueue
  *
@@ -124,7 +231,7 @@ OPERATE_RET tal_workqueue_release(WORKQUEUE_HANDLE handle);
  *
  * @param[in] handle the workqueue handle
  *
- * @return thread handle
+ * @return thread handle, the first worker for a pool
  */
 THREAD_HANDLE tal_workqueue_get_thread(WORKQUEUE_HANDLE handle);
 
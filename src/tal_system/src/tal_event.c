@@ -19,6 +19,8 @@
  * - Event node creation and initialization
  * - Subscription management (addition, deletion, retrieval)
  * - Event dispatching to subscribed listeners
+ * - Event lookup through a name hash table, and interned event ids
+ * - Copy-on-write subscriber sets, so callbacks run without any lock held
  * - Thread-safe operations through mutex locking
  * - Debugging utilities for event and subscription dumping
  *
@@ -33,6 +35,7 @@
 #include "tuya_cloud_types.h"
 #include "tal_event.h"
 #include "tal_api.h"
+#include "mix_method.h"
 
 static EVENT_MANAGE_T g_event_manager = {0};
 
@@ -62,66 +65,175 @@ BOOL_T _event_desc_is_valid(const char *desc)
     return TRUE;
 }
 
-EVENT_NODE_T *_event_node_create_init(const char *name)
+static SUBSCRIBE_SET_T *_event_set_alloc(uint16_t num)
 {
+    SUBSCRIBE_SET_T *set = tal_malloc(sizeof(SUBSCRIBE_SET_T) + num * sizeof(SUBSCRIBER_T));
+    TUYA_CHECK_NULL_RETURN(set, NULL);
+    memset(set, 0, sizeof(SUBSCRIBE_SET_T));
+    set->ref_cnt = 1;
+
+    return set;
+}
+
+static void _event_set_add(SUBSCRIBE_SET_T *set, const SUBSCRIBER_T *sub)
+{
+    // if emergence, add to first, otherwise, add to tail
+    if (sub->type == SUBSCRIBE_TYPE_EMERGENCY) {
+        memmove(&set->subs[1], &set->subs[0], set->num * sizeof(SUBSCRIBER_T));
+        set->subs[0] = *sub;
+    } else {
+        set->subs[set->num] = *sub;
+    }
+    set->num++;
+
+    if (sub->type == SUBSCRIBE_TYPE_ONETIME) {
+        set->onetime_num++;
+    }
+}
+
+// drop one reference of the set, must be called in event mutex lock
+static void _event_set_put(SUBSCRIBE_SET_T *set)
+{
+    if (set && --set->ref_cnt == 0) {
+        tal_free(set);
+    }
+}
+
+// publish the new set to the event, must be called in event mutex lock
+static void _event_set_replace(EVENT_NODE_T *event, SUBSCRIBE_SET_T *set)
+{
+    SUBSCRIBE_SET_T *old = event->subs;
+
+    if (set && set->num == 0) {
+        tal_free(set);
+        set = NULL;
+    }
+    event->subs = set;
+
+    // publisher still dispatching the old set keeps it alive
+    _event_set_put(old);
+}
+
+static SUBSCRIBER_T *_event_set_find(SUBSCRIBE_SET_T *set, const char *desc, EVENT_SUBSCRIBE_CB cb)
+{
+    uint16_t i = 0;
+
+    if (NULL == set) {
+        return NULL;
+    }
+
+    for (i = 0; i < set->num; i++) {
+        if (0 == strcmp(set->subs[i].desc, desc) && set->subs[i].cb == cb) {
+            return &set->subs[i];
+        }
+    }
+
+    return NULL;
+}
+
+// find event by name, must be called in manager mutex lock
+static EVENT_NODE_T *_event_node_find(const char *name, uint32_t hash)
+{
+    EVENT_NODE_T *entry = NULL;
+    struct tuya_list_head *pos = NULL;
+    tuya_list_for_each(pos, &g_event_manager.bucket[hash % EVENT_HASH_BUCKET_NUM])
+    {
+        // compare hash first, name only on hash hit
+        entry = tuya_list_entry(pos, EVENT_NODE_T, hash_node);
+        if (entry->hash == hash && 0 == strcmp(entry->name, name)) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+// create event, must be called in manager mutex lock
+static EVENT_NODE_T *_event_node_create_init(const char *name, uint32_t hash)
+{
+    SUBSCRIBE_SET_T *set = NULL;
+
+    // event id is the index of id table, grow it when full
+    if (g_event_manager.event_cnt >= g_event_manager.id_cap) {
+        uint16_t cap = g_event_manager.id_cap ? g_event_manager.id_cap * 2 : EVENT_HASH_BUCKET_NUM;
+        EVENT_NODE_T **table = tal_realloc(g_event_manager.id_table, cap * sizeof(EVENT_NODE_T *));
+        TUYA_CHECK_NULL_RETURN(table, NULL);
+        g_event_manager.id_table = table;
+        g_event_manager.id_cap = cap;
+    }
+
     // allocate memory
     EVENT_NODE_T *event = tal_malloc(sizeof(EVENT_NODE_T));
     TUYA_CHECK_NULL_RETURN(event, NULL);
     memset(event, 0, sizeof(EVENT_NODE_T));
 
+    // need check if there have free subscriber which subscribe this event
+    uint16_t num = 0;
+    struct tuya_list_head *free_pos = NULL;
+    struct tuya_list_head *free_next = NULL;
+    SUBSCRIBE_NODE_T *free_entry = NULL;
+    tuya_list_for_each(free_pos, &g_event_manager.free_subscribe_root)
+    {
+        free_entry = tuya_list_entry(free_pos, SUBSCRIBE_NODE_T, node);
+        if (0 == strcmp(free_entry->name, name)) {
+            num++;
+        }
+    }
+
+    if (num) {
+        set = _event_set_alloc(num);
+        if (NULL == set) {
+            tal_free(event);
+            return NULL;
+        }
+    }
+
     // initialze the event node
     memcpy(event->name, name, strlen(name));
     event->name[strlen(name)] = '\0';
-    INIT_LIST_HEAD(&event->subscribe_root);
+    event->hash = hash;
+    event->id = g_event_manager.event_cnt;
     tal_mutex_create_init(&event->mutex);
 
-    tal_mutex_lock(g_event_manager.mutex);
-
-    // need check if there have free subscriber which subscribe this event
-    struct tuya_list_head *free_pos = NULL;
-    struct tuya_list_head *free_next = NULL;
-    SUBSCRIBE_NODE_T *free_entry = NULL;
+    // move the free subscriber to the subscriber set
     tuya_list_for_each_safe(free_pos, free_next, &g_event_manager.free_subscribe_root)
     {
-        // find by event name, and add it to subscribe list
         free_entry = tuya_list_entry(free_pos, SUBSCRIBE_NODE_T, node);
         if (0 == strcmp(free_entry->name, name)) {
+            SUBSCRIBER_T sub = {.cb = free_entry->cb, .type = free_entry->type};
+            memcpy(sub.desc, free_entry->desc, sizeof(sub.desc));
+            _event_set_add(set, &sub);
+
             // del from free subscrbe list
             tuya_list_del(&free_entry->node);
-
-            // add to different position according to the emergence flag
-            if (free_entry->type == SUBSCRIBE_TYPE_EMERGENCY) {
-                tuya_list_add(&free_entry->node, &event->subscribe_root);
-            } else {
-                tuya_list_add_tail(&free_entry->node, &event->subscribe_root);
-            }
+            tal_free(free_entry);
         }
     }
+    event->subs = set;
 
     // at last, need add this event to event manage root
     tuya_list_add_tail(&event->node, &g_event_manager.event_root);
+    tuya_list_add_tail(&event->hash_node, &g_event_manager.bucket[hash % EVENT_HASH_BUCKET_NUM]);
+    g_event_manager.id_table[event->id] = event;
     g_event_manager.event_cnt++;
 
-    tal_mutex_unlock(g_event_manager.mutex);
-
     return event;
 }
 
-EVENT_NODE_T *_event_node_get(const char *name)
+EVENT_NODE_T *_event_node_obtain(const char *name)
 {
-    // try to get event from event root
-    EVENT_NODE_T *entry = NULL;
-    struct tuya_list_head *pos = NULL;
-    tuya_list_for_each(pos, &g_event_manager.event_root)
-    {
-        // find by name
-        entry = tuya_list_entry(pos, EVENT_NODE_T, node);
-        if (0 == strcmp(entry->name, name)) {
-            return entry;
-        }
+    EVENT_NODE_T *event = NULL;
+    uint32_t hash = mm_str_hash(name);
+
+    // event node is never freed, the lock only protect the lookup and create
+    tal_mutex_lock(g_event_manager.mutex);
+    event = _event_node_find(name, hash);
+    if (!event) {
+        event = _event_node_create_init(name, hash);
     }
+    tal_mutex_unlock(g_event_manager.mutex);
 
-    return NULL;
+    return event;
 }
 
 SUBSCRIBE_NODE_T *_event_node_get_free_subscribe(SUBSCRIBE_NODE_T *subscribe)
@@ -141,46 +253,48 @@ SUBSCRIBE_NODE_T *_event_node_get_free_subscribe(SUBSCRIBE_NODE_T *subscribe)
     return NULL;
 }
 
-SUBSCRIBE_NODE_T *_event_node_get_subscribe(EVENT_NODE_T *event, SUBSCRIBE_NODE_T *subscribe)
-{
-    struct tuya_list_head *pos = NULL;
-    SUBSCRIBE_NODE_T *entry = NULL;
-    tuya_list_for_each(pos, &event->subscribe_root)
-    {
-        // find by desc
-        entry = tuya_list_entry(pos, SUBSCRIBE_NODE_T, node);
-        if (0 == strcmp(entry->desc, subscribe->desc) && entry->cb == subscribe->cb) {
-            return entry;
-        }
-    }
-
-    return NULL;
-}
-
 OPERATE_RET _event_node_dispatch(EVENT_NODE_T *event, void *data)
 {
     OPERATE_RET rt = OPRT_OK;
+    uint16_t i = 0;
 
-    // dispatch in order
-    struct tuya_list_head *p = NULL;
-    struct tuya_list_head *n = NULL;
-    SUBSCRIBE_NODE_T *entry = NULL;
-    tuya_list_for_each_safe(p, n, &event->subscribe_root)
-    {
-        // find and call cb one by one
-        entry = tuya_list_entry(p, SUBSCRIBE_NODE_T, node);
-        if (entry->cb) {
-            TUYA_CALL_ERR_LOG(entry->cb(data));
+    // take a reference of the current set, the lock is only held for that,
+    // so publisher never wait for other publisher's callback
+    tal_mutex_lock(event->mutex);
+    SUBSCRIBE_SET_T *set = event->subs;
+    if (NULL == set) {
+        tal_mutex_unlock(event->mutex);
+        return OPRT_OK;
+    }
+    set->ref_cnt++;
+
+    // one-time subscriber belongs to this publisher, remove them before dispatch
+    if (set->onetime_num) {
+        SUBSCRIBE_SET_T *new_set = _event_set_alloc(set->num - set->onetime_num);
+        if (new_set) {
+            for (i = 0; i < set->num; i++) {
+                if (set->subs[i].type != SUBSCRIBE_TYPE_ONETIME) {
+                    new_set->subs[new_set->num++] = set->subs[i];
+                }
+            }
+            _event_set_replace(event, new_set);
+        } else {
+            PR_ERR("event %s remove onetime subscriber failed", event->name);
         }
+    }
+    tal_mutex_unlock(event->mutex);
 
-        // one-time event should be removed after dispatch
-        if (entry->type == SUBSCRIBE_TYPE_ONETIME) {
-            tuya_list_del(&entry->node);
-            tal_free(entry);
-            entry = NULL;
+    // dispatch in order
+    for (i = 0; i < set->num; i++) {
+        if (set->subs[i].cb) {
+            TUYA_CALL_ERR_LOG(set->subs[i].cb(data));
         }
     }
 
+    tal_mutex_lock(event->mutex);
+    _event_set_put(set);
+    tal_mutex_unlock(event->mutex);
+
     return rt;
 }
 
@@ -205,27 +319,28 @@ OPERATE_RET _event_node_add_free_subscribe(SUBSCRIBE_NODE_T *subscribe)
 
 OPERATE_RET _event_node_add_subscribe(EVENT_NODE_T *event, SUBSCRIBE_NODE_T *subscribe)
 {
-    OPERATE_RET rt = OPRT_OK;
+    SUBSCRIBE_SET_T *old = event->subs;
 
     // existed, return ok, dont care, pretend to success
-    SUBSCRIBE_NODE_T *new_entry = _event_node_get_subscribe(event, subscribe);
-    if (new_entry) {
+    if (_event_set_find(old, subscribe->desc, subscribe->cb)) {
         return OPRT_OK;
     }
 
-    // malloc a new entry and prepare to add
-    new_entry = (SUBSCRIBE_NODE_T *)tal_malloc(sizeof(SUBSCRIBE_NODE_T));
-    TUYA_CHECK_NULL_RETURN(new_entry, OPRT_MALLOC_FAILED);
-    memcpy(new_entry, subscribe, sizeof(SUBSCRIBE_NODE_T));
-
-    // try to add, if emergence, add to first, otherwise, add to tail
-    if (subscribe->type == SUBSCRIBE_TYPE_EMERGENCY) {
-        tuya_list_add(&new_entry->node, &event->subscribe_root);
-    } else {
-        tuya_list_add_tail(&new_entry->node, &event->subscribe_root);
+    // copy the current set with the new subscriber, then switch to it
+    SUBSCRIBE_SET_T *set = _event_set_alloc((old ? old->num : 0) + 1);
+    TUYA_CHECK_NULL_RETURN(set, OPRT_MALLOC_FAILED);
+    if (old) {
+        memcpy(set->subs, old->subs, old->num * sizeof(SUBSCRIBER_T));
+        set->num = old->num;
+        set->onetime_num = old->onetime_num;
     }
 
-    return rt;
+    SUBSCRIBER_T sub = {.cb = subscribe->cb, .type = subscribe->type};
+    memcpy(sub.desc, subscribe->desc, sizeof(sub.desc));
+    _event_set_add(set, &sub);
+    _event_set_replace(event, set);
+
+    return OPRT_OK;
 }
 
 OPERATE_RET _event_node_del_free_subscribe(SUBSCRIBE_NODE_T *subscribe)
@@ -247,19 +362,27 @@ OPERATE_RET _event_node_del_free_subscribe(SUBSCRIBE_NODE_T *subscribe)
 
 OPERATE_RET _event_node_del_subscribe(EVENT_NODE_T *event, SUBSCRIBE_NODE_T *subscribe)
 {
-    OPERATE_RET rt = OPRT_OK;
-    SUBSCRIBE_NODE_T *new_entry = NULL;
+    uint16_t i = 0;
+    SUBSCRIBE_SET_T *old = event->subs;
+
     // not existed, return ok, dont care, pretend to success
-    new_entry = _event_node_get_subscribe(event, subscribe);
-    if (new_entry == NULL) {
+    SUBSCRIBER_T *entry = _event_set_find(old, subscribe->desc, subscribe->cb);
+    if (entry == NULL) {
         return OPRT_OK;
     }
 
-    // dont forget remove and free
-    tuya_list_del(&new_entry->node);
-    tal_free(new_entry);
-    new_entry = NULL;
-    return rt;
+    // copy the current set without the subscriber, then switch to it
+    SUBSCRIBE_SET_T *set = _event_set_alloc(old->num - 1);
+    TUYA_CHECK_NULL_RETURN(set, OPRT_MALLOC_FAILED);
+    for (i = 0; i < old->num; i++) {
+        if (&old->subs[i] != entry) {
+            set->subs[set->num++] = old->subs[i];
+        }
+    }
+    set->onetime_num = old->onetime_num - (entry->type == SUBSCRIBE_TYPE_ONETIME ? 1 : 0);
+    _event_set_replace(event, set);
+
+    return OPRT_OK;
 }
 
 #if 0
@@ -280,14 +403,9 @@ int _ty_event_dump()
     tuya_list_for_each(e_pos, &g_event_manager.event_root) {
         event = tuya_list_entry(e_pos, EVENT_NODE_T, node);
         if (event) {
-            SUBSCRIBE_NODE_T *subscribe = NULL;
-            if (!tuya_list_empty(&event->subscribe_root)) {
-                tuya_list_for_each(s_pos, &event->subscribe_root) {
-                    subscribe = tuya_list_entry(s_pos, SUBSCRIBE_NODE_T, node);
-                    if (subscribe) {
-                        PR_DEBUG("%-16s    %-32s    0x%08x", subscribe->name, subscribe->desc, subscribe->cb);
-                    }
-                }
+            SUBSCRIBE_SET_T *set = event->subs;
+            for (int i = 0; set && i < set->num; i++) {
+                PR_DEBUG("%-16s    %-32s    0x%08x", event->name, set->subs[i].desc, set->subs[i].cb);
             }
         }
     }
@@ -317,7 +435,8 @@ int _ty_event_dump()
  * steps:
  * 1. Checks if the event manager is already initialized. If it is, the function
  * returns OPRT_OK.
- * 2. Initializes the event root and free subscribe root lists.
+ * 2. Initializes the event root, the event hash buckets and free subscribe
+ * root lists.
  * 3. Creates and initializes the event manager mutex.
  * 4. Sets the event count to 0 and marks the event manager as initialized.
  *
@@ -327,6 +446,7 @@ int _ty_event_dump()
 OPERATE_RET tal_event_init(void)
 {
     OPERATE_RET rt = OPRT_OK;
+    int i = 0;
 
     if (g_event_manager.inited == TRUE) {
         return OPRT_OK;
@@ -337,6 +457,9 @@ OPERATE_RET tal_event_init(void)
 
     INIT_LIST_HEAD(&g_event_manager.event_root);
     INIT_LIST_HEAD(&g_event_manager.free_subscribe_root);
+    for (i = 0; i < EVENT_HASH_BUCKET_NUM; i++) {
+        INIT_LIST_HEAD(&g_event_manager.bucket[i]);
+    }
     tal_mutex_create_init(&g_event_manager.mutex);
     g_event_manager.event_cnt = 0;
     g_event_manager.inited = TRUE;
@@ -376,20 +499,75 @@ OPERATE_RET tal_event_publish(const char *name, void *data)
 
     OPERATE_RET rt = OPRT_OK;
     // try to get event, if not exist, create and init.
-    EVENT_NODE_T *event = _event_node_get(name);
-    if (!event) {
-        event = _event_node_create_init(name);
-        TUYA_CHECK_NULL_RETURN(event, OPRT_MALLOC_FAILED);
-    }
+    EVENT_NODE_T *event = _event_node_obtain(name);
+    TUYA_CHECK_NULL_RETURN(event, OPRT_MALLOC_FAILED);
 
-    // to keep the consistency, dispatch will done in mutex lock
-    tal_mutex_lock(event->mutex);
     // try to dispatch event to all subscribe
     // if one of the subscribe failed, it will continue but will return failed
     // to record the execute status
     TUYA_CALL_ERR_LOG(_event_node_dispatch(event, data));
 
-    tal_mutex_unlock(event->mutex);
+    return rt;
+}
+
+/**
+ * @brief Gets the interned id of an event.
+ *
+ * The event is created if it does not exist yet. Publishers with a high rate
+ * can keep the id and use tal_event_publish_by_id to skip the name lookup.
+ *
+ * @param[in] name The name of the event.
+ * @param[out] id The interned id of the event.
+ * @return The operation result. Returns OPRT_OK on success, or an error code on
+ * failure.
+ */
+OPERATE_RET tal_event_get_id(const char *name, EVENT_ID_T *id)
+{
+    if (g_event_manager.inited != TRUE) {
+        tal_event_init();
+    }
+
+    if (!_event_name_is_valid(name) || NULL == id) {
+        return OPRT_BASE_EVENT_INVALID_EVENT_NAME;
+    }
+
+    EVENT_NODE_T *event = _event_node_obtain(name);
+    TUYA_CHECK_NULL_RETURN(event, OPRT_MALLOC_FAILED);
+    *id = event->id;
+
+    return OPRT_OK;
+}
+
+/**
+ * @brief Publishes an event by its interned id.
+ *
+ * Same as tal_event_publish, but the event is found by index instead of name.
+ *
+ * @param[in] id The id of the event, got from tal_event_get_id.
+ * @param[in] data The data associated with the event.
+ * @return The operation result. Returns OPRT_OK on success, or an error code on
+ * failure.
+ */
+OPERATE_RET tal_event_publish_by_id(EVENT_ID_T id, void *data)
+{
+    OPERATE_RET rt = OPRT_OK;
+    EVENT_NODE_T *event = NULL;
+
+    if (g_event_manager.inited != TRUE) {
+        return OPRT_BASE_EVENT_INVALID_EVENT_NAME;
+    }
+
+    tal_mutex_lock(g_event_manager.mutex);
+    if (id < g_event_manager.event_cnt) {
+        event = g_event_manager.id_table[id];
+    }
+    tal_mutex_unlock(g_event_manager.mutex);
+
+    if (NULL == event) {
+        return OPRT_BASE_EVENT_INVALID_EVENT_NAME;
+    }
+
+    TUYA_CALL_ERR_LOG(_event_node_dispatch(event, data));
 
     return rt;
 }
@@ -432,14 +610,17 @@ OPERATE_RET tal_event_subscribe(const char *name, const char *desc, const EVENT_
     memcpy(subscribe.desc, desc, strlen(desc));
     subscribe.desc[strlen(desc)] = '\0';
 
-    EVENT_NODE_T *event = _event_node_get(name);
+    // lookup and free list change must be atomic, or the event created
+    // between them will miss the free subscriber
+    tal_mutex_lock(g_event_manager.mutex);
+    EVENT_NODE_T *event = _event_node_find(name, mm_str_hash(name));
     if (!event) {
         // if not found the event, add to the free list
-        tal_mutex_lock(g_event_manager.mutex);
         TUYA_CALL_ERR_LOG(_event_node_add_free_subscribe(&subscribe));
         tal_mutex_unlock(g_event_manager.mutex);
     } else {
-        // if found the event, add to the subscribe list
+        tal_mutex_unlock(g_event_manager.mutex);
+        // if found the event, add to the subscribe set
         tal_mutex_lock(event->mutex);
         TUYA_CALL_ERR_LOG(_event_node_add_subscribe(event, &subscribe));
         tal_mutex_unlock(event->mutex);
@@ -458,6 +639,10 @@ OPERATE_RET tal_event_subscribe(const char *name, const char *desc, const EVENT_
  * operation. If the event is found, it is removed from the subscribe list. If
  * the event is not found, the subscription is removed from the free list.
  *
+ * Publishers dispatch from the subscriber set they took a reference of, the
+ * unsubscribe only replaces the current set. A publish that is already
+ * dispatching can therefore still call cb after this function returns.
+ *
  * @param[in] name The name of the event to unsubscribe from.
  * @param[in] desc The description of the event to unsubscribe from.
  * @param[in] cb The callback function to be unregistered.
@@ -487,14 +672,17 @@ OPERATE_RET tal_event_unsubscribe(const char *name, const char *desc, EVENT_SUBS
     memcpy(subscribe.desc, desc, strlen(desc));
     subscribe.desc[strlen(desc)] = '\0';
 
-    EVENT_NODE_T *event = _event_node_get(name);
+    // lookup and free list change must be atomic, or the event created
+    // between them will miss the free subscriber
+    tal_mutex_lock(g_event_manager.mutex);
+    EVENT_NODE_T *event = _event_node_find(name, mm_str_hash(name));
     if (!event) {
         // if not found the event, del from the free list
-        tal_mutex_lock(g_event_manager.mutex);
         TUYA_CALL_ERR_LOG(_event_node_del_free_subscribe(&subscribe));
         tal_mutex_unlock(g_event_manager.mutex);
     } else {
-        // if found the event, del from the subscribe list
+        tal_mutex_unlock(g_event_manager.mutex);
+        // if found the event, del from the subscribe set
         tal_mutex_lock(event->mutex);
         TUYA_CALL_ERR_LOG(_event_node_del_subscribe(event, &subscribe));
         tal_mutex_unlock(event->mutex);
@@ -12,6 +12,13 @@
 #define STACK_SIZE_TIMERQ (4 * 1024)
 #endif
 
+#if defined(ENABLE_SW_TIMER_HEAP) && (ENABLE_SW_TIMER_HEAP == 1)
+#define TIMER_HEAP_INIT_CAP 16
+#endif
+
+// expired timers collected under one lock and dispatched together
+#define TIMER_DISPATCH_BATCH 8
+
 typedef struct {
     LIST_HEAD node;
 
@@ -23,8 +30,20 @@ typedef struct {
     BOOL_T is_running;
     TIMER_ID timer_id;
     TIMER_TYPE type;
+    TIME_MS slack;      // the timer may fire up to slack ms late to share a wakeup
+    uint8_t batch_slot; // slot in the dispatch batch + 1, 0 when not pending
+#if defined(ENABLE_SW_TIMER_HEAP) && (ENABLE_SW_TIMER_HEAP == 1)
+    uint16_t heap_idx; // position in the heap + 1, 0 when not queued
+#endif
 } TIMER_T;
 
+typedef struct {
+    TIMER_T *timer; // NULL once the timer was stopped, restarted or deleted
+    TAL_TIMER_CB cb;
+    TIMER_ID timer_id;
+    void *data;
+} TIMER_BATCH_T;
+
 typedef struct {
     LIST_HEAD list_active;
     LIST_HEAD list_standby;
@@ -36,10 +55,122 @@ typedef struct {
     THREAD_HANDLE thread;
     SEM_HANDLE sem;
     TAL_TIMER_CB last_cb; // used to debug which cb is blocked
+    TIMER_BATCH_T batch[TIMER_DISPATCH_BATCH];
+    uint32_t wakeup_cnt;
+    uint32_t dispatch_cnt;
+
+#if defined(ENABLE_SW_TIMER_HEAP) && (ENABLE_SW_TIMER_HEAP == 1)
+    // running timers ordered by expire_time, list_active is then unordered
+    TIMER_T **heap;
+    uint16_t heap_num;
+    uint16_t heap_cap;
+#endif
 } SW_TIMER_MGR_T;
 
 static SW_TIMER_MGR_T s_timer_mgr;
 
+#if defined(ENABLE_SW_TIMER_HEAP) && (ENABLE_SW_TIMER_HEAP == 1)
+static void __heap_set(uint16_t idx, TIMER_T *timer)
+{
+    s_timer_mgr.heap[idx] = timer;
+    timer->heap_idx = idx + 1;
+}
+
+static void __heap_sift_up(uint16_t idx)
+{
+    TIMER_T *timer = s_timer_mgr.heap[idx];
+
+    while (idx > 0) {
+        uint16_t parent = (idx - 1) / 2;
+        if (s_timer_mgr.heap[parent]->expire_time <= timer->expire_time) {
+            break;
+        }
+        __heap_set(idx, s_timer_mgr.heap[parent]);
+        idx = parent;
+    }
+    __heap_set(idx, timer);
+}
+
+static void __heap_sift_down(uint16_t idx)
+{
+    TIMER_T *timer = s_timer_mgr.heap[idx];
+    uint16_t num = s_timer_mgr.heap_num;
+
+    for (;;) {
+        uint32_t child = 2 * (uint32_t)idx + 1;
+        if (child >= num) {
+            break;
+        }
+        if (child + 1 < num && s_timer_mgr.heap[child + 1]->expire_time < s_timer_mgr.heap[child]->expire_time) {
+            child++;
+        }
+        if (timer->expire_time <= s_timer_mgr.heap[child]->expire_time) {
+            break;
+        }
+        __heap_set(idx, s_timer_mgr.heap[child]);
+        idx = child;
+    }
+    __heap_set(idx, timer);
+}
+
+// the heap always has room for every created timer, see __heap_reserve()
+static void __timer_attach(TIMER_T *timer)
+{
+    if (0 == timer->heap_idx) {
+        tuya_list_del(&(timer->node));
+        tuya_list_add_tail(&(timer->node), &(s_timer_mgr.list_active));
+        __heap_set(s_timer_mgr.heap_num++, timer);
+        __heap_sift_up(timer->heap_idx - 1);
+        return;
+    }
+
+    __heap_sift_up(timer->heap_idx - 1);
+    __heap_sift_down(timer->heap_idx - 1);
+}
+
+static void __timer_detach(TIMER_T *timer)
+{
+    tuya_list_del(&(timer->node));
+    if (0 == timer->heap_idx) {
+        return;
+    }
+
+    uint16_t idx = timer->heap_idx - 1;
+    TIMER_T *last = s_timer_mgr.heap[--s_timer_mgr.heap_num];
+
+    timer->heap_idx = 0;
+    if (last != timer) {
+        __heap_set(idx, last);
+        __heap_sift_up(idx);
+        __heap_sift_down(last->heap_idx - 1);
+    }
+}
+
+static TIMER_T *__timer_first(void)
+{
+    return s_timer_mgr.heap_num ? s_timer_mgr.heap[0] : NULL;
+}
+
+static OPERATE_RET __heap_reserve(uint16_t num)
+{
+    if (num <= s_timer_mgr.heap_cap) {
+        return OPRT_OK;
+    }
+
+    uint32_t cap = s_timer_mgr.heap_cap ? 2 * (uint32_t)s_timer_mgr.heap_cap : TIMER_HEAP_INIT_CAP;
+    if (cap > 0xFFFF) {
+        cap = 0xFFFF;
+    }
+    TIMER_T **heap = tal_realloc(s_timer_mgr.heap, cap * sizeof(TIMER_T *));
+    if (NULL == heap) {
+        return OPRT_MALLOC_FAILED;
+    }
+    s_timer_mgr.heap = heap;
+    s_timer_mgr.heap_cap = cap;
+
+    return OPRT_OK;
+}
+#else
 static void __timer_attach(TIMER_T *timer)
 {
     tuya_list_del(&(timer->node));
@@ -53,7 +184,8 @@ static void __timer_attach(TIMER_T *timer)
         {
             timer_tmp = tuya_list_entry(p, TIMER_T, node);
 
-            if (timer_tmp->expire_time >= timer->expire_time) {
+            // after the timers with the same expiry, so a coalesced start does not become first and wake the thread
+            if (timer_tmp->expire_time > timer->expire_time) {
                 tuya_list_add(&(timer->node), (&(timer_tmp->node))->prev);
                 break;
             }
@@ -65,6 +197,51 @@ static void __timer_attach(TIMER_T *timer)
     }
 }
 
+static void __timer_detach(TIMER_T *timer)
+{
+    tuya_list_del(&(timer->node));
+}
+
+static TIMER_T *__timer_first(void)
+{
+    if (tuya_list_empty(&(s_timer_mgr.list_active))) {
+        return NULL;
+    }
+
+    return tuya_list_entry(s_timer_mgr.list_active.next, TIMER_T, node);
+}
+#endif
+
+/*
+ * Round expire_time up to the coarsest power-of-two boundary that is still
+ * within the slack window, so timers with slack line up on the same ms and
+ * are dispatched in one wakeup.
+ */
+static uint64_t __timer_apply_slack(uint64_t expire_time, TIME_MS slack)
+{
+    uint64_t limit = expire_time + slack;
+    uint64_t mask = expire_time ^ limit;
+    uint64_t bit = 1;
+
+    if (slack < 2 || 0 == mask) {
+        return expire_time;
+    }
+    while (mask >>= 1) {
+        bit <<= 1;
+    }
+
+    return limit & ~(bit - 1);
+}
+
+// drop a pending dispatch of the timer, the caller holds the mutex
+static void __timer_unbatch(TIMER_T *timer)
+{
+    if (timer->batch_slot) {
+        s_timer_mgr.batch[timer->batch_slot - 1].timer = NULL;
+        timer->batch_slot = 0;
+    }
+}
+
 static void __timer_dump(void)
 {
     struct tuya_list_head *p = NULL;
@@ -85,6 +262,7 @@ static void __timer_dump(void)
 
     tal_mutex_lock(s_timer_mgr.mutex);
 
+    PR_NOTICE("wakeups:%u dispatched:%u", s_timer_mgr.wakeup_cnt, s_timer_mgr.dispatch_cnt);
     PR_NOTICE("running timers count:%d", s_timer_mgr.running_cnt);
     tuya_list_for_each(p, &(s_timer_mgr.list_active))
     {
@@ -122,51 +300,78 @@ static void __timer_dispatch(SYS_TIME_T *next_expired)
     TIME_MS nowMsTime = 0;
     uint64_t nowMS = 0;
     TIMER_T *timer = NULL;
-    TAL_TIMER_CB timer_cb = NULL;
-    struct tuya_list_head *p = NULL;
+    TIMER_BATCH_T *item = NULL;
+    uint8_t i, num;
+
+    s_timer_mgr.wakeup_cnt++;
 
-    *next_expired = SEM_WAIT_FOREVER;
+    for (;;) {
+        *next_expired = SEM_WAIT_FOREVER;
 
-    do {
         tal_time_get_system_time(&nowSecTime, &nowMsTime);
         nowMS = (uint64_t)nowSecTime * 1000 + (uint64_t)nowMsTime;
 
         tal_mutex_lock(s_timer_mgr.mutex);
 
-        timer_cb = NULL;
-        tuya_list_for_each(p, &(s_timer_mgr.list_active))
-        {
-            timer = tuya_list_entry(p, TIMER_T, node);
-
+        for (num = 0; num < TIMER_DISPATCH_BATCH; num++) {
+            timer = __timer_first();
+            if (NULL == timer) {
+                break;
+            }
             if (timer->expire_time > nowMS) {
-                p = &(s_timer_mgr.list_active);
                 *next_expired = timer->expire_time - nowMS;
-            } else {
-                timer_cb = timer->cb;
-
-                if (TAL_TIMER_ONCE == timer->type) {
-                    timer->is_running = FALSE;
-                    s_timer_mgr.running_cnt--;
-                    tuya_list_del(&(timer->node));
-                    tuya_list_add_tail(&(timer->node), &(s_timer_mgr.list_standby));
-                } else {
-                    timer->expire_time = nowMS + timer->interval;
-                    __timer_attach(timer);
-                }
+                break;
+            }
+            if (timer->batch_slot) {
+                // a zero interval cycle timer is due again, leave it to the next pass
+                break;
             }
 
-            break;
+            item = &s_timer_mgr.batch[num];
+            item->timer = timer;
+            item->cb = timer->cb;
+            item->timer_id = timer->timer_id;
+            item->data = timer->data;
+            timer->batch_slot = num + 1;
+
+            if (TAL_TIMER_ONCE == timer->type) {
+                timer->is_running = FALSE;
+                s_timer_mgr.running_cnt--;
+                __timer_detach(timer);
+                tuya_list_add_tail(&(timer->node), &(s_timer_mgr.list_standby));
+            } else {
+                timer->expire_time = __timer_apply_slack(nowMS + timer->interval, timer->slack);
+                __timer_attach(timer);
+            }
         }
 
         tal_mutex_unlock(s_timer_mgr.mutex);
 
-        if (timer_cb) {
-            s_timer_mgr.last_cb = timer_cb;
-            timer_cb(timer->timer_id, timer->data);
-            timer_cb = NULL;
+        if (0 == num) {
+            break;
+        }
+
+        // a callback may stop or delete a timer later in the batch, its slot is cleared then
+        for (i = 0; i < num; i++) {
+            item = &s_timer_mgr.batch[i];
+            if (NULL == item->timer) {
+                continue;
+            }
+            s_timer_mgr.last_cb = item->cb;
+            item->cb(item->timer_id, item->data);
             s_timer_mgr.last_cb = NULL;
         }
-    } while (p != &(s_timer_mgr.list_active));
+        s_timer_mgr.dispatch_cnt += num;
+
+        tal_mutex_lock(s_timer_mgr.mutex);
+        for (i = 0; i < num; i++) {
+            if (s_timer_mgr.batch[i].timer) {
+                s_timer_mgr.batch[i].timer->batch_slot = 0;
+                s_timer_mgr.batch[i].timer = NULL;
+            }
+        }
+        tal_mutex_unlock(s_timer_mgr.mutex);
+    }
 }
 
 static void __timer_thread_cb(void *data)
@@ -242,6 +447,13 @@ OPERATE_RET tal_sw_timer_create(TAL_TIMER_CB func, void *arg, TIMER_ID *timer_id
     timer->timer_id = (TIMER_ID)timer;
 
     tal_mutex_lock(s_timer_mgr.mutex);
+#if defined(ENABLE_SW_TIMER_HEAP) && (ENABLE_SW_TIMER_HEAP == 1)
+    if (OPRT_OK != __heap_reserve(s_timer_mgr.total_cnt + 1)) {
+        tal_mutex_unlock(s_timer_mgr.mutex);
+        tal_free(timer);
+        return OPRT_MALLOC_FAILED;
+    }
+#endif
     s_timer_mgr.total_cnt++;
     tuya_list_add_tail(&(timer->node), &(s_timer_mgr.list_standby));
     tal_mutex_unlock(s_timer_mgr.mutex);
@@ -270,13 +482,13 @@ OPERATE_RET tal_sw_timer_delete(TIMER_ID timer_id)
     TIMER_T *timer = (TIMER_T *)timer_id;
 
     tal_mutex_lock(s_timer_mgr.mutex);
-    tuya_list_del(&(timer->node));
+    __timer_unbatch(timer);
+    __timer_detach(timer);
     s_timer_mgr.total_cnt--;
     if (timer->is_running) {
         s_timer_mgr.running_cnt--;
     }
     tal_mutex_unlock(s_timer_mgr.mutex);
-    tal_semaphore_post(s_timer_mgr.sem);
     tal_free(timer);
 
     return OPRT_OK;
@@ -301,15 +513,15 @@ OPERATE_RET tal_sw_timer_stop(TIMER_ID timer_id)
     TIMER_T *timer = (TIMER_T *)timer_id;
 
     tal_mutex_lock(s_timer_mgr.mutex);
+    __timer_unbatch(timer);
     if (timer->is_running) {
         timer->is_running = FALSE;
 
         s_timer_mgr.running_cnt--;
-        tuya_list_del(&(timer->node));
+        __timer_detach(timer);
         tuya_list_add_tail(&(timer->node), &(s_timer_mgr.list_standby));
     }
     tal_mutex_unlock(s_timer_mgr.mutex);
-    tal_semaphore_post(s_timer_mgr.sem);
 
     return OPRT_OK;
 }
@@ -376,32 +588,16 @@ OPERATE_RET tal_sw_timer_remain_time_get(TIMER_ID timer_id, uint32_t *remain_tim
     return OPRT_OK;
 }
 
-/**
- * @brief Start the software timer
- *
- * @param[in] timerID: timer id
- * @param[in] timeCycle: timer running cycle
- * @param[in] timer_type: timer type
- *
- * @note This API is used for starting the software timer
- *
- * @return OPRT_OK on success. Others on error, please refer to
- * tuya_error_code.h
- */
-OPERATE_RET tal_sw_timer_start(TIMER_ID timer_id, TIME_MS time_ms, TIMER_TYPE timer_type)
+static OPERATE_RET __timer_start(TIMER_T *timer, TIME_MS time_ms, TIME_MS slack_ms, TIMER_TYPE timer_type)
 {
-    if (NULL == timer_id) {
-        return OPRT_INVALID_PARM;
-    }
-
-    TIMER_T *timer = (TIMER_T *)timer_id;
-
+    BOOL_T is_first = FALSE;
     TIME_S secTime = 0;
     TIME_MS msTime = 0;
     tal_time_get_system_time(&secTime, &msTime);
 
     tal_mutex_lock(s_timer_mgr.mutex);
 
+    __timer_unbatch(timer);
     if (!timer->is_running) {
         timer->is_running = TRUE;
         s_timer_mgr.running_cnt++;
@@ -412,15 +608,69 @@ OPERATE_RET tal_sw_timer_start(TIMER_ID timer_id, TIME_MS time_ms, TIMER_TYPE ti
     }
 
     timer->type = timer_type;
-    timer->expire_time = (uint64_t)secTime * 1000 + (uint64_t)msTime + timer->interval;
+    timer->slack = slack_ms;
+    timer->expire_time =
+        __timer_apply_slack((uint64_t)secTime * 1000 + (uint64_t)msTime + timer->interval, timer->slack);
     __timer_attach(timer);
+    is_first = (__timer_first() == timer);
 
     tal_mutex_unlock(s_timer_mgr.mutex);
-    tal_semaphore_post(s_timer_mgr.sem);
+
+    // the timer thread only needs to recompute its wait when the earliest expiry moved
+    if (is_first) {
+        tal_semaphore_post(s_timer_mgr.sem);
+    }
 
     return OPRT_OK;
 }
 
+/**
+ * @brief Start the software timer
+ *
+ * @param[in] timerID: timer id
+ * @param[in] timeCycle: timer running cycle
+ * @param[in] timer_type: timer type
+ *
+ * @note This API is used for starting the software timer, the slack set by
+ * tal_sw_timer_start_with_slack is kept
+ *
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_sw_timer_start(TIMER_ID timer_id, TIME_MS time_ms, TIMER_TYPE timer_type)
+{
+    if (NULL == timer_id) {
+        return OPRT_INVALID_PARM;
+    }
+
+    TIMER_T *timer = (TIMER_T *)timer_id;
+
+    return __timer_start(timer, time_ms, timer->slack, timer_type);
+}
+
+/**
+ * @brief Start the software timer with a slack
+ *
+ * @param[in] timer_id: timer id
+ * @param[in] time_ms: timer running cycle
+ * @param[in] slack_ms: how late the timer may fire, 0 for exact expiry
+ * @param[in] timer_type: timer type
+ *
+ * @note Timers with slack are aligned so that those due close together fire
+ * in one wakeup of the timer thread, which saves power on idle devices.
+ *
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_sw_timer_start_with_slack(TIMER_ID timer_id, TIME_MS time_ms, TIME_MS slack_ms, TIMER_TYPE timer_type)
+{
+    if (NULL == timer_id) {
+        return OPRT_INVALID_PARM;
+    }
+
+    return __timer_start((TIMER_T *)timer_id, time_ms, slack_ms, timer_type);
+}
+
 /**
  * @brief Trigger the software timer
  *
@@ -442,8 +692,7 @@ OPERATE_RET tal_sw_timer_trigger(TIMER_ID timer_id)
     tal_mutex_lock(s_timer_mgr.mutex);
     timer->expire_time = 0;
     if (timer->is_running) {
-        tuya_list_del(&(timer->node));
-        tuya_list_add(&(timer->node), &(s_timer_mgr.list_active));
+        __timer_attach(timer);
     }
     tal_mutex_unlock(s_timer_mgr.mutex);
     tal_semaphore_post(s_timer_mgr.sem);
@@ -49,6 +49,14 @@
 #define STACK_SIZE_MSG_QUEUE (4 * 1024)
 #endif
 
+#ifndef WORKER_NUM_WORK_QUEUE
+#define WORKER_NUM_WORK_QUEUE 1
+#endif
+
+#ifndef WORKER_NUM_MSG_QUEUE
+#define WORKER_NUM_MSG_QUEUE 1
+#endif
+
 static WORKQUEUE_HANDLE wq_system;
 static WORKQUEUE_HANDLE wq_highpri;
 
@@ -73,7 +81,8 @@ OPERATE_RET tal_workq_init(void)
     thread_cfg.stackDepth += 1024;
 #endif
     thread_cfg.thrdname = "wq_system";
-    TUYA_CALL_ERR_GOTO(tal_workqueue_create(MAX_NODE_NUM_WORK_QUEUE, &thread_cfg, &wq_system), ERR_EXIT);
+    TUYA_CALL_ERR_GOTO(
+        tal_workqueue_create_pool(MAX_NODE_NUM_WORK_QUEUE, WORKER_NUM_WORK_QUEUE, &thread_cfg, &wq_system), ERR_EXIT);
 
     thread_cfg.priority = THREAD_PRIO_1;
     thread_cfg.stackDepth = STACK_SIZE_MSG_QUEUE;
@@ -81,7 +90,8 @@ OPERATE_RET tal_workq_init(void)
     thread_cfg.stackDepth += 1024;
 #endif
     thread_cfg.thrdname = "wq_highpri";
-    TUYA_CALL_ERR_GOTO(tal_workqueue_create(MAX_NODE_NUM_MSG_QUEUE, &thread_cfg, &wq_highpri), ERR_EXIT);
+    TUYA_CALL_ERR_GOTO(
+        tal_workqueue_create_pool(MAX_NODE_NUM_MSG_QUEUE, WORKER_NUM_MSG_QUEUE, &thread_cfg, &wq_highpri), ERR_EXIT);
 
     return OPRT_OK;
 
@@ -151,6 +161,45 @@ OPERATE_RET tal_workq_schedule_instant(WORKQ_SERVICE_E service, WORKQUEUE_CB cb,
     return tal_workqueue_schedule_instant(tal_workq_get_handle(service), cb, data);
 }
 
+/**
+ * @brief put work task in workqueue with a priority class and a deadline
+ *
+ * @param[in] service the workqueue service
+ * @param[in] prio the priority class, higher classes are dequeued first
+ * @param[in] deadline_ms once this many ms have passed the work runs ahead of
+ * all classes, 0 for no deadline
+ * @param[in] cb the work callback
+ * @param[in] data the work data
+ *
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_workq_schedule_prio(WORKQ_SERVICE_E service, WORK_PRIO_E prio, TIME_MS deadline_ms, WORKQUEUE_CB cb,
+                                    void *data)
+{
+    return tal_workqueue_schedule_prio(tal_workq_get_handle(service), prio, deadline_ms, cb, data);
+}
+
+/**
+ * @brief put work task in workqueue, work with the same key runs serially and
+ * in order within its priority class, even when the service has several
+ * workers
+ *
+ * @param[in] service the workqueue service
+ * @param[in] prio the priority class, higher classes are dequeued first
+ * @param[in] key the serialization key
+ * @param[in] cb the work callback
+ * @param[in] data the work data
+ *
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_workq_schedule_key(WORKQ_SERVICE_E service, WORK_PRIO_E prio, uint32_t key, WORKQUEUE_CB cb,
+                                   void *data)
+{
+    return tal_workqueue_schedule_key(tal_workq_get_handle(service), prio, key, cb, data);
+}
+
 /**
  * @brief cancel work task in workqueue
  *
@@ -180,6 +229,20 @@ uint16_t tal_workq_get_num(WORKQ_SERVICE_E service)
     return tal_workqueue_get_num(tal_workq_get_handle(service));
 }
 
+/**
+ * @brief get the scheduling statistics of the workqueue service
+ *
+ * @param[in] service the workqueue service
+ * @param[out] stats the statistics, see WORKQUEUE_STATS_T
+ *
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_workq_get_stats(WORKQ_SERVICE_E service, WORKQUEUE_STATS_T *stats)
+{
+    return tal_workqueue_get_stats(tal_workq_get_handle(service), stats);
+}
+
 // used for debug
 static BOOL_T _dump_cb(WORK_ITEM_T *item, void *ctx)
 {
@@ -189,7 +252,14 @@ static BOOL_T _dump_cb(WORK_ITEM_T *item, void *ctx)
 
 void tal_workq_dump(WORKQ_SERVICE_E service)
 {
+    WORKQUEUE_STATS_T stats;
+
     PR_NOTICE("---------workq-%d dump begin---------", service);
+    if (OPRT_OK == tal_workq_get_stats(service, &stats)) {
+        PR_NOTICE("scheduled:%u executed:%u deadline_miss:%u", stats.scheduled, stats.executed, stats.deadline_miss);
+        PR_NOTICE("delay p50:%u p90:%u p99:%u max:%u exec_max:%u", stats.delay_p50, stats.delay_p90, stats.delay_p99,
+                  stats.delay_max, stats.exec_max);
+    }
     tal_workqueue_traverse(tal_workq_get_handle(service), _dump_cb, NULL);
     tal_thread_diagnose(tal_workqueue_get_thread(tal_workq_get_handle(service)));
     PR_NOTICE("---------workq-%d dump end---------", service);
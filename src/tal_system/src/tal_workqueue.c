@@ -31,53 +31,378 @@
  *
  */
 
-#include "tuya_queue.h"
+#include "tuya_list.h"
 #include "tal_log.h"
 #include "tal_memory.h"
 #include "tal_thread.h"
 #include "tal_system.h"
 #include "tal_semaphore.h"
+#include "tal_mutex.h"
 #include "tal_workqueue.h"
 #include "tal_sw_timer.h"
 
+// queue delay histogram, bucket n counts delays below 2^n ms
+#define WORK_DELAY_BUCKET_NUM 16
+
+// work nodes kept allocated per worker, the rest up to queue_len are allocated on demand
+#ifndef PREALLOC_NODE_NUM_WORK_QUEUE
+#define PREALLOC_NODE_NUM_WORK_QUEUE 8
+#endif
+
+typedef struct {
+    LIST_HEAD node;
+    LIST_HEAD dl_node; // in deadline_list when the work has a deadline
+    WORK_ITEM_T work;
+    uint8_t prio;
+    BOOL_T pinned; // keyed work, only its own worker may run it
+    SYS_TIME_T enqueue_time;
+    SYS_TIME_T deadline; // 0 when the work has no deadline
+} WORK_NODE_T;
+
+typedef struct {
+    uint32_t scheduled;
+    uint32_t executed;
+    uint32_t deadline_miss;
+    uint32_t delay_max;
+    uint32_t exec_max;
+    uint32_t delay_hist[WORK_DELAY_BUCKET_NUM];
+} WORK_STATS_T;
+
 typedef struct {
-    TUYA_QUEUE_HANDLE queue;
     THREAD_HANDLE thread;
     SEM_HANDLE sem;
+    MUTEX_HANDLE mutex;
+    LIST_HEAD list[WORK_PRIO_NUM]; // FIFO per priority class
+    LIST_HEAD deadline_list;       // work with a deadline, earliest first
+    LIST_HEAD free_list;
+    WORK_NODE_T *nodes; // the preallocated nodes
+    uint16_t num;
+    BOOL_T busy;
     WORKQUEUE_CB last_cb; // used to debug which cb is blocked
+    WORK_STATS_T stats;   // written by this worker only
+    struct tal_workqueue *workqueue;
+} WORKER_T;
+
+/*
+ * A workqueue is served by one or more workers. Every worker owns a bounded
+ * set of work nodes kept in one FIFO list per priority class, the first
+ * PREALLOC_NODE_NUM_WORK_QUEUE of them preallocated. The owner runs
+ * the highest class first, except that work whose deadline has passed runs
+ * before anything else, earliest deadline first. With several workers, work
+ * goes to an idle worker (or round robin) and a worker with nothing to do
+ * steals from the others, so one slow callback no longer blocks the rest.
+ * Keyed work is pinned to the worker selected by its key and never stolen,
+ * which keeps it serial and ordered per key.
+ */
+typedef struct tal_workqueue {
+    WORKER_T *workers;
+    uint8_t worker_num;
+    uint8_t next_worker;
+    uint16_t node_num;     // nodes per worker
+    uint16_t prealloc_num; // preallocated nodes per worker
+    WORKQUEUE_TRACE_CB trace_cb;
 } TAL_WORKQUEUE_T;
 
+static BOOL_T __worker_node_pooled(WORKER_T *worker, WORK_NODE_T *node)
+{
+    return (node >= worker->nodes && node < worker->nodes + worker->workqueue->prealloc_num) ? TRUE : FALSE;
+}
+
+static WORK_NODE_T *__worker_pick(WORKER_T *worker, SYS_TIME_T now, BOOL_T steal)
+{
+    int prio;
+    struct tuya_list_head *p = NULL;
+    WORK_NODE_T *node = NULL;
+
+    // the deadline list is sorted, only the late head is looked at
+    tuya_list_for_each(p, &(worker->deadline_list))
+    {
+        node = tuya_list_entry(p, WORK_NODE_T, dl_node);
+        if (node->deadline > now) {
+            break;
+        }
+        if (!(steal && node->pinned)) {
+            return node;
+        }
+    }
+
+    for (prio = WORK_PRIO_NUM - 1; prio >= 0; prio--) {
+        tuya_list_for_each(p, &(worker->list[prio]))
+        {
+            node = tuya_list_entry(p, WORK_NODE_T, node);
+            if (!(steal && node->pinned)) {
+                return node;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+static BOOL_T __worker_take(WORKER_T *worker, SYS_TIME_T now, BOOL_T steal, WORK_NODE_T *out)
+{
+    WORK_NODE_T *node = NULL;
+    BOOL_T pooled = TRUE;
+
+    tal_mutex_lock(worker->mutex);
+    if (worker->num) {
+        node = __worker_pick(worker, now, steal);
+    }
+    if (node) {
+        *out = *node;
+        tuya_list_del(&(node->node));
+        if (node->deadline) {
+            tuya_list_del(&(node->dl_node));
+        }
+        pooled = __worker_node_pooled(worker, node);
+        if (pooled) {
+            tuya_list_add(&(node->node), &(worker->free_list));
+        }
+        worker->num--;
+    }
+    tal_mutex_unlock(worker->mutex);
+
+    if (!pooled) {
+        tal_free(node);
+    }
+
+    return node ? TRUE : FALSE;
+}
+
+static BOOL_T __work_take(WORKER_T *self, WORK_NODE_T *out)
+{
+    TAL_WORKQUEUE_T *workqueue = self->workqueue;
+    uint8_t idx = self - workqueue->workers;
+    SYS_TIME_T now = tal_system_get_millisecond();
+    uint8_t i;
+
+    if (__worker_take(self, now, FALSE, out)) {
+        return TRUE;
+    }
+
+    for (i = 1; i < workqueue->worker_num; i++) {
+        if (__worker_take(&workqueue->workers[(idx + i) % workqueue->worker_num], now, TRUE, out)) {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+static void __work_stats_update(WORK_STATS_T *stats, WORK_NODE_T *node, SYS_TIME_T start, SYS_TIME_T finish)
+{
+    uint32_t delay = (uint32_t)(start - node->enqueue_time);
+    uint32_t exec = (uint32_t)(finish - start);
+    uint8_t bucket = 0;
+
+    while (bucket < WORK_DELAY_BUCKET_NUM - 1 && delay >= (1u << bucket)) {
+        bucket++;
+    }
+    stats->delay_hist[bucket]++;
+    stats->executed++;
+    if (delay > stats->delay_max) {
+        stats->delay_max = delay;
+    }
+    if (exec > stats->exec_max) {
+        stats->exec_max = exec;
+    }
+    if (node->deadline && start > node->deadline) {
+        stats->deadline_miss++;
+    }
+}
+
 static void __work_thread_cb(void *data)
 {
     OPERATE_RET op_ret = OPRT_OK;
-    TAL_WORKQUEUE_T *workqueue = (TAL_WORKQUEUE_T *)data;
-    WORK_ITEM_T work_item = {0};
+    WORKER_T *worker = (WORKER_T *)data;
+    WORK_NODE_T work_node;
+    SYS_TIME_T start, finish;
 
-    while (THREAD_STATE_RUNNING == tal_thread_get_state(workqueue->thread)) {
-        op_ret = tal_semaphore_wait(workqueue->sem, SEM_WAIT_FOREVER);
+    while (THREAD_STATE_RUNNING == tal_thread_get_state(worker->thread)) {
+        op_ret = tal_semaphore_wait(worker->sem, SEM_WAIT_FOREVER);
         if (OPRT_OK != op_ret) {
             tal_system_sleep(10);
             continue;
         }
 
-        op_ret = tuya_queue_output(workqueue->queue, &work_item);
-        if (OPRT_OK != op_ret) {
-            tal_system_sleep(10);
-            continue;
+        // the semaphore is only a wakeup hint, drain everything this worker can take
+        while (__work_take(worker, &work_node)) {
+            if (NULL == work_node.work.cb) {
+                continue;
+            }
+            worker->busy = TRUE;
+            worker->last_cb = work_node.work.cb;
+            start = tal_system_get_millisecond();
+            work_node.work.cb(work_node.work.data);
+            finish = tal_system_get_millisecond();
+            worker->last_cb = NULL;
+            worker->busy = FALSE;
+
+            __work_stats_update(&worker->stats, &work_node, start, finish);
+            if (worker->workqueue->trace_cb) {
+                worker->workqueue->trace_cb(&work_node.work, work_node.enqueue_time, start, finish);
+            }
+        }
+    }
+}
+
+static OPERATE_RET __worker_push(WORKER_T *worker, const WORK_ITEM_T *work, WORK_PRIO_E prio, TIME_MS deadline_ms,
+                                 BOOL_T pinned, BOOL_T instant)
+{
+    OPERATE_RET op_ret = OPRT_OK;
+    WORK_NODE_T *node = NULL;
+    struct tuya_list_head *p = NULL;
+
+    tal_mutex_lock(worker->mutex);
+    if (worker->num >= worker->workqueue->node_num) {
+        op_ret = OPRT_EXCEED_UPPER_LIMIT;
+    } else if (!tuya_list_empty(&(worker->free_list))) {
+        node = tuya_list_entry(worker->free_list.next, WORK_NODE_T, node);
+        tuya_list_del(&(node->node));
+    } else {
+        node = (WORK_NODE_T *)tal_malloc(sizeof(WORK_NODE_T));
+        if (NULL == node) {
+            op_ret = OPRT_MALLOC_FAILED;
+        }
+    }
+    if (node) {
+        node->work = *work;
+        node->prio = prio;
+        node->pinned = pinned;
+        node->enqueue_time = tal_system_get_millisecond();
+        node->deadline = deadline_ms ? node->enqueue_time + deadline_ms : 0;
+        if (instant) {
+            tuya_list_add(&(node->node), &(worker->list[prio]));
+        } else {
+            tuya_list_add_tail(&(node->node), &(worker->list[prio]));
+        }
+        if (node->deadline) {
+            // deadlines are mostly scheduled in order, so search from the latest one
+            for (p = worker->deadline_list.prev; p != &(worker->deadline_list); p = p->prev) {
+                if (tuya_list_entry(p, WORK_NODE_T, dl_node)->deadline <= node->deadline) {
+                    break;
+                }
+            }
+            tuya_list_add(&(node->dl_node), p);
         }
+        worker->num++;
+        worker->stats.scheduled++;
+    }
+    tal_mutex_unlock(worker->mutex);
+
+    return op_ret;
+}
 
-        if (work_item.cb) {
-            workqueue->last_cb = work_item.cb;
-            work_item.cb(work_item.data);
-            workqueue->last_cb = NULL;
+static void __worker_wake_idle(TAL_WORKQUEUE_T *workqueue, WORKER_T *except)
+{
+    uint8_t i;
+
+    for (i = 0; i < workqueue->worker_num; i++) {
+        WORKER_T *worker = &workqueue->workers[i];
+        if (worker != except && !worker->busy) {
+            tal_semaphore_post(worker->sem);
+            return;
         }
     }
 }
 
-static BOOL_T __work_cancel_traverse(void *item, void *ctx)
+static OPERATE_RET __work_schedule(TAL_WORKQUEUE_T *workqueue, const WORK_ITEM_T *work, WORK_PRIO_E prio,
+                                   TIME_MS deadline_ms, BOOL_T instant)
+{
+    uint8_t start = workqueue->next_worker++ % workqueue->worker_num;
+    uint8_t i;
+    WORKER_T *worker = NULL;
+
+    // prefer an idle worker, fall back to any worker with room
+    for (i = 0; i < workqueue->worker_num; i++) {
+        worker = &workqueue->workers[(start + i) % workqueue->worker_num];
+        if (!worker->busy && OPRT_OK == __worker_push(worker, work, prio, deadline_ms, FALSE, instant)) {
+            return tal_semaphore_post(worker->sem);
+        }
+    }
+    for (i = 0; i < workqueue->worker_num; i++) {
+        worker = &workqueue->workers[(start + i) % workqueue->worker_num];
+        if (OPRT_OK == __worker_push(worker, work, prio, deadline_ms, FALSE, instant)) {
+            tal_semaphore_post(worker->sem);
+            // the owner is busy, let an idle worker steal it
+            __worker_wake_idle(workqueue, worker);
+            return OPRT_OK;
+        }
+    }
+
+    return OPRT_EXCEED_UPPER_LIMIT;
+}
+
+static void __work_traverse(TAL_WORKQUEUE_T *workqueue, WORKQUEUE_TRAVERSE_CB cb, void *ctx)
+{
+    uint8_t i;
+    int prio;
+    struct tuya_list_head *p = NULL;
+    BOOL_T go_on = TRUE;
+
+    for (i = 0; i < workqueue->worker_num && go_on; i++) {
+        WORKER_T *worker = &workqueue->workers[i];
+
+        tal_mutex_lock(worker->mutex);
+        for (prio = WORK_PRIO_NUM - 1; prio >= 0 && go_on; prio--) {
+            tuya_list_for_each(p, &(worker->list[prio]))
+            {
+                go_on = cb(&(tuya_list_entry(p, WORK_NODE_T, node)->work), ctx);
+                if (!go_on) {
+                    break;
+                }
+            }
+        }
+        tal_mutex_unlock(worker->mutex);
+    }
+}
+
+static void __workqueue_free(TAL_WORKQUEUE_T *workqueue)
+{
+    uint8_t i;
+    int prio;
+    uint32_t count = 1;
+    struct tuya_list_head *p = NULL;
+    struct tuya_list_head *n = NULL;
+
+    for (i = 0; i < workqueue->worker_num; i++) {
+        WORKER_T *worker = &workqueue->workers[i];
+
+        if (worker->thread) {
+            tal_thread_delete(worker->thread);
+            tal_semaphore_post(worker->sem);
+            while (THREAD_STATE_DELETE != tal_thread_get_state(worker->thread)) {
+                tal_system_sleep(10);
+                if ((count++) % 500 == 0) {
+                    PR_NOTICE("%p still running", worker->thread);
+                }
+            }
+        }
+        if (worker->sem) {
+            tal_semaphore_release(worker->sem);
+        }
+        if (worker->mutex) {
+            tal_mutex_release(worker->mutex);
+        }
+        for (prio = 0; prio < WORK_PRIO_NUM && worker->workqueue; prio++) {
+            tuya_list_for_each_safe(p, n, &(worker->list[prio]))
+            {
+                WORK_NODE_T *node = tuya_list_entry(p, WORK_NODE_T, node);
+                if (!__worker_node_pooled(worker, node)) {
+                    tal_free(node);
+                }
+            }
+        }
+        tal_free(worker->nodes);
+    }
+
+    tal_free(workqueue->workers);
+    tal_free(workqueue);
+}
+
+static BOOL_T __work_cancel_traverse(WORK_ITEM_T *src, void *ctx)
 {
     BOOL_T is_same = FALSE;
-    WORK_ITEM_T *src = (WORK_ITEM_T *)item;
     WORK_ITEM_T *dst = (WORK_ITEM_T *)ctx;
 
     if (src && dst) {
@@ -110,10 +435,35 @@ static BOOL_T __work_cancel_traverse(void *item, void *ctx)
  */
 OPERATE_RET tal_workqueue_create(const uint16_t queue_len, THREAD_CFG_T *thread_cfg, WORKQUEUE_HANDLE *handle)
 {
-    OPERATE_RET op_ret = OPRT_OK;
+    return tal_workqueue_create_pool(queue_len, 1, thread_cfg, handle);
+}
+
+/**
+ * @brief create a workqueue served by a pool of worker threads
+ *
+ * @param[in] queue_len the maximum number of items that the workqueue can
+ * contain
+ * @param[in] worker_num the number of worker threads, 1 behaves like
+ * tal_workqueue_create
+ * @param[in] thread_cfg thread param, shared by all workers
+ * @param[out] handle the workqueue handle
+ *
+ * @note work scheduled on a pool may run concurrently and out of order, use
+ * tal_workqueue_schedule_key for work that must stay serial
+ *
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_workqueue_create_pool(const uint16_t queue_len, const uint8_t worker_num, THREAD_CFG_T *thread_cfg,
+                                      WORKQUEUE_HANDLE *handle)
+{
+    OPERATE_RET rt = OPRT_OK;
     TAL_WORKQUEUE_T *workqueue = NULL;
+    uint8_t i;
+    uint16_t j;
+    int prio;
 
-    if ((0 == queue_len) || (NULL == thread_cfg) || (NULL == handle)) {
+    if ((0 == queue_len) || (0 == worker_num) || (NULL == thread_cfg) || (NULL == handle)) {
         return OPRT_INVALID_PARM;
     }
 
@@ -121,30 +471,53 @@ OPERATE_RET tal_workqueue_create(const uint16_t queue_len, THREAD_CFG_T *thread_
     if (NULL == workqueue) {
         return OPRT_MALLOC_FAILED;
     }
-
-    op_ret = tuya_queue_create(queue_len, sizeof(WORK_ITEM_T), &workqueue->queue);
-    if (OPRT_OK != op_ret) {
+    workqueue->worker_num = worker_num;
+    workqueue->node_num = (queue_len + worker_num - 1) / worker_num;
+    workqueue->prealloc_num =
+        (PREALLOC_NODE_NUM_WORK_QUEUE < workqueue->node_num) ? PREALLOC_NODE_NUM_WORK_QUEUE : workqueue->node_num;
+    workqueue->workers = (WORKER_T *)tal_calloc(worker_num, sizeof(WORKER_T));
+    if (NULL == workqueue->workers) {
         tal_free(workqueue);
-        return op_ret;
+        return OPRT_MALLOC_FAILED;
     }
 
-    op_ret = tal_semaphore_create_init(&workqueue->sem, 0, queue_len);
-    if (OPRT_OK != op_ret) {
-        tuya_queue_release(workqueue->queue);
-        tal_free(workqueue);
-        return op_ret;
+    for (i = 0; i < worker_num; i++) {
+        WORKER_T *worker = &workqueue->workers[i];
+
+        worker->workqueue = workqueue;
+        for (prio = 0; prio < WORK_PRIO_NUM; prio++) {
+            INIT_LIST_HEAD(&(worker->list[prio]));
+        }
+        INIT_LIST_HEAD(&(worker->deadline_list));
+        INIT_LIST_HEAD(&(worker->free_list));
+        if (workqueue->prealloc_num) {
+            worker->nodes = (WORK_NODE_T *)tal_calloc(workqueue->prealloc_num, sizeof(WORK_NODE_T));
+            if (NULL == worker->nodes) {
+                rt = OPRT_MALLOC_FAILED;
+                goto __exit;
+            }
+        }
+        for (j = 0; j < workqueue->prealloc_num; j++) {
+            tuya_list_add_tail(&(worker->nodes[j].node), &(worker->free_list));
+        }
+        TUYA_CALL_ERR_GOTO(tal_mutex_create_init(&worker->mutex), __exit);
+        TUYA_CALL_ERR_GOTO(tal_semaphore_create_init(&worker->sem, 0, queue_len), __exit);
     }
 
-    op_ret = tal_thread_create_and_start(&workqueue->thread, NULL, NULL, __work_thread_cb, workqueue, thread_cfg);
-    if (OPRT_OK != op_ret) {
-        tal_semaphore_release(workqueue->sem);
-        tuya_queue_release(workqueue->queue);
-        tal_free(workqueue);
-    } else {
-        *handle = workqueue;
+    // start the workers only once every worker is set up, they steal from each other
+    for (i = 0; i < worker_num; i++) {
+        WORKER_T *worker = &workqueue->workers[i];
+        TUYA_CALL_ERR_GOTO(
+            tal_thread_create_and_start(&worker->thread, NULL, NULL, __work_thread_cb, worker, thread_cfg), __exit);
     }
 
-    return op_ret;
+    *handle = workqueue;
+
+    return OPRT_OK;
+
+__exit:
+    __workqueue_free(workqueue);
+    return rt;
 }
 
 /**
@@ -159,47 +532,90 @@ OPERATE_RET tal_workqueue_create(const uint16_t queue_len, THREAD_CFG_T *thread_
  */
 OPERATE_RET tal_workqueue_schedule(WORKQUEUE_HANDLE handle, WORKQUEUE_CB cb, void *data)
 {
-    OPERATE_RET op_ret = OPRT_OK;
+    if ((NULL == handle) || (NULL == cb)) {
+        return OPRT_INVALID_PARM;
+    }
+
+    WORK_ITEM_T work_item = {.cb = cb, .data = data};
+
+    return __work_schedule((TAL_WORKQUEUE_T *)handle, &work_item, WORK_PRIO_NORMAL, 0, FALSE);
+}
 
+/**
+ * @brief put work task in workqueue, instant will be dequeued first
+ *
+ * @param[in] handle the workqueue handle
+ * @param[in] cb the work callback
+ * @param[in] data the work data
+ *
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_workqueue_schedule_instant(WORKQUEUE_HANDLE handle, WORKQUEUE_CB cb, void *data)
+{
     if ((NULL == handle) || (NULL == cb)) {
         return OPRT_INVALID_PARM;
     }
 
-    TAL_WORKQUEUE_T *workqueue = (TAL_WORKQUEUE_T *)handle;
     WORK_ITEM_T work_item = {.cb = cb, .data = data};
 
-    op_ret = tuya_queue_input(workqueue->queue, &work_item);
-    if (OPRT_OK == op_ret) {
-        op_ret = tal_semaphore_post(workqueue->sem);
+    return __work_schedule((TAL_WORKQUEUE_T *)handle, &work_item, WORK_PRIO_NORMAL, 0, TRUE);
+}
+
+/**
+ * @brief put work task in workqueue with a priority class and a deadline
+ *
+ * @param[in] handle the workqueue handle
+ * @param[in] prio the priority class, higher classes are dequeued first
+ * @param[in] deadline_ms once this many ms have passed the work runs ahead of
+ * all classes, 0 for no deadline
+ * @param[in] cb the work callback
+ * @param[in] data the work data
+ *
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_workqueue_schedule_prio(WORKQUEUE_HANDLE handle, WORK_PRIO_E prio, TIME_MS deadline_ms,
+                                        WORKQUEUE_CB cb, void *data)
+{
+    if ((NULL == handle) || (NULL == cb) || (prio >= WORK_PRIO_NUM)) {
+        return OPRT_INVALID_PARM;
     }
 
-    return op_ret;
+    WORK_ITEM_T work_item = {.cb = cb, .data = data};
+
+    return __work_schedule((TAL_WORKQUEUE_T *)handle, &work_item, prio, deadline_ms, FALSE);
 }
 
 /**
- * @brief put work task in workqueue, instant will be dequeued first
+ * @brief put work task in workqueue, work with the same key runs serially and
+ * in order within its priority class
  *
  * @param[in] handle the workqueue handle
+ * @param[in] prio the priority class, higher classes are dequeued first
+ * @param[in] key the serialization key
  * @param[in] cb the work callback
  * @param[in] data the work data
  *
  * @return OPRT_OK on success. Others on error, please refer to
  * tuya_error_code.h
  */
-OPERATE_RET tal_workqueue_schedule_instant(WORKQUEUE_HANDLE handle, WORKQUEUE_CB cb, void *data)
+OPERATE_RET tal_workqueue_schedule_key(WORKQUEUE_HANDLE handle, WORK_PRIO_E prio, uint32_t key, WORKQUEUE_CB cb,
+                                       void *data)
 {
     OPERATE_RET op_ret = OPRT_OK;
 
-    if ((NULL == handle) || (NULL == cb)) {
+    if ((NULL == handle) || (NULL == cb) || (prio >= WORK_PRIO_NUM)) {
         return OPRT_INVALID_PARM;
     }
 
     TAL_WORKQUEUE_T *workqueue = (TAL_WORKQUEUE_T *)handle;
     WORK_ITEM_T work_item = {.cb = cb, .data = data};
+    WORKER_T *worker = &workqueue->workers[key % workqueue->worker_num];
 
-    op_ret = tuya_queue_input_instant(workqueue->queue, &work_item);
+    op_ret = __worker_push(worker, &work_item, prio, 0, TRUE, FALSE);
     if (OPRT_OK == op_ret) {
-        op_ret = tal_semaphore_post(workqueue->sem);
+        op_ret = tal_semaphore_post(worker->sem);
     }
 
     return op_ret;
@@ -221,10 +637,11 @@ OPERATE_RET tal_workqueue_cancel(WORKQUEUE_HANDLE handle, WORKQUEUE_CB cb, void
         return OPRT_INVALID_PARM;
     }
 
-    TAL_WORKQUEUE_T *workqueue = (TAL_WORKQUEUE_T *)handle;
     WORK_ITEM_T work_item = {.cb = cb, .data = data};
 
-    return tuya_queue_traverse(workqueue->queue, __work_cancel_traverse, &work_item);
+    __work_traverse((TAL_WORKQUEUE_T *)handle, __work_cancel_traverse, &work_item);
+
+    return OPRT_OK;
 }
 
 /**
@@ -243,8 +660,9 @@ OPERATE_RET tal_workqueue_traverse(WORKQUEUE_HANDLE handle, WORKQUEUE_TRAVERSE_C
         return OPRT_INVALID_PARM;
     }
 
-    TAL_WORKQUEUE_T *workqueue = (TAL_WORKQUEUE_T *)handle;
-    return tuya_queue_traverse(workqueue->queue, (TRAVERSE_CB)cb, ctx);
+    __work_traverse((TAL_WORKQUEUE_T *)handle, cb, ctx);
+
+    return OPRT_OK;
 }
 
 /**
@@ -261,49 +679,129 @@ uint16_t tal_workqueue_get_num(WORKQUEUE_HANDLE handle)
     }
 
     TAL_WORKQUEUE_T *workqueue = (TAL_WORKQUEUE_T *)handle;
+    uint16_t num = 0;
+    uint8_t i;
 
-    if (workqueue->last_cb) {
-        PR_NOTICE("%p:last_cb %p", workqueue->thread, workqueue->last_cb);
+    for (i = 0; i < workqueue->worker_num; i++) {
+        WORKER_T *worker = &workqueue->workers[i];
+        if (worker->last_cb) {
+            PR_NOTICE("%p:last_cb %p", worker->thread, worker->last_cb);
+        }
+        num += worker->num;
     }
 
-    return tuya_queue_get_used_num(workqueue->queue);
+    return num;
 }
 
 /**
- * @brief release the workqueue
+ * @brief get the scheduling statistics of the workqueue
  *
  * @param[in] handle the workqueue handle
+ * @param[out] stats the statistics since creation or the last reset
  *
  * @return OPRT_OK on success. Others on error, please refer to
  * tuya_error_code.h
  */
-OPERATE_RET tal_workqueue_release(WORKQUEUE_HANDLE handle)
+OPERATE_RET tal_workqueue_get_stats(WORKQUEUE_HANDLE handle, WORKQUEUE_STATS_T *stats)
+{
+    if (NULL == handle || NULL == stats) {
+        return OPRT_INVALID_PARM;
+    }
+
+    TAL_WORKQUEUE_T *workqueue = (TAL_WORKQUEUE_T *)handle;
+    uint32_t hist[WORK_DELAY_BUCKET_NUM] = {0};
+    uint32_t *pct[] = {&stats->delay_p50, &stats->delay_p90, &stats->delay_p99};
+    const uint8_t pct_val[] = {50, 90, 99};
+    uint32_t seen = 0;
+    uint8_t i, b, k = 0;
+
+    memset(stats, 0, sizeof(WORKQUEUE_STATS_T));
+    for (i = 0; i < workqueue->worker_num; i++) {
+        WORK_STATS_T *ws = &workqueue->workers[i].stats;
+        stats->scheduled += ws->scheduled;
+        stats->executed += ws->executed;
+        stats->deadline_miss += ws->deadline_miss;
+        stats->delay_max = ws->delay_max > stats->delay_max ? ws->delay_max : stats->delay_max;
+        stats->exec_max = ws->exec_max > stats->exec_max ? ws->exec_max : stats->exec_max;
+        for (b = 0; b < WORK_DELAY_BUCKET_NUM; b++) {
+            hist[b] += ws->delay_hist[b];
+        }
+    }
+
+    // percentiles resolve to the upper bound of their histogram bucket
+    for (b = 0; b < WORK_DELAY_BUCKET_NUM && k < CNTSOF(pct_val); b++) {
+        seen += hist[b];
+        while (k < CNTSOF(pct_val) && (uint64_t)seen * 100 >= (uint64_t)stats->executed * pct_val[k] && seen) {
+            *pct[k] = (b == WORK_DELAY_BUCKET_NUM - 1) ? stats->delay_max : (1u << b) - 1;
+            if (*pct[k] > stats->delay_max) {
+                *pct[k] = stats->delay_max;
+            }
+            k++;
+        }
+    }
+
+    return OPRT_OK;
+}
+
+/**
+ * @brief reset the scheduling statistics of the workqueue
+ *
+ * @param[in] handle the workqueue handle
+ *
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_workqueue_reset_stats(WORKQUEUE_HANDLE handle)
 {
     if (NULL == handle) {
         return OPRT_INVALID_PARM;
     }
 
-    OPERATE_RET op_ret = OPRT_OK;
-    uint32_t count = 1;
     TAL_WORKQUEUE_T *workqueue = (TAL_WORKQUEUE_T *)handle;
+    uint8_t i;
 
-    op_ret = tal_thread_delete(workqueue->thread);
-    if (OPRT_OK != op_ret) {
-        return op_ret;
+    for (i = 0; i < workqueue->worker_num; i++) {
+        memset(&workqueue->workers[i].stats, 0, sizeof(WORK_STATS_T));
     }
 
-    tal_semaphore_post(workqueue->sem);
+    return OPRT_OK;
+}
 
-    while (THREAD_STATE_DELETE != tal_thread_get_state(workqueue->thread)) {
-        tal_system_sleep(10);
-        if ((count++) % 500 == 0) {
-            PR_NOTICE("%p still running", workqueue->thread);
-        }
+/**
+ * @brief set a callback that receives the timestamps of every executed work
+ *
+ * @param[in] handle the workqueue handle
+ * @param[in] cb the trace callback, NULL to disable, runs in the worker thread
+ *
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_workqueue_set_trace(WORKQUEUE_HANDLE handle, WORKQUEUE_TRACE_CB cb)
+{
+    if (NULL == handle) {
+        return OPRT_INVALID_PARM;
     }
 
-    tuya_queue_release(workqueue->queue);
-    tal_semaphore_release(workqueue->sem);
-    tal_free(workqueue);
+    ((TAL_WORKQUEUE_T *)handle)->trace_cb = cb;
+
+    return OPRT_OK;
+}
+
+/**
+ * @brief release the workqueue
+ *
+ * @param[in] handle the workqueue handle
+ *
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_workqueue_release(WORKQUEUE_HANDLE handle)
+{
+    if (NULL == handle) {
+        return OPRT_INVALID_PARM;
+    }
+
+    __workqueue_free((TAL_WORKQUEUE_T *)handle);
 
     return OPRT_OK;
 }
@@ -313,7 +811,7 @@ OPERATE_RET tal_workqueue_release(WORKQUEUE_HANDLE handle)
  *
  * @param[in] handle the workqueue handle
  *
- * @return thread handle
+ * @return thread handle, the first worker for a pool
  */
 THREAD_HANDLE tal_workqueue_get_thread(WORKQUEUE_HANDLE handle)
 {
@@ -322,7 +820,7 @@ THREAD_HANDLE tal_workqueue_get_thread(WORKQUEUE_HANDLE handle)
     }
 
     TAL_WORKQUEUE_T *workqueue = (TAL_WORKQUEUE_T *)handle;
-    return workqueue->thread;
+    return workqueue->workers[0].thread;
 }
 
 typedef struct {
@@ -397,7 +895,13 @@ OPERATE_RET tal_workqueue_start_delayed(DELAYED_WORK_HANDLE delayed_work, TIME_M
 
     DELAYED_WORK_T *p_delayed_work = (DELAYED_WORK_T *)delayed_work;
 
+#if defined(DELAYED_WORK_SLACK_PERCENT) && (DELAYED_WORK_SLACK_PERCENT > 0)
+    // delayed work due close together is coalesced into one timer wakeup
+    return tal_sw_timer_start_with_slack(p_delayed_work->timer, interval,
+                                         (TIME_MS)((uint64_t)interval * DELAYED_WORK_SLACK_PERCENT / 100), type);
+#else
     return tal_sw_timer_start(p_delayed_work->timer, interval, type);
+#endif
 }
 
 /**
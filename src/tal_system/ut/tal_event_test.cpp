@@ -0,0 +1,204 @@
+/**
+ * @file tal_event_test.cpp
+ * @brief UT of tal_event: dispatch order, one-time subscribers, concurrent
+ * publishers and publish latency.
+ *
+ * @copyright Copyright (c) 2021-2024 Tuya Inc. All Rights Reserved.
+ *
+ */
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tal_api.h"
+#include "tal_event.h"
+
+#define UT_PUBLISH_ROUNDS 100000
+#define UT_FILL_EVENT_NUM 64
+
+static std::mutex s_order_mutex;
+static std::vector<int> s_order;
+static std::atomic<int> s_count;
+
+static int ut_event_record(void *data)
+{
+    std::lock_guard<std::mutex> lock(s_order_mutex);
+    s_order.push_back((int)(intptr_t)data);
+    return 0;
+}
+
+static int ut_event_normal(void *data)
+{
+    return ut_event_record((void *)((intptr_t)data * 10 + 1));
+}
+
+static int ut_event_emergency(void *data)
+{
+    return ut_event_record((void *)((intptr_t)data * 10 + 2));
+}
+
+static int ut_event_onetime(void *data)
+{
+    return ut_event_record((void *)((intptr_t)data * 10 + 3));
+}
+
+static int ut_event_count(void *data)
+{
+    s_count.fetch_add(1, std::memory_order_relaxed);
+    return 0;
+}
+
+static int ut_event_slow(void *data)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    s_count.fetch_add(1);
+    return 0;
+}
+
+class EventTest : public ::testing::Test {
+protected:
+    void SetUp() override
+    {
+        ASSERT_EQ(OPRT_OK, tal_event_init());
+        s_order.clear();
+        s_count = 0;
+    }
+};
+
+TEST_F(EventTest, dispatch_order)
+{
+    ASSERT_EQ(OPRT_OK, tal_event_subscribe("ut.order", "normal", ut_event_normal, SUBSCRIBE_TYPE_NORMAL));
+    ASSERT_EQ(OPRT_OK, tal_event_subscribe("ut.order", "onetime", ut_event_onetime, SUBSCRIBE_TYPE_ONETIME));
+    ASSERT_EQ(OPRT_OK, tal_event_subscribe("ut.order", "emergency", ut_event_emergency, SUBSCRIBE_TYPE_EMERGENCY));
+
+    EXPECT_EQ(OPRT_OK, tal_event_publish("ut.order", (void *)1));
+    EXPECT_EQ(OPRT_OK, tal_event_publish("ut.order", (void *)2));
+
+    // emergency first, the one-time subscriber only for the first publish
+    EXPECT_EQ((std::vector<int>{12, 11, 13, 22, 21}), s_order);
+
+    EXPECT_EQ(OPRT_OK, tal_event_unsubscribe("ut.order", "normal", ut_event_normal));
+    EXPECT_EQ(OPRT_OK, tal_event_unsubscribe("ut.order", "emergency", ut_event_emergency));
+}
+
+TEST_F(EventTest, subscribe_before_event)
+{
+    EVENT_ID_T id = 0;
+
+    // a subscriber of an unknown event is kept until the event is created
+    ASSERT_EQ(OPRT_OK, tal_event_subscribe("ut.late", "normal", ut_event_normal, SUBSCRIBE_TYPE_NORMAL));
+    ASSERT_EQ(OPRT_OK, tal_event_get_id("ut.late", &id));
+    EXPECT_EQ(OPRT_OK, tal_event_publish_by_id(id, (void *)1));
+    EXPECT_EQ(OPRT_OK, tal_event_publish("ut.late", (void *)2));
+    EXPECT_EQ((std::vector<int>{11, 21}), s_order);
+
+    EXPECT_EQ(OPRT_OK, tal_event_unsubscribe("ut.late", "normal", ut_event_normal));
+    EXPECT_EQ(OPRT_OK, tal_event_publish_by_id(id, (void *)3));
+    EXPECT_EQ(2u, s_order.size());
+}
+
+TEST_F(EventTest, onetime_concurrent)
+{
+    std::vector<std::thread> threads;
+
+    ASSERT_EQ(OPRT_OK, tal_event_subscribe("ut.onetime", "once", ut_event_count, SUBSCRIBE_TYPE_ONETIME));
+    for (int i = 0; i < 8; i++) {
+        threads.emplace_back([] { tal_event_publish("ut.onetime", NULL); });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+    EXPECT_EQ(1, s_count.load());
+}
+
+/**
+ * callbacks run without the event lock, so a second publisher, subscribe and
+ * unsubscribe do not wait for a slow subscriber
+ */
+TEST_F(EventTest, slow_subscriber)
+{
+    ASSERT_EQ(OPRT_OK, tal_event_subscribe("ut.slow", "slow", ut_event_slow, SUBSCRIBE_TYPE_NORMAL));
+
+    auto t0 = std::chrono::steady_clock::now();
+    std::thread first([] { tal_event_publish("ut.slow", NULL); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    std::thread second([] { tal_event_publish("ut.slow", NULL); });
+    EXPECT_EQ(OPRT_OK, tal_event_subscribe("ut.slow", "count", ut_event_count, SUBSCRIBE_TYPE_NORMAL));
+    EXPECT_EQ(OPRT_OK, tal_event_unsubscribe("ut.slow", "count", ut_event_count));
+    auto t1 = std::chrono::steady_clock::now();
+    first.join();
+    second.join();
+    auto t2 = std::chrono::steady_clock::now();
+
+    EXPECT_EQ(2, s_count.load());
+    EXPECT_LT(std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count(), 50);
+    EXPECT_LT(std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t0).count(), 190);
+
+    EXPECT_EQ(OPRT_OK, tal_event_unsubscribe("ut.slow", "slow", ut_event_slow));
+}
+
+/**
+ * publish latency by name and by id with 0 to 32 subscribers, among
+ * UT_FILL_EVENT_NUM other events, from 1 and 4 publisher threads
+ */
+TEST_F(EventTest, bench)
+{
+    static const int subs_nums[] = {0, 1, 8, 32};
+    static const int thread_nums[] = {1, 4};
+    char name[EVENT_NAME_MAX_LEN + 1];
+    char desc[EVENT_DESC_MAX_LEN + 1];
+    EVENT_ID_T id = 0;
+
+    for (int i = 0; i < UT_FILL_EVENT_NUM; i++) {
+        snprintf(name, sizeof(name), "ut.fill.%d", i);
+        ASSERT_EQ(OPRT_OK, tal_event_get_id(name, &id));
+    }
+
+    for (int subs : subs_nums) {
+        snprintf(name, sizeof(name), "ut.bench.%d", subs);
+        for (int i = 0; i < subs; i++) {
+            snprintf(desc, sizeof(desc), "sub%d", i);
+            ASSERT_EQ(OPRT_OK, tal_event_subscribe(name, desc, ut_event_count, SUBSCRIBE_TYPE_NORMAL));
+        }
+        ASSERT_EQ(OPRT_OK, tal_event_get_id(name, &id));
+
+        for (int threads : thread_nums) {
+            double ns[2];
+            for (int by_id = 0; by_id < 2; by_id++) {
+                std::vector<std::thread> workers;
+                s_count = 0;
+                auto t0 = std::chrono::steady_clock::now();
+                for (int t = 0; t < threads; t++) {
+                    workers.emplace_back([&, by_id] {
+                        for (int r = 0; r < UT_PUBLISH_ROUNDS; r++) {
+                            if (by_id) {
+                                tal_event_publish_by_id(id, NULL);
+                            } else {
+                                tal_event_publish(name, NULL);
+                            }
+                        }
+                    });
+                }
+                for (auto &w : workers) {
+                    w.join();
+                }
+                double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+                ns[by_id] = s * 1e9 / UT_PUBLISH_ROUNDS;
+                EXPECT_EQ(subs * threads * UT_PUBLISH_ROUNDS, s_count.load());
+            }
+            printf("[ BENCH    ] %2d subscribers, %d publishers: %6.0f ns by name, %6.0f ns by id per publish\n", subs,
+                   threads, ns[0], ns[1]);
+        }
+
+        for (int i = 0; i < subs; i++) {
+            snprintf(desc, sizeof(desc), "sub%d", i);
+            EXPECT_EQ(OPRT_OK, tal_event_unsubscribe(name, desc, ut_event_count));
+        }
+    }
+}
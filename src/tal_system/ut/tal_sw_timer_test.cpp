@@ -0,0 +1,205 @@
+/**
+ * @file tal_sw_timer_test.cpp
+ * @brief UT of tal_sw_timer: expiry, slack coalescing and start/stop/expire rates.
+ *
+ * @copyright Copyright (c) 2021-2024 Tuya Inc. All Rights Reserved.
+ *
+ */
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "tal_api.h"
+#include "ut_tal_stub.h"
+
+#if defined(ENABLE_SW_TIMER_HEAP) && (ENABLE_SW_TIMER_HEAP == 1)
+#define UT_TIMER_BACKEND "heap"
+#else
+#define UT_TIMER_BACKEND "list"
+#endif
+
+#define UT_START_ROUNDS 20
+#define UT_EXPIRE_MS    500
+
+static void ut_timer_count_cb(TIMER_ID timer_id, void *arg)
+{
+    ((std::atomic<int> *)arg)->fetch_add(1);
+}
+
+static bool ut_wait_count(std::atomic<int> &count, int expect, int timeout_ms)
+{
+    for (int i = 0; i < timeout_ms && count.load() < expect; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return count.load() >= expect;
+}
+
+class SwTimerTest : public ::testing::Test {
+protected:
+    std::atomic<int> count{0};
+    std::vector<TIMER_ID> timers;
+
+    static void SetUpTestSuite()
+    {
+        ASSERT_EQ(OPRT_OK, tal_sw_timer_init());
+    }
+
+    void create(int num)
+    {
+        for (int i = 0; i < num; i++) {
+            TIMER_ID id = NULL;
+            ASSERT_EQ(OPRT_OK, tal_sw_timer_create(ut_timer_count_cb, &count, &id));
+            timers.push_back(id);
+        }
+    }
+
+    void TearDown() override
+    {
+        for (TIMER_ID id : timers) {
+            tal_sw_timer_delete(id);
+        }
+        EXPECT_EQ(0, tal_sw_timer_get_num());
+    }
+};
+
+TEST_F(SwTimerTest, once)
+{
+    create(1);
+    ASSERT_EQ(OPRT_OK, tal_sw_timer_start(timers[0], 20, TAL_TIMER_ONCE));
+    EXPECT_TRUE(tal_sw_timer_is_running(timers[0]));
+    EXPECT_TRUE(ut_wait_count(count, 1, 1000));
+    std::this_thread::sleep_for(std::chrono::milliseconds(60));
+    EXPECT_EQ(1, count.load());
+    EXPECT_FALSE(tal_sw_timer_is_running(timers[0]));
+}
+
+TEST_F(SwTimerTest, cycle_and_stop)
+{
+    create(1);
+    ASSERT_EQ(OPRT_OK, tal_sw_timer_start(timers[0], 10, TAL_TIMER_CYCLE));
+    EXPECT_TRUE(ut_wait_count(count, 3, 1000));
+    ASSERT_EQ(OPRT_OK, tal_sw_timer_stop(timers[0]));
+    int stopped = count.load();
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_EQ(stopped, count.load());
+}
+
+TEST_F(SwTimerTest, expire_order)
+{
+    static std::vector<int> order;
+    static std::mutex order_mutex;
+    auto cb = [](TIMER_ID timer_id, void *arg) {
+        std::lock_guard<std::mutex> lock(order_mutex);
+        order.push_back((int)(intptr_t)arg);
+    };
+    TIMER_ID ids[5];
+
+    order.clear();
+    for (int i = 0; i < 5; i++) {
+        ASSERT_EQ(OPRT_OK, tal_sw_timer_create(cb, (void *)(intptr_t)i, &ids[i]));
+        timers.push_back(ids[i]);
+    }
+    // started out of order, expire in timeout order
+    for (int i : {3, 0, 4, 1, 2}) {
+        ASSERT_EQ(OPRT_OK, tal_sw_timer_start(ids[i], 20 + i * 20, TAL_TIMER_ONCE));
+    }
+    ASSERT_EQ(OPRT_OK, tal_sw_timer_stop(ids[4]));
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    std::lock_guard<std::mutex> lock(order_mutex);
+    EXPECT_EQ((std::vector<int>{0, 1, 2, 3}), order);
+}
+
+TEST_F(SwTimerTest, remain_time)
+{
+    uint32_t remain = 0;
+
+    create(1);
+    ASSERT_EQ(OPRT_OK, tal_sw_timer_start(timers[0], 10000, TAL_TIMER_ONCE));
+    ASSERT_EQ(OPRT_OK, tal_sw_timer_remain_time_get(timers[0], &remain));
+    EXPECT_GT(remain, 9000u);
+    EXPECT_LE(remain, 10000u);
+}
+
+/**
+ * 100 one-shot timers due every 10 ms over 1 s, the timer thread wakes up
+ * about once per timer without slack and far less often with it
+ */
+TEST_F(SwTimerTest, slack_wakeups)
+{
+    static const TIME_MS slacks[] = {0, 100, 500};
+    size_t wakeups[3];
+
+    create(100);
+    for (int k = 0; k < 3; k++) {
+        count = 0;
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        size_t base = ut_semaphore_wait_count();
+        for (int i = 0; i < 100; i++) {
+            tal_sw_timer_start_with_slack(timers[i], 10 + i * 10, slacks[k], TAL_TIMER_ONCE);
+        }
+        EXPECT_TRUE(ut_wait_count(count, 100, 3000));
+        wakeups[k] = ut_semaphore_wait_count() - base;
+        printf("[ BENCH    ] %s 100 timers over 1 s, slack %4u ms: %zu wakeups\n", UT_TIMER_BACKEND, slacks[k],
+               wakeups[k]);
+    }
+    EXPECT_LT(wakeups[1], wakeups[0]);
+    EXPECT_LT(wakeups[2], wakeups[1]);
+}
+
+/**
+ * start/stop: every timer is started then stopped with far and scattered
+ * timeouts, so neither insertion nor removal is always at the head
+ * expire: every timer is a 1 ms cycle timer, the rate is how many expiries
+ * the dispatcher delivers per second, at most timers * 1000
+ */
+TEST_F(SwTimerTest, bench)
+{
+    static const int nums[] = {10, 100, 1000};
+
+    for (int num : nums) {
+        timers.clear();
+        create(num);
+
+        double start_s = 0, stop_s = 0;
+        for (int round = 0; round < UT_START_ROUNDS; round++) {
+            auto t0 = std::chrono::steady_clock::now();
+            for (int i = 0; i < num; i++) {
+                tal_sw_timer_start(timers[i], 3600000 + (i * 7919) % num, TAL_TIMER_ONCE);
+            }
+            auto t1 = std::chrono::steady_clock::now();
+            for (int i = 0; i < num; i++) {
+                tal_sw_timer_stop(timers[(i * 7919) % num]);
+            }
+            auto t2 = std::chrono::steady_clock::now();
+            start_s += std::chrono::duration<double>(t1 - t0).count();
+            stop_s += std::chrono::duration<double>(t2 - t1).count();
+        }
+
+        count = 0;
+        auto t0 = std::chrono::steady_clock::now();
+        for (int i = 0; i < num; i++) {
+            tal_sw_timer_start(timers[i], 1, TAL_TIMER_CYCLE);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(UT_EXPIRE_MS));
+        for (int i = 0; i < num; i++) {
+            tal_sw_timer_stop(timers[i]);
+        }
+        double expire_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        int expired = count.load();
+
+        printf("[ BENCH    ] %s %4d timers: start %.2f M/s, stop %.2f M/s, expire %.0f /s\n", UT_TIMER_BACKEND, num,
+               num * UT_START_ROUNDS / start_s / 1e6, num * UT_START_ROUNDS / stop_s / 1e6, expired / expire_s);
+        EXPECT_GT(expired, 0);
+
+        for (TIMER_ID id : timers) {
+            tal_sw_timer_delete(id);
+        }
+        timers.clear();
+    }
+}
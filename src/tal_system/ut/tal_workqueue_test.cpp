@@ -0,0 +1,181 @@
+/**
+ * @file tal_workqueue_test.cpp
+ * @brief UT of tal_workqueue: priority classes, deadlines, keyed order and
+ * the work node pool.
+ *
+ * @copyright Copyright (c) 2021-2024 Tuya Inc. All Rights Reserved.
+ *
+ */
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "tal_api.h"
+#include "tal_workqueue.h"
+#include "ut_tal_stub.h"
+
+#define UT_QUEUE_LEN 32
+
+#ifndef PREALLOC_NODE_NUM_WORK_QUEUE
+#define PREALLOC_NODE_NUM_WORK_QUEUE 8
+#endif
+
+static std::mutex s_order_mutex;
+static std::vector<int> s_order;
+static std::atomic<bool> s_blocked;
+
+static void ut_work_record(void *data)
+{
+    std::lock_guard<std::mutex> lock(s_order_mutex);
+    s_order.push_back((int)(intptr_t)data);
+}
+
+// keeps the worker busy until s_blocked is cleared, so work can be queued behind it
+static void ut_work_block(void *data)
+{
+    while (s_blocked.load()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+class WorkqueueTest : public ::testing::Test {
+protected:
+    WORKQUEUE_HANDLE wq = NULL;
+
+    void create(uint8_t worker_num)
+    {
+        THREAD_CFG_T cfg = {.stackDepth = 4096, .priority = THREAD_PRIO_2, .thrdname = (char *)"ut_wq"};
+        ASSERT_EQ(OPRT_OK, tal_workqueue_create_pool(UT_QUEUE_LEN, worker_num, &cfg, &wq));
+    }
+
+    void block()
+    {
+        s_blocked = true;
+        ASSERT_EQ(OPRT_OK, tal_workqueue_schedule(wq, ut_work_block, NULL));
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+
+    void drain()
+    {
+        s_blocked = false;
+        for (int i = 0; i < 1000 && tal_workqueue_get_num(wq); i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+
+    void SetUp() override
+    {
+        s_order.clear();
+    }
+
+    void TearDown() override
+    {
+        s_blocked = false;
+        if (wq) {
+            tal_workqueue_release(wq);
+        }
+    }
+};
+
+TEST_F(WorkqueueTest, prio_order)
+{
+    create(1);
+    block();
+    tal_workqueue_schedule_prio(wq, WORK_PRIO_LOW, 0, ut_work_record, (void *)1);
+    tal_workqueue_schedule(wq, ut_work_record, (void *)2);
+    tal_workqueue_schedule_prio(wq, WORK_PRIO_HIGH, 0, ut_work_record, (void *)3);
+    tal_workqueue_schedule_instant(wq, ut_work_record, (void *)4);
+    drain();
+
+    EXPECT_EQ((std::vector<int>{3, 4, 2, 1}), s_order);
+}
+
+// keyed work keeps its class on the worker of its key
+TEST_F(WorkqueueTest, key_prio)
+{
+    create(1);
+    block();
+    tal_workqueue_schedule_key(wq, WORK_PRIO_LOW, 7, ut_work_record, (void *)1);
+    tal_workqueue_schedule(wq, ut_work_record, (void *)2);
+    tal_workqueue_schedule_key(wq, WORK_PRIO_HIGH, 7, ut_work_record, (void *)3);
+    tal_workqueue_schedule_key(wq, WORK_PRIO_HIGH, 7, ut_work_record, (void *)4);
+    drain();
+
+    EXPECT_EQ((std::vector<int>{3, 4, 2, 1}), s_order);
+    EXPECT_EQ(OPRT_INVALID_PARM, tal_workqueue_schedule_key(wq, WORK_PRIO_NUM, 7, ut_work_record, NULL));
+}
+
+TEST_F(WorkqueueTest, deadline)
+{
+    WORKQUEUE_STATS_T stats;
+
+    create(1);
+    block();
+    tal_workqueue_schedule_prio(wq, WORK_PRIO_LOW, 50, ut_work_record, (void *)1);
+    tal_workqueue_schedule_prio(wq, WORK_PRIO_LOW, 10, ut_work_record, (void *)2);
+    tal_workqueue_schedule_prio(wq, WORK_PRIO_LOW, 1000, ut_work_record, (void *)3);
+    tal_workqueue_schedule_prio(wq, WORK_PRIO_HIGH, 0, ut_work_record, (void *)4);
+    std::this_thread::sleep_for(std::chrono::milliseconds(80));
+    drain();
+
+    // late work first and earliest deadline first, then the classes
+    EXPECT_EQ((std::vector<int>{2, 1, 4, 3}), s_order);
+    ASSERT_EQ(OPRT_OK, tal_workqueue_get_stats(wq, &stats));
+    EXPECT_EQ(2u, stats.deadline_miss);
+    EXPECT_EQ(5u, stats.executed);
+}
+
+static void ut_work_keyed(void *data)
+{
+    std::this_thread::sleep_for(std::chrono::microseconds(rand() % 500));
+    ut_work_record(data);
+}
+
+TEST_F(WorkqueueTest, key_order)
+{
+    create(4);
+    for (int seq = 0; seq < 7; seq++) {
+        for (int key = 0; key < 4; key++) {
+            ASSERT_EQ(OPRT_OK,
+                      tal_workqueue_schedule_key(wq, WORK_PRIO_NORMAL, 1000 + key, ut_work_keyed,
+                                                 (void *)(intptr_t)(key * 100 + seq)));
+        }
+    }
+    drain();
+
+    ASSERT_EQ(28u, s_order.size());
+    int next[4] = {0};
+    for (int v : s_order) {
+        EXPECT_EQ(next[v / 100]++, v % 100) << "key " << v / 100;
+    }
+}
+
+/**
+ * the first PREALLOC_NODE_NUM_WORK_QUEUE nodes of a worker are allocated
+ * with the workqueue, the rest on demand and freed once taken
+ */
+TEST_F(WorkqueueTest, node_pool)
+{
+    size_t base = ut_heap_used();
+
+    create(1);
+    size_t created = ut_heap_used();
+    block();
+    for (int i = 0; i < UT_QUEUE_LEN; i++) {
+        ASSERT_EQ(OPRT_OK, tal_workqueue_schedule(wq, ut_work_record, (void *)(intptr_t)i));
+    }
+    EXPECT_EQ(OPRT_EXCEED_UPPER_LIMIT, tal_workqueue_schedule(wq, ut_work_record, NULL));
+    size_t full = ut_heap_used();
+    drain();
+
+    EXPECT_EQ((size_t)UT_QUEUE_LEN, s_order.size());
+    EXPECT_EQ(created, ut_heap_used());
+    printf("[ BENCH    ] queue of %d: %zu bytes idle, %zu bytes full (prealloc %d nodes)\n", UT_QUEUE_LEN,
+           created - base, full - base, PREALLOC_NODE_NUM_WORK_QUEUE);
+}
@@ -34,9 +34,22 @@
 #include "crc32i.h"
 #include "tal_api.h"
 #include "tuya_protocol.h"
+#include "mix_method.h"
+
+//! handlers matched by one message are called from the stack up to this count
+#define MQTT_DISPATCH_STACK_NUM 4
 
 static void on_subscribe_message_default(uint16_t msgid, const mqtt_client_message_t *msg, void *userdata);
 
+/* handlers are copied out under the lock and called without it, so they may register or unregister */
+typedef struct {
+    union {
+        mqtt_subscribe_message_cb_t topic;
+        tuya_protocol_callback_t protocol;
+    } cb;
+    void *user_data;
+} mqtt_dispatch_entry_t;
+
 typedef struct {
     uint32_t sequence;
     uint32_t source;
@@ -92,6 +105,61 @@ static int tuya_mqtt_signature_tool(const tuya_meta_info_t *input, tuya_mqtt_acc
     return OPRT_OK;
 }
 
+/* MQTT 3.1.1 topic filter match, '+' is one level and a trailing '#' any number of levels */
+static bool mqtt_topic_match(const char *filter, const char *topic)
+{
+    //! wildcards at the first level do not match topics starting with '$'
+    if ('$' == *topic && ('+' == *filter || '#' == *filter)) {
+        return false;
+    }
+
+    while (*filter) {
+        if ('#' == *filter) {
+            return true;
+        }
+        if ('+' == *filter) {
+            while (*topic && '/' != *topic) {
+                topic++;
+            }
+            filter++;
+            continue;
+        }
+        if (*filter != *topic) {
+            //! "a/#" also matches its parent "a"
+            return ('\0' == *topic && 0 == strcmp(filter, "/#"));
+        }
+        filter++;
+        topic++;
+    }
+    return '\0' == *topic;
+}
+
+static mqtt_subscribe_handle_t **mqtt_subscribe_head(tuya_mqtt_context_t *context, bool wildcard, uint32_t hash)
+{
+    if (wildcard) {
+        return &context->subscribe_wildcard;
+    }
+    return &context->subscribe_table[hash % MQTT_SUBSCRIBE_BUCKETS];
+}
+
+static uint16_t mqtt_protocol_collect(tuya_mqtt_context_t *context, uint16_t protocol_id,
+                                      mqtt_dispatch_entry_t *entries, uint16_t max)
+{
+    uint16_t num = 0;
+    tuya_protocol_handle_t *target = context->protocol_table[protocol_id % MQTT_PROTOCOL_BUCKETS];
+
+    for (; target; target = target->next) {
+        if (target->id == protocol_id) {
+            if (num < max) {
+                entries[num].cb.protocol = target->cb;
+                entries[num].user_data = target->user_data;
+            }
+            num++;
+        }
+    }
+    return num;
+}
+
 /**
  * @brief Registers a callback function for handling MQTT subscribe messages.
  *
@@ -119,37 +187,46 @@ int tuya_mqtt_subscribe_message_callback_register(tuya_mqtt_context_t *context,
         return OPRT_COM_ERROR;
     }
 
+    size_t topic_length = strlen(topic);
+    bool wildcard = (NULL != strpbrk(topic, "+#"));
+    uint32_t hash = wildcard ? 0 : mm_str_hash(topic);
+    if (NULL == cb) {
+        cb = on_subscribe_message_default;
+    }
+
+    tal_mutex_lock(context->handler_mutex);
+    mqtt_subscribe_handle_t **head = mqtt_subscribe_head(context, wildcard, hash);
+
     /* Repetition filter */
-    mqtt_subscribe_handle_t *target = context->subscribe_list;
-    while (target) {
-        if (!memcmp(target->topic, topic, target->topic_length) && target->cb == cb) {
+    mqtt_subscribe_handle_t *target = *head;
+    for (; target; target = target->next) {
+        if (target->hash == hash && target->topic_length == topic_length && !memcmp(target->topic, topic, topic_length) &&
+            target->cb == cb) {
+            tal_mutex_unlock(context->handler_mutex);
             PR_WARN("Repetition:%s", topic);
             return OPRT_OK;
         }
-        target = target->next;
     }
 
-    /* Intser new handle */
-    mqtt_subscribe_handle_t *newtarget = tal_calloc(1, sizeof(mqtt_subscribe_handle_t));
+    /* Insert new handle, the topic is stored behind it */
+    mqtt_subscribe_handle_t *newtarget = tal_calloc(1, sizeof(mqtt_subscribe_handle_t) + topic_length + 1);
     if (!newtarget) {
+        tal_mutex_unlock(context->handler_mutex);
         PR_ERR("malloc error");
         return OPRT_MALLOC_FAILED;
     }
 
-    newtarget->topic_length = strlen(topic);
-    newtarget->topic = tal_calloc(1, newtarget->topic_length + 1); // strdup
-    strcpy(newtarget->topic, topic);
-
-    if (cb) {
-        newtarget->cb = cb;
-    } else {
-        newtarget->cb = on_subscribe_message_default;
-    }
+    newtarget->topic_length = topic_length;
+    newtarget->topic = (char *)(newtarget + 1);
+    memcpy(newtarget->topic, topic, topic_length);
+    newtarget->hash = hash;
+    newtarget->wildcard = wildcard;
+    newtarget->cb = cb;
     newtarget->userdata = userdata;
-    /* LOCK */
-    newtarget->next = context->subscribe_list;
-    context->subscribe_list = newtarget;
-    /* UNLOCK */
+    newtarget->next = *head;
+    *head = newtarget;
+    tal_mutex_unlock(context->handler_mutex);
+
     return OPRT_OK;
 }
 
@@ -173,21 +250,22 @@ int tuya_mqtt_subscribe_message_callback_unregister(tuya_mqtt_context_t *context
     }
 
     size_t topic_length = strlen(topic);
+    bool wildcard = (NULL != strpbrk(topic, "+#"));
+    uint32_t hash = wildcard ? 0 : mm_str_hash(topic);
 
-    /* LOCK */
+    tal_mutex_lock(context->handler_mutex);
     /* Remove object form list */
-    mqtt_subscribe_handle_t **target = &context->subscribe_list;
+    mqtt_subscribe_handle_t **target = mqtt_subscribe_head(context, wildcard, hash);
     while (*target) {
         mqtt_subscribe_handle_t *entry = *target;
-        if (entry->topic_length == topic_length && !memcmp(topic, entry->topic, topic_length)) {
+        if (entry->hash == hash && entry->topic_length == topic_length && !memcmp(topic, entry->topic, topic_length)) {
             *target = entry->next;
-            tal_free(entry->topic);
             tal_free(entry);
         } else {
             target = &entry->next;
         }
     }
-    /* UNLOCK */
+    tal_mutex_unlock(context->handler_mutex);
 
     uint16_t msgid = mqtt_client_unsubscribe(context->mqtt_client, topic, MQTT_QOS_1);
     if (msgid <= 0) {
@@ -197,32 +275,89 @@ int tuya_mqtt_subscribe_message_callback_unregister(tuya_mqtt_context_t *context
     return OPRT_OK;
 }
 
+/* copy the handlers of a topic into entries, returns how many match */
+static uint16_t mqtt_subscribe_collect(tuya_mqtt_context_t *context, const char *topic, size_t topic_length,
+                                       uint32_t hash, mqtt_dispatch_entry_t *entries, uint16_t max)
+{
+    uint16_t num = 0;
+    mqtt_subscribe_handle_t *target = *mqtt_subscribe_head(context, false, hash);
+
+    for (; target; target = target->next) {
+        if (target->hash == hash && target->topic_length == topic_length &&
+            !memcmp(topic, target->topic, topic_length)) {
+            if (num < max) {
+                entries[num].cb.topic = target->cb;
+                entries[num].user_data = target->userdata;
+            }
+            num++;
+        }
+    }
+    for (target = context->subscribe_wildcard; target; target = target->next) {
+        if (mqtt_topic_match(target->topic, topic)) {
+            if (num < max) {
+                entries[num].cb.topic = target->cb;
+                entries[num].user_data = target->userdata;
+            }
+            num++;
+        }
+    }
+    return num;
+}
+
 static void mqtt_subscribe_message_distribute(tuya_mqtt_context_t *context, uint16_t msgid,
                                               const mqtt_client_message_t *msg)
 {
     const char *topic = msg->topic;
     size_t topic_length = strlen(msg->topic);
+    uint32_t hash = mm_str_hash(topic);
+    mqtt_dispatch_entry_t stack_entries[MQTT_DISPATCH_STACK_NUM];
+    mqtt_dispatch_entry_t *entries = stack_entries;
+    mqtt_dispatch_entry_t *protocol = NULL;
+    uint16_t num = 0, i = 0;
+
+    tal_mutex_lock(context->handler_mutex);
+    num = mqtt_subscribe_collect(context, topic, topic_length, hash, entries, MQTT_DISPATCH_STACK_NUM);
+    if (num > MQTT_DISPATCH_STACK_NUM) {
+        entries = tal_malloc(num * sizeof(mqtt_dispatch_entry_t));
+        if (NULL == entries) {
+            PR_ERR("malloc error, %d handlers skipped", num - MQTT_DISPATCH_STACK_NUM);
+            entries = stack_entries;
+            num = MQTT_DISPATCH_STACK_NUM;
+        } else {
+            mqtt_subscribe_collect(context, topic, topic_length, hash, entries, num);
+        }
+    }
+    tal_mutex_unlock(context->handler_mutex);
 
-    /* LOCK */
-    mqtt_subscribe_handle_t *target = context->subscribe_list;
-    for (; target; target = target->next) {
-        if (target->topic_length == topic_length && !memcmp(topic, target->topic, target->topic_length)) {
-            target->cb(msgid, msg, target->userdata);
+    /* the protocol handler decrypts the payload in place in the receive
+     * buffer, so it runs once and after every other handler of the topic */
+    for (i = 0; i < num; i++) {
+        if (entries[i].cb.topic == on_subscribe_message_default) {
+            protocol = &entries[i];
+            continue;
         }
+        entries[i].cb.topic(msgid, msg, entries[i].user_data);
+    }
+    if (protocol) {
+        protocol->cb.topic(msgid, msg, protocol->user_data);
+    }
+    if (entries != stack_entries) {
+        tal_free(entries);
     }
-    /* UNLOCK */
 }
 
 /* -------------------------------------------------------------------------- */
 /*                       Tuya internal subscribe message                      */
 /* -------------------------------------------------------------------------- */
-static int tuya_protocol_message_parse_process(tuya_mqtt_context_t *context, const uint8_t *payload, size_t payload_len)
+static int tuya_protocol_message_parse_process(tuya_mqtt_context_t *context, uint8_t *payload, size_t payload_len)
 {
     int ret = OPRT_OK;
 
+    /* decrypted in place, mqtt_subscribe_message_distribute calls the other
+     * handlers of the topic before this one */
     char *jsonstr = NULL;
-    ret = tuya_parse_protocol_data(DP_CMD_MQ, (uint8_t *)payload, payload_len, context->signature.cipherkey,
-                                   (char **)&jsonstr);
+    ret = tuya_parse_protocol_data_inplace(DP_CMD_MQ, payload, payload_len, context->signature.cipherkey,
+                                           (char **)&jsonstr, NULL);
     if (OPRT_OK != ret) {
         PR_ERR("Cmd Parse Fail:%d", ret);
         return OPRT_COM_ERROR;
@@ -234,7 +369,6 @@ static int tuya_protocol_message_parse_process(tuya_mqtt_context_t *context, con
     cJSON *root = NULL;
     cJSON *json = NULL;
     root = cJSON_Parse((const char *)jsonstr);
-    tal_free(jsonstr);
     if (NULL == root) {
         PR_ERR("JSON parse error");
         return OPRT_CJSON_PARSE_ERR;
@@ -263,14 +397,31 @@ static int tuya_protocol_message_parse_process(tuya_mqtt_context_t *context, con
     event.root_json = root;
     event.data = cJSON_GetObjectItem(root, "data");
 
-    /* LOCK */
-    tuya_protocol_handle_t *target = context->protocol_list;
-    for (; target; target = target->next) {
-        if (target->id == protocol_id) {
-            event.user_data = target->user_data, target->cb(&event);
+    mqtt_dispatch_entry_t stack_entries[MQTT_DISPATCH_STACK_NUM];
+    mqtt_dispatch_entry_t *entries = stack_entries;
+    uint16_t num = 0, i = 0;
+
+    tal_mutex_lock(context->handler_mutex);
+    num = mqtt_protocol_collect(context, protocol_id, entries, MQTT_DISPATCH_STACK_NUM);
+    if (num > MQTT_DISPATCH_STACK_NUM) {
+        entries = tal_malloc(num * sizeof(mqtt_dispatch_entry_t));
+        if (NULL == entries) {
+            PR_ERR("malloc error, %d handlers skipped", num - MQTT_DISPATCH_STACK_NUM);
+            entries = stack_entries;
+            num = MQTT_DISPATCH_STACK_NUM;
+        } else {
+            mqtt_protocol_collect(context, protocol_id, entries, num);
         }
     }
-    /* UNLOCK */
+    tal_mutex_unlock(context->handler_mutex);
+
+    for (i = 0; i < num; i++) {
+        event.user_data = entries[i].user_data;
+        entries[i].cb.protocol(&event);
+    }
+    if (entries != stack_entries) {
+        tal_free(entries);
+    }
 
     cJSON_Delete(root);
     return OPRT_OK;
@@ -279,12 +430,197 @@ static int tuya_protocol_message_parse_process(tuya_mqtt_context_t *context, con
 static void on_subscribe_message_default(uint16_t msgid, const mqtt_client_message_t *msg, void *userdata)
 {
     tuya_mqtt_context_t *context = (tuya_mqtt_context_t *)userdata;
-    int ret = tuya_protocol_message_parse_process(context, msg->payload, msg->length);
+    /* the payload points into the mqtt client receive buffer, which is
+     * rewritten by the next packet anyway */
+    int ret = tuya_protocol_message_parse_process(context, (uint8_t *)msg->payload, msg->length);
     if (ret != OPRT_OK) {
         PR_ERR("protocol message parse error:%d", ret);
     }
 }
 
+/* -------------------------------------------------------------------------- */
+/*                            Publish in-flight queue                         */
+/* -------------------------------------------------------------------------- */
+/* every queued publish is in the deadline heap, and either in the pending
+ * queue until it is sent or in the msgid bucket until its PUBACK */
+static bool mqtt_publish_before(uint32_t a, uint32_t b)
+{
+    return (int32_t)(a - b) < 0;
+}
+
+static void mqtt_publish_heap_set(tuya_mqtt_context_t *context, uint16_t index, mqtt_publish_handle_t *handle)
+{
+    context->publish_heap[index] = handle;
+    handle->heap_index = index;
+}
+
+static void mqtt_publish_heap_fix(tuya_mqtt_context_t *context, uint16_t index)
+{
+    mqtt_publish_handle_t *handle = context->publish_heap[index];
+    uint16_t child = 0;
+
+    while (index > 0 &&
+           mqtt_publish_before(handle->deadline, context->publish_heap[(index - 1) / 2]->deadline)) {
+        mqtt_publish_heap_set(context, index, context->publish_heap[(index - 1) / 2]);
+        index = (index - 1) / 2;
+    }
+    while ((child = index * 2 + 1) < context->publish_count) {
+        if (child + 1 < context->publish_count &&
+            mqtt_publish_before(context->publish_heap[child + 1]->deadline, context->publish_heap[child]->deadline)) {
+            child++;
+        }
+        if (!mqtt_publish_before(context->publish_heap[child]->deadline, handle->deadline)) {
+            break;
+        }
+        mqtt_publish_heap_set(context, index, context->publish_heap[child]);
+        index = child;
+    }
+    mqtt_publish_heap_set(context, index, handle);
+}
+
+static void mqtt_publish_heap_remove(tuya_mqtt_context_t *context, mqtt_publish_handle_t *handle)
+{
+    uint16_t index = handle->heap_index;
+
+    context->publish_count--;
+    if (index < context->publish_count) {
+        mqtt_publish_heap_set(context, index, context->publish_heap[context->publish_count]);
+        mqtt_publish_heap_fix(context, index);
+    }
+}
+
+static void mqtt_publish_inflight_add(tuya_mqtt_context_t *context, mqtt_publish_handle_t *handle)
+{
+    mqtt_publish_handle_t **bucket = &context->publish_inflight[handle->msgid % MQTT_PUBLISH_INFLIGHT_BUCKETS];
+
+    handle->next = *bucket;
+    *bucket = handle;
+}
+
+static mqtt_publish_handle_t *mqtt_publish_inflight_take(tuya_mqtt_context_t *context, uint16_t msgid)
+{
+    mqtt_publish_handle_t **target = &context->publish_inflight[msgid % MQTT_PUBLISH_INFLIGHT_BUCKETS];
+
+    for (; *target; target = &(*target)->next) {
+        mqtt_publish_handle_t *entry = *target;
+        if (entry->msgid == msgid) {
+            *target = entry->next;
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static void mqtt_publish_pending_add(tuya_mqtt_context_t *context, mqtt_publish_handle_t *handle)
+{
+    handle->msgid = 0;
+    handle->next = NULL;
+    *context->publish_pending_tail = handle;
+    context->publish_pending_tail = &handle->next;
+}
+
+/* take the oldest unsent publish, it stays in the heap until it is put back or tracked by msgid */
+static mqtt_publish_handle_t *mqtt_publish_pending_pop(tuya_mqtt_context_t *context)
+{
+    mqtt_publish_handle_t *entry = context->publish_pending;
+
+    if (entry) {
+        context->publish_pending = entry->next;
+        if (NULL == context->publish_pending) {
+            context->publish_pending_tail = &context->publish_pending;
+        }
+        entry->next = NULL;
+    }
+    return entry;
+}
+
+static void mqtt_publish_pending_push(tuya_mqtt_context_t *context, mqtt_publish_handle_t *handle)
+{
+    handle->next = context->publish_pending;
+    context->publish_pending = handle;
+    if (NULL == handle->next) {
+        context->publish_pending_tail = &handle->next;
+    }
+}
+
+static void mqtt_publish_pending_remove(tuya_mqtt_context_t *context, mqtt_publish_handle_t *handle)
+{
+    mqtt_publish_handle_t **target = &context->publish_pending;
+
+    for (; *target; target = &(*target)->next) {
+        if (*target == handle) {
+            *target = handle->next;
+            if (context->publish_pending_tail == &handle->next) {
+                context->publish_pending_tail = target;
+            }
+            return;
+        }
+    }
+}
+
+/* unlink all expired publishes into a list, the caller notifies them unlocked */
+static mqtt_publish_handle_t *mqtt_publish_expire(tuya_mqtt_context_t *context, uint32_t now)
+{
+    mqtt_publish_handle_t *expired = NULL;
+
+    while (context->publish_count && !mqtt_publish_before(now, context->publish_heap[0]->deadline)) {
+        mqtt_publish_handle_t *entry = context->publish_heap[0];
+        mqtt_publish_heap_remove(context, entry);
+        if (entry->msgid) {
+            mqtt_publish_inflight_take(context, entry->msgid);
+        } else {
+            mqtt_publish_pending_remove(context, entry);
+        }
+        entry->next = expired;
+        expired = entry;
+    }
+    return expired;
+}
+
+static void mqtt_publish_notify(mqtt_publish_handle_t *list, int result)
+{
+    while (list) {
+        mqtt_publish_handle_t *entry = list;
+        list = entry->next;
+        entry->cb(result, entry->user_data);
+        tal_free(entry);
+    }
+}
+
+/* the event loop does not sleep in here, it only sets when to try again */
+static void mqtt_reconnect_backoff(tuya_mqtt_context_t *context, uint32_t extra_ms)
+{
+    uint16_t nextRetryBackOff = 0U;
+    if (BackoffAlgorithm_GetNextBackoff(&context->backoff_algorithm, rand(), &nextRetryBackOff) !=
+        BackoffAlgorithmSuccess) {
+        return;
+    }
+    PR_WARN("Connection to the MQTT server failed. Retrying "
+            "connection after %hu ms backoff.",
+            (unsigned short)nextRetryBackOff);
+#if defined(ENABLE_MQTT_EVENT_LOOP) && (ENABLE_MQTT_EVENT_LOOP == 1)
+    context->reconnect_at = (uint32_t)tal_system_get_millisecond() + nextRetryBackOff + extra_ms;
+    context->reconnect_backoff = true;
+#else
+    tal_system_sleep(nextRetryBackOff + extra_ms);
+#endif
+}
+
+#if defined(ENABLE_MQTT_EVENT_LOOP) && (ENABLE_MQTT_EVENT_LOOP == 1)
+uint32_t tuya_mqtt_reconnect_wait(tuya_mqtt_context_t *context)
+{
+    if (context == NULL || context->reconnect_backoff == false) {
+        return 0;
+    }
+    int32_t left = (int32_t)(context->reconnect_at - (uint32_t)tal_system_get_millisecond());
+    if (left <= 0) {
+        context->reconnect_backoff = false;
+        return 0;
+    }
+    return (uint32_t)left;
+}
+#endif
+
 /* -------------------------------------------------------------------------- */
 /*                         MQTT Client event callback                         */
 /* -------------------------------------------------------------------------- */
@@ -298,6 +634,9 @@ static void mqtt_client_connected_cb(void *client, void *userdata)
                                                   userdata);
     PR_DEBUG("SUBSCRIBE sent for topic %s to broker.", context->signature.topic_in);
     context->is_connected = true;
+#if defined(ENABLE_MQTT_EVENT_LOOP) && (ENABLE_MQTT_EVENT_LOOP == 1)
+    context->reconnect_backoff = false;
+#endif
     if (context->on_connected) {
         context->on_connected(context, context->user_data);
     }
@@ -337,20 +676,15 @@ static void mqtt_client_puback_cb(void *client, uint16_t msgid, void *userdata)
     tuya_mqtt_context_t *context = (tuya_mqtt_context_t *)userdata;
     PR_DEBUG("PUBACK ID:%d", msgid);
 
-    /* LOCK */
-    /* publish async process */
-    mqtt_publish_handle_t **next_handle = &context->publish_list;
-    for (; *next_handle; next_handle = &(*next_handle)->next) {
-        mqtt_publish_handle_t *entry = *next_handle;
-        if (msgid == entry->msgid) {
-            entry->cb(OPRT_OK, entry->user_data);
-            *next_handle = entry->next;
-            tal_free(entry->payload);
-            tal_free(entry);
-            break;
-        }
+    tal_mutex_lock(context->publish_mutex);
+    mqtt_publish_handle_t *entry = mqtt_publish_inflight_take(context, msgid);
+    if (entry) {
+        mqtt_publish_heap_remove(context, entry);
+        entry->next = NULL;
     }
-    /* UNLOCK */
+    tal_mutex_unlock(context->publish_mutex);
+
+    mqtt_publish_notify(entry, OPRT_OK);
 }
 
 /**
@@ -370,6 +704,15 @@ int tuya_mqtt_init(tuya_mqtt_context_t *context, const tuya_mqtt_config_t *confi
 
     /* Clean to zero */
     memset(context, 0, sizeof(tuya_mqtt_context_t));
+    context->publish_pending_tail = &context->publish_pending;
+    rt = tal_mutex_create_init(&context->publish_mutex);
+    if (OPRT_OK != rt) {
+        return rt;
+    }
+    rt = tal_mutex_create_init(&context->handler_mutex);
+    if (OPRT_OK != rt) {
+        return rt;
+    }
 
     /* configuration */
     context->user_data = config->user_data;
@@ -449,6 +792,11 @@ int tuya_mqtt_start(tuya_mqtt_context_t *context)
     if (context == NULL || context->is_inited == false) {
         return OPRT_INVALID_PARM;
     }
+#if defined(ENABLE_MQTT_EVENT_LOOP) && (ENABLE_MQTT_EVENT_LOOP == 1)
+    if (tuya_mqtt_reconnect_wait(context)) {
+        return OPRT_RESOURCE_NOT_READY;
+    }
+#endif
 
     PR_INFO("clientid:%s", context->signature.clientid);
     PR_INFO("username:%s", context->signature.username);
@@ -473,14 +821,7 @@ int tuya_mqtt_start(tuya_mqtt_context_t *context)
         PR_ERR("MQTT connect fail:%d", mqtt_status);
         /* Generate a random number and get back-off value (in milliseconds) for
          * the next connection retry. */
-        uint16_t nextRetryBackOff = 0U;
-        if (BackoffAlgorithm_GetNextBackoff(&context->backoff_algorithm, rand(), &nextRetryBackOff) ==
-            BackoffAlgorithmSuccess) {
-            PR_WARN("Connection to the MQTT server failed. Retrying "
-                    "connection after %hu ms backoff.",
-                    (unsigned short)nextRetryBackOff);
-            tal_system_sleep(nextRetryBackOff + 10000);
-        }
+        mqtt_reconnect_backoff(context, 10000);
         return OPRT_COM_ERROR;
     }
     return OPRT_OK;
@@ -533,11 +874,14 @@ int tuya_mqtt_protocol_register(tuya_mqtt_context_t *context, uint16_t protocol_
         return OPRT_INVALID_PARM;
     }
 
-    /* LOCK */
+    tuya_protocol_handle_t **head = &context->protocol_table[protocol_id % MQTT_PROTOCOL_BUCKETS];
+
+    tal_mutex_lock(context->handler_mutex);
     /* Repetition filter */
-    tuya_protocol_handle_t *target = context->protocol_list;
+    tuya_protocol_handle_t *target = *head;
     while (target) {
         if (target->id == protocol_id && target->cb == cb) {
+            tal_mutex_unlock(context->handler_mutex);
             return OPRT_COM_ERROR;
         }
         target = target->next;
@@ -545,14 +889,15 @@ int tuya_mqtt_protocol_register(tuya_mqtt_context_t *context, uint16_t protocol_
 
     tuya_protocol_handle_t *new_handle = tal_calloc(1, sizeof(tuya_protocol_handle_t));
     if (!new_handle) {
+        tal_mutex_unlock(context->handler_mutex);
         return OPRT_MALLOC_FAILED;
     }
     new_handle->id = protocol_id;
     new_handle->cb = cb;
     new_handle->user_data = user_data;
-    new_handle->next = context->protocol_list;
-    context->protocol_list = new_handle;
-    /* UNLOCK */
+    new_handle->next = *head;
+    *head = new_handle;
+    tal_mutex_unlock(context->handler_mutex);
 
     return OPRT_OK;
 }
@@ -575,9 +920,9 @@ int tuya_mqtt_protocol_unregister(tuya_mqtt_context_t *context, uint16_t protoco
         return OPRT_INVALID_PARM;
     }
 
-    /* LOCK */
+    tal_mutex_lock(context->handler_mutex);
     /* Remove object form list */
-    tuya_protocol_handle_t **target = &context->protocol_list;
+    tuya_protocol_handle_t **target = &context->protocol_table[protocol_id % MQTT_PROTOCOL_BUCKETS];
     while (*target) {
         tuya_protocol_handle_t *entry = *target;
         if (entry->id == protocol_id && entry->cb == cb) {
@@ -587,7 +932,7 @@ int tuya_mqtt_protocol_unregister(tuya_mqtt_context_t *context, uint16_t protoco
             target = &entry->next;
         }
     }
-    /* UNLOCK */
+    tal_mutex_unlock(context->handler_mutex);
 
     return OPRT_OK;
 }
@@ -607,18 +952,19 @@ int tuya_mqtt_protocol_unregister_all(tuya_mqtt_context_t *context)
     }
 
     PR_DEBUG("Unregister all MQTT Protocol");
-    /* LOCK */
+    tal_mutex_lock(context->handler_mutex);
     /* Remove object form list */
     tuya_protocol_handle_t *entry = NULL;
-    tuya_protocol_handle_t *target = context->protocol_list;
-    while (target) {
-        entry = target;
-        target = entry->next;
-        tal_free(entry);
+    for (uint16_t i = 0; i < MQTT_PROTOCOL_BUCKETS; i++) {
+        tuya_protocol_handle_t *target = context->protocol_table[i];
+        while (target) {
+            entry = target;
+            target = entry->next;
+            tal_free(entry);
+        }
+        context->protocol_table[i] = NULL;
     }
-    /* UNLOCK */
-
-    context->protocol_list = NULL;
+    tal_mutex_unlock(context->handler_mutex);
 
     return OPRT_OK;
 }
@@ -636,7 +982,8 @@ int tuya_mqtt_protocol_unregister_all(tuya_mqtt_context_t *context)
  * @param timeout_ms The timeout for the publish operation in milliseconds.
  * @param async Whether to perform the publish operation asynchronously or not.
  *
- * @return 0 on success, or a negative error code on failure.
+ * @return 0 on success, OPRT_EXCEED_UPPER_LIMIT if MQTT_PUBLISH_QUEUE_MAX
+ * publishes are queued, or another negative error code on failure.
  */
 int tuya_mqtt_client_publish_common(tuya_mqtt_context_t *context, const char *topic, const uint8_t *payload,
                                     size_t payload_length, mqtt_publish_notify_cb_t cb, void *user_data, int timeout_ms,
@@ -654,36 +1001,58 @@ int tuya_mqtt_client_publish_common(tuya_mqtt_context_t *context, const char *to
         return OPRT_OK;
     }
 
-    mqtt_publish_handle_t *handle = tal_malloc(sizeof(mqtt_publish_handle_t));
+    /* the payload is kept in the same allocation */
+    mqtt_publish_handle_t *handle = tal_malloc(sizeof(mqtt_publish_handle_t) + payload_length);
     TUYA_CHECK_NULL_RETURN(handle, OPRT_MALLOC_FAILED);
     handle->next = NULL;
     handle->msgid = 0;
     handle->topic = (char *)topic;
-    handle->timeout = tal_time_get_posix() + timeout_ms;
+    handle->deadline = (uint32_t)tal_system_get_millisecond() + timeout_ms;
     handle->cb = cb;
     handle->user_data = user_data;
     handle->payload_length = payload_length;
-    handle->payload = tal_malloc(payload_length);
-    if (handle->payload == NULL) {
-        return OPRT_MALLOC_FAILED;
-    }
+    handle->payload = (uint8_t *)(handle + 1);
     memcpy(handle->payload, payload, payload_length);
 
-    if (async == false) {
-        handle->msgid = mqtt_client_publish(context->mqtt_client, handle->topic, handle->payload,
-                                            handle->payload_length, MQTT_QOS_1);
-    }
+    /* the packet id is taken first so the entry is tracked before the PUBACK can arrive */
+    uint16_t msgid = mqtt_client_packet_id(context->mqtt_client);
+    bool send = false;
 
-    if (context->publish_list == NULL) {
-        context->publish_list = handle;
-        return OPRT_OK;
+    tal_mutex_lock(context->publish_mutex);
+    if (context->publish_count >= MQTT_PUBLISH_QUEUE_MAX) {
+        tal_mutex_unlock(context->publish_mutex);
+        tal_free(handle);
+        PR_WARN("publish queue full");
+        return OPRT_EXCEED_UPPER_LIMIT;
     }
 
-    mqtt_publish_handle_t *last = context->publish_list;
-    while (last->next != NULL) {
-        last = last->next;
+#if defined(ENABLE_MQTT_EVENT_LOOP) && (ENABLE_MQTT_EVENT_LOOP == 1)
+    /* the loop may sleep on the socket, do not leave it a publish to send */
+    send = (async == false || (context->is_connected && context->publish_pending == NULL));
+#else
+    send = (async == false);
+#endif
+    if (send) {
+        handle->msgid = msgid;
+        mqtt_publish_inflight_add(context, handle);
+    } else {
+        mqtt_publish_pending_add(context, handle);
+    }
+    mqtt_publish_heap_set(context, context->publish_count++, handle);
+    mqtt_publish_heap_fix(context, handle->heap_index);
+    tal_mutex_unlock(context->publish_mutex);
+
+    /* sent unlocked, the PUBACK may free the handle at any time, so only the caller's buffers are used */
+    if (send && 0 == mqtt_client_publish_with_id(context->mqtt_client, msgid, topic, payload, payload_length,
+                                                 MQTT_QOS_1)) {
+        //! not sent, the loop tries again unless it has timed out meanwhile
+        tal_mutex_lock(context->publish_mutex);
+        mqtt_publish_handle_t *entry = mqtt_publish_inflight_take(context, msgid);
+        if (entry) {
+            mqtt_publish_pending_add(context, entry);
+        }
+        tal_mutex_unlock(context->publish_mutex);
     }
-    last->next = handle;
 
     return OPRT_OK;
 }
@@ -830,6 +1199,11 @@ int tuya_mqtt_loop(tuya_mqtt_context_t *context)
 
     /* reconnect */
     if (context->is_connected == false) {
+#if defined(ENABLE_MQTT_EVENT_LOOP) && (ENABLE_MQTT_EVENT_LOOP == 1)
+        if (tuya_mqtt_reconnect_wait(context)) {
+            return rt;
+        }
+#endif
         mqtt_status = mqtt_client_connect(context->mqtt_client);
         if (mqtt_status == MQTT_STATUS_NOT_AUTHORIZED) {
             if (context->on_unbind) {
@@ -838,42 +1212,61 @@ int tuya_mqtt_loop(tuya_mqtt_context_t *context)
             return rt;
 
         } else if (mqtt_status != MQTT_STATUS_SUCCESS) {
-            uint16_t nextRetryBackOff = 0U;
-            if (BackoffAlgorithm_GetNextBackoff(&context->backoff_algorithm, rand(), &nextRetryBackOff) ==
-                BackoffAlgorithmSuccess) {
-                PR_WARN("Connection to the MQTT server failed. Retrying "
-                        "connection after %hu ms backoff.",
-                        (unsigned short)nextRetryBackOff);
-                tal_system_sleep(nextRetryBackOff);
-                return rt;
-            }
+            mqtt_reconnect_backoff(context, 0);
         }
         return rt;
     }
 
-    /* LOCK */
-    /* publish async process */
-    mqtt_publish_handle_t **next_handle = &context->publish_list;
-    for (; *next_handle; next_handle = &(*next_handle)->next) {
-        mqtt_publish_handle_t *entry = *next_handle;
-
-        if (entry->timeout <= tal_time_get_posix()) {
-            entry->cb(OPRT_TIMEOUT, entry->user_data);
-            *next_handle = entry->next;
-            tal_free(entry->payload);
-            tal_free(entry);
-            continue;
+    /* publish async process, only expired entries and a batch of unsent ones are touched */
+    uint32_t now = (uint32_t)tal_system_get_millisecond();
+    tal_mutex_lock(context->publish_mutex);
+    mqtt_publish_handle_t *expired = mqtt_publish_expire(context, now);
+    tal_mutex_unlock(context->publish_mutex);
+    mqtt_publish_notify(expired, OPRT_TIMEOUT);
+
+    /* sent unlocked, PUBACKs and timeouts are handled on this thread so the entry stays until it is tracked */
+    uint32_t batch = 0;
+    while (batch < MQTT_PUBLISH_BATCH) {
+        tal_mutex_lock(context->publish_mutex);
+        mqtt_publish_handle_t *entry = mqtt_publish_pending_pop(context);
+        tal_mutex_unlock(context->publish_mutex);
+        if (NULL == entry) {
+            break;
         }
-
-        if (entry->msgid <= 0) {
-            entry->msgid =
-                mqtt_client_publish(context->mqtt_client, entry->topic, entry->payload, entry->payload_length, 1);
+        batch++;
+        uint16_t msgid = mqtt_client_publish(context->mqtt_client, entry->topic, entry->payload,
+                                             entry->payload_length, MQTT_QOS_1);
+        tal_mutex_lock(context->publish_mutex);
+        if (msgid) {
+            entry->msgid = msgid;
+            mqtt_publish_inflight_add(context, entry);
+        } else {
+            mqtt_publish_pending_push(context, entry);
         }
+        tal_mutex_unlock(context->publish_mutex);
+        if (0 == msgid) {
+            break;
+        }
+    }
+#if defined(ENABLE_MQTT_EVENT_LOOP) && (ENABLE_MQTT_EVENT_LOOP == 1)
+    /* sleep until a packet arrives, the next batch or the earliest publish timeout */
+    uint32_t wait_ms = MQTT_EVENT_WAIT_MAX_MS;
+    tal_mutex_lock(context->publish_mutex);
+    if (context->publish_pending && batch == MQTT_PUBLISH_BATCH) {
+        wait_ms = 0;
+    } else if (context->publish_count) {
+        int32_t left = (int32_t)(context->publish_heap[0]->deadline - now);
+        wait_ms = (left <= 0) ? 0 : ((uint32_t)left < wait_ms ? (uint32_t)left : wait_ms);
     }
-    /* UNLOCK */
+    tal_mutex_unlock(context->publish_mutex);
+#endif
 
     /* yield */
+#if defined(ENABLE_MQTT_EVENT_LOOP) && (ENABLE_MQTT_EVENT_LOOP == 1)
+    mqtt_client_yield_wait(context->mqtt_client, wait_ms);
+#else
     mqtt_client_yield(context->mqtt_client);
+#endif
 
     return rt;
 }
@@ -894,6 +1287,21 @@ int tuya_mqtt_destory(tuya_mqtt_context_t *context)
     }
 
     tuya_mqtt_protocol_unregister_all(context);
+
+    /* fail what is still queued, the callbacks own their user data */
+    tal_mutex_lock(context->publish_mutex);
+    mqtt_publish_handle_t *queued = NULL;
+    while (context->publish_count) {
+        mqtt_publish_handle_t *entry = context->publish_heap[--context->publish_count];
+        entry->next = queued;
+        queued = entry;
+    }
+    context->publish_pending = NULL;
+    context->publish_pending_tail = &context->publish_pending;
+    memset(context->publish_inflight, 0, sizeof(context->publish_inflight));
+    tal_mutex_unlock(context->publish_mutex);
+    mqtt_publish_notify(queued, OPRT_COM_ERROR);
+
     if (context->mqtt_client) {
         mqtt_client_status_t mqtt_status = mqtt_client_deinit(context->mqtt_client);
         mqtt_client_free(context->mqtt_client);
@@ -902,6 +1310,10 @@ int tuya_mqtt_destory(tuya_mqtt_context_t *context)
             return OPRT_COM_ERROR;
         }
     }
+    tal_mutex_release(context->publish_mutex);
+    context->publish_mutex = NULL;
+    tal_mutex_release(context->handler_mutex);
+    context->handler_mutex = NULL;
 
     return OPRT_OK;
 }
@@ -27,9 +27,12 @@ extern "C" {
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "tuya_cloud_types.h"
+#include "tal_mutex.h"
 #include "cJSON.h"
 #include "mqtt_client_interface.h"
 #include "backoff_algorithm.h"
+#include "tuya_config_defaults.h"
 
 // data max len
 #define TUYA_MQTT_CLIENTID_MAXLEN   (32U)
@@ -147,6 +150,8 @@ typedef struct mqtt_subscribe_handle {
     struct mqtt_subscribe_handle *next;
     char *topic;
     size_t topic_length;
+    uint32_t hash; /* mm_str_hash of the topic, filters with '+' or '#' are not hashed */
+    bool wildcard;
     mqtt_subscribe_message_cb_t cb;
     void *userdata;
 } mqtt_subscribe_handle_t;
@@ -154,9 +159,10 @@ typedef struct mqtt_subscribe_handle {
 typedef void (*mqtt_publish_notify_cb_t)(int result, void *user_data);
 
 typedef struct mqtt_publish_handle {
-    struct mqtt_publish_handle *next;
+    struct mqtt_publish_handle *next; /* pending queue, or in-flight bucket once sent */
     uint16_t msgid;
-    int timeout;
+    uint16_t heap_index;
+    uint32_t deadline;
     char *topic;
     uint8_t *payload;
     size_t payload_length;
@@ -167,10 +173,21 @@ typedef struct mqtt_publish_handle {
 typedef struct {
     void *mqtt_client;
     tuya_mqtt_access_t signature;
-    tuya_protocol_handle_t *protocol_list;
-    mqtt_subscribe_handle_t *subscribe_list;
-    mqtt_publish_handle_t *publish_list;
+    MUTEX_HANDLE handler_mutex; /* protects the protocol and subscribe tables */
+    tuya_protocol_handle_t *protocol_table[MQTT_PROTOCOL_BUCKETS];
+    mqtt_subscribe_handle_t *subscribe_table[MQTT_SUBSCRIBE_BUCKETS];
+    mqtt_subscribe_handle_t *subscribe_wildcard;
+    MUTEX_HANDLE publish_mutex;
+    mqtt_publish_handle_t *publish_pending;
+    mqtt_publish_handle_t **publish_pending_tail;
+    mqtt_publish_handle_t *publish_inflight[MQTT_PUBLISH_INFLIGHT_BUCKETS];
+    mqtt_publish_handle_t *publish_heap[MQTT_PUBLISH_QUEUE_MAX]; /* min heap of deadlines */
+    uint16_t publish_count;
     BackoffAlgorithmContext_t backoff_algorithm;
+#if defined(ENABLE_MQTT_EVENT_LOOP) && (ENABLE_MQTT_EVENT_LOOP == 1)
+    uint32_t reconnect_at; /* no connect attempt before this time while reconnect_backoff */
+    bool reconnect_backoff;
+#endif
     uint32_t sequence_in;
     uint32_t sequence_out;
     bool manual_disconnect;
@@ -228,6 +245,20 @@ int tuya_mqtt_stop(tuya_mqtt_context_t *context);
  */
 int tuya_mqtt_loop(tuya_mqtt_context_t *context);
 
+#if defined(ENABLE_MQTT_EVENT_LOOP) && (ENABLE_MQTT_EVENT_LOOP == 1)
+/**
+ * @brief Gets how long a failed connect holds off the next attempt.
+ *
+ * With the event loop a failed connect does not sleep, tuya_mqtt_start and
+ * tuya_mqtt_loop skip the attempts until the backoff has passed. The caller
+ * sleeps for the returned time instead of polling.
+ *
+ * @param context Pointer to the MQTT context.
+ * @return The remaining backoff in milliseconds, 0 if a connect may be tried.
+ */
+uint32_t tuya_mqtt_reconnect_wait(tuya_mqtt_context_t *context);
+#endif
+
 /**
  * @brief Destroys the MQTT context and releases any resources associated with
  * it.
@@ -372,7 +403,8 @@ int tuya_mqtt_protocol_data_publish_with_topic_common(tuya_mqtt_context_t *conte
  * @param user_data User data to be passed to the callback function.
  * @param timeout_ms The timeout for the publish operation in milliseconds.
  * @param async Whether to perform the publish operation asynchronously or not.
- * @return 0 on success, or a negative error code on failure.
+ * @return 0 on success, OPRT_EXCEED_UPPER_LIMIT if MQTT_PUBLISH_QUEUE_MAX
+ * publishes are queued, or another negative error code on failure.
  */
 int tuya_mqtt_client_publish_common(tuya_mqtt_context_t *context, const char *topic, const uint8_t *payload,
                                     size_t payload_length, mqtt_publish_notify_cb_t cb, void *user_data, int timeout_ms,
@@ -76,6 +76,58 @@
 #define MQTT_CONNECT_RETRY_MIN_DELAY_MS (1000U)
 #endif
 
+/**
+ * @brief The maximum number of QoS1 publishes waiting to be sent or acked,
+ * further publishes are refused with OPRT_EXCEED_UPPER_LIMIT.
+ */
+#ifndef MQTT_PUBLISH_QUEUE_MAX
+#define MQTT_PUBLISH_QUEUE_MAX (32U)
+#endif
+
+/**
+ * @brief The number of msgid buckets of the in-flight publish table.
+ */
+#ifndef MQTT_PUBLISH_INFLIGHT_BUCKETS
+#define MQTT_PUBLISH_INFLIGHT_BUCKETS (16U)
+#endif
+
+/**
+ * @brief The maximum number of queued publishes sent by one loop.
+ */
+#ifndef MQTT_PUBLISH_BATCH
+#define MQTT_PUBLISH_BATCH (8U)
+#endif
+
+/**
+ * @brief The number of buckets of the mqtt protocol id table.
+ */
+#ifndef MQTT_PROTOCOL_BUCKETS
+#define MQTT_PROTOCOL_BUCKETS (16U)
+#endif
+
+/**
+ * @brief The number of buckets of the mqtt subscribe topic table.
+ */
+#ifndef MQTT_SUBSCRIBE_BUCKETS
+#define MQTT_SUBSCRIBE_BUCKETS (8U)
+#endif
+
+/**
+ * @brief The longest ENABLE_MQTT_EVENT_LOOP sleeps on the mqtt socket, matop
+ * timeouts and a stop request wait at most this long.
+ */
+#ifndef MQTT_EVENT_WAIT_MAX_MS
+#define MQTT_EVENT_WAIT_MAX_MS (5000U)
+#endif
+
+/**
+ * @brief The longest ENABLE_MQTT_EVENT_LOOP sleeps in the idle and network
+ * check states, a state change or a link change wakes it earlier.
+ */
+#ifndef IOT_EVENT_IDLE_WAIT_MS
+#define IOT_EVENT_IDLE_WAIT_MS (10000U)
+#endif
+
 /**
  * @brief MQTT BIND TLS timeout config.
  */
@@ -41,17 +41,28 @@ static int tuya_region_regist_key_write(const char *region, const char *regist_k
         return OPRT_INVALID_PARM;
     }
 
-    /* Write kv storage */
+    /* Write kv storage, both or none */
     int ret = 0;
-    ret = tal_kv_set("region", (const uint8_t *)region, strlen(region));
+    KV_BATCH_HANDLE batch = NULL;
+    ret = tal_kv_batch_begin(&batch);
     if (ret != OPRT_OK) {
-        PR_ERR("tal_kv_set region, error:0x%02x", ret);
+        PR_ERR("tal_kv_batch_begin, error:0x%02x", ret);
         return OPRT_KVS_WR_FAIL;
     }
 
-    ret = tal_kv_set("regist_key", (const uint8_t *)regist_key, strlen(regist_key));
+    ret = tal_kv_batch_put(batch, "region", (const uint8_t *)region, strlen(region));
+    if (ret == OPRT_OK) {
+        ret = tal_kv_batch_put(batch, "regist_key", (const uint8_t *)regist_key, strlen(regist_key));
+    }
+    if (ret != OPRT_OK) {
+        PR_ERR("tal_kv_batch_put, error:0x%02x", ret);
+        tal_kv_batch_abort(batch);
+        return OPRT_KVS_WR_FAIL;
+    }
+
+    ret = tal_kv_batch_commit(batch);
     if (ret != OPRT_OK) {
-        PR_ERR("tal_kv_set regist_key, error:0x%02x", ret);
+        PR_ERR("tal_kv_batch_commit region regist_key, error:0x%02x", ret);
         return OPRT_KVS_WR_FAIL;
     }
 
@@ -65,13 +76,20 @@ static int tuya_region_regist_key_read(char *region, char *regist_key)
         return OPRT_INVALID_PARM;
     }
 
-    /* Read the region&env from kv storage */
+    /* Read the region&env from kv storage, in a batch to read a pair written together */
     int ret = 0;
     size_t len = 0;
     uint8_t *value = NULL;
+    KV_BATCH_HANDLE batch = NULL;
+    ret = tal_kv_batch_begin(&batch);
+    if (ret != OPRT_OK) {
+        return OPRT_KVS_RD_FAIL;
+    }
+
     ret = tal_kv_get("region", &value, &len);
     if (ret != OPRT_OK) {
         PR_ERR("tal_kv_get region fail:0x%02x", ret);
+        tal_kv_batch_abort(batch);
         return OPRT_KVS_RD_FAIL;
     }
     memcpy(region, value, MAX_LENGTH_REGION);
@@ -79,6 +97,7 @@ static int tuya_region_regist_key_read(char *region, char *regist_key)
     tal_kv_free(value);
 
     ret = tal_kv_get("regist_key", &value, &len);
+    tal_kv_batch_abort(batch);
     if (ret != OPRT_OK) {
         PR_ERR("tal_kv_get regist_key fail:0x%02x", ret);
         return OPRT_KVS_RD_FAIL;
@@ -245,10 +264,20 @@ int tuya_endpoint_region_regist_set(const char *region, const char *regist_key)
  */
 int tuya_endpoint_remove(void)
 {
-    tal_kv_del("region");
-    tal_kv_del("regist_key");
-    tal_kv_del("endpoint.cert");
-    tal_kv_del("endpoint.domain");
+    KV_BATCH_HANDLE batch = NULL;
+
+    if (OPRT_OK != tal_kv_batch_begin(&batch)) {
+        tal_kv_del("region");
+        tal_kv_del("regist_key");
+        tal_kv_del("endpoint.cert");
+        tal_kv_del("endpoint.domain");
+        return OPRT_OK;
+    }
+    tal_kv_batch_del(batch, "region");
+    tal_kv_batch_del(batch, "regist_key");
+    tal_kv_batch_del(batch, "endpoint.cert");
+    tal_kv_batch_del(batch, "endpoint.domain");
+    tal_kv_batch_commit(batch);
 
     return OPRT_OK;
 }
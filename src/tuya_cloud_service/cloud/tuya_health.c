@@ -291,7 +291,7 @@ static bool __health_memory_check(void)
 {
     // dump all active threads' wartmark
     extern void tal_thread_dump_watermark(void);
-    tal_workq_schedule(WORKQ_SYSTEM, (WORKQUEUE_CB)tal_thread_dump_watermark, NULL);
+    tal_workq_schedule_prio(WORKQ_SYSTEM, WORK_PRIO_LOW, 0, (WORKQUEUE_CB)tal_thread_dump_watermark, NULL);
 
     int free_heap = 0;
     free_heap = tal_system_get_free_heap_size();
@@ -196,6 +196,7 @@ int tuya_http_client_post_simple(char *url, char *body, http_client_header_t *he
     request.method = "POST";
     request.headers = headers;
     request.headers_count = headers_count;
+    request.keep_alive = true;
     request.host = tal_calloc(1, purl.field_data[UF_HOST].len + 1);
     request.path = tal_calloc(1, strlen(url) - purl.field_data[UF_PATH].off + 1);
     if (NULL == request.host || NULL == request.path) {
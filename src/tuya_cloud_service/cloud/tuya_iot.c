@@ -27,6 +27,7 @@
 #include "tuya_iot_dp.h"
 #include "tuya_register_center.h"
 #include "tuya_tls.h"
+#include "http_client_interface.h"
 #include "netmgr.h"
 #include "tuya_health.h"
 typedef enum {
@@ -52,10 +53,57 @@ typedef enum {
 
 static tuya_iot_client_t *s_iot_client_solo;
 
+#if defined(ENABLE_MQTT_EVENT_LOOP) && (ENABLE_MQTT_EVENT_LOOP == 1)
+/* these states end on a wakeup, the timeout only covers a network_check without link events */
+#define IOT_IDLE_WAIT_MS    IOT_EVENT_IDLE_WAIT_MS
+#define IOT_NETWORK_WAIT_MS IOT_EVENT_IDLE_WAIT_MS
+#else
+#define IOT_IDLE_WAIT_MS    500
+#define IOT_NETWORK_WAIT_MS 1000
+#endif
+
 /* -------------------------------------------------------------------------- */
 /*                          Internal utils functions                          */
 /* -------------------------------------------------------------------------- */
 
+/* sleeps in the iot thread, tuya_iot_start/stop/reset cut it short with ENABLE_MQTT_EVENT_LOOP */
+static void iot_wait(tuya_iot_client_t *client, uint32_t timeout_ms)
+{
+#if defined(ENABLE_MQTT_EVENT_LOOP) && (ENABLE_MQTT_EVENT_LOOP == 1)
+    tal_semaphore_wait(client->wakeup, timeout_ms);
+#else
+    tal_system_sleep(timeout_ms);
+#endif
+}
+
+static void iot_wakeup(tuya_iot_client_t *client)
+{
+#if defined(ENABLE_MQTT_EVENT_LOOP) && (ENABLE_MQTT_EVENT_LOOP == 1)
+    tal_semaphore_post(client->wakeup);
+#endif
+}
+
+#if defined(ENABLE_MQTT_EVENT_LOOP) && (ENABLE_MQTT_EVENT_LOOP == 1)
+static int iot_link_status_on(void *data)
+{
+    if (s_iot_client_solo) {
+        iot_wakeup(s_iot_client_solo);
+    }
+    return OPRT_OK;
+}
+#endif
+
+#if defined(ENABLE_HTTP_KEEPALIVE) && (ENABLE_HTTP_KEEPALIVE == 1)
+/* the idle https connections died with the link, do not try them first */
+static int iot_http_link_status_on(void *data)
+{
+    if (NETMGR_LINK_DOWN == (netmgr_status_e)(intptr_t)data) {
+        http_client_keepalive_flush();
+    }
+    return OPRT_OK;
+}
+#endif
+
 static int iot_dispatch_event(tuya_iot_client_t *client)
 {
     if (client->config.event_handler) {
@@ -109,6 +157,13 @@ static dp_schema_t *schema_instance_create(char *devid, char *schema_id)
     size_t readlen = 0;
     uint8_t *schema_data = NULL;
 
+#if defined(ENABLE_DP_SCHEMA_CACHE) && (ENABLE_DP_SCHEMA_CACHE == 1)
+    /* Binary cache hit, skip schema json parse */
+    if (OPRT_OK == dp_schema_cache_load(devid, schema_id, &schema)) {
+        return schema;
+    }
+#endif
+
     if (OPRT_OK != tal_kv_get((const char *)schema_id, &schema_data, &readlen)) {
         PR_WARN("schema data read failed");
         goto __exit;
@@ -116,6 +171,12 @@ static dp_schema_t *schema_instance_create(char *devid, char *schema_id)
 
     dp_schema_create(devid, (char *)schema_data, &schema);
 
+#if defined(ENABLE_DP_SCHEMA_CACHE) && (ENABLE_DP_SCHEMA_CACHE == 1)
+    if (schema) {
+        dp_schema_cache_save(schema, schema_id);
+    }
+#endif
+
 __exit:
     if (schema_data) {
         tal_kv_free(schema_data);
@@ -177,26 +238,41 @@ static int activate_response_parse(atop_base_response_t *response)
         return OPRT_CJSON_GET_ERR;
     }
 
-    // cJSON object to string save
-    char *schemaId = cJSON_GetObjectItem(result_root, "schemaId")->valuestring;
-    cJSON *schema_obj = cJSON_DetachItemFromObject(result_root, "schema");
-    ret = tal_kv_set(schemaId, (const uint8_t *)schema_obj->valuestring, strlen(schema_obj->valuestring));
-    cJSON_Delete(schema_obj);
+    // schema and activate info are saved together, a power loss keeps both or none
+    KV_BATCH_HANDLE batch = NULL;
+    ret = tal_kv_batch_begin(&batch);
     if (ret != OPRT_OK) {
         PR_ERR("activate data save error:%d", ret);
         return OPRT_KVS_WR_FAIL;
     }
 
+    // cJSON object to string save
+    char *schemaId = cJSON_GetObjectItem(result_root, "schemaId")->valuestring;
+    cJSON *schema_obj = cJSON_DetachItemFromObject(result_root, "schema");
+    ret = tal_kv_batch_put(batch, schemaId, (const uint8_t *)schema_obj->valuestring, strlen(schema_obj->valuestring));
+    cJSON_Delete(schema_obj);
+
     // activate info save
     char *result_string = cJSON_PrintUnformatted(result_root);
     const char *activate_data_key = client->config.storage_namespace;
     PR_DEBUG("result len %d :%s", (int)strlen(result_string), result_string);
-    ret = tal_kv_set(activate_data_key, (const uint8_t *)result_string, strlen(result_string));
+    if (ret == OPRT_OK) {
+        ret = tal_kv_batch_put(batch, activate_data_key, (const uint8_t *)result_string, strlen(result_string));
+    }
     tal_free(result_string);
+    if (ret == OPRT_OK) {
+        ret = tal_kv_batch_commit(batch);
+    } else {
+        tal_kv_batch_abort(batch);
+    }
     if (ret != OPRT_OK) {
         PR_ERR("activate data save error:%d", ret);
         return OPRT_KVS_WR_FAIL;
     }
+#if defined(ENABLE_DP_SCHEMA_CACHE) && (ENABLE_DP_SCHEMA_CACHE == 1)
+    /* Schema json changed, drop the stale binary cache */
+    dp_schema_cache_delete(schemaId);
+#endif
 
     if (cJSON_GetObjectItem(result_root, "resetFactory") != NULL) {
         BOOL_T cloud_reset_factory =
@@ -572,6 +648,16 @@ int tuya_iot_init(tuya_iot_client_t *client, const tuya_iot_config_t *config)
     PR_DEBUG("authkey:%s", client->config.authkey);
 
     tal_semaphore_create_init(&client->token_get.sem, 0, 1);
+#if defined(ENABLE_MQTT_EVENT_LOOP) && (ENABLE_MQTT_EVENT_LOOP == 1)
+    ret = tal_semaphore_create_init(&client->wakeup, 0, 1);
+    if (OPRT_OK != ret) {
+        return ret;
+    }
+    tal_event_subscribe(EVENT_LINK_STATUS_CHG, "iot", iot_link_status_on, SUBSCRIBE_TYPE_NORMAL);
+#endif
+#if defined(ENABLE_HTTP_KEEPALIVE) && (ENABLE_HTTP_KEEPALIVE == 1)
+    tal_event_subscribe(EVENT_LINK_STATUS_CHG, "iot_http", iot_http_link_status_on, SUBSCRIBE_TYPE_NORMAL);
+#endif
 
     /* Default storage namespace */
     if (client->config.storage_namespace == NULL) {
@@ -629,6 +715,7 @@ int tuya_iot_start(tuya_iot_client_t *client)
         return OPRT_COM_ERROR;
     }
     client->nextstate = STATE_START;
+    iot_wakeup(client);
     return OPRT_OK;
 }
 
@@ -643,6 +730,7 @@ int tuya_iot_start(tuya_iot_client_t *client)
 int tuya_iot_stop(tuya_iot_client_t *client)
 {
     client->nextstate = STATE_STOP;
+    iot_wakeup(client);
     return OPRT_OK;
 }
 
@@ -663,6 +751,7 @@ int tuya_iot_reconnect(tuya_iot_client_t *client)
         return OPRT_COM_ERROR;
     }
     client->nextstate = STATE_MQTT_RECONNECT;
+    iot_wakeup(client);
     return OPRT_OK;
 }
 
@@ -697,6 +786,7 @@ int tuya_iot_reset(tuya_iot_client_t *client)
     client->event.value.asInteger = TUYA_RESET_TYPE_FACTORY;
     iot_dispatch_event(client);
     client->nextstate = STATE_RESET;
+    iot_wakeup(client);
 
     if (client->state == STATE_TOKEN_PENDING) {
         client->token_get.result = OPRT_COM_ERROR;
@@ -778,10 +868,15 @@ int tuya_iot_yield(tuya_iot_client_t *client)
     case STATE_MQTT_YIELD:
         tuya_mqtt_loop(&client->mqctx);
         matop_serice_yield(&client->matop);
+#if defined(ENABLE_MQTT_EVENT_LOOP) && (ENABLE_MQTT_EVENT_LOOP == 1)
+        if (!tuya_mqtt_connected(&client->mqctx)) {
+            iot_wait(client, tuya_mqtt_reconnect_wait(&client->mqctx));
+        }
+#endif
         break;
 
     case STATE_IDLE:
-        tal_system_sleep(500);
+        iot_wait(client, IOT_IDLE_WAIT_MS);
         break;
 
     case STATE_START:
@@ -848,7 +943,7 @@ int tuya_iot_yield(tuya_iot_client_t *client)
             client->status = TUYA_STATUS_WIFI_CONNECTED;
             client->nextstate = client->is_activated ? STATE_ENDPOINT_GET : STATE_ENDPOINT_UPDATE;
         } else {
-            tal_system_sleep(1000);
+            iot_wait(client, IOT_NETWORK_WAIT_MS);
         }
         break;
 
@@ -866,7 +961,7 @@ int tuya_iot_yield(tuya_iot_client_t *client)
     case STATE_ENDPOINT_UPDATE:
         ret = tuya_endpoint_update();
         if (ret != OPRT_OK) {
-            tal_system_sleep(1000);
+            iot_wait(client, 1000);
             break;
         }
         if (client->is_activated) {
@@ -884,7 +979,7 @@ int tuya_iot_yield(tuya_iot_client_t *client)
     case STATE_ACTIVATING:
         ret = client_activate_process(client, client->binding->token);
         if (ret != OPRT_OK) {
-            tal_system_sleep(1000);
+            iot_wait(client, 1000);
             break;
         }
 
@@ -929,7 +1024,11 @@ int tuya_iot_yield(tuya_iot_client_t *client)
     case STATE_MQTT_CONNECT_START:
         if (run_state_mqtt_connect_start(client) == OPRT_OK) {
             client->nextstate = STATE_MQTT_CONNECTING;
+            break;
         }
+#if defined(ENABLE_MQTT_EVENT_LOOP) && (ENABLE_MQTT_EVENT_LOOP == 1)
+        iot_wait(client, tuya_mqtt_reconnect_wait(&client->mqctx));
+#endif
         break;
 
     case STATE_MQTT_CONNECTING:
@@ -956,7 +1055,7 @@ int tuya_iot_yield(tuya_iot_client_t *client)
             client->status = TUYA_STATUS_WIFI_CONNECTED;
             client->nextstate = STATE_MQTT_CONNECT_START;
         } else {
-            tal_system_sleep(1000);
+            iot_wait(client, IOT_NETWORK_WAIT_MS);
         }
         break;
 
@@ -1019,8 +1118,13 @@ int tuya_iot_activated_data_remove(tuya_iot_client_t *client)
     /* Clean client local data */
     dp_schema_delete(client->activate.devid);
     tal_kv_del((const char *)(client->activate.schemaId));
+#if defined(ENABLE_DP_SCHEMA_CACHE) && (ENABLE_DP_SCHEMA_CACHE == 1)
+    dp_schema_cache_delete((const char *)(client->activate.schemaId));
+#endif
     tal_kv_del((const char *)(client->config.storage_namespace));
     tuya_endpoint_remove();
+    tuya_tls_session_cache_clear();
+    http_client_keepalive_flush();
     client->is_activated = false;
     PR_INFO("Activated data remove successed");
 
@@ -223,6 +223,9 @@ struct tuya_iot_client_handle {
     matop_context_t matop;
     tuya_event_msg_t event;
     tuya_token_get_t token_get;
+#if defined(ENABLE_MQTT_EVENT_LOOP) && (ENABLE_MQTT_EVENT_LOOP == 1)
+    SEM_HANDLE wakeup; /* posted when nextstate or the link changes */
+#endif
     tuya_binding_info_t *binding;
     TIMER_ID check_upgrade_timer;
     uint8_t status;
@@ -326,7 +329,8 @@ int tuya_iot_dp_report_json_with_time(tuya_iot_client_t *client, const char *dps
  * @param cb - report result callback, result: OPRT_OK or OPRT_TIMEOUT.
  * @param user_data - user context data.
  * @param timeout_ms - timeout setting uint ms.
- * @return int - OPRT_OK successful or error code.
+ * @return int - OPRT_OK successful, OPRT_EXCEED_UPPER_LIMIT when MQTT_PUBLISH_QUEUE_MAX
+ *               reports are pending, or error code. cb is only called on OPRT_OK.
  */
 int tuya_iot_dp_report_json_async(tuya_iot_client_t *client, const char *dps, const char *time, tuya_dp_notify_cb_t cb,
                                   void *user_data, int timeout_ms);
@@ -340,7 +344,8 @@ int tuya_iot_dp_report_json_async(tuya_iot_client_t *client, const char *dps, co
  * @param cb - report result callback, result: OPRT_OK or OPRT_TIMEOUT.
  * @param user_data - user context data.
  * @param timeout_ms - timeout setting uint ms.
- * @return int - OPRT_OK successful or error code.
+ * @return int - OPRT_OK successful, OPRT_EXCEED_UPPER_LIMIT when MQTT_PUBLISH_QUEUE_MAX
+ *               reports are pending, or error code. cb is only called on OPRT_OK.
  */
 int tuya_iot_dp_report_json_with_notify(tuya_iot_client_t *client, const char *dps, const char *time,
                                         tuya_dp_notify_cb_t cb, void *user_data, int timeout_ms);
@@ -20,6 +20,34 @@
 #include "tuya_endpoint.h"
 #include "iotdns.h"
 #include "mix_method.h"
+#include "tuya_ota_delta.h"
+
+#if defined(ENABLE_OTA_RESUME) && (ENABLE_OTA_RESUME == 1)
+#if !defined(MBEDTLS_CONFIG_FILE)
+#include "tuya_tls_config.h"
+#else
+#include MBEDTLS_CONFIG_FILE
+#endif
+#include "mbedtls/sha256.h"
+
+//! the midstate of a software sha256 context can be saved and restored
+#if defined(MBEDTLS_SHA256_C) && !defined(MBEDTLS_SHA256_ALT)
+#define OTA_RESUME_ENABLE
+#endif
+#endif
+
+#ifdef OTA_RESUME_ENABLE
+#define OTA_CHECKPOINT_KEY "ota_ckpt"
+
+#ifndef OTA_CHECKPOINT_SIZE
+#define OTA_CHECKPOINT_SIZE (64 * 1024)
+#endif
+
+typedef struct {
+    char fw_hmac[FW_HMAC_LEN + 1];
+    mbedtls_sha256_context sha256;
+} ota_checkpoint_t;
+#endif
 
 typedef struct {
     tuya_ota_config_t config;
@@ -28,7 +56,17 @@ typedef struct {
     uint8_t channel;
     uint8_t progress_percent;
     THREAD_HANDLE upgrade_thrd;
+#ifdef OTA_RESUME_ENABLE
+    mbedtls_sha256_context sha256;
+    ota_checkpoint_t checkpoint;
+#else
     TKL_HASH_HANDLE sha256;
+#endif
+#if defined(ENABLE_OTA_DELTA) && (ENABLE_OTA_DELTA == 1)
+    bool image_started;
+    tuya_ota_delta_t *delta;
+    int delta_rt;
+#endif
 } tuya_ota_t;
 
 int tuya_ota_upgrade_status_report(tuya_ota_t *handle, int status);
@@ -36,6 +74,111 @@ int tuya_ota_upgrade_progress_report(tuya_ota_t *handle, int percent);
 
 static tuya_ota_t *s_ota_ctx;
 
+static void ota_sha256_start(tuya_ota_t *ota)
+{
+#ifdef OTA_RESUME_ENABLE
+    mbedtls_sha256_init(&ota->sha256);
+    mbedtls_sha256_starts(&ota->sha256, 0);
+#else
+    tal_sha256_create_init(&ota->sha256);
+    tal_sha256_starts_ret(ota->sha256, 0);
+#endif
+}
+
+static void ota_sha256_update(tuya_ota_t *ota, const uint8_t *data, size_t len)
+{
+#ifdef OTA_RESUME_ENABLE
+    mbedtls_sha256_update(&ota->sha256, data, len);
+#else
+    tal_sha256_update_ret(ota->sha256, data, len);
+#endif
+}
+
+static void ota_sha256_finish(tuya_ota_t *ota, uint8_t output[32])
+{
+#ifdef OTA_RESUME_ENABLE
+    mbedtls_sha256_finish(&ota->sha256, output);
+    mbedtls_sha256_free(&ota->sha256);
+#else
+    tal_sha256_finish_ret(ota->sha256, output);
+    tal_sha256_free(ota->sha256);
+#endif
+}
+
+static void ota_image_data_write(tuya_ota_t *ota, http_download_event_t *event)
+{
+    TUYA_OTA_DATA_T ota_pack;
+
+    ota_pack.total_len = event->file_size;
+    ota_pack.offset = event->offset;
+    ota_pack.data = event->data;
+    ota_pack.len = event->data_len;
+    ota_pack.pri_data = NULL;
+    tal_ota_data_process(&ota_pack, (uint32_t *)&event->remain_len);
+    if (event->remain_len) {
+        ota_sha256_update(ota, event->data, event->data_len - event->remain_len);
+    } else {
+        ota_sha256_update(ota, event->data, event->data_len);
+    }
+}
+
+#if defined(ENABLE_OTA_DELTA) && (ENABLE_OTA_DELTA == 1)
+/* the image is started on the first data, a delta package starts it once its header is verified */
+static int ota_image_begin(tuya_ota_t *ota, http_download_event_t *event)
+{
+    if (ota->image_started) {
+        return OPRT_OK;
+    }
+    if (0 == event->offset && event->data_len < TUYA_OTA_DELTA_MAGIC_LEN && event->data_len < event->file_size) {
+        return OPRT_RESOURCE_NOT_READY;
+    }
+    ota->image_started = true;
+    ota->delta_rt = OPRT_OK;
+
+    if (0 == event->offset && tuya_ota_delta_is_patch(event->data, event->data_len)) {
+        PR_DEBUG("delta ota package");
+        ota->delta_rt = tuya_ota_delta_create(&ota->delta);
+        return OPRT_OK;
+    }
+    return tal_ota_start_notify(event->file_size, TUYA_OTA_FULL, TUYA_OTA_PATH_AIR);
+}
+
+/* returns true if the data belongs to a delta package and was taken by the applier */
+static bool ota_image_delta_data(tuya_ota_t *ota, http_download_event_t *event)
+{
+    if (OPRT_RESOURCE_NOT_READY == ota_image_begin(ota, event)) {
+        //! too short to tell a delta package, wait for more
+        event->remain_len = event->data_len;
+        return true;
+    }
+    if (NULL == ota->delta && OPRT_OK == ota->delta_rt) {
+        return false;
+    }
+
+    //! a failed package is still downloaded to the end, the error is reported on finish
+    if (OPRT_OK == ota->delta_rt) {
+        ota->delta_rt = tuya_ota_delta_apply(ota->delta, event->data, event->data_len);
+    }
+    event->remain_len = 0;
+    ota_sha256_update(ota, event->data, event->data_len);
+    return true;
+}
+
+static int ota_image_end(tuya_ota_t *ota)
+{
+    int rt = ota->delta_rt;
+
+    if (ota->delta && OPRT_OK == rt) {
+        rt = tuya_ota_delta_finish(ota->delta);
+    }
+    tuya_ota_delta_destroy(ota->delta);
+    ota->delta = NULL;
+    ota->delta_rt = OPRT_OK;
+    ota->image_started = false;
+    return rt;
+}
+#endif
+
 static void file_download_event_cb(http_download_event_id_t id, http_download_event_t *event)
 {
     tuya_ota_t *ota = (tuya_ota_t *)event->user_data;
@@ -49,14 +192,47 @@ static void file_download_event_cb(http_download_event_id_t id, http_download_ev
     case DL_EVENT_START:
         PR_DEBUG("DL_EVENT_START");
         tuya_ota_upgrade_status_report(ota, TUS_UPGRDING);
-        tal_sha256_create_init(&ota->sha256);
-        tal_sha256_starts_ret(ota->sha256, 0);
+        ota_sha256_start(ota);
+        break;
+
+#ifdef OTA_RESUME_ENABLE
+    case DL_EVENT_ON_RESUME:
+        //! only a checkpoint of the same firmware can continue the hash
+        if (event->data_len != sizeof(ota_checkpoint_t)) {
+            event->offset = 0;
+            break;
+        }
+        memcpy(&ota->checkpoint, event->data, sizeof(ota_checkpoint_t));
+        if (strcmp(ota->checkpoint.fw_hmac, ota->msg.fw_hmac)) {
+            event->offset = 0;
+            break;
+        }
+        PR_DEBUG("DL_EVENT_ON_RESUME:%d", event->offset);
+        memcpy(&ota->sha256, &ota->checkpoint.sha256, sizeof(mbedtls_sha256_context));
+        ota->progress_percent = event->offset * 100 / event->file_size;
+        break;
+
+    case DL_EVENT_ON_CHECKPOINT:
+#if defined(ENABLE_OTA_DELTA) && (ENABLE_OTA_DELTA == 1)
+        //! the delta applier state cannot be saved, a delta package gets no checkpoint and restarts from the beginning
+        if (ota->delta) {
+            event->offset = 0;
+            break;
+        }
+#endif
+        strcpy(ota->checkpoint.fw_hmac, ota->msg.fw_hmac);
+        memcpy(&ota->checkpoint.sha256, &ota->sha256, sizeof(mbedtls_sha256_context));
+        event->data = &ota->checkpoint;
+        event->data_len = sizeof(ota_checkpoint_t);
         break;
+#endif
 
     case DL_EVENT_ON_FILESIZE:
         PR_DEBUG("DL_EVENT_ON_FILESIZE");
         if (0 == ota->channel) {
+#if !defined(ENABLE_OTA_DELTA) || (ENABLE_OTA_DELTA == 0)
             tal_ota_start_notify(event->file_size, TUYA_OTA_FULL, TUYA_OTA_PATH_AIR);
+#endif
         } else if (event_cb) {
             ota->event.id = TUYA_OTA_EVENT_START;
             ota->event.file_size = event->file_size;
@@ -69,19 +245,14 @@ static void file_download_event_cb(http_download_event_id_t id, http_download_ev
         PR_DEBUG("DL_EVENT_ON_DATA:%d", event->data_len);
         PR_DEBUG("event->file_size %d, offset:%d, last remain %d", event->file_size, event->offset, event->remain_len);
         if (0 == ota->channel) {
-            TUYA_OTA_DATA_T ota_pack;
-
-            ota_pack.total_len = event->file_size;
-            ota_pack.offset = event->offset;
-            ota_pack.data = event->data;
-            ota_pack.len = event->data_len;
-            ota_pack.pri_data = NULL;
-            tal_ota_data_process(&ota_pack, (uint32_t *)&event->remain_len);
-            if (event->remain_len) {
-                tal_sha256_update_ret(ota->sha256, event->data, event->data_len - event->remain_len);
-            } else {
-                tal_sha256_update_ret(ota->sha256, event->data, event->data_len);
+#if defined(ENABLE_OTA_DELTA) && (ENABLE_OTA_DELTA == 1)
+            //! a delta package is rebuilt and written by the applier
+            if (!ota_image_delta_data(ota, event)) {
+                ota_image_data_write(ota, event);
             }
+#else
+            ota_image_data_write(ota, event);
+#endif
         } else if (event_cb) {
             ota->event.id = TUYA_OTA_EVENT_ON_DATA;
             ota->event.data = event->data;
@@ -101,12 +272,19 @@ static void file_download_event_cb(http_download_event_id_t id, http_download_ev
     case DL_EVENT_FINISH:
         PR_DEBUG("DL_EVENT_FINISH");
         PR_DEBUG("File Download Percent: %d%%", 100);
-        tal_sha256_finish_ret(ota->sha256, file_hmac);
-        tal_sha256_free(ota->sha256);
+        ota_sha256_finish(ota, file_hmac);
         hex2str((uint8_t *)file_sha256, file_hmac, 32);
         tal_sha256_mac((const uint8_t *)client->activate.seckey, strlen(client->activate.seckey), file_sha256, 32 * 2,
                        file_hmac);
         ascs2hex(self_hmac, (uint8_t *)(ota->msg.fw_hmac), FW_HMAC_LEN);
+#if defined(ENABLE_OTA_DELTA) && (ENABLE_OTA_DELTA == 1)
+        //! a delta package must also have rebuilt the image it describes
+        if (OPRT_OK != ota_image_end(ota)) {
+            PR_ERR("delta ota apply failed");
+            tuya_ota_upgrade_status_report(ota, TUS_UPGRD_EXEC);
+            break;
+        }
+#endif
         if ((memcmp(self_hmac, file_hmac, 32) == 0)) {
             PR_DEBUG("file hmac check success");
             tuya_ota_upgrade_progress_report(ota, 100);
@@ -122,6 +300,9 @@ static void file_download_event_cb(http_download_event_id_t id, http_download_ev
 
     case DL_EVENT_FAULT:
         PR_DEBUG("DL_EVENT_FAULT");
+#if defined(ENABLE_OTA_DELTA) && (ENABLE_OTA_DELTA == 1)
+        ota_image_end(ota);
+#endif
         tuya_ota_upgrade_status_report(ota, TUS_UPGRD_EXEC);
         if (event_cb) {
             ota->event.id = TUYA_OTA_EVENT_FAULT;
@@ -170,6 +351,7 @@ static void ota_process_thread_func(void *arg)
     tuya_iotdns_query_domain_certs(ota->msg.fw_url, &cert, &cert_len);
 
     http_download_config_t download_cfg;
+    memset(&download_cfg, 0, sizeof(download_cfg));
     download_cfg.file_size = ota->msg.file_size;
     download_cfg.range_length = ota->config.range_size;
     download_cfg.timeout_ms = ota->config.timeout_ms;
@@ -178,6 +360,16 @@ static void ota_process_thread_func(void *arg)
     download_cfg.url = ota->msg.fw_url;
     download_cfg.event_handler = file_download_event_cb;
     download_cfg.user_data = ota;
+#if defined(ENABLE_OTA_DOWNLOAD_PIPELINE) && (ENABLE_OTA_DOWNLOAD_PIPELINE == 1)
+    download_cfg.pipeline = true;
+#endif
+#ifdef OTA_RESUME_ENABLE
+    //! user channels handle the data themselves and may not be able to continue
+    if (0 == ota->channel) {
+        download_cfg.resume_key = OTA_CHECKPOINT_KEY;
+        download_cfg.checkpoint_size = OTA_CHECKPOINT_SIZE;
+    }
+#endif
 
     http_file_download(&download_cfg);
     tal_free(cert);
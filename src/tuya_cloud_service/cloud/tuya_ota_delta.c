@@ -0,0 +1,528 @@
+/**
+ * @file tuya_ota_delta.c
+ * @brief Streaming applier of binary delta ota packages.
+ *
+ * The package is parsed by a byte oriented state machine, so it can be fed
+ * with download chunks of any size. The old image is read from the
+ * TUYA_FLASH_TYPE_APP partition and the rebuilt image is buffered and written
+ * through tal_ota_data_process, the same path a full image takes.
+ *
+ * @copyright Copyright (c) 2021-2024 Tuya Inc. All Rights Reserved.
+ *
+ */
+
+#include "tuya_ota_delta.h"
+
+#if defined(ENABLE_OTA_DELTA) && (ENABLE_OTA_DELTA == 1)
+
+#include "tal_api.h"
+#include "tkl_flash.h"
+
+#ifndef OTA_DELTA_BUF_SIZE
+#define OTA_DELTA_BUF_SIZE 4096
+#endif
+
+#define OTA_DELTA_HEADER_LEN (4 + 4 + 4 + 4 + 32 + 32)
+
+//! the body is lzss coded: flag 1 + 8 bit literal, or flag 0 + window offset + length
+#define OTA_DELTA_LZ_WINDOW_BITS 8
+#define OTA_DELTA_LZ_LENGTH_BITS 4
+#define OTA_DELTA_LZ_MIN_MATCH   3
+#define OTA_DELTA_LZ_WINDOW      (1 << OTA_DELTA_LZ_WINDOW_BITS)
+#define OTA_DELTA_LZ_REF_BITS    (1 + OTA_DELTA_LZ_WINDOW_BITS + OTA_DELTA_LZ_LENGTH_BITS)
+#define OTA_DELTA_LZ_STAGE_SIZE  64
+
+typedef enum {
+    DELTA_STATE_HEADER,
+    DELTA_STATE_CTRL,
+    DELTA_STATE_DIFF_TOKEN,
+    DELTA_STATE_DIFF_LITERAL,
+    DELTA_STATE_EXTRA,
+    DELTA_STATE_DONE,
+} delta_state_t;
+
+struct tuya_ota_delta {
+    delta_state_t state;
+    uint8_t header[OTA_DELTA_HEADER_LEN];
+    uint32_t header_len;
+    uint32_t old_addr;
+    uint32_t old_size;
+    uint32_t new_size;
+    uint8_t new_sha256[32];
+    TKL_HASH_HANDLE sha256;
+    /* varint being parsed and the record control it belongs to */
+    uint32_t varint;
+    uint8_t varint_shift;
+    uint8_t ctrl_idx;
+    uint32_t ctrl[3];
+    /* position in the old image and what is left of the current record */
+    uint32_t old_pos;
+    uint32_t diff_left;
+    uint32_t literal_left;
+    uint32_t extra_left;
+    /* rebuilt image not yet taken by tal_ota_data_process */
+    uint8_t out[OTA_DELTA_BUF_SIZE];
+    uint32_t out_len;
+    uint32_t out_offset;
+    uint32_t new_pos;
+    /* lzss decoder */
+    uint32_t lz_bits;
+    uint8_t lz_bit_cnt;
+    uint8_t lz_window[OTA_DELTA_LZ_WINDOW];
+    uint32_t lz_pos;
+    uint8_t lz_stage[OTA_DELTA_LZ_STAGE_SIZE];
+    uint32_t lz_stage_len;
+};
+
+static uint32_t __get_le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static int __delta_flush(tuya_ota_delta_t *delta)
+{
+    OPERATE_RET rt = OPRT_OK;
+    uint32_t remain_len = 0;
+    TUYA_OTA_DATA_T pack;
+
+    if (0 == delta->out_len) {
+        return OPRT_OK;
+    }
+
+    pack.total_len = delta->new_size;
+    pack.offset = delta->out_offset;
+    pack.data = delta->out;
+    pack.len = delta->out_len;
+    pack.pri_data = NULL;
+    rt = tal_ota_data_process(&pack, &remain_len);
+    if (OPRT_OK != rt) {
+        PR_ERR("delta ota write err:%d", rt);
+        return rt;
+    }
+    if (remain_len > delta->out_len) {
+        remain_len = delta->out_len;
+    }
+    //! the platform keeps the tail until more data arrives
+    memmove(delta->out, delta->out + delta->out_len - remain_len, remain_len);
+    delta->out_offset += delta->out_len - remain_len;
+    delta->out_len = remain_len;
+    if (delta->out_len == OTA_DELTA_BUF_SIZE) {
+        PR_ERR("delta ota write stalled");
+        return OPRT_COM_ERROR;
+    }
+
+    return OPRT_OK;
+}
+
+/* hand out space in the output buffer, writing it to flash when full */
+static int __delta_out_reserve(tuya_ota_delta_t *delta, uint32_t want, uint32_t *len)
+{
+    OPERATE_RET rt = OPRT_OK;
+
+    if (delta->out_len == OTA_DELTA_BUF_SIZE) {
+        TUYA_CALL_ERR_RETURN(__delta_flush(delta));
+    }
+    *len = OTA_DELTA_BUF_SIZE - delta->out_len;
+    if (*len > want) {
+        *len = want;
+    }
+    if (delta->new_pos + *len > delta->new_size) {
+        PR_ERR("delta ota rebuilds more than %d bytes", delta->new_size);
+        return OPRT_EXCEED_UPPER_LIMIT;
+    }
+
+    return OPRT_OK;
+}
+
+static void __delta_out_commit(tuya_ota_delta_t *delta, uint32_t len)
+{
+    tal_sha256_update_ret(delta->sha256, delta->out + delta->out_len, len);
+    delta->out_len += len;
+    delta->new_pos += len;
+}
+
+/* copy old bytes with the difference added, NULL diff means an unchanged run */
+static int __delta_copy_old(tuya_ota_delta_t *delta, const uint8_t *diff, uint32_t len)
+{
+    OPERATE_RET rt = OPRT_OK;
+    uint32_t n = 0, i = 0;
+
+    if (delta->old_pos + len > delta->old_size || delta->old_pos + len < delta->old_pos) {
+        PR_ERR("delta ota reads beyond the old image");
+        return OPRT_EXCEED_UPPER_LIMIT;
+    }
+
+    while (len) {
+        TUYA_CALL_ERR_RETURN(__delta_out_reserve(delta, len, &n));
+        TUYA_CALL_ERR_RETURN(tkl_flash_read(delta->old_addr + delta->old_pos, delta->out + delta->out_len, n));
+        if (diff) {
+            for (i = 0; i < n; i++) {
+                delta->out[delta->out_len + i] += diff[i];
+            }
+            diff += n;
+        }
+        __delta_out_commit(delta, n);
+        delta->old_pos += n;
+        len -= n;
+    }
+
+    return OPRT_OK;
+}
+
+static int __delta_copy_new(tuya_ota_delta_t *delta, const uint8_t *data, uint32_t len)
+{
+    OPERATE_RET rt = OPRT_OK;
+    uint32_t n = 0;
+
+    while (len) {
+        TUYA_CALL_ERR_RETURN(__delta_out_reserve(delta, len, &n));
+        memcpy(delta->out + delta->out_len, data, n);
+        __delta_out_commit(delta, n);
+        data += n;
+        len -= n;
+    }
+
+    return OPRT_OK;
+}
+
+static int __delta_header_parse(tuya_ota_delta_t *delta)
+{
+    OPERATE_RET rt = OPRT_OK;
+    uint8_t sha256[32];
+    uint32_t pos = 0, n = 0;
+    TUYA_FLASH_BASE_INFO_T info;
+
+    if (!tuya_ota_delta_is_patch(delta->header, delta->header_len) ||
+        TUYA_OTA_DELTA_VERSION != __get_le32(delta->header + 4)) {
+        PR_ERR("delta ota header invalid");
+        return OPRT_INVALID_PARM;
+    }
+    delta->old_size = __get_le32(delta->header + 8);
+    delta->new_size = __get_le32(delta->header + 12);
+    memcpy(delta->new_sha256, delta->header + 16 + 32, 32);
+
+    memset(&info, 0, sizeof(info));
+    TUYA_CALL_ERR_RETURN(tkl_flash_get_one_type_info(TUYA_FLASH_TYPE_APP, &info));
+    if (0 == info.partition_num || delta->old_size > info.partition[0].size) {
+        PR_ERR("delta ota old image size %d invalid", delta->old_size);
+        return OPRT_INVALID_PARM;
+    }
+    delta->old_addr = info.partition[0].start_addr;
+
+    //! the package only applies to the image it was made from, nothing is rebuilt yet so borrow the out buffer
+    tal_sha256_starts_ret(delta->sha256, 0);
+    for (pos = 0; pos < delta->old_size; pos += n) {
+        n = delta->old_size - pos > OTA_DELTA_BUF_SIZE ? OTA_DELTA_BUF_SIZE : delta->old_size - pos;
+        TUYA_CALL_ERR_RETURN(tkl_flash_read(delta->old_addr + pos, delta->out, n));
+        tal_sha256_update_ret(delta->sha256, delta->out, n);
+    }
+    tal_sha256_finish_ret(delta->sha256, sha256);
+    if (memcmp(sha256, delta->header + 16, 32)) {
+        PR_ERR("delta ota does not match the running image");
+        return OPRT_COM_ERROR;
+    }
+
+    PR_INFO("delta ota old:%d new:%d", delta->old_size, delta->new_size);
+    TUYA_CALL_ERR_RETURN(tal_ota_start_notify(delta->new_size, TUYA_OTA_FULL, TUYA_OTA_PATH_AIR));
+    tal_sha256_starts_ret(delta->sha256, 0);
+
+    return rt;
+}
+
+/* feed one byte of a varint, true once it is complete */
+static bool __delta_varint(tuya_ota_delta_t *delta, uint8_t byte, uint32_t *value)
+{
+    delta->varint |= (uint32_t)(byte & 0x7f) << delta->varint_shift;
+    if (byte & 0x80) {
+        delta->varint_shift += 7;
+        return false;
+    }
+    *value = delta->varint;
+    delta->varint = 0;
+    delta->varint_shift = 0;
+    return true;
+}
+
+static void __delta_record_start(tuya_ota_delta_t *delta)
+{
+    delta->diff_left = delta->ctrl[0];
+    delta->extra_left = delta->ctrl[1];
+    delta->state = delta->diff_left ? DELTA_STATE_DIFF_TOKEN : DELTA_STATE_EXTRA;
+}
+
+static int __delta_record_end(tuya_ota_delta_t *delta)
+{
+    //! zigzag decoded seek of the old position
+    int32_t seek = (int32_t)(delta->ctrl[2] >> 1) ^ -(int32_t)(delta->ctrl[2] & 1);
+
+    if ((seek < 0 && (uint32_t)(-seek) > delta->old_pos) || delta->old_pos + seek > delta->old_size) {
+        PR_ERR("delta ota seeks beyond the old image");
+        return OPRT_EXCEED_UPPER_LIMIT;
+    }
+    delta->old_pos += seek;
+    delta->state = delta->new_pos == delta->new_size ? DELTA_STATE_DONE : DELTA_STATE_CTRL;
+    return OPRT_OK;
+}
+
+/**
+ * @brief Checks whether the head of a download is a delta package.
+ *
+ * @param data The first bytes of the file.
+ * @param len The length of data, at least TUYA_OTA_DELTA_MAGIC_LEN.
+ *
+ * @return true if the file is a delta package.
+ */
+bool tuya_ota_delta_is_patch(const uint8_t *data, size_t len)
+{
+    return len >= TUYA_OTA_DELTA_MAGIC_LEN && 0 == memcmp(data, TUYA_OTA_DELTA_MAGIC, TUYA_OTA_DELTA_MAGIC_LEN);
+}
+
+/**
+ * @brief Creates a delta applier.
+ *
+ * @param delta Receives the applier handle.
+ *
+ * @return OPRT_OK on success, others on failure.
+ */
+int tuya_ota_delta_create(tuya_ota_delta_t **delta)
+{
+    OPERATE_RET rt = OPRT_OK;
+    tuya_ota_delta_t *ctx = NULL;
+
+    ctx = tal_malloc(sizeof(tuya_ota_delta_t));
+    TUYA_CHECK_NULL_RETURN(ctx, OPRT_MALLOC_FAILED);
+    memset(ctx, 0, sizeof(tuya_ota_delta_t));
+
+    rt = tal_sha256_create_init(&ctx->sha256);
+    if (OPRT_OK != rt) {
+        tal_free(ctx);
+        return rt;
+    }
+    ctx->state = DELTA_STATE_HEADER;
+    *delta = ctx;
+
+    return OPRT_OK;
+}
+
+static int __delta_body_feed(tuya_ota_delta_t *delta, const uint8_t *data, uint32_t len)
+{
+    OPERATE_RET rt = OPRT_OK;
+    uint32_t n = 0, token = 0;
+
+    while (len) {
+        switch (delta->state) {
+        case DELTA_STATE_CTRL:
+            n = 1;
+            if (delta->varint_shift > 28) {
+                return OPRT_INVALID_PARM;
+            }
+            if (__delta_varint(delta, *data, &delta->ctrl[delta->ctrl_idx]) && 3 == ++delta->ctrl_idx) {
+                delta->ctrl_idx = 0;
+                __delta_record_start(delta);
+            }
+            break;
+
+        case DELTA_STATE_DIFF_TOKEN:
+            n = 1;
+            if (delta->varint_shift > 28) {
+                return OPRT_INVALID_PARM;
+            }
+            if (!__delta_varint(delta, *data, &token)) {
+                break;
+            }
+            //! odd token: run of unchanged bytes, even token: literal difference follows
+            if (0 == (token >> 1) || (token >> 1) > delta->diff_left) {
+                PR_ERR("delta ota diff token invalid");
+                return OPRT_INVALID_PARM;
+            }
+            if (token & 1) {
+                TUYA_CALL_ERR_RETURN(__delta_copy_old(delta, NULL, token >> 1));
+                delta->diff_left -= token >> 1;
+            } else {
+                delta->literal_left = token >> 1;
+                delta->state = DELTA_STATE_DIFF_LITERAL;
+                break;
+            }
+            if (0 == delta->diff_left) {
+                delta->state = DELTA_STATE_EXTRA;
+            }
+            break;
+
+        case DELTA_STATE_DIFF_LITERAL:
+            n = delta->literal_left > len ? len : delta->literal_left;
+            TUYA_CALL_ERR_RETURN(__delta_copy_old(delta, data, n));
+            delta->literal_left -= n;
+            delta->diff_left -= n;
+            if (0 == delta->literal_left) {
+                delta->state = delta->diff_left ? DELTA_STATE_DIFF_TOKEN : DELTA_STATE_EXTRA;
+            }
+            break;
+
+        case DELTA_STATE_EXTRA:
+            n = delta->extra_left > len ? len : delta->extra_left;
+            TUYA_CALL_ERR_RETURN(__delta_copy_new(delta, data, n));
+            delta->extra_left -= n;
+            break;
+
+        case DELTA_STATE_HEADER:
+        case DELTA_STATE_DONE:
+        default:
+            PR_ERR("delta ota trailing data %d", (int)len);
+            return OPRT_INVALID_PARM;
+        }
+        data += n;
+        len -= n;
+
+        //! records with nothing left to copy end without consuming input
+        if (DELTA_STATE_EXTRA == delta->state && 0 == delta->extra_left) {
+            TUYA_CALL_ERR_RETURN(__delta_record_end(delta));
+        }
+    }
+
+    return rt;
+}
+
+static int __delta_lz_emit(tuya_ota_delta_t *delta, uint8_t byte)
+{
+    OPERATE_RET rt = OPRT_OK;
+
+    delta->lz_window[delta->lz_pos++ & (OTA_DELTA_LZ_WINDOW - 1)] = byte;
+    delta->lz_stage[delta->lz_stage_len++] = byte;
+    if (OTA_DELTA_LZ_STAGE_SIZE == delta->lz_stage_len) {
+        delta->lz_stage_len = 0;
+        TUYA_CALL_ERR_RETURN(__delta_body_feed(delta, delta->lz_stage, OTA_DELTA_LZ_STAGE_SIZE));
+    }
+
+    return rt;
+}
+
+static int __delta_lz_decode(tuya_ota_delta_t *delta, uint8_t byte)
+{
+    OPERATE_RET rt = OPRT_OK;
+    uint32_t code = 0, offset = 0, count = 0;
+
+    delta->lz_bits = (delta->lz_bits << 8) | byte;
+    delta->lz_bit_cnt += 8;
+
+    while (delta->lz_bit_cnt) {
+        if ((delta->lz_bits >> (delta->lz_bit_cnt - 1)) & 1) {
+            if (delta->lz_bit_cnt < 9) {
+                break;
+            }
+            delta->lz_bit_cnt -= 9;
+            TUYA_CALL_ERR_RETURN(__delta_lz_emit(delta, (delta->lz_bits >> delta->lz_bit_cnt) & 0xff));
+        } else {
+            if (delta->lz_bit_cnt < OTA_DELTA_LZ_REF_BITS) {
+                break;
+            }
+            delta->lz_bit_cnt -= OTA_DELTA_LZ_REF_BITS;
+            code = (delta->lz_bits >> delta->lz_bit_cnt) & ((1 << (OTA_DELTA_LZ_REF_BITS - 1)) - 1);
+            offset = (code >> OTA_DELTA_LZ_LENGTH_BITS) + 1;
+            count = (code & ((1 << OTA_DELTA_LZ_LENGTH_BITS) - 1)) + OTA_DELTA_LZ_MIN_MATCH;
+            if (offset > delta->lz_pos) {
+                PR_ERR("delta ota lzss reference invalid");
+                return OPRT_INVALID_PARM;
+            }
+            while (count--) {
+                TUYA_CALL_ERR_RETURN(
+                    __delta_lz_emit(delta, delta->lz_window[(delta->lz_pos - offset) & (OTA_DELTA_LZ_WINDOW - 1)]));
+            }
+        }
+    }
+    delta->lz_bits &= (1 << delta->lz_bit_cnt) - 1;
+
+    return rt;
+}
+
+/**
+ * @brief Feeds the next bytes of the delta package.
+ *
+ * The old image is verified and tal_ota_start_notify is called once the
+ * header is complete. The rebuilt image is written as it is produced.
+ *
+ * @param delta The applier handle.
+ * @param data The package bytes following the previous call.
+ * @param len The length of data.
+ *
+ * @return OPRT_OK on success, others if the package does not apply.
+ */
+int tuya_ota_delta_apply(tuya_ota_delta_t *delta, const uint8_t *data, size_t len)
+{
+    OPERATE_RET rt = OPRT_OK;
+    uint32_t n = 0;
+
+    if (NULL == delta || (NULL == data && len)) {
+        return OPRT_INVALID_PARM;
+    }
+
+    if (DELTA_STATE_HEADER == delta->state) {
+        n = OTA_DELTA_HEADER_LEN - delta->header_len;
+        n = n > len ? len : n;
+        memcpy(delta->header + delta->header_len, data, n);
+        delta->header_len += n;
+        data += n;
+        len -= n;
+        if (OTA_DELTA_HEADER_LEN == delta->header_len) {
+            TUYA_CALL_ERR_RETURN(__delta_header_parse(delta));
+            delta->state = delta->new_size ? DELTA_STATE_CTRL : DELTA_STATE_DONE;
+        }
+    }
+
+    while (len--) {
+        TUYA_CALL_ERR_RETURN(__delta_lz_decode(delta, *data++));
+    }
+    if (delta->lz_stage_len) {
+        n = delta->lz_stage_len;
+        delta->lz_stage_len = 0;
+        TUYA_CALL_ERR_RETURN(__delta_body_feed(delta, delta->lz_stage, n));
+    }
+
+    return rt;
+}
+
+/**
+ * @brief Flushes the rebuilt image and checks its size and sha256.
+ *
+ * @param delta The applier handle.
+ *
+ * @return OPRT_OK if the new image is complete and matches the package.
+ */
+int tuya_ota_delta_finish(tuya_ota_delta_t *delta)
+{
+    OPERATE_RET rt = OPRT_OK;
+    uint8_t sha256[32];
+
+    if (NULL == delta || DELTA_STATE_DONE != delta->state) {
+        PR_ERR("delta ota package incomplete");
+        return OPRT_COM_ERROR;
+    }
+    TUYA_CALL_ERR_RETURN(__delta_flush(delta));
+    if (delta->out_len) {
+        //! the last pack must be taken whole, a kept tail would never reach flash
+        PR_ERR("delta ota platform kept %d bytes of the last pack", delta->out_len);
+        return OPRT_COM_ERROR;
+    }
+    tal_sha256_finish_ret(delta->sha256, sha256);
+    if (memcmp(sha256, delta->new_sha256, 32)) {
+        PR_ERR("delta ota new image sha256 mismatch");
+        return OPRT_COM_ERROR;
+    }
+
+    return rt;
+}
+
+/**
+ * @brief Releases the applier.
+ *
+ * @param delta The applier handle.
+ */
+void tuya_ota_delta_destroy(tuya_ota_delta_t *delta)
+{
+    if (NULL == delta) {
+        return;
+    }
+    tal_sha256_free(delta->sha256);
+    tal_free(delta);
+}
+
+#endif
@@ -0,0 +1,91 @@
+/**
+ * @file tuya_ota_delta.h
+ * @brief Streaming applier of binary delta ota packages.
+ *
+ * A delta package rebuilds the new firmware from the image running in the
+ * TUYA_FLASH_TYPE_APP partition. The package is applied while it is being
+ * downloaded: every record copies bytes of the old image with a difference
+ * added and then inserts new bytes, the rebuilt image is handed to
+ * tal_ota_data_process as a full image.
+ *
+ * Package layout (little endian), generated by tools/ota_delta:
+ *   header: magic "TYDF", version, old_size, new_size, sha256 of the old image
+ *           and sha256 of the new image
+ *   body:   lzss coded (256 byte window) sequence of records
+ *   record: varint diff_len, varint extra_len, zigzag varint old seek,
+ *           diff_len bytes of difference coded as zero runs / literals,
+ *           extra_len new bytes
+ *
+ * @copyright Copyright (c) 2021-2024 Tuya Inc. All Rights Reserved.
+ *
+ */
+
+#ifndef __TUYA_OTA_DELTA_H__
+#define __TUYA_OTA_DELTA_H__
+
+#include "tuya_cloud_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TUYA_OTA_DELTA_MAGIC     "TYDF"
+#define TUYA_OTA_DELTA_MAGIC_LEN 4
+#define TUYA_OTA_DELTA_VERSION   1
+
+typedef struct tuya_ota_delta tuya_ota_delta_t;
+
+/**
+ * @brief Checks whether the head of a download is a delta package.
+ *
+ * @param data The first bytes of the file.
+ * @param len The length of data, at least TUYA_OTA_DELTA_MAGIC_LEN.
+ *
+ * @return true if the file is a delta package.
+ */
+bool tuya_ota_delta_is_patch(const uint8_t *data, size_t len);
+
+/**
+ * @brief Creates a delta applier.
+ *
+ * @param delta Receives the applier handle.
+ *
+ * @return OPRT_OK on success, others on failure.
+ */
+int tuya_ota_delta_create(tuya_ota_delta_t **delta);
+
+/**
+ * @brief Feeds the next bytes of the delta package.
+ *
+ * The old image is verified and tal_ota_start_notify is called once the
+ * header is complete. The rebuilt image is written as it is produced.
+ *
+ * @param delta The applier handle.
+ * @param data The package bytes following the previous call.
+ * @param len The length of data.
+ *
+ * @return OPRT_OK on success, others if the package does not apply.
+ */
+int tuya_ota_delta_apply(tuya_ota_delta_t *delta, const uint8_t *data, size_t len);
+
+/**
+ * @brief Flushes the rebuilt image and checks its size and sha256.
+ *
+ * @param delta The applier handle.
+ *
+ * @return OPRT_OK if the new image is complete and matches the package.
+ */
+int tuya_ota_delta_finish(tuya_ota_delta_t *delta);
+
+/**
+ * @brief Releases the applier.
+ *
+ * @param delta The applier handle.
+ */
+void tuya_ota_delta_destroy(tuya_ota_delta_t *delta);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __TUYA_OTA_DELTA_H__ */
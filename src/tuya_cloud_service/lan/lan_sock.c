@@ -6,8 +6,8 @@
  * The mechanism is designed to manage multiple socket readers, handle socket
  * events efficiently, and provide a clean shutdown process.
  *
- * The implementation utilizes a select-based approach to monitor and react to
- * socket events across multiple sockets. It supports operations such as adding
+ * The implementation keeps the sockets in a tal_net poller (epoll on linux,
+ * select elsewhere) and only dispatches the sockets reported ready. It supports operations such as adding
  * a new socket reader, updating existing readers, and removing readers. Error
  * handling and socket event detection are integral parts of the loop to ensure
  * robust operation.
@@ -40,11 +40,16 @@ typedef struct LAN_SLOOP_S {
     sloop_sock_t *readers;
     BOOL_T terminate;
     QUEUE_HANDLE queue;
+    NET_POLLER_HANDLE poller;
+    TUYA_NET_POLL_EVENT_T *events;
 } LAN_SLOOP_S, *P_LAN_SLOOP_S;
 #pragma pack()
 
 static P_LAN_SLOOP_S g_sloop = NULL;
-#define LAN_QUEUE_NUM 6
+// bounds the wait so pre_select and the terminate flag are checked each second
+#define LAN_SLOOP_WAIT_MS 1000
+// a full queue is drained by the next loop turn, which starts within a wait
+#define LAN_QUEUE_POST_MS (2 * LAN_SLOOP_WAIT_MS)
 
 #ifndef STACK_SIZE_LAN
 #define STACK_SIZE_LAN (4 * 1024)
@@ -55,17 +60,6 @@ static uint32_t __ty_sock_get_reader_num(void)
     return (LAN_UDP_READER_CNT + tuya_lan_get_client_num());
 }
 
-static void __sock_table_set_fds(TUYA_FD_SET_T *rfds, TUYA_FD_SET_T *efds)
-{
-    int idx;
-    for (idx = 0; idx < __ty_sock_get_reader_num(); idx++) {
-        if (g_sloop->readers[idx].sock >= 0) {
-            tal_net_fd_set(g_sloop->readers[idx].sock, rfds);
-            tal_net_fd_set(g_sloop->readers[idx].sock, efds);
-        }
-    }
-}
-
 static void __sock_select_err_handle()
 {
     int idx;
@@ -90,6 +84,7 @@ void __ty_sock_loop_deinit(void)
         for (idx = 0; idx < __ty_sock_get_reader_num(); idx++) {
             if (g_sloop->readers[idx].sock != -1) {
                 PR_DEBUG("deinit lan sock %d and close it", g_sloop->readers[idx].sock);
+                tal_net_poller_del(g_sloop->poller, g_sloop->readers[idx].sock);
                 tal_net_close(g_sloop->readers[idx].sock);
                 g_sloop->readers[idx].sock = -1;
                 g_sloop->readers[idx].pre_select = NULL;
@@ -102,6 +97,12 @@ void __ty_sock_loop_deinit(void)
         tal_free(g_sloop->readers);
         g_sloop->readers = NULL;
     }
+    if (g_sloop->poller) {
+        tal_net_poller_destroy(g_sloop->poller);
+    }
+    if (g_sloop->events) {
+        tal_free(g_sloop->events);
+    }
     if (g_sloop->queue) {
         tal_queue_free(g_sloop->queue);
     }
@@ -147,6 +148,10 @@ void __ty_add_sock_reader(sloop_sock_t sock_info)
         return;
     }
 
+    if (OPRT_OK != tal_net_poller_add(g_sloop->poller, sock_info.sock, &g_sloop->readers[idx])) {
+        PR_ERR("poller add sock %d err", sock_info.sock);
+    }
+
     return;
 }
 
@@ -156,6 +161,7 @@ void __ty_del_sock_reader(int sock)
     for (idx = 0; idx < __ty_sock_get_reader_num(); idx++) {
         if (g_sloop->readers[idx].sock == sock) {
             PR_DEBUG("unreg lan sock %d and close it", sock);
+            tal_net_poller_del(g_sloop->poller, sock);
             tal_net_close(g_sloop->readers[idx].sock);
             g_sloop->readers[idx].sock = -1;
             // g_sloop->readers[idx].pre_select = NULL;
@@ -179,28 +185,25 @@ void tuya_sock_loop_run(void *data)
 {
     int actv_cnt = 0;
     int idx = 0;
-    TUYA_FD_SET_T *rfds, *efds;
+    uint32_t wait_ms = 0;
+    sloop_sock_t *reader = NULL;
     sloop_sock_t queue_data = {0};
 
-    rfds = tal_malloc(sizeof(TUYA_FD_SET_T));
-    efds = tal_malloc(sizeof(TUYA_FD_SET_T));
-    if (rfds == NULL || efds == NULL) {
-        PR_ERR("malloc err");
-        goto Err;
-    }
-    memset(rfds, 0, sizeof(TUYA_FD_SET_T));
-    memset(efds, 0, sizeof(TUYA_FD_SET_T));
-
     // while (tuya_get_sock_loop_terminate() &&
     // tal_thread_get_state(g_sloop->thread) == THREAD_STATE_RUNNING) {
     while (tuya_get_sock_loop_terminate()) {
+        // apply every pending (un)registration, wait on the queue when there
+        // is no socket to wait on
+        wait_ms = (0 == g_sloop->cnt) ? LAN_SLOOP_WAIT_MS : 0;
         memset(&queue_data, 0, sizeof(sloop_sock_t));
-        if (tal_queue_fetch(g_sloop->queue, &queue_data, 0) == 0) {
+        while (tal_queue_fetch(g_sloop->queue, &queue_data, wait_ms) == 0) {
             if (queue_data.read) {
                 __ty_add_sock_reader(queue_data);
             } else {
                 __ty_del_sock_reader(queue_data.sock);
             }
+            wait_ms = 0;
+            memset(&queue_data, 0, sizeof(sloop_sock_t));
         }
         for (idx = 0; idx < __ty_sock_get_reader_num(); idx++) {
             if (g_sloop->readers[idx].pre_select) {
@@ -208,54 +211,29 @@ void tuya_sock_loop_run(void *data)
             }
         }
         if (g_sloop->cnt == 0) {
-            tal_system_sleep(2000);
             continue;
         }
 
-        tal_net_fd_zero(rfds);
-        tal_net_fd_zero(efds);
-        __sock_table_set_fds(rfds, efds);
-        actv_cnt = tal_net_select(g_sloop->max_sock + 1, rfds, NULL, efds, 1 * 1000);
+        actv_cnt =
+            tal_net_poller_wait(g_sloop->poller, g_sloop->events, __ty_sock_get_reader_num(), LAN_SLOOP_WAIT_MS);
         if (actv_cnt < 0) {
             PR_ERR("errno:%d", tal_net_get_errno());
             __sock_select_err_handle();
             tal_system_sleep(1000);
             continue;
-        } else if (actv_cnt == 0) {
-            continue;
-        } else {
-            for (idx = 0; idx < __ty_sock_get_reader_num(); idx++) {
-                if (g_sloop->readers[idx].sock >= 0) {
-                    if (0 == tal_net_fd_isset(g_sloop->readers[idx].sock, efds)) {
-                        continue;
-                    }
-                    if (g_sloop->readers[idx].err) {
-                        PR_ERR("socket err:%d, sock:%d, idx:%d", tal_net_get_errno(), g_sloop->readers[idx].sock, idx);
-                        g_sloop->readers[idx].err(g_sloop->readers[idx].sock);
-                    }
-                    actv_cnt--;
-                    if (0 == actv_cnt) {
-                        break;
-                    }
-                }
-            }
         }
 
-        if (0 == actv_cnt) {
-            continue;
-        }
-
-        for (idx = 0; idx < __ty_sock_get_reader_num(); idx++) {
-            if (g_sloop->readers[idx].sock >= 0) {
-                if (tal_net_fd_isset(g_sloop->readers[idx].sock, rfds)) {
-                    if (g_sloop->readers[idx].read) {
-                        g_sloop->readers[idx].read(g_sloop->readers[idx].sock);
-                        actv_cnt--;
-                        if (0 == actv_cnt) {
-                            break;
-                        }
-                    }
-                }
+        for (idx = 0; idx < actv_cnt; idx++) {
+            reader = (sloop_sock_t *)g_sloop->events[idx].ctx;
+            if (reader->sock != g_sloop->events[idx].fd) {
+                continue;
+            }
+            if ((g_sloop->events[idx].events & TAL_NET_POLL_ERR) && reader->err) {
+                PR_ERR("socket err:%d, sock:%d", tal_net_get_errno(), reader->sock);
+                reader->err(reader->sock);
+            }
+            if ((g_sloop->events[idx].events & TAL_NET_POLL_IN) && reader->read) {
+                reader->read(reader->sock);
             }
         }
     }
@@ -266,14 +244,6 @@ void tuya_sock_loop_run(void *data)
         }
     }
 
-Err:
-    if (rfds) {
-        tal_free(rfds);
-    }
-    if (efds) {
-        tal_free(efds);
-    }
-
     tuya_lan_exit();
     __ty_sock_loop_deinit();
 
@@ -307,7 +277,8 @@ OPERATE_RET tuya_sock_loop_init(void)
     memset(g_sloop, 0, sizeof(LAN_SLOOP_S));
     g_sloop->terminate = TRUE;
 
-    op_ret = tal_queue_create_init(&g_sloop->queue, sizeof(sloop_sock_t), LAN_QUEUE_NUM);
+    // room to unregister every reader in one turn, as closing all sessions does
+    op_ret = tal_queue_create_init(&g_sloop->queue, sizeof(sloop_sock_t), __ty_sock_get_reader_num());
     if (OPRT_OK != op_ret) {
         PR_ERR("init queue err");
         goto Err;
@@ -323,6 +294,18 @@ OPERATE_RET tuya_sock_loop_init(void)
     for (idx = 0; idx < __ty_sock_get_reader_num(); idx++) {
         g_sloop->readers[idx].sock = -1;
     }
+
+    op_ret = tal_net_poller_create(&g_sloop->poller, __ty_sock_get_reader_num());
+    if (OPRT_OK != op_ret) {
+        PR_ERR("init poller err");
+        goto Err;
+    }
+    g_sloop->events = tal_malloc(__ty_sock_get_reader_num() * sizeof(TUYA_NET_POLL_EVENT_T));
+    if (NULL == g_sloop->events) {
+        op_ret = OPRT_MALLOC_FAILED;
+        goto Err;
+    }
+
     THREAD_CFG_T thread_cfg = {.priority = THREAD_PRIO_2, .stackDepth = STACK_SIZE_LAN, .thrdname = "lan_sock_loop"};
 
     op_ret = tal_thread_create_and_start(&g_sloop->thread, NULL, NULL, tuya_sock_loop_run, NULL, &thread_cfg);
@@ -368,7 +351,8 @@ OPERATE_RET tuya_reg_lan_sock(sloop_sock_t sock_info)
  * @brief Unregisters a LAN socket.
  *
  * This function unregisters a LAN socket identified by the given socket
- * descriptor.
+ * descriptor. On the loop thread, e.g. from a reader callback, the socket is
+ * closed at once, otherwise the request waits for room in the queue.
  *
  * @param sock The socket descriptor of the LAN socket to unregister.
  * @return The result of the operation. Possible values are:
@@ -378,9 +362,20 @@ OPERATE_RET tuya_reg_lan_sock(sloop_sock_t sock_info)
 OPERATE_RET tuya_unreg_lan_sock(int sock)
 {
     OPERATE_RET op_ret = OPRT_OK;
+    BOOL_T is_self = FALSE;
     sloop_sock_t sock_info = {0};
+
+    // the loop can not drain the queue while it waits to post, unreg in place
+    if (g_sloop->thread) {
+        tal_thread_is_self(g_sloop->thread, &is_self);
+    }
+    if (is_self) {
+        __ty_del_sock_reader(sock);
+        return OPRT_OK;
+    }
+
     sock_info.sock = sock;
-    op_ret = tal_queue_post(g_sloop->queue, &sock_info, 0);
+    op_ret = tal_queue_post(g_sloop->queue, &sock_info, LAN_QUEUE_POST_MS);
     if (OPRT_OK != op_ret) {
         PR_ERR("queue post err");
         return op_ret;
@@ -36,12 +36,16 @@
 #define SERV_PORT_APP_UDP_BCAST 7000 // APP broadcast, device listening port
 
 #define UDP_T_ITRV         5 // s
-#define CLIENT_LMT         3
-#define RECV_BUF_LMT       512
+#define RECV_BUF_LMT       512 // per session, a longer frame is buffered from the heap
 #define LAN_FRAME_MAX_LEN  (4 * 1024)
 #define HEART_BEAT_TIMEOUT 30
 #define ALLOW_NO_KEY_NUM   3
 
+#ifndef LAN_CLIENT_NUM
+#define LAN_CLIENT_NUM 3
+#endif
+#define CLIENT_LMT LAN_CLIENT_NUM
+
 #define HMAC_LEN       32
 #define RAND_LEN       16
 #define SESSIONKEY_LEN 16
@@ -57,6 +61,12 @@ typedef struct {
     uint8_t randB[RAND_LEN];
     uint8_t hmac[HMAC_LEN];
     uint8_t secret_key[SESSIONKEY_LEN];
+    // received bytes not parsed yet, rx_buf is the slab slice of the session
+    // or a heap buffer while a frame longer than the slice is pending
+    uint8_t *rx_buf;
+    uint32_t rx_size;
+    uint32_t rx_len;
+    int next_free;
 } lan_session_t;
 
 typedef struct {
@@ -79,7 +89,9 @@ typedef struct {
 
 typedef struct {
     int fd_num;
-    lan_session_t *session;
+    lan_session_t *session; // slab of cfg->client_num sessions
+    uint8_t *rx_slab;       // cfg->bufsize receive buffer per session
+    int free_session;       // head of the free session list, -1 if empty
     MUTEX_HANDLE mutex;
     MUTEX_HANDLE tcp_mutex;
 
@@ -93,8 +105,7 @@ typedef struct {
     tuya_iot_client_t *iot_client;
     lan_cfg_t *cfg;
     // extension
-    uint32_t recv_offset;
-    uint8_t recv_buf[0]; // keep it last !!!
+    uint8_t recv_buf[0]; // udp only, keep it last !!!
 } lan_mgr_t;
 
 static uint8_t app_key2[APP_KEY_LEN] = {0};
@@ -111,10 +122,26 @@ static lan_mgr_t *lan_mgr_get(void)
     return s_lan_mgr;
 }
 
+static uint8_t *lan_session_slab_buf(lan_mgr_t *lan, lan_session_t *session)
+{
+    return lan->rx_slab + (session - lan->session) * lan->cfg->bufsize;
+}
+
+/* reset the session and put it back on the free list */
 static void lan_session_free(lan_session_t *session)
 {
+    lan_mgr_t *lan = lan_mgr_get();
+    uint8_t *slab_buf = lan_session_slab_buf(lan, session);
+
+    if (session->rx_buf && session->rx_buf != slab_buf) {
+        tal_free(session->rx_buf);
+    }
     memset(session, 0, sizeof(lan_session_t));
     session->fd = -1;
+    session->rx_buf = slab_buf;
+    session->rx_size = lan->cfg->bufsize;
+    session->next_free = lan->free_session;
+    lan->free_session = session - lan->session;
 }
 
 static void lan_session_close(lan_session_t *session)
@@ -151,19 +178,17 @@ static void lan_sesison_add(int socket, TIME_T time)
     }
 
     tal_mutex_lock(lan->mutex);
-    for (i = 0; i < lan->cfg->client_num; i++) {
-        if (lan->session[i].active) {
-            continue;
-        }
+    i = lan->free_session;
+    if (i >= 0) {
         PR_TRACE("add session[%d] socket:%d", i, socket);
-        lan_session_free(&lan->session[i]);
+        lan->free_session = lan->session[i].next_free;
+        lan->session[i].next_free = -1;
         lan->session[i].active = true;
         lan->session[i].fd = socket;
         lan->session[i].fault = false;
         lan->session[i].time = time;
         lan->session[i].sequence_out = uni_random_range(0xFFFF);
         lan->fd_num++;
-        break;
     }
     tal_mutex_unlock(lan->mutex);
 }
@@ -204,7 +229,7 @@ static void lan_session_close_all(void)
         tuya_unreg_lan_sock(lan->udp_serv_fd);
         lan->udp_serv_fd = -1;
     }
-    for (i = 0; i < lan->cfg->client_num; i++) {
+    for (i = 0; lan->session && i < lan->cfg->client_num; i++) {
         if (lan->session[i].active) {
             tal_event_publish(EVENT_LAN_CLIENT_CLOSE, &lan->session[i].fd);
             tuya_unreg_lan_sock(lan->session[i].fd);
@@ -376,7 +401,7 @@ static int lan_tcp_setup_serv_socket(int port)
     }
     ret = tal_net_set_reuse(fd);
     ret |= tal_net_bind(fd, ip_addr, port);
-    ret |= tal_net_listen(fd, 5);
+    ret |= tal_net_listen(fd, (CLIENT_LMT > 5) ? CLIENT_LMT : 5);
     if (OPRT_OK != ret) {
         ret = OPRT_SOCK_ERR;
         goto __exit;
@@ -845,51 +870,79 @@ static void lan_tcp_client_sock_err(int fd)
     return;
 }
 
-static void lan_tcp_client_sock_read(int fd)
+/*
+ * keep the unparsed bytes from offset at the head of the receive buffer, the
+ * buffer is grown to need bytes for a long frame and goes back to the slab
+ * slice when the bytes fit it
+ */
+static int lan_session_rx_compact(lan_mgr_t *lan, lan_session_t *session, uint32_t offset, uint32_t need)
 {
-    int ret = 0;
-    uint8_t *frame_buffer = NULL;
-    uint8_t *tmp_recv_buf = NULL;
-
-    lan_mgr_t *lan = lan_mgr_get();
-    lan_session_t *session = lan_session_get_by_fd(fd);
-
-    if (NULL == lan || NULL == session || !session->active) {
-        return;
+    uint8_t *slab_buf = lan_session_slab_buf(lan, session);
+    uint32_t left = session->rx_len - offset;
+    uint8_t *buf = NULL;
+    uint32_t size = 0;
+
+    if (need <= lan->cfg->bufsize) {
+        buf = slab_buf;
+        size = lan->cfg->bufsize;
+    } else if (session->rx_buf != slab_buf && need <= session->rx_size) {
+        buf = session->rx_buf;
+        size = session->rx_size;
+    } else {
+        buf = tal_malloc(need);
+        size = need;
+        if (NULL == buf) {
+            PR_ERR("malloc error");
+            session->rx_len = 0;
+            lan_session_fault_set(session);
+            return OPRT_MALLOC_FAILED;
+        }
     }
 
-    uint32_t offset = 0;
-    int recv_datalen = 0;
-
-    lan->recv_offset = 0;
-
-recv_again:
-    recv_datalen = tal_net_recv(fd, lan->recv_buf + lan->recv_offset, lan->cfg->bufsize - lan->recv_offset);
-    if (recv_datalen <= 0) {
-        PR_ERR("net recv err fd:%d,errno:%d", fd, tal_net_get_errno());
-        lan_session_fault_set(session);
-        return;
+    if (left && (offset || buf != session->rx_buf)) {
+        memmove(buf, session->rx_buf + offset, left);
     }
-    // recv data process
-    recv_datalen += lan->recv_offset;
-    if (recv_datalen < LPV35_FRAME_MINI_SIZE) {
-        PR_ERR("not enough data len:%d", recv_datalen);
-        return;
+    if (session->rx_buf != buf && session->rx_buf != slab_buf) {
+        tal_free(session->rx_buf);
     }
+    session->rx_buf = buf;
+    session->rx_size = size;
+    session->rx_len = left;
 
-    offset = 0;
-    frame_buffer = NULL;
-    tmp_recv_buf = NULL;
-    while (recv_datalen >= LPV35_FRAME_MINI_SIZE + offset) {
-        if (tmp_recv_buf) {
-            break;
-        }
-        if (memcmp(lan->recv_buf + offset, LPV35_FRAME_HEAD, LPV35_FRAME_HEAD_SIZE) != 0) {
+    return OPRT_OK;
+}
+
+/*
+ * handle every complete frame in the receive buffer, a partial frame is kept
+ * for the next read. Returns an error if the session can not go on.
+ */
+static int lan_session_rx_process(lan_mgr_t *lan, lan_session_t *session)
+{
+    int ret = 0;
+    uint32_t offset = 0;
+    uint32_t need = 0;
+    uint8_t *frame_buffer = NULL;
+
+    while (session->rx_len - offset >= LPV35_FRAME_MINI_SIZE) {
+        frame_buffer = session->rx_buf + offset;
+        if (memcmp(frame_buffer, LPV35_FRAME_HEAD, LPV35_FRAME_HEAD_SIZE) != 0) {
             offset++;
             continue;
         }
-        frame_buffer = lan->recv_buf + offset;
         lpv35_fixed_head_t *fixed_head = (lpv35_fixed_head_t *)(frame_buffer + LPV35_FRAME_HEAD_SIZE);
+        // frame_len verify, skip a bad head to find the next frame
+        uint32_t frame_len =
+            LPV35_FRAME_HEAD_SIZE + sizeof(lpv35_fixed_head_t) + UNI_NTOHL(fixed_head->length) + LPV35_FRAME_TAIL_SIZE;
+        if (UNI_NTOHL(fixed_head->length) >= LAN_FRAME_MAX_LEN || frame_len >= LAN_FRAME_MAX_LEN) {
+            PR_ERR("lan data len is out of limit");
+            offset++;
+            continue;
+        }
+        if (frame_len > (session->rx_len - offset)) { // wait for the rest of the frame
+            need = frame_len;
+            break;
+        }
+
         // verify sequence
         uint32_t fr_sequence = UNI_NTOHL(fixed_head->sequence);
         if (fr_sequence <= session->sequence_in) {
@@ -897,36 +950,13 @@ recv_again:
             PR_ERR("threshold:%d", lan->cfg->sequence_err_threshold);
             if ((session->sequence_in - fr_sequence) >= lan->cfg->sequence_err_threshold) {
                 lan_session_close(session);
+                return OPRT_COM_ERROR;
             }
-            break;
+            offset += frame_len;
+            continue;
         }
         PR_TRACE("fr_num in:%u, pre:%u", fr_sequence, session->sequence_in);
         session->sequence_in = fr_sequence;
-        // frame_len verify
-        uint32_t frame_len =
-            LPV35_FRAME_HEAD_SIZE + sizeof(lpv35_fixed_head_t) + UNI_NTOHL(fixed_head->length) + LPV35_FRAME_TAIL_SIZE;
-        if (frame_len > (recv_datalen - offset)) { // recv data not enough buf
-            if (frame_len >= LAN_FRAME_MAX_LEN) {
-                PR_ERR("lan data len is out of limit");
-                break;
-            }
-            tmp_recv_buf = tal_malloc(frame_len + 1);
-            if (NULL == tmp_recv_buf) {
-                PR_ERR("malloc error");
-                break;
-            }
-            memset(tmp_recv_buf, 0, frame_len + 1);
-            memcpy(tmp_recv_buf, lan->recv_buf + offset, recv_datalen - offset);
-            recv_datalen = recv_datalen - offset;
-            offset = 0;
-            ret = tal_net_recv_nd_size(session->fd, tmp_recv_buf + recv_datalen, frame_len + 1 - recv_datalen,
-                                       frame_len - recv_datalen);
-            if (ret < 0) {
-                PR_ERR("tuya_hal_net_recv_nd_size error ret:%d", ret);
-                break;
-            }
-            frame_buffer = tmp_recv_buf;
-        }
 
         uint32_t fr_type = UNI_NTOHL(fixed_head->type);
         uint8_t *key = NULL;
@@ -938,7 +968,7 @@ recv_again:
                 if (session->secret_key[0]) {
                     PR_WARN("already have the session_key, reset session..");
                     lan_session_close(session);
-                    break;
+                    return OPRT_COM_ERROR;
                 }
                 key = (uint8_t *)lan->iot_client->activate.localkey;
             } else {
@@ -948,12 +978,13 @@ recv_again:
                     if (lan->cfg->allow_no_session_key_num > 0) {
                         PR_ERR("allow no seesion key %d", lan->cfg->allow_no_session_key_num);
                         lan->cfg->allow_no_session_key_num--;
-                    } else {
-                        PR_ERR("ERROR, no session_key");
-                        lan_session_close(session);
-                        lan->cfg->allow_no_session_key_num = ALLOW_NO_KEY_NUM;
+                        offset += frame_len;
+                        continue;
                     }
-                    break;
+                    PR_ERR("ERROR, no session_key");
+                    lan_session_close(session);
+                    lan->cfg->allow_no_session_key_num = ALLOW_NO_KEY_NUM;
+                    return OPRT_COM_ERROR;
                 }
                 // PR_DEBUG("use session_key");
                 key = (uint8_t *)session->secret_key;
@@ -961,7 +992,7 @@ recv_again:
         } else {
             //! TODO:
             lan_session_close(session);
-            break;
+            return OPRT_COM_ERROR;
         }
 
         // Heartbeat packet has no data content and responds directly
@@ -975,11 +1006,11 @@ recv_again:
         //! TODO:
         lpv35_frame_object_t frame_out = {0};
         ret = lpv35_frame_parse(key, SESSIONKEY_LEN, frame_buffer, frame_len, &frame_out);
+        offset += frame_len;
         if (ret != OPRT_OK) {
             PR_ERR("lpv35_frame_parse fail:%d", ret);
-            break;
+            continue;
         }
-        offset += frame_len;
         // update time
         lan_session_time_update(session, tal_time_get_posix());
         lan_protocol_process(lan, session, &frame_out);
@@ -988,15 +1019,40 @@ recv_again:
         }
     }
 
-    if (tmp_recv_buf) {
-        tal_free(tmp_recv_buf);
-    } else if (recv_datalen != offset) {
-        PR_DEBUG("recv_datalen:%d, offset:%d", recv_datalen, offset);
-        memmove(lan->recv_buf, lan->recv_buf + offset, recv_datalen - offset);
-        lan->recv_offset = recv_datalen - offset;
-        goto recv_again;
+    return lan_session_rx_compact(lan, session, offset, need);
+}
+
+static void lan_tcp_client_sock_read(int fd)
+{
+    int recv_datalen = 0;
+    uint32_t space = 0;
+
+    lan_mgr_t *lan = lan_mgr_get();
+    lan_session_t *session = lan_session_get_by_fd(fd);
+
+    if (NULL == lan || NULL == session || !session->active) {
+        return;
     }
 
+    // the socket is non-blocking, read until it is drained and parse the
+    // frames as they complete, a partial frame waits in the session buffer
+    do {
+        space = session->rx_size - session->rx_len;
+        recv_datalen = tal_net_recv(fd, session->rx_buf + session->rx_len, space);
+        if (recv_datalen < 0 && (tal_net_get_errno() == UNW_EAGAIN || tal_net_get_errno() == UNW_EINTR)) {
+            return;
+        }
+        if (recv_datalen <= 0) {
+            PR_ERR("net recv err fd:%d,errno:%d", fd, tal_net_get_errno());
+            lan_session_fault_set(session);
+            return;
+        }
+        session->rx_len += recv_datalen;
+        if (OPRT_OK != lan_session_rx_process(lan, session)) {
+            return;
+        }
+    } while ((uint32_t)recv_datalen == space);
+
     return;
 }
 
@@ -1273,12 +1329,20 @@ int tuya_lan_init(tuya_iot_client_t *iot_client)
         goto __exit;
     }
 
-    uint32_t client_len = sizeof(lan_session_t) * s_lan_mgr->cfg->client_num;
+    // one slab for the sessions and their receive buffers
+    uint32_t client_len = (sizeof(lan_session_t) + s_lan_mgr->cfg->bufsize) * s_lan_mgr->cfg->client_num;
     s_lan_mgr->session = tal_malloc(client_len);
     if (NULL == s_lan_mgr->session) {
+        op_ret = OPRT_MALLOC_FAILED;
         goto __exit;
     }
     memset(s_lan_mgr->session, 0, client_len);
+    s_lan_mgr->rx_slab = (uint8_t *)(s_lan_mgr->session + s_lan_mgr->cfg->client_num);
+    s_lan_mgr->free_session = -1;
+    int i;
+    for (i = s_lan_mgr->cfg->client_num - 1; i >= 0; i--) {
+        lan_session_free(&s_lan_mgr->session[i]);
+    }
     s_lan_mgr->iot_client = iot_client;
 
     if (lan_tcp_create_serv_socket(s_lan_mgr) < 0) {
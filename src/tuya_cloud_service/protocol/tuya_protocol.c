@@ -71,10 +71,13 @@ uint32_t tuya_pack_protocol_serial_no(void)
     return serial_no;
 }
 
-static OPERATE_RET __parse_data_with_pv23(const DP_CMD_TYPE_E cmd, const uint8_t *data, const uint32_t len,
-                                          const uint8_t *key, char **out_data)
+static OPERATE_RET __pv23_head_check(const uint8_t *data, const uint32_t len)
 {
-    OPERATE_RET op_ret = OPRT_OK;
+    if (len < PV23_EXCEPT_DATA_LEN) {
+        PR_ERR("pv2.3 len invalid %d", len);
+        return OPRT_INVALID_PARM;
+    }
+
     if (memcmp(data, TUYA_PV23, PV23_VERSION_LEN) != 0) {
         PR_ERR("verison error, must pv2.3");
         return OPRT_VERSION_FMT_ERR;
@@ -95,6 +98,17 @@ static OPERATE_RET __parse_data_with_pv23(const DP_CMD_TYPE_E cmd, const uint8_t
         return OPRT_VERSION_FMT_ERR;
     }
 
+    return OPRT_OK;
+}
+
+static OPERATE_RET __parse_data_with_pv23(const DP_CMD_TYPE_E cmd, const uint8_t *data, const uint32_t len,
+                                          const uint8_t *key, char **out_data)
+{
+    OPERATE_RET op_ret = __pv23_head_check(data, len);
+    if (OPRT_OK != op_ret) {
+        return op_ret;
+    }
+
     uint8_t *ad_data = (uint8_t *)(data + 0);
     uint32_t data_len = len - PV23_EXCEPT_DATA_LEN;
     size_t ec_len = 0;
@@ -127,6 +141,47 @@ static OPERATE_RET __parse_data_with_pv23(const DP_CMD_TYPE_E cmd, const uint8_t
     return OPRT_OK;
 }
 
+static OPERATE_RET __parse_data_with_pv23_inplace(uint8_t *data, const uint32_t len, const uint8_t *key,
+                                                  char **out_data, uint32_t *out_len)
+{
+    OPERATE_RET op_ret = __pv23_head_check(data, len);
+    if (OPRT_OK != op_ret) {
+        return op_ret;
+    }
+
+    uint32_t data_len = len - PV23_EXCEPT_DATA_LEN;
+    size_t ec_len = 0;
+    uint8_t *ec_data = data + PV23_DATA_OFFSET;
+
+    // decrypt data over the ciphertext, the tag follows the ciphertext directly
+    op_ret = mbedtls_cipher_auth_decrypt_inplace_wrapper(
+        &(const cipher_params_t){.cipher_type = MBEDTLS_CIPHER_AES_128_GCM,
+                                 .key = (unsigned char *)key,
+                                 .key_len = 16,
+                                 .nonce = data + PV23_NONCE_OFFSET,
+                                 .nonce_len = PV23_NONCE_LEN,
+                                 .ad = data,
+                                 .ad_len = PV23_AD_DATA_LEN,
+                                 .data = ec_data,
+                                 .data_len = data_len},
+        &ec_len, PV23_TAG_LEN);
+    if (op_ret != OPRT_OK) {
+        PR_ERR("mbedtls_cipher_auth_decrypt_inplace_wrapper:0x%x", -op_ret);
+        *out_data = NULL;
+        return op_ret;
+    }
+
+    // the verified tag is no longer needed, its first byte becomes the terminator
+    ec_data[ec_len] = 0;
+
+    *out_data = (char *)ec_data;
+    if (out_len) {
+        *out_len = ec_len;
+    }
+
+    return OPRT_OK;
+}
+
 static OPERATE_RET __parse_data_with_lpv35(const DP_CMD_TYPE_E cmd, const uint8_t *data, const uint32_t len,
                                            const uint8_t *key, char **out_data)
 {
@@ -217,6 +272,41 @@ OPERATE_RET tuya_parse_protocol_data(const DP_CMD_TYPE_E cmd, uint8_t *data, con
     return op_ret;
 }
 
+/**
+ * @brief Parses the protocol data in place, without allocating a plaintext
+ * buffer.
+ *
+ * The plaintext is written over the ciphertext region of `data` and is NUL
+ * terminated, so `*out_data` is a slice borrowed from `data`: it must not be
+ * freed and is only valid as long as `data` is. Only MQTT (PV2.3) data is
+ * supported.
+ *
+ * @param cmd The command type to parse.
+ * @param data The input data to be parsed, overwritten by the plaintext.
+ * @param len The length of the input data.
+ * @param key The key used for parsing the data.
+ * @param out_data A pointer to store the plaintext slice.
+ * @param out_len A pointer to store the plaintext length, can be NULL.
+ *
+ * @return OPRT_OK on success, or an error code on failure.
+ */
+OPERATE_RET tuya_parse_protocol_data_inplace(const DP_CMD_TYPE_E cmd, uint8_t *data, const int len, const char *key,
+                                             char **out_data, uint32_t *out_len)
+{
+    if ((NULL == data) || (NULL == out_data) || (len < DATA_OFFSET_22_32)) {
+        PR_ERR("data is NULL OR Len Invalid %d", len);
+        return OPRT_INVALID_PARM;
+    }
+
+    if (DP_CMD_MQ != cmd) {
+        PR_ERR("Inplace parse not support cmd:%d", cmd);
+        return OPRT_NOT_SUPPORTED;
+    }
+
+    PR_TRACE("Data From MQTT AND V=2.3, inplace");
+    return __parse_data_with_pv23_inplace(data, len, (const uint8_t *)key, out_data, out_len);
+}
+
 static OPERATE_RET __pack_data_with_cmd_pv23(const DP_CMD_TYPE_E cmd, const char *pv, const char *src,
                                              const uint32_t pro, const uint32_t num, const uint8_t *key,
                                              uint8_t **pack_out, uint32_t *out_len)
@@ -112,6 +112,9 @@ typedef dp_cmd_type_t DP_CMD_TYPE_E;
 OPERATE_RET tuya_parse_protocol_data(const DP_CMD_TYPE_E cmd, uint8_t *data, const int len, const char *key,
                                      char **out_data);
 
+OPERATE_RET tuya_parse_protocol_data_inplace(const DP_CMD_TYPE_E cmd, uint8_t *data, const int len, const char *key,
+                                             char **out_data, uint32_t *out_len);
+
 /**
  * @brief pack protocol data
  *
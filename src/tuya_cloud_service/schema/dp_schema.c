@@ -16,10 +16,9 @@
 #include "dp_schema.h"
 #include "cJSON.h"
 #include "mix_method.h"
+#include "crc32i.h"
 #include "tal_api.h"
 
-#define MAX_ITEM_LEN 1024
-
 #define MAX_TRANS_TYPE_NUM (DTT_SCT_SCENE + 1)
 
 #define DP_SCHEMA_NUM_MAX 1
@@ -110,6 +109,7 @@ __err_exit:
 
 /**
  * Finds a DP node in the given schema based on the provided ID.
+ * The lookup goes through the dp id index built in dp_schema_create().
  *
  * @param schema The DP schema to search in.
  * @param id The ID of the DP node to find.
@@ -117,16 +117,11 @@ __err_exit:
  */
 dp_node_t *dp_node_find(dp_schema_t *schema, int id)
 {
-    int i;
-    dp_node_t *dpnode = NULL;
-
-    for (i = 0; i < schema->num; i++) {
-        if (schema->node[i].desc.id == id) {
-            dpnode = &schema->node[i];
-            break;
-        }
+    if (NULL == schema || id < 0 || id >= DP_ID_INDEX_NUM || 0 == schema->index[id]) {
+        return NULL;
     }
-    return dpnode;
+
+    return &schema->node[schema->index[id] - 1];
 }
 
 /**
@@ -139,13 +134,19 @@ dp_schema_t *dp_schema_find(const char *devid)
 {
     int i = 0;
 
+    if (NULL == devid) {
+        return NULL;
+    }
+
     PR_TRACE("try to find schema devid %s", devid);
     dp_schema_mgr_t *dsmgr = &s_dsmgr;
+    uint32_t hash = mm_str_hash(devid);
     for (i = 0; i < DP_SCHEMA_NUM_MAX; i++) {
         if (NULL == dsmgr->schema_list[i]) {
             continue;
         }
-        if (0 == strcmp(devid, dsmgr->schema_list[i]->devid)) {
+        // compare hash first, strcmp only on hash hit
+        if (hash == dsmgr->schema_list[i]->devid_hash && 0 == strcmp(devid, dsmgr->schema_list[i]->devid)) {
             return dsmgr->schema_list[i];
         }
 
@@ -167,20 +168,12 @@ dp_schema_t *dp_schema_find(const char *devid)
  */
 dp_node_t *dp_node_find_by_devid(char *devid, int id)
 {
-    int i;
-    dp_node_t *dpnode = NULL;
-
     dp_schema_t *schema = dp_schema_find(devid);
     if (NULL == schema) {
         return NULL;
     }
-    for (i = 0; i < schema->num; i++) {
-        if (schema->node[i].desc.id == id) {
-            dpnode = &schema->node[i];
-            break;
-        }
-    }
-    return dpnode;
+
+    return dp_node_find(schema, id);
 }
 
 static OPERATE_RET dp_obj_equal_resp(dp_schema_t *schema, uint8_t *dpid, uint8_t num, dp_cmd_type_t cmd_tp)
@@ -818,141 +811,314 @@ int dp_rept_valid_check(dp_schema_t *schema, dp_rept_in_t *dpin, dp_rept_valid_t
     return OPRT_OK;
 }
 
+/*
+ * Bounded JSON writer used on the report path. With buf == NULL it only
+ * counts, so a report is sized exactly in one pass and written straight into
+ * its final buffer in the next one, without a cJSON tree or a second copy.
+ * Once a chunk does not fit nothing more is stored, the caller compares len
+ * against size to detect the overflow.
+ */
+typedef struct {
+    char *buf;
+    uint32_t size;
+    uint32_t len;
+} dp_json_wr_t;
+
+static void __wr_raw(dp_json_wr_t *wr, const char *str, uint32_t len)
+{
+    if (wr->buf && wr->len + len < wr->size) {
+        memcpy(wr->buf + wr->len, str, len);
+    }
+    wr->len += len;
+}
+
+static void __wr_str(dp_json_wr_t *wr, const char *str)
+{
+    __wr_raw(wr, str, strlen(str));
+}
+
+static void __wr_int(dp_json_wr_t *wr, int value)
+{
+    char tmp[12];
+    char *p = tmp + sizeof(tmp);
+    uint32_t uval = value < 0 ? 0u - (uint32_t)value : (uint32_t)value;
+
+    do {
+        *--p = '0' + uval % 10;
+        uval /= 10;
+    } while (uval);
+    if (value < 0) {
+        *--p = '-';
+    }
+    __wr_raw(wr, p, tmp + sizeof(tmp) - p);
+}
+
+static void __wr_uint(dp_json_wr_t *wr, uint32_t value)
+{
+    char tmp[10];
+    char *p = tmp + sizeof(tmp);
+
+    do {
+        *--p = '0' + value % 10;
+        value /= 10;
+    } while (value);
+    __wr_raw(wr, p, tmp + sizeof(tmp) - p);
+}
+
+// quoted and escaped the same way cJSON prints strings
+static void __wr_json_str(dp_json_wr_t *wr, const char *str)
+{
+    static const char hex[] = "0123456789abcdef";
+    const char *run = str;
+    char esc[6] = {'\\', 'u', '0', '0', 0, 0};
+
+    __wr_raw(wr, "\"", 1);
+    for (; *str; str++) {
+        uint8_t c = (uint8_t)*str;
+        uint32_t esc_len = 2;
+
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        __wr_raw(wr, run, str - run);
+        run = str + 1;
+        switch (c) {
+        case '"':
+        case '\\':
+            esc[1] = c;
+            break;
+        case '\b':
+            esc[1] = 'b';
+            break;
+        case '\f':
+            esc[1] = 'f';
+            break;
+        case '\n':
+            esc[1] = 'n';
+            break;
+        case '\r':
+            esc[1] = 'r';
+            break;
+        case '\t':
+            esc[1] = 't';
+            break;
+        default:
+            esc[1] = 'u';
+            esc[4] = hex[c >> 4];
+            esc[5] = hex[c & 0x0f];
+            esc_len = 6;
+            break;
+        }
+        __wr_raw(wr, esc, esc_len);
+    }
+    __wr_raw(wr, run, str - run);
+    __wr_raw(wr, "\"", 1);
+}
+
+static void __wr_dp_key(dp_json_wr_t *wr, bool first, uint8_t id)
+{
+    __wr_raw(wr, first ? "{\"" : ",\"", 2);
+    __wr_uint(wr, id);
+    __wr_raw(wr, "\":", 2);
+}
+
+static void __wr_header_begin(dp_json_wr_t *wr, dp_schema_t *schema)
+{
+    __wr_str(wr, "{\"devId\":\"");
+    __wr_str(wr, schema->devid);
+    __wr_str(wr, "\",\"dps\":");
+}
+
+static OPERATE_RET __wr_finish(dp_json_wr_t *wr, uint32_t *out_len)
+{
+    if (out_len) {
+        *out_len = wr->len;
+    }
+    if (NULL == wr->buf) {
+        return OPRT_OK;
+    }
+    if (wr->len >= wr->size) {
+        return OPRT_BUFFER_NOT_ENOUGH;
+    }
+    wr->buf[wr->len] = '\0';
+    return OPRT_OK;
+}
+
+static dp_obj_t *dp_rept_obj_find(dp_rept_in_t *dpin, uint8_t id, uint16_t *cursor)
+{
+    uint16_t j;
+
+    // dpvalid->dpid keeps the order of dpin->dps, so the next match is usually at the cursor
+    for (j = *cursor; j < dpin->dpscnt; j++) {
+        if (id == dpin->dps[j].id) {
+            *cursor = j + 1;
+            return &dpin->dps[j];
+        }
+    }
+    for (j = 0; j < *cursor && j < dpin->dpscnt; j++) {
+        if (id == dpin->dps[j].id) {
+            return &dpin->dps[j];
+        }
+    }
+
+    return NULL;
+}
+
 /**
- * @brief Outputs the JSON representation of a device property (DP) schema.
+ * @brief Serializes the valid DPs of a report into a caller provided buffer.
  *
- * This function takes a DP schema, input data, validation information, and
- * output data as parameters. It generates the JSON representation of the DP
- * schema based on the provided input data and validation information, and
- * stores the result in the output data structure.
+ * Call it once with buf set to NULL to get the exact length, then again with
+ * a buffer of at least that length plus one.
  *
  * @param schema Pointer to the DP schema structure.
  * @param dpin Pointer to the input data structure.
  * @param dpvalid Pointer to the validation information structure.
- * @param dpout Pointer to the output data structure.
- * @return Integer value indicating the success or failure of the operation.
+ * @param flags DP_APPEND_HEADER_FLAG to wrap the dps into the devId envelope.
+ * @param buf Output buffer, NULL to only compute the length.
+ * @param size Size of buf.
+ * @param out_len Length of the JSON text, without the terminating NUL.
+ * @return OPRT_OK on success, OPRT_BUFFER_NOT_ENOUGH if buf is too small, or
+ * another error code.
  */
-int dp_rept_json_output(dp_schema_t *schema, dp_rept_in_t *dpin, dp_rept_valid_t *dpvalid, dp_rept_out_t *dpout)
+int dp_rept_json_write(dp_schema_t *schema, dp_rept_in_t *dpin, dp_rept_valid_t *dpvalid, int flags, char *buf,
+                       uint32_t size, uint32_t *out_len)
 {
-    uint16_t i, j;
-    uint16_t offset = 0;
-    uint16_t time_offset = 0;
-    OPERATE_RET op_ret = OPRT_OK;
-    char *dpstr = NULL;
-    char *dptimestr = NULL;
-    bool is_need_time = false;
+    uint16_t i;
+    uint16_t cursor = 0;
+    dp_json_wr_t wr = {.buf = buf, .size = size, .len = 0};
 
-    dpstr = (char *)tal_malloc(dpvalid->len);
-    if (NULL == dpstr) {
-        PR_ERR("malloc err:%d", dpvalid->len);
-        return OPRT_MALLOC_FAILED;
-    }
-    // STAT type DP needs to assemble a timestamp
-    if ((T_STAT_REPT == dpin->rept_type) && dpvalid->timelen && dpout->timejson) {
-        dptimestr = (char *)tal_malloc(dpvalid->timelen);
-        if (NULL == dptimestr) {
-            PR_ERR("malloc err:%d", dpvalid->timelen);
-            op_ret = OPRT_MALLOC_FAILED;
-            goto __err_exit;
-        }
-        is_need_time = true;
-    }
-    dpstr[offset++] = '{';
-    if (is_need_time) {
-        dptimestr[time_offset++] = '{';
+    if (flags & DP_APPEND_HEADER_FLAG) {
+        __wr_header_begin(&wr, schema);
     }
 
     for (i = 0; i < dpvalid->num; i++) {
-        dp_obj_t *dp = NULL;
-        for (j = 0; j < dpin->dpscnt; j++) {
-            if (dpvalid->dpid[i] == dpin->dps[j].id) {
-                dp = &dpin->dps[j];
-                break;
-            }
-        }
+        dp_obj_t *dp = dp_rept_obj_find(dpin, dpvalid->dpid[i], &cursor);
         if (NULL == dp) {
             PR_DEBUG("dp not found");
-            op_ret = OPRT_SVC_DP_ID_NOT_FOUND;
-            goto __err_exit;
+            return OPRT_SVC_DP_ID_NOT_FOUND;
         }
-        // dp_obj_t  *dp     = &dpin->dps[dpvalid->dpid[i]];
         dp_node_t *dpnode = dp_node_find(schema, dp->id);
         if (NULL == dpnode) {
             PR_DEBUG("dp->id = %d not found", dp->id);
-            op_ret = OPRT_SVC_DP_ID_NOT_FOUND;
-            goto __err_exit;
+            return OPRT_SVC_DP_ID_NOT_FOUND;
         }
-
         if (dp->type != dpnode->desc.prop_tp) {
-            op_ret = OPRT_SVC_DP_TP_NOT_MATCH;
-            goto __err_exit;
+            return OPRT_SVC_DP_TP_NOT_MATCH;
         }
 
+        __wr_dp_key(&wr, 0 == i, dp->id);
         switch (dp->type) {
-        case PROP_BOOL: {
-            if (TRUE == dp->value.dp_bool) {
-                offset += sprintf(dpstr + offset, "\"%d\":true,", dp->id);
-            } else {
-                offset += sprintf(dpstr + offset, "\"%d\":false,", dp->id);
-            }
+        case PROP_BOOL:
+            __wr_str(&wr, dp->value.dp_bool ? "true" : "false");
             break;
-        }
 
-        case PROP_VALUE: {
-            offset += sprintf(dpstr + offset, "\"%d\":%d,", dp->id, dp->value.dp_value);
+        case PROP_VALUE:
+            __wr_int(&wr, dp->value.dp_value);
             break;
-        }
 
-        case PROP_BITMAP: {
-            offset += sprintf(dpstr + offset, "\"%d\":%d,", dp->id, dp->value.dp_bitmap);
+        case PROP_BITMAP:
+            __wr_uint(&wr, dp->value.dp_bitmap);
             break;
-        }
 
-        case PROP_STR: {
-            cJSON *temp_str = cJSON_CreateString(dp->value.dp_str);
-            char *tmp_data = cJSON_PrintUnformatted(temp_str);
-            if (tmp_data) {
-                offset += sprintf(dpstr + offset, "\"%d\":%s,", dp->id, tmp_data);
-            }
-            tal_free(tmp_data);
-            cJSON_Delete(temp_str);
+        case PROP_STR:
+            __wr_json_str(&wr, dp->value.dp_str ? dp->value.dp_str : "");
             break;
-        }
 
-        case PROP_ENUM: {
-            offset +=
-                sprintf(dpstr + offset, "\"%d\":\"%s\",", dp->id, dpnode->prop.prop_enum.pp_enum[dp->value.dp_enum]);
-        } break;
-        }
+        case PROP_ENUM:
+            __wr_json_str(&wr, dpnode->prop.prop_enum.pp_enum[dp->value.dp_enum]);
+            break;
 
-        if (is_need_time && dp->time_stamp) {
-            time_offset += sprintf(dptimestr + time_offset, "\"%d\":%u,", dp->id, dp->time_stamp);
+        default:
+            return OPRT_SVC_DP_TP_NOT_MATCH;
         }
     }
+    __wr_raw(&wr, "}", 1);
 
-    dpstr[offset - 1] = '}';
-    dpstr[offset] = 0;
+    if (flags & DP_APPEND_HEADER_FLAG) {
+        __wr_raw(&wr, "}", 1);
+    }
 
-    dpout->dpsjson = dpstr;
+    return __wr_finish(&wr, out_len);
+}
+
+static void dp_rept_time_write(dp_json_wr_t *wr, dp_rept_in_t *dpin, dp_rept_valid_t *dpvalid)
+{
+    uint16_t i;
+    uint16_t cursor = 0;
+    bool first = true;
+
+    for (i = 0; i < dpvalid->num; i++) {
+        dp_obj_t *dp = dp_rept_obj_find(dpin, dpvalid->dpid[i], &cursor);
+        if (NULL == dp || 0 == dp->time_stamp) {
+            continue;
+        }
+        __wr_dp_key(wr, first, dp->id);
+        __wr_uint(wr, dp->time_stamp);
+        first = false;
+    }
+    __wr_raw(wr, first ? "{}" : "}", first ? 2 : 1);
+}
+
+/**
+ * @brief Outputs the JSON representation of a device property (DP) schema.
+ *
+ * This function takes a DP schema, input data, validation information, and
+ * output data as parameters. It generates the JSON representation of the DP
+ * schema based on the provided input data and validation information, and
+ * stores the result in the output data structure.
+ *
+ * @param schema Pointer to the DP schema structure.
+ * @param dpin Pointer to the input data structure.
+ * @param dpvalid Pointer to the validation information structure.
+ * @param dpout Pointer to the output data structure.
+ * @return Integer value indicating the success or failure of the operation.
+ */
+int dp_rept_json_output(dp_schema_t *schema, dp_rept_in_t *dpin, dp_rept_valid_t *dpvalid, dp_rept_out_t *dpout)
+{
+    OPERATE_RET op_ret = OPRT_OK;
+    uint32_t len = 0;
+    char *dpstr = NULL;
+    char *dptimestr = NULL;
 
+    op_ret = dp_rept_json_write(schema, dpin, dpvalid, 0, NULL, 0, &len);
+    if (OPRT_OK != op_ret) {
+        return op_ret;
+    }
+    dpstr = (char *)tal_malloc(len + 1);
+    if (NULL == dpstr) {
+        PR_ERR("malloc err:%d", len + 1);
+        return OPRT_MALLOC_FAILED;
+    }
+    op_ret = dp_rept_json_write(schema, dpin, dpvalid, 0, dpstr, len + 1, NULL);
+    if (OPRT_OK != op_ret) {
+        tal_free(dpstr);
+        return op_ret;
+    }
     PR_DEBUG("dp rept out: %s", dpstr);
 
-    if (is_need_time) {
-        dptimestr[time_offset - 1] = '}';
-        dptimestr[time_offset] = 0;
+    // STAT type DP needs to assemble a timestamp
+    if ((T_STAT_REPT == dpin->rept_type) && dpvalid->timelen && dpout->timejson) {
+        dp_json_wr_t wr = {0};
+
+        dp_rept_time_write(&wr, dpin, dpvalid);
+        dptimestr = (char *)tal_malloc(wr.len + 1);
+        if (NULL == dptimestr) {
+            PR_ERR("malloc err:%d", wr.len + 1);
+            tal_free(dpstr);
+            return OPRT_MALLOC_FAILED;
+        }
+        wr.buf = dptimestr;
+        wr.size = wr.len + 1;
+        wr.len = 0;
+        dp_rept_time_write(&wr, dpin, dpvalid);
+        __wr_finish(&wr, NULL);
         PR_DEBUG("dptimestr:%s", dptimestr);
         dpout->timejson = dptimestr;
     }
 
-    return OPRT_OK;
-
-__err_exit:
-    tal_free(dpstr);
-    if (is_need_time) {
-        tal_free(dptimestr);
-    }
+    dpout->dpsjson = dpstr;
 
-    return op_ret;
+    return OPRT_OK;
 }
 
 // int dp_rept_json_output(dp_schema_t *schema, dp_rept_in_t *dpin,
@@ -991,56 +1157,132 @@ __err_exit:
 //     return op_ret;
 // }
 
-static int dp_obj_json_create(cJSON *root, dp_node_t *dpnode)
+static bool dp_obj_json_write(dp_json_wr_t *wr, bool first, dp_node_t *dpnode)
 {
-    int length = 0;
-
-    char dpid[10] = {0};
-    snprintf(dpid, 10, "%d", dpnode->desc.id);
+    // raw DPs keep no value in the node
+    if (T_OBJ != dpnode->desc.type) {
+        return false;
+    }
 
     switch (dpnode->desc.prop_tp) {
     case PROP_BOOL: {
-        length += 10;
-        cJSON_AddBoolToObject(root, dpid, dpnode->prop.prop_bool.value);
+        __wr_dp_key(wr, first, dpnode->desc.id);
+        __wr_str(wr, dpnode->prop.prop_bool.value ? "true" : "false");
         break;
     }
 
     case PROP_VALUE: {
-        length += 10;
-        cJSON_AddNumberToObject(root, dpid, dpnode->prop.prop_int.value);
+        __wr_dp_key(wr, first, dpnode->desc.id);
+        __wr_int(wr, dpnode->prop.prop_int.value);
         break;
     }
 
     case PROP_STR: {
+        bool written = false;
         tal_mutex_lock(dpnode->prop.prop_str.dp_str_mutex);
         if (dpnode->prop.prop_str.value) {
-            length += (10 + strlen(dpnode->prop.prop_str.value));
-            cJSON_AddStringToObject(root, dpid, dpnode->prop.prop_str.value);
+            __wr_dp_key(wr, first, dpnode->desc.id);
+            __wr_json_str(wr, dpnode->prop.prop_str.value);
+            written = true;
         }
         tal_mutex_unlock(dpnode->prop.prop_str.dp_str_mutex);
-        break;
+        return written;
     }
 
     case PROP_ENUM: {
-        int value = dpnode->prop.prop_enum.value;
-        length += (10 + strlen(dpnode->prop.prop_enum.pp_enum[value]));
-        cJSON_AddStringToObject(root, dpid, dpnode->prop.prop_enum.pp_enum[value]);
+        __wr_dp_key(wr, first, dpnode->desc.id);
+        __wr_json_str(wr, dpnode->prop.prop_enum.pp_enum[dpnode->prop.prop_enum.value]);
         break;
     }
 
     case PROP_BITMAP: {
-        length += 10;
-        cJSON_AddNumberToObject(root, dpid, dpnode->prop.prop_bitmap.value);
+        __wr_dp_key(wr, first, dpnode->desc.id);
+        __wr_uint(wr, dpnode->prop.prop_bitmap.value);
         break;
     }
 
     default: {
         PR_ERR("dp type err:%d", dpnode->desc.prop_tp);
-        break;
+        return false;
+    }
+    }
+
+    return true;
+}
+
+/*
+ * Writes the current DP values of the schema. With DP_DUMP_STAT_LOCAL_FLAG
+ * only the DPs not yet synced to the cloud are written, and their ids are
+ * recorded in dpvalid (at most max_num of them) when it is given.
+ */
+static uint16_t dp_obj_dump_write(dp_json_wr_t *wr, dp_schema_t *schema, dp_rept_valid_t *dpvalid, uint8_t max_num,
+                                  int flags)
+{
+    int i;
+    uint16_t cnt = 0;
+
+    if (flags & DP_APPEND_HEADER_FLAG) {
+        __wr_header_begin(wr, schema);
     }
+    if (dpvalid) {
+        dpvalid->num = 0;
     }
 
-    return length;
+    for (i = 0; i < schema->num; i++) {
+        dp_node_t *dpnode = &(schema->node[i]);
+        if (DP_DUMP_STAT_LOCAL_FLAG & flags) {
+            if (T_OBJ == dpnode->desc.type && PV_STAT_CLOUD == dpnode->pv_stat) {
+                continue;
+            }
+        }
+        if (dpvalid) {
+            if (dpvalid->num >= max_num) {
+                break;
+            }
+            dpvalid->dpid[dpvalid->num++] = dpnode->desc.id;
+        }
+        if (dp_obj_json_write(wr, 0 == cnt, dpnode)) {
+            cnt++;
+        }
+    }
+
+    __wr_raw(wr, cnt ? "}" : "{}", cnt ? 1 : 2);
+    if (flags & DP_APPEND_HEADER_FLAG) {
+        __wr_raw(wr, "}", 1);
+    }
+
+    return cnt;
+}
+
+static char *dp_obj_dump_json(dp_schema_t *schema, dp_rept_valid_t *dpvalid, uint8_t max_num, int flags)
+{
+    int retry;
+    dp_json_wr_t wr = {0};
+
+    if (0 == dp_obj_dump_write(&wr, schema, dpvalid, max_num, flags)) {
+        PR_DEBUG("Nothing To Pack");
+        return NULL;
+    }
+
+    // string DPs may grow between the sizing and the writing pass, resize and retry then
+    for (retry = 0; retry < 3; retry++) {
+        wr.size = wr.len + 1;
+        wr.len = 0;
+        wr.buf = tal_malloc(wr.size);
+        if (NULL == wr.buf) {
+            PR_ERR("malloc err:%d", wr.size);
+            return NULL;
+        }
+        dp_obj_dump_write(&wr, schema, dpvalid, max_num, flags);
+        if (OPRT_OK == __wr_finish(&wr, NULL)) {
+            return wr.buf;
+        }
+        tal_free(wr.buf);
+        wr.buf = NULL;
+    }
+
+    PR_ERR("dp dump overflow");
+    return NULL;
 }
 
 /**
@@ -1065,19 +1307,17 @@ static int dp_obj_json_create(cJSON *root, dp_node_t *dpnode)
 int dp_obj_dump_stat_local_json(char *devid, dp_rept_valid_t **outdpvalid, char **outjson, int flags)
 {
     int i;
-    size_t length = 0;
     dp_schema_t *schema = dp_schema_find(devid);
     uint8_t dp_stat_local_num = 0;
 
+    if (NULL == schema) {
+        return OPRT_INVALID_PARM;
+    }
+
     for (i = 0; i < schema->num; i++) {
         dp_node_t *dpnode = &(schema->node[i]);
-        if (dpnode == NULL) {
-            PR_DEBUG("dpnode NULL");
-            break;
-        }
         if (T_OBJ == dpnode->desc.type && PV_STAT_CLOUD != dpnode->pv_stat) {
             dp_stat_local_num++;
-            continue;
         }
     }
 
@@ -1085,53 +1325,18 @@ int dp_obj_dump_stat_local_json(char *devid, dp_rept_valid_t **outdpvalid, char
         return OPRT_OK;
     }
 
-    cJSON *cjson = cJSON_CreateObject();
-    if (NULL == cjson) {
-        PR_ERR("json err");
-        return OPRT_MALLOC_FAILED;
-    }
-
     dp_rept_valid_t *dpvaild = tal_malloc(sizeof(dp_rept_valid_t) + sizeof(uint8_t) * dp_stat_local_num);
     if (NULL == dpvaild) {
-        cJSON_Delete(cjson);
         return OPRT_MALLOC_FAILED;
     }
     memset(dpvaild, 0, sizeof(dp_rept_valid_t) + sizeof(uint8_t) * dp_stat_local_num);
     dpvaild->schema = schema;
 
-    for (i = 0; i < schema->num; i++) {
-        dp_node_t *dpnode = &(schema->node[i]);
-        if (dpnode == NULL) {
-            PR_DEBUG("dpnode NULL");
-            break;
-        }
-        if (T_OBJ == dpnode->desc.type && PV_STAT_CLOUD == dpnode->pv_stat) {
-            continue;
-        }
-        if (dpvaild->num < dp_stat_local_num) {
-            dpvaild->dpid[dpvaild->num++] = dpnode->desc.id;
-            length += dp_obj_json_create(cjson, dpnode);
-        }
-    }
-
-    if (length == 0) {
-        PR_DEBUG("Nothing To Pack");
-        cJSON_Delete(cjson);
-        return OPRT_SVC_DP_ID_NOT_FOUND;
-    }
-    char *jsonstr = cJSON_PrintUnformatted(cjson);
-    cJSON_Delete(cjson);
+    char *jsonstr =
+        dp_obj_dump_json(schema, dpvaild, dp_stat_local_num, DP_DUMP_STAT_LOCAL_FLAG | (flags & DP_APPEND_HEADER_FLAG));
     if (NULL == jsonstr) {
         tal_free(dpvaild);
-        PR_ERR("Json err");
-        return OPRT_CR_CJSON_ERR;
-    }
-
-    if (flags & DP_APPEND_HEADER_FLAG) {
-        char *out = NULL;
-        dp_rept_json_append(schema, jsonstr, NULL, NULL, 0, &out);
-        tal_free(jsonstr);
-        jsonstr = out;
+        return OPRT_SVC_DP_ID_NOT_FOUND;
     }
 
     if (outjson) {
@@ -1164,344 +1369,649 @@ int dp_obj_dump_stat_local_json(char *devid, dp_rept_valid_t **outdpvalid, char
  */
 char *dp_obj_dump_all_json(char *devid, int flags)
 {
-    cJSON *cjson = cJSON_CreateObject();
-    if (NULL == cjson) {
-        PR_ERR("json err");
-        return NULL;
-    }
-
-    size_t length = 0;
     dp_schema_t *schema = dp_schema_find(devid);
     if (NULL == schema) {
-        cJSON_Delete(cjson);
         PR_ERR("schema err");
         return NULL;
     }
 
-    int i;
+    return dp_obj_dump_json(schema, NULL, 0, flags);
+}
 
-    for (i = 0; i < schema->num; i++) {
-        dp_node_t *dpnode = &(schema->node[i]);
-        if (dpnode == NULL) {
-            PR_DEBUG("dpnode NULL");
-            break;
+/*
+ * Minimal allocation-free JSON tokenizer used by the schema parser. It works
+ * on the raw schema string in place and fills dp_node_t directly, so no cJSON
+ * tree and no per-node scratch buffer is needed.
+ */
+static const char *__json_skip_ws(const char *p)
+{
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') {
+        p++;
+    }
+    return p;
+}
+
+static OPERATE_RET __json_string(const char **pp, const char **str, int *len)
+{
+    const char *p = __json_skip_ws(*pp);
+
+    if (*p != '"') {
+        return OPRT_CJSON_PARSE_ERR;
+    }
+    p++;
+    *str = p;
+    while (*p && *p != '"') {
+        if (*p == '\\') {
+            p++;
+            if (*p == '\0') {
+                return OPRT_CJSON_PARSE_ERR;
+            }
         }
-        if (DP_DUMP_STAT_LOCAL_FLAG & flags) {
-            if (T_OBJ == dpnode->desc.type && PV_STAT_CLOUD == dpnode->pv_stat) {
-                continue;
+        p++;
+    }
+    if (*p != '"') {
+        return OPRT_CJSON_PARSE_ERR;
+    }
+    *len = p - *str;
+    *pp = p + 1;
+
+    return OPRT_OK;
+}
+
+static bool __json_str_eq(const char *str, int len, const char *lit)
+{
+    return ((int)strlen(lit) == len) && (0 == memcmp(str, lit, len));
+}
+
+static OPERATE_RET __json_skip_value(const char **pp)
+{
+    const char *p = __json_skip_ws(*pp);
+    const char *str;
+    int len;
+    int depth = 0;
+
+    do {
+        if (*p == '"') {
+            if (OPRT_OK != __json_string(&p, &str, &len)) {
+                return OPRT_CJSON_PARSE_ERR;
             }
+            continue;
         }
-        length += dp_obj_json_create(cjson, dpnode);
-    } /* end of for */
+        if (*p == '\0') {
+            return OPRT_CJSON_PARSE_ERR;
+        }
+        if (*p == '{' || *p == '[') {
+            depth++;
+        } else if (*p == '}' || *p == ']') {
+            if (0 == depth) {
+                break;
+            }
+            depth--;
+        } else if (0 == depth && *p == ',') {
+            break;
+        }
+        p++;
+    } while (depth > 0 || (*p != ',' && *p != '}' && *p != ']' && *p != '\0'));
 
-    if (length == 0) {
-        PR_DEBUG("Nothing To Pack");
-        cJSON_Delete(cjson);
-        return NULL;
+    *pp = p;
+    return OPRT_OK;
+}
+
+static OPERATE_RET __json_int(const char **pp, int *value)
+{
+    const char *p = __json_skip_ws(*pp);
+    bool quoted = FALSE;
+    bool neg = FALSE;
+    int64_t val = 0;
+
+    if (*p == '"') {
+        quoted = TRUE;
+        p++;
+    }
+    if (*p == '-') {
+        neg = TRUE;
+        p++;
+    }
+    if (*p < '0' || *p > '9') {
+        return OPRT_CJSON_PARSE_ERR;
+    }
+    // out of range values are clamped, same as cJSON valueint
+    while (*p >= '0' && *p <= '9') {
+        if (val <= (int64_t)INT32_MAX + 1) {
+            val = val * 10 + (*p - '0');
+        }
+        p++;
+    }
+    if (neg) {
+        val = (val > (int64_t)INT32_MAX + 1) ? INT32_MIN : -val;
+    } else if (val > INT32_MAX) {
+        val = INT32_MAX;
     }
+    // fraction and exponent are truncated, same as cJSON valueint
+    while ((*p >= '0' && *p <= '9') || *p == '.' || *p == 'e' || *p == 'E' || *p == '+' || *p == '-') {
+        p++;
+    }
+    if (quoted) {
+        if (*p != '"') {
+            return OPRT_CJSON_PARSE_ERR;
+        }
+        p++;
+    }
+    *value = (int)val;
+    *pp = p;
 
-    char *tmp = cJSON_PrintUnformatted(cjson);
-    cJSON_Delete(cjson);
-    if (NULL == tmp) {
-        PR_ERR("Json err");
-        return NULL;
+    return OPRT_OK;
+}
+
+static bool __json_hex4(const char *str, int len, uint32_t *code)
+{
+    int i;
+
+    if (len < 4) {
+        return FALSE;
     }
+    *code = 0;
+    for (i = 0; i < 4; i++) {
+        char c = str[i] | 0x20;
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))) {
+            return FALSE;
+        }
+        *code = (*code << 4) | asc2hex(str[i]);
+    }
+    return TRUE;
+}
 
-    char *out = tmp;
+static char *__json_strdup(const char *str, int len)
+{
+    char *out = tal_malloc(len + 1);
+    if (NULL == out) {
+        return NULL;
+    }
 
-    if (flags & DP_APPEND_HEADER_FLAG) {
-        dp_rept_json_append(schema, out, NULL, NULL, 0, &out);
+    int i = 0, n = 0;
+    while (i < len) {
+        if (str[i] != '\\') {
+            out[n++] = str[i++];
+            continue;
+        }
+        i++;
+        switch (str[i]) {
+        case 'b':
+            out[n++] = '\b';
+            break;
+        case 'f':
+            out[n++] = '\f';
+            break;
+        case 'n':
+            out[n++] = '\n';
+            break;
+        case 'r':
+            out[n++] = '\r';
+            break;
+        case 't':
+            out[n++] = '\t';
+            break;
+        case 'u': {
+            uint32_t code = 0, low = 0;
+            if (!__json_hex4(&str[i + 1], len - i - 1, &code) || (code >= 0xDC00 && code <= 0xDFFF)) {
+                goto err;
+            }
+            i += 4;
+            // a high surrogate must be followed by a \uDCxx low surrogate, the pair is one code point
+            if (code >= 0xD800 && code <= 0xDBFF) {
+                if (len - i < 7 || str[i + 1] != '\\' || str[i + 2] != 'u' ||
+                    !__json_hex4(&str[i + 3], len - i - 3, &low) || low < 0xDC00 || low > 0xDFFF) {
+                    goto err;
+                }
+                i += 6;
+                code = 0x10000 + (((code & 0x3FF) << 10) | (low & 0x3FF));
+            }
+            // the utf-8 form of a \uXXXX escape (or pair) is never longer than the escape itself
+            if (code < 0x80) {
+                out[n++] = code;
+            } else if (code < 0x800) {
+                out[n++] = 0xC0 | (code >> 6);
+                out[n++] = 0x80 | (code & 0x3F);
+            } else if (code < 0x10000) {
+                out[n++] = 0xE0 | (code >> 12);
+                out[n++] = 0x80 | ((code >> 6) & 0x3F);
+                out[n++] = 0x80 | (code & 0x3F);
+            } else {
+                out[n++] = 0xF0 | (code >> 18);
+                out[n++] = 0x80 | ((code >> 12) & 0x3F);
+                out[n++] = 0x80 | ((code >> 6) & 0x3F);
+                out[n++] = 0x80 | (code & 0x3F);
+            }
+        } break;
+        default:
+            out[n++] = str[i];
+            break;
+        }
+        i++;
     }
+    out[n] = '\0';
 
     return out;
+
+err:
+    PR_ERR("invalid unicode escape");
+    tal_free(out);
+    return NULL;
 }
 
-typedef struct {
-    uint16_t start;
-    uint16_t end;
-} dp_node_pos_t;
+/**
+ * @brief Steps to the next member of a JSON object.
+ *
+ * @return 1 when a member is available and *pp points at its value, 0 when the
+ * object is finished, or OPRT_CJSON_PARSE_ERR on syntax error.
+ */
+static int __json_obj_next(const char **pp, const char **key, int *key_len)
+{
+    const char *p = __json_skip_ws(*pp);
+
+    if (*p == ',') {
+        p++;
+    } else if (*p == '}') {
+        *pp = p + 1;
+        return 0;
+    }
+    if (OPRT_OK != __json_string(&p, key, key_len)) {
+        return OPRT_CJSON_PARSE_ERR;
+    }
+    p = __json_skip_ws(p);
+    if (*p != ':') {
+        return OPRT_CJSON_PARSE_ERR;
+    }
+    *pp = __json_skip_ws(p + 1);
+
+    return 1;
+}
+
+/**
+ * @brief Steps to the next element of a JSON array.
+ *
+ * @return 1 when an element is available and *pp points at it, 0 when the
+ * array is finished, or OPRT_CJSON_PARSE_ERR on syntax error.
+ */
+static int __json_arr_next(const char **pp)
+{
+    const char *p = __json_skip_ws(*pp);
 
-#define MAX_ITEM_LEN 1024
+    if (*p == ',') {
+        p = __json_skip_ws(p + 1);
+    } else if (*p == ']') {
+        *pp = p + 1;
+        return 0;
+    }
+    if (*p == '\0' || *p == ']' || *p == '}') {
+        return OPRT_CJSON_PARSE_ERR;
+    }
+    *pp = p;
 
-static int dp_node_pos_decode(char *schema_json, dp_node_pos_t pos[], int pos_num)
+    return 1;
+}
+
+static int dp_node_num_get(const char *schema_json)
 {
     if (!schema_json) {
         return 0;
     }
 
-    int i = 0, brace = 0, n = 0;
+    int brace = 0, n = 0;
+    bool in_str = FALSE;
 
-    while (*schema_json) {
-        if (*schema_json == '{') {
+    for (; *schema_json; schema_json++) {
+        if (in_str) {
+            if (*schema_json == '\\' && *(schema_json + 1)) {
+                schema_json++;
+            } else if (*schema_json == '"') {
+                in_str = FALSE;
+            }
+        } else if (*schema_json == '"') {
+            in_str = TRUE;
+        } else if (*schema_json == '{') {
             if (brace == 0) {
-                pos[n].start = i;
+                n++;
             }
             brace++;
         } else if (*schema_json == '}') {
             brace--;
-            if (brace == 0) {
-                pos[n++].end = i;
-            }
-
-            if (n >= pos_num) {
-                return n;
-            }
         }
-        i++;
-        schema_json++;
     }
 
     return n;
 }
 
-static OPERATE_RET dp_node_parse(char *schema_json, dp_node_pos_t *nodepos, uint16_t nodenum, dp_node_t *dpnode,
-                                 SCHEMA_OTHER_ATTR_S *other_attr)
+static void dp_node_release(dp_node_t *dpnode)
 {
-    OPERATE_RET op_ret = OPRT_OK;
-    dp_desc_t *dp_desc;
-    dp_prop_vaule_t *prop;
+    int i;
 
-    cJSON *cjson = NULL;
-    cJSON *item = NULL;
-    char *pBuf = NULL;
+    if (dpnode->desc.type != T_OBJ) {
+        return;
+    }
 
-    pBuf = (char *)tal_malloc(MAX_ITEM_LEN);
-    if (NULL == pBuf) {
+    if (dpnode->desc.prop_tp == PROP_STR) {
+        if (dpnode->prop.prop_str.dp_str_mutex) {
+            tal_mutex_release(dpnode->prop.prop_str.dp_str_mutex);
+            dpnode->prop.prop_str.dp_str_mutex = NULL;
+        }
+        if (dpnode->prop.prop_str.value) {
+            tal_free(dpnode->prop.prop_str.value);
+            dpnode->prop.prop_str.value = NULL;
+        }
+    } else if (dpnode->desc.prop_tp == PROP_ENUM && dpnode->prop.prop_enum.pp_enum) {
+        for (i = 0; i < dpnode->prop.prop_enum.cnt; i++) {
+            if (dpnode->prop.prop_enum.pp_enum[i]) {
+                tal_free(dpnode->prop.prop_enum.pp_enum[i]);
+            }
+        }
+        tal_free(dpnode->prop.prop_enum.pp_enum);
+        dpnode->prop.prop_enum.pp_enum = NULL;
+    }
+}
+
+static OPERATE_RET dp_prop_enum_parse(const char *p, dp_prop_enum_t *prop_enum)
+{
+    const char *str;
+    int len, rt, num = 0;
+    const char *cur = __json_skip_ws(p);
+
+    if (*cur != '[') {
+        PR_ERR("get range null");
+        return OPRT_CJSON_GET_ERR;
+    }
+    cur++;
+    while ((rt = __json_arr_next(&cur)) > 0) {
+        if (OPRT_OK != __json_skip_value(&cur)) {
+            return OPRT_CJSON_PARSE_ERR;
+        }
+        num++;
+    }
+    if (rt < 0) {
+        return OPRT_CJSON_PARSE_ERR;
+    }
+    if (num == 0) {
+        PR_ERR("get array size null");
+        return OPRT_CJSON_GET_ERR;
+    }
+
+    prop_enum->pp_enum = tal_calloc(num, sizeof(char *));
+    if (NULL == prop_enum->pp_enum) {
         PR_ERR("malloc fail");
-        op_ret = OPRT_COM_ERROR;
-        goto __exit;
+        return OPRT_MALLOC_FAILED;
     }
+    prop_enum->cnt = num;
 
     int i = 0;
-
-    for (i = 0; i < nodenum; i++) {
-        dp_desc = &(dpnode[i].desc);
-        prop = &(dpnode[i].prop);
-
-        memset(pBuf, 0, MAX_ITEM_LEN);
-        memcpy(pBuf, schema_json + nodepos[i].start, nodepos[i].end - nodepos[i].start + 1);
-        cjson = cJSON_Parse(pBuf);
-        if (NULL == cjson) {
-            PR_ERR("cjson NULL:%s", pBuf);
-            op_ret = OPRT_CJSON_PARSE_ERR;
-            goto __exit;
+    cur = __json_skip_ws(p) + 1;
+    while (__json_arr_next(&cur) > 0) {
+        if (OPRT_OK != __json_string(&cur, &str, &len)) {
+            PR_ERR("get array null");
+            return OPRT_CJSON_GET_ERR;
         }
-        item = cJSON_GetObjectItem(cjson, "id"); // id
-        if (NULL == item) {
-            PR_ERR("get id null");
-            op_ret = OPRT_CJSON_GET_ERR;
-            goto __exit;
+        prop_enum->pp_enum[i] = __json_strdup(str, len);
+        if (NULL == prop_enum->pp_enum[i]) {
+            PR_ERR("malloc fail");
+            return OPRT_MALLOC_FAILED;
         }
-        if (item->type == cJSON_String) {
-            dp_desc->id = atoi(item->valuestring);
+        i++;
+    }
+
+    return OPRT_OK;
+}
+
+static OPERATE_RET dp_prop_parse(const char *p, dp_desc_t *dp_desc, dp_prop_vaule_t *prop)
+{
+    OPERATE_RET op_ret = OPRT_OK;
+    const char *key, *str;
+    int key_len, len, rt;
+    const char *type = NULL, *range = NULL;
+    int type_len = 0;
+    bool has_max = FALSE, has_min = FALSE, has_maxlen = FALSE;
+    int max = 0, min = 0, scale = 0, maxlen = 0;
+
+    p = __json_skip_ws(p);
+    if (*p != '{') {
+        PR_ERR("get property null");
+        return OPRT_CJSON_GET_ERR;
+    }
+    p++;
+    while ((rt = __json_obj_next(&p, &key, &key_len)) > 0) {
+        if (__json_str_eq(key, key_len, "type")) {
+            op_ret = __json_string(&p, &type, &type_len);
+        } else if (__json_str_eq(key, key_len, "max")) {
+            op_ret = __json_int(&p, &max);
+            has_max = TRUE;
+        } else if (__json_str_eq(key, key_len, "min")) {
+            op_ret = __json_int(&p, &min);
+            has_min = TRUE;
+        } else if (__json_str_eq(key, key_len, "scale")) {
+            op_ret = __json_int(&p, &scale);
+        } else if (__json_str_eq(key, key_len, "maxlen")) {
+            op_ret = __json_int(&p, &maxlen);
+            has_maxlen = TRUE;
+        } else if (__json_str_eq(key, key_len, "range")) {
+            range = p;
+            op_ret = __json_skip_value(&p);
         } else {
-            dp_desc->id = item->valueint;
-        }
-        //! mode
-        item = cJSON_GetObjectItem(cjson, "mode");
-        if (NULL == item) {
-            PR_ERR("get mode null");
-            op_ret = OPRT_CJSON_GET_ERR;
-            goto __exit;
+            op_ret = __json_skip_value(&p);
         }
-        if (!strcmp(item->valuestring, "rw")) {
-            dp_desc->mode = M_RW;
-        } else if (!strcmp(item->valuestring, "ro")) {
-            dp_desc->mode = M_RO;
-        } else {
-            dp_desc->mode = M_WR;
+        if (OPRT_OK != op_ret) {
+            return OPRT_CJSON_PARSE_ERR;
         }
-        //! passive
-        item = cJSON_GetObjectItem(cjson, "passive");
-        if (item == NULL) {
-            dp_desc->passive = PSV_FALSE;
-        } else {
+    }
+    if (rt < 0) {
+        return OPRT_CJSON_PARSE_ERR;
+    }
+
+    if (NULL == type) {
+        PR_ERR("get type null");
+        return OPRT_CJSON_GET_ERR;
+    }
+    str = type;
+    len = type_len;
+    if (__json_str_eq(str, len, "bool")) {
+        dp_desc->prop_tp = PROP_BOOL;
+    } else if (__json_str_eq(str, len, "value")) {
+        dp_desc->prop_tp = PROP_VALUE;
+        if (!has_max || !has_min) {
+            PR_ERR("get property null");
+            return OPRT_CJSON_GET_ERR;
+        }
+        prop->prop_int.max = max;
+        prop->prop_int.min = min;
+        prop->prop_int.scale = scale;
+    } else if (__json_str_eq(str, len, "string")) {
+        dp_desc->prop_tp = PROP_STR;
+        if (!has_maxlen) {
+            PR_ERR("get maxlen null");
+            return OPRT_CJSON_GET_ERR;
+        }
+        prop->prop_str.max_len = maxlen;
+        prop->prop_str.value = NULL;
+        prop->prop_str.cur_len = 0;
+        op_ret = tal_mutex_create_init(&prop->prop_str.dp_str_mutex);
+        if (OPRT_OK != op_ret) {
+            PR_ERR("mutex init fail:%d", op_ret);
+            return OPRT_CR_MUTEX_ERR;
+        }
+    } else if (__json_str_eq(str, len, "enum")) {
+        dp_desc->prop_tp = PROP_ENUM;
+        if (NULL == range) {
+            PR_ERR("get range null");
+            return OPRT_CJSON_GET_ERR;
+        }
+        return dp_prop_enum_parse(range, &prop->prop_enum);
+    } else if (__json_str_eq(str, len, "bitmap")) {
+        dp_desc->prop_tp = PROP_BITMAP;
+        if (!has_maxlen) {
+            PR_ERR("get maxlen null");
+            return OPRT_CJSON_GET_ERR;
+        }
+        prop->prop_bitmap.max_len = maxlen;
+    } else {
+        return OPRT_SVC_DEVOS_SCMA_INVALID;
+    }
+
+    return OPRT_OK;
+}
+
+static OPERATE_RET dp_node_parse_one(const char **pp, dp_node_t *dpnode, SCHEMA_OTHER_ATTR_S *other_attr)
+{
+    OPERATE_RET op_ret = OPRT_OK;
+    dp_desc_t *dp_desc = &(dpnode->desc);
+    const char *p = *pp;
+    const char *key, *str;
+    const char *property = NULL;
+    int key_len, len, rt, val;
+    bool has_id = FALSE, has_mode = FALSE;
+
+    if (*p != '{') {
+        PR_ERR("node is not object");
+        return OPRT_CJSON_PARSE_ERR;
+    }
+    p++;
+    // defaults of passive/trigger/route/stat/type are all 0 after memset
+    while ((rt = __json_obj_next(&p, &key, &key_len)) > 0) {
+        if (__json_str_eq(key, key_len, "id")) {
+            op_ret = __json_int(&p, &val);
+            dp_desc->id = val;
+            has_id = TRUE;
+        } else if (__json_str_eq(key, key_len, "mode")) {
+            // str and len are only set when the string is read, a parse error is returned below
+            op_ret = __json_string(&p, &str, &len);
+            if (OPRT_OK == op_ret) {
+                if (__json_str_eq(str, len, "rw")) {
+                    dp_desc->mode = M_RW;
+                } else if (__json_str_eq(str, len, "ro")) {
+                    dp_desc->mode = M_RO;
+                } else {
+                    dp_desc->mode = M_WR;
+                }
+                has_mode = TRUE;
+            }
+        } else if (__json_str_eq(key, key_len, "passive")) {
             other_attr->preprocess = TRUE;
             // passive processing is disabled first. The default value is false
             dp_desc->passive = PSV_FALSE;
-        }
-        //! trigger
-        item = cJSON_GetObjectItem(cjson, "trigger");
-        if (NULL == item) {
-            dp_desc->trig = TRIG_PULSE;
-        } else {
-            if (!strcmp(item->valuestring, "pulse")) {
-                dp_desc->trig = TRIG_PULSE;
-            } else {
-                dp_desc->trig = TRIG_DIRECT;
+            op_ret = __json_skip_value(&p);
+        } else if (__json_str_eq(key, key_len, "trigger")) {
+            op_ret = __json_string(&p, &str, &len);
+            if (OPRT_OK == op_ret) {
+                dp_desc->trig = __json_str_eq(str, len, "pulse") ? TRIG_PULSE : TRIG_DIRECT;
             }
-        }
-        // route
-        item = cJSON_GetObjectItem(cjson, "route");
-        if (NULL == item) {
-            dp_desc->route_t = ROUTE_DEFAULT;
-        } else {
-            if (item->valueint == 2) {
+        } else if (__json_str_eq(key, key_len, "route")) {
+            op_ret = __json_int(&p, &val);
+            if (val == 2) {
                 dp_desc->route_t = ROUTE_FORCE_BT;
-            }
-
-            else if (item->valueint == 1) {
+            } else if (val == 1) {
                 dp_desc->route_t = ROUTE_BLE_FIRST;
             } else {
                 dp_desc->route_t = ROUTE_DEFAULT;
             }
-        }
-        // stat //todo
-        item = cJSON_GetObjectItem(cjson, "stat");
-        if (NULL == item) {
-            dp_desc->stat = DST_NONE;
-        } else {
-            if (!strcmp(item->valuestring, "total")) {
-                dp_desc->stat = DST_TOTAL;
-            } else {
-                dp_desc->stat = DST_INC;
+        } else if (__json_str_eq(key, key_len, "stat")) {
+            op_ret = __json_string(&p, &str, &len);
+            if (OPRT_OK == op_ret) {
+                dp_desc->stat = __json_str_eq(str, len, "total") ? DST_TOTAL : DST_INC;
             }
-        }
-        // type
-        item = cJSON_GetObjectItem(cjson, "type");
-        if (NULL == item) {
-            dp_desc->type = T_OBJ;
-        } else {
-            if (!strcmp(item->valuestring, "obj")) {
-                dp_desc->type = T_OBJ;
-            } else {
-                if (!strcmp(item->valuestring, "raw")) {
+        } else if (__json_str_eq(key, key_len, "type")) {
+            op_ret = __json_string(&p, &str, &len);
+            if (OPRT_OK == op_ret) {
+                if (__json_str_eq(str, len, "obj")) {
+                    dp_desc->type = T_OBJ;
+                } else if (__json_str_eq(str, len, "raw")) {
                     dp_desc->type = T_RAW;
                 } else {
                     dp_desc->type = T_FILE;
                 }
-                cJSON_Delete(cjson);
-                continue;
             }
-        }
-        // property
-        item = cJSON_GetObjectItem(cjson, "property");
-        if (NULL == item) {
-            PR_ERR("get property null");
-            op_ret = OPRT_CJSON_GET_ERR;
-            goto __exit;
-        }
-        cJSON *child;
-        child = cJSON_GetObjectItem(item, "type");
-        if (NULL == child) {
-            PR_ERR("get type null");
-            op_ret = OPRT_CJSON_GET_ERR;
-            goto __exit;
-        }
-        if (!strcmp(child->valuestring, "bool")) {
-            dp_desc->prop_tp = PROP_BOOL;
-        } else if (!strcmp(child->valuestring, "value")) {
-            dp_desc->prop_tp = PROP_VALUE;
-            char *str[] = {"max", "min", "scale"};
-            int i;
-            for (i = 0; i < CNTSOF(str); i++) {
-                child = cJSON_GetObjectItem(item, str[i]);
-                if (NULL == child && (i != CNTSOF(str) - 1)) {
-                    PR_ERR("get property null");
-                    op_ret = OPRT_CJSON_GET_ERR;
-                    goto __exit;
-                } else if (NULL == child && (i == CNTSOF(str) - 1)) {
-                    prop->prop_int.scale = 0;
-                } else {
-                    switch (i) {
-                    case 0:
-                        prop->prop_int.max = child->valueint;
-                        break;
-                    case 1:
-                        prop->prop_int.min = child->valueint;
-                        break;
-                    case 2:
-                        prop->prop_int.scale = child->valueint;
-                        break;
-                    }
-                }
-            }
-        } else if (!strcmp(child->valuestring, "string")) {
-            dp_desc->prop_tp = PROP_STR;
-            child = cJSON_GetObjectItem(item, "maxlen");
-            if (NULL == child) {
-                PR_ERR("get maxlen null");
-                op_ret = OPRT_CJSON_GET_ERR;
-                goto __exit;
-            }
-            prop->prop_str.max_len = child->valueint;
-            prop->prop_str.value = NULL;
-            prop->prop_str.cur_len = 0;
-            op_ret = tal_mutex_create_init(&prop->prop_str.dp_str_mutex);
-            if (OPRT_OK != op_ret) {
-                PR_ERR("mutex init fail:%d", op_ret);
-                op_ret = OPRT_CR_MUTEX_ERR;
-                goto __exit;
-            }
-        } else if (!strcmp(child->valuestring, "enum")) {
-            dp_desc->prop_tp = PROP_ENUM;
-            child = cJSON_GetObjectItem(item, "range");
-            if (NULL == child) {
-                PR_ERR("get range null");
-                op_ret = OPRT_CJSON_GET_ERR;
-                goto __exit;
-            }
-            int i, num;
-            num = cJSON_GetArraySize(child);
-            if (num == 0) {
-                PR_ERR("get array size null");
-                op_ret = OPRT_CJSON_GET_ERR;
-                goto __exit;
-            }
-            prop->prop_enum.pp_enum = tal_malloc(num * sizeof(char *));
-            if (NULL == prop->prop_enum.pp_enum) {
-                PR_ERR("malloc fail");
-                op_ret = OPRT_MALLOC_FAILED;
-                goto __exit;
-            }
-            prop->prop_enum.cnt = num;
-            for (i = 0; i < num; i++) {
-                cJSON *c_child = cJSON_GetArrayItem(child, i);
-                if (NULL == c_child) {
-                    PR_ERR("get array null");
-                    op_ret = OPRT_CJSON_GET_ERR;
-                    goto __exit;
-                }
-                prop->prop_enum.pp_enum[i] = mm_strdup(c_child->valuestring);
-                if (NULL == prop->prop_enum.pp_enum[i]) {
-                    PR_ERR("malloc fail");
-                    op_ret = OPRT_MALLOC_FAILED;
-                    goto __exit;
-                }
-            }
-        } else if (!strcmp(child->valuestring, "bitmap")) {
-            dp_desc->prop_tp = PROP_BITMAP;
-            child = cJSON_GetObjectItem(item, "maxlen");
-            if (NULL == child) {
-                PR_ERR("get maxlen null");
-                op_ret = OPRT_CJSON_GET_ERR;
-                goto __exit;
-            }
-
-            prop->prop_bitmap.max_len = child->valueint;
+        } else if (__json_str_eq(key, key_len, "property")) {
+            // "type" may come after "property", so parse it when the node is done
+            property = p;
+            op_ret = __json_skip_value(&p);
         } else {
-            op_ret = OPRT_SVC_DEVOS_SCMA_INVALID;
-            goto __exit;
+            op_ret = __json_skip_value(&p);
+        }
+        if (OPRT_OK != op_ret) {
+            PR_ERR("json parse err:%.*s", key_len, key);
+            return OPRT_CJSON_PARSE_ERR;
         }
+    }
+    if (rt < 0) {
+        PR_ERR("json parse err");
+        return OPRT_CJSON_PARSE_ERR;
+    }
+    *pp = p;
 
-        cJSON_Delete(cjson);
-        cjson = NULL;
+    if (!has_id) {
+        PR_ERR("get id null");
+        return OPRT_CJSON_GET_ERR;
+    }
+    if (!has_mode) {
+        PR_ERR("get mode null");
+        return OPRT_CJSON_GET_ERR;
+    }
+    if (dp_desc->type != T_OBJ) {
+        return OPRT_OK;
+    }
+    if (NULL == property) {
+        PR_ERR("get property null");
+        return OPRT_CJSON_GET_ERR;
     }
 
-    tal_free(pBuf);
+    return dp_prop_parse(property, dp_desc, &(dpnode->prop));
+}
 
-    return OPRT_OK;
+static OPERATE_RET dp_node_parse(const char *schema_json, uint16_t nodenum, dp_node_t *dpnode,
+                                 SCHEMA_OTHER_ATTR_S *other_attr)
+{
+    OPERATE_RET op_ret = OPRT_OK;
+    const char *p = __json_skip_ws(schema_json);
+    int i = 0, rt;
 
-__exit:
-    if (pBuf) {
-        tal_free(pBuf);
+    if (*p != '[') {
+        PR_ERR("schema is not array");
+        return OPRT_CJSON_PARSE_ERR;
     }
-
-    if (cjson) {
-        cJSON_Delete(cjson);
+    p++;
+    while ((rt = __json_arr_next(&p)) > 0) {
+        if (i >= nodenum) {
+            PR_ERR("dp num overflow:%d", nodenum);
+            return OPRT_SVC_DEVOS_DEV_DP_CNT_INVALID;
+        }
+        op_ret = dp_node_parse_one(&p, &dpnode[i], other_attr);
+        if (OPRT_OK != op_ret) {
+            PR_ERR("dp node[%d] parse fail:%d", i, op_ret);
+            return op_ret;
+        }
+        i++;
+    }
+    if (rt < 0 || i != nodenum) {
+        PR_ERR("schema parse err:%d %d", i, nodenum);
+        return OPRT_CJSON_PARSE_ERR;
     }
 
-    return op_ret;
+    return OPRT_OK;
+}
+
+static void dp_schema_install(dp_schema_t *dp_schema, char *devid, dp_schema_t **dp_schema_out)
+{
+    int i;
+
+    // build dp id index, keep the first node on duplicate id as the old scan did
+    for (i = dp_schema->num - 1; i >= 0; i--) {
+        dp_schema->index[dp_schema->node[i].desc.id] = i + 1;
+    }
+    dp_schema->actv.attach_dp_if = TRUE;
+    strncpy(dp_schema->devid, devid, DEV_ID_LEN);
+    dp_schema->devid_hash = mm_str_hash(dp_schema->devid);
+    if (dp_schema_out) {
+        *dp_schema_out = dp_schema;
+    }
+    if (s_dsmgr.schema_num < DP_SCHEMA_NUM_MAX) {
+        s_dsmgr.schema_list[s_dsmgr.schema_num] = dp_schema;
+        s_dsmgr.schema_num++;
+    }
 }
 
 /**
@@ -1521,25 +2031,18 @@ __exit:
 int dp_schema_create(char *devid, char *schema_json, dp_schema_t **dp_schema_out)
 {
     OPERATE_RET op_ret = OPRT_OK;
-    dp_node_pos_t *nodepos = NULL;
     int nodenum;
+    int i;
 
-    nodepos = tal_malloc(sizeof(dp_node_pos_t) * 255);
-    if (NULL == nodepos) {
-        PR_ERR("malloc fail");
-        return OPRT_MALLOC_FAILED;
-    }
     PR_DEBUG("devid %s, schema_json %s", devid, schema_json);
 
-    nodenum = dp_node_pos_decode(schema_json, nodepos, 255);
+    nodenum = dp_node_num_get(schema_json);
     if (0 == nodenum || nodenum >= 255) {
         PR_ERR("dp num parse err:%d", nodenum);
-        tal_free(nodepos);
         return OPRT_SVC_DEVOS_DEV_DP_CNT_INVALID;
     }
     dp_schema_t *dp_schema = (dp_schema_t *)tal_malloc(sizeof(dp_schema_t) + nodenum * sizeof(dp_node_t));
     if (NULL == dp_schema) {
-        tal_free(nodepos);
         PR_ERR("malloc fail:%d", nodenum);
         return OPRT_MALLOC_FAILED;
     }
@@ -1554,34 +2057,411 @@ int dp_schema_create(char *devid, char *schema_json, dp_schema_t **dp_schema_out
     SCHEMA_OTHER_ATTR_S other_attr;
     memset(&other_attr, 0, sizeof(other_attr));
     tal_mutex_lock(dp_schema->mutex);
-    op_ret = dp_node_parse(schema_json, nodepos, nodenum, dp_schema->node, &other_attr);
+    op_ret = dp_node_parse(schema_json, nodenum, dp_schema->node, &other_attr);
     tal_mutex_unlock(dp_schema->mutex);
     if (OPRT_OK != op_ret) {
         PR_ERR("dp_node_parse fail:%d", op_ret);
         goto __exit;
     }
     dp_schema->actv.preprocess = other_attr.preprocess;
-    dp_schema->actv.attach_dp_if = TRUE;
-    strncpy(dp_schema->devid, devid, DEV_ID_LEN);
-    if (dp_schema_out) {
-        *dp_schema_out = dp_schema;
-    }
-    if (s_dsmgr.schema_num < DP_SCHEMA_NUM_MAX) {
-        s_dsmgr.schema_list[s_dsmgr.schema_num] = dp_schema;
-        s_dsmgr.schema_num++;
-    }
+    dp_schema_install(dp_schema, devid, dp_schema_out);
     PR_DEBUG("create dp_schema Success ");
-    tal_free(nodepos);
 
     return OPRT_OK;
 
 __exit:
+    for (i = 0; i < nodenum; i++) {
+        dp_node_release(&dp_schema->node[i]);
+    }
     tal_mutex_release(dp_schema->mutex);
     tal_free(dp_schema);
-    tal_free(nodepos);
+    return op_ret;
+}
+
+#if defined(ENABLE_DP_SCHEMA_CACHE) && (ENABLE_DP_SCHEMA_CACHE == 1)
+/*
+ * Binary schema cache layout, all integers are little endian:
+ *   header:  magic[4] "DPSC" | ver u8 | num u8 | preprocess u8 | rsv u8 | len u32 | crc32 u32
+ *   payload: for each node
+ *            id | mode | passive | type | prop_tp | trig | stat | route (u8 each)
+ *            and for T_OBJ nodes the property:
+ *              value:  max i32 | min i32 | scale u16
+ *              string: max_len u32
+ *              bitmap: max_len u32
+ *              enum:   cnt u8 | (len u16 | bytes) * cnt
+ */
+#define DP_SCHEMA_CACHE_MAGIC    "DPSC"
+#define DP_SCHEMA_CACHE_VER      1
+#define DP_SCHEMA_CACHE_HEAD_LEN 16
+#define DP_SCHEMA_CACHE_KEY_FMT  "%s.sc"
+#define DP_SCHEMA_CACHE_KEY_LEN  32
+
+static uint8_t *__cache_put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    return p + 2;
+}
+
+static uint8_t *__cache_put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    p[2] = (v >> 16) & 0xFF;
+    p[3] = (v >> 24) & 0xFF;
+    return p + 4;
+}
+
+static uint16_t __cache_get_u16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t __cache_get_u32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static int dp_node_cache_len(dp_node_t *dpnode)
+{
+    int i, len = 8;
+
+    if (dpnode->desc.type != T_OBJ) {
+        return len;
+    }
+
+    switch (dpnode->desc.prop_tp) {
+    case PROP_VALUE:
+        len += 10;
+        break;
+    case PROP_STR:
+    case PROP_BITMAP:
+        len += 4;
+        break;
+    case PROP_ENUM:
+        if (dpnode->prop.prop_enum.cnt > 0xFF) {
+            return -1;
+        }
+        len += 1;
+        for (i = 0; i < dpnode->prop.prop_enum.cnt; i++) {
+            len += 2 + strlen(dpnode->prop.prop_enum.pp_enum[i]);
+        }
+        break;
+    default:
+        break;
+    }
+
+    return len;
+}
+
+static uint8_t *dp_node_cache_write(uint8_t *p, dp_node_t *dpnode)
+{
+    int i, len;
+    dp_desc_t *desc = &dpnode->desc;
+    dp_prop_vaule_t *prop = &dpnode->prop;
+
+    *p++ = desc->id;
+    *p++ = desc->mode;
+    *p++ = desc->passive;
+    *p++ = desc->type;
+    *p++ = desc->prop_tp;
+    *p++ = desc->trig;
+    *p++ = desc->stat;
+    *p++ = desc->route_t;
+    if (desc->type != T_OBJ) {
+        return p;
+    }
+
+    switch (desc->prop_tp) {
+    case PROP_VALUE:
+        p = __cache_put_u32(p, (uint32_t)prop->prop_int.max);
+        p = __cache_put_u32(p, (uint32_t)prop->prop_int.min);
+        p = __cache_put_u16(p, prop->prop_int.scale);
+        break;
+    case PROP_STR:
+        p = __cache_put_u32(p, (uint32_t)prop->prop_str.max_len);
+        break;
+    case PROP_BITMAP:
+        p = __cache_put_u32(p, prop->prop_bitmap.max_len);
+        break;
+    case PROP_ENUM:
+        *p++ = (uint8_t)prop->prop_enum.cnt;
+        for (i = 0; i < prop->prop_enum.cnt; i++) {
+            len = strlen(prop->prop_enum.pp_enum[i]);
+            p = __cache_put_u16(p, len);
+            memcpy(p, prop->prop_enum.pp_enum[i], len);
+            p += len;
+        }
+        break;
+    default:
+        break;
+    }
+
+    return p;
+}
+
+static OPERATE_RET dp_node_cache_read(const uint8_t **pp, const uint8_t *end, dp_node_t *dpnode)
+{
+    OPERATE_RET op_ret = OPRT_OK;
+    const uint8_t *p = *pp;
+    dp_desc_t *desc = &dpnode->desc;
+    dp_prop_vaule_t *prop = &dpnode->prop;
+    int i, len;
+
+    if (end - p < 8) {
+        return OPRT_BUFFER_NOT_ENOUGH;
+    }
+    desc->id = *p++;
+    desc->mode = *p++;
+    desc->passive = *p++;
+    desc->type = *p++;
+    desc->prop_tp = *p++;
+    desc->trig = *p++;
+    desc->stat = *p++;
+    desc->route_t = *p++;
+    if (desc->type != T_OBJ) {
+        *pp = p;
+        return OPRT_OK;
+    }
+
+    switch (desc->prop_tp) {
+    case PROP_BOOL:
+        break;
+    case PROP_VALUE:
+        if (end - p < 10) {
+            return OPRT_BUFFER_NOT_ENOUGH;
+        }
+        prop->prop_int.max = (int)__cache_get_u32(p);
+        prop->prop_int.min = (int)__cache_get_u32(p + 4);
+        prop->prop_int.scale = __cache_get_u16(p + 8);
+        p += 10;
+        break;
+    case PROP_STR:
+        if (end - p < 4) {
+            return OPRT_BUFFER_NOT_ENOUGH;
+        }
+        prop->prop_str.max_len = (int)__cache_get_u32(p);
+        p += 4;
+        op_ret = tal_mutex_create_init(&prop->prop_str.dp_str_mutex);
+        if (OPRT_OK != op_ret) {
+            PR_ERR("mutex init fail:%d", op_ret);
+            return OPRT_CR_MUTEX_ERR;
+        }
+        break;
+    case PROP_BITMAP:
+        if (end - p < 4) {
+            return OPRT_BUFFER_NOT_ENOUGH;
+        }
+        prop->prop_bitmap.max_len = __cache_get_u32(p);
+        p += 4;
+        break;
+    case PROP_ENUM:
+        if (end - p < 1 || 0 == *p) {
+            return OPRT_BUFFER_NOT_ENOUGH;
+        }
+        prop->prop_enum.pp_enum = tal_calloc(*p, sizeof(char *));
+        if (NULL == prop->prop_enum.pp_enum) {
+            return OPRT_MALLOC_FAILED;
+        }
+        prop->prop_enum.cnt = *p++;
+        for (i = 0; i < prop->prop_enum.cnt; i++) {
+            if (end - p < 2 || end - p - 2 < __cache_get_u16(p)) {
+                return OPRT_BUFFER_NOT_ENOUGH;
+            }
+            len = __cache_get_u16(p);
+            p += 2;
+            prop->prop_enum.pp_enum[i] = tal_malloc(len + 1);
+            if (NULL == prop->prop_enum.pp_enum[i]) {
+                return OPRT_MALLOC_FAILED;
+            }
+            memcpy(prop->prop_enum.pp_enum[i], p, len);
+            prop->prop_enum.pp_enum[i][len] = '\0';
+            p += len;
+        }
+        break;
+    default:
+        return OPRT_SVC_DEVOS_SCMA_INVALID;
+    }
+    *pp = p;
+
+    return OPRT_OK;
+}
+
+/**
+ * @brief Saves the parsed data point schema as a binary blob in kv.
+ *
+ * @param schema The parsed data point schema.
+ * @param schema_id The cloud schema id the schema was parsed from.
+ *
+ * @return Returns 0 on success, or a negative error code on failure.
+ */
+int dp_schema_cache_save(dp_schema_t *schema, const char *schema_id)
+{
+    OPERATE_RET op_ret = OPRT_OK;
+    char key[DP_SCHEMA_CACHE_KEY_LEN];
+    int i, node_len, len = 0;
+
+    if (NULL == schema || NULL == schema_id) {
+        return OPRT_INVALID_PARM;
+    }
+
+    tal_mutex_lock(schema->mutex);
+    for (i = 0; i < schema->num; i++) {
+        node_len = dp_node_cache_len(&schema->node[i]);
+        if (node_len < 0) {
+            tal_mutex_unlock(schema->mutex);
+            PR_ERR("dp %d not cacheable", schema->node[i].desc.id);
+            return OPRT_NOT_SUPPORTED;
+        }
+        len += node_len;
+    }
+
+    uint8_t *blob = tal_malloc(DP_SCHEMA_CACHE_HEAD_LEN + len);
+    if (NULL == blob) {
+        tal_mutex_unlock(schema->mutex);
+        PR_ERR("malloc fail:%d", len);
+        return OPRT_MALLOC_FAILED;
+    }
+    uint8_t *p = blob + DP_SCHEMA_CACHE_HEAD_LEN;
+    for (i = 0; i < schema->num; i++) {
+        p = dp_node_cache_write(p, &schema->node[i]);
+    }
+    memcpy(blob, DP_SCHEMA_CACHE_MAGIC, 4);
+    blob[4] = DP_SCHEMA_CACHE_VER;
+    blob[5] = schema->num;
+    blob[6] = schema->actv.preprocess;
+    blob[7] = 0;
+    tal_mutex_unlock(schema->mutex);
+    __cache_put_u32(blob + 8, len);
+    __cache_put_u32(blob + 12, hash_crc32i_total(blob + DP_SCHEMA_CACHE_HEAD_LEN, len));
+
+    snprintf(key, sizeof(key), DP_SCHEMA_CACHE_KEY_FMT, schema_id);
+    op_ret = tal_kv_set(key, blob, DP_SCHEMA_CACHE_HEAD_LEN + len);
+    tal_free(blob);
+    if (OPRT_OK != op_ret) {
+        PR_ERR("schema cache save fail:%d", op_ret);
+        return op_ret;
+    }
+    PR_DEBUG("schema cache saved, len %d", DP_SCHEMA_CACHE_HEAD_LEN + len);
+
+    return OPRT_OK;
+}
+
+/**
+ * @brief Creates a data point schema from the binary blob saved by
+ * dp_schema_cache_save().
+ *
+ * The blob is rejected if its magic, version, length or CRC does not match, in
+ * which case the caller should fall back to dp_schema_create().
+ *
+ * @param devid The device ID for which the schema is being created.
+ * @param schema_id The cloud schema id the cache was saved with.
+ * @param dp_schema_out A pointer to a variable that will hold the created data
+ * point schema.
+ *
+ * @return Returns 0 on success, or a negative error code on failure.
+ */
+int dp_schema_cache_load(char *devid, const char *schema_id, dp_schema_t **dp_schema_out)
+{
+    OPERATE_RET op_ret = OPRT_OK;
+    char key[DP_SCHEMA_CACHE_KEY_LEN];
+    uint8_t *blob = NULL;
+    size_t blob_len = 0;
+    dp_schema_t *dp_schema = NULL;
+    int i, nodenum = 0;
+
+    if (NULL == devid || NULL == schema_id) {
+        return OPRT_INVALID_PARM;
+    }
+
+    snprintf(key, sizeof(key), DP_SCHEMA_CACHE_KEY_FMT, schema_id);
+    op_ret = tal_kv_get(key, &blob, &blob_len);
+    if (OPRT_OK != op_ret) {
+        PR_DEBUG("schema cache not found:%d", op_ret);
+        return op_ret;
+    }
+
+    if (blob_len < DP_SCHEMA_CACHE_HEAD_LEN || memcmp(blob, DP_SCHEMA_CACHE_MAGIC, 4) ||
+        blob[4] != DP_SCHEMA_CACHE_VER || 0 == blob[5] ||
+        __cache_get_u32(blob + 8) != blob_len - DP_SCHEMA_CACHE_HEAD_LEN ||
+        __cache_get_u32(blob + 12) !=
+            hash_crc32i_total(blob + DP_SCHEMA_CACHE_HEAD_LEN, blob_len - DP_SCHEMA_CACHE_HEAD_LEN)) {
+        PR_WARN("schema cache invalid, len %d ver %d", (int)blob_len, blob_len > 4 ? blob[4] : 0);
+        op_ret = OPRT_SVC_DEVOS_SCMA_INVALID;
+        goto __exit;
+    }
+
+    nodenum = blob[5];
+    dp_schema = (dp_schema_t *)tal_malloc(sizeof(dp_schema_t) + nodenum * sizeof(dp_node_t));
+    if (NULL == dp_schema) {
+        PR_ERR("malloc fail:%d", nodenum);
+        op_ret = OPRT_MALLOC_FAILED;
+        goto __exit;
+    }
+    memset(dp_schema, 0, sizeof(dp_schema_t) + nodenum * sizeof(dp_node_t));
+    op_ret = tal_mutex_create_init(&(dp_schema->mutex));
+    if (OPRT_OK != op_ret) {
+        PR_ERR("mutex create fail:%d", op_ret);
+        tal_free(dp_schema);
+        dp_schema = NULL;
+        goto __exit;
+    }
+    dp_schema->num = nodenum;
+    dp_schema->actv.preprocess = blob[6];
+
+    const uint8_t *p = blob + DP_SCHEMA_CACHE_HEAD_LEN;
+    const uint8_t *end = blob + blob_len;
+    for (i = 0; i < nodenum; i++) {
+        op_ret = dp_node_cache_read(&p, end, &dp_schema->node[i]);
+        if (OPRT_OK != op_ret) {
+            PR_ERR("schema cache node[%d] err:%d", i, op_ret);
+            goto __exit;
+        }
+    }
+    if (p != end) {
+        op_ret = OPRT_SVC_DEVOS_SCMA_INVALID;
+        goto __exit;
+    }
+
+    dp_schema_install(dp_schema, devid, dp_schema_out);
+    PR_DEBUG("load dp_schema from cache Success");
+    tal_kv_free(blob);
+
+    return OPRT_OK;
+
+__exit:
+    if (dp_schema) {
+        for (i = 0; i < nodenum; i++) {
+            dp_node_release(&dp_schema->node[i]);
+        }
+        tal_mutex_release(dp_schema->mutex);
+        tal_free(dp_schema);
+    }
+    tal_kv_free(blob);
     return op_ret;
 }
 
+/**
+ * @brief Removes the binary schema cache saved for a cloud schema id.
+ *
+ * @param schema_id The cloud schema id.
+ *
+ * @return Returns 0 on success, or a negative error code on failure.
+ */
+int dp_schema_cache_delete(const char *schema_id)
+{
+    char key[DP_SCHEMA_CACHE_KEY_LEN];
+
+    if (NULL == schema_id) {
+        return OPRT_INVALID_PARM;
+    }
+
+    snprintf(key, sizeof(key), DP_SCHEMA_CACHE_KEY_FMT, schema_id);
+
+    return tal_kv_del(key);
+}
+#endif
+
 /**
  * @brief Deletes the data point schema for a device.
  *
@@ -1594,7 +2474,7 @@ __exit:
  */
 int dp_schema_delete(char *devid)
 {
-    int i = 0;
+    int i = 0, j = 0;
 
     PR_TRACE("try to delete schema devid %s", devid);
     dp_schema_mgr_t *dsmgr = &s_dsmgr;
@@ -1604,6 +2484,9 @@ int dp_schema_delete(char *devid)
         }
 
         if (0 == strcmp(devid, dsmgr->schema_list[i]->devid)) {
+            for (j = 0; j < dsmgr->schema_list[i]->num; j++) {
+                dp_node_release(&dsmgr->schema_list[i]->node[j]);
+            }
             tal_mutex_release(dsmgr->schema_list[i]->mutex);
             tal_free(dsmgr->schema_list[i]);
             dsmgr->schema_list[i] = NULL;
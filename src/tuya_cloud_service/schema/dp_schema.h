@@ -321,15 +321,21 @@ typedef struct {
 
 // typedef struct dev_cntl_n_s {
 
+#define DP_ID_INDEX_NUM 256
+
 typedef struct {
     /** virtual id */
     char devid[DEV_ID_LEN + 1];
+    /** hash of devid, for fast schema lookup */
+    uint32_t devid_hash;
     /** device attribute, see DEV_ACTV_ATTR_S */
     dp_prop_actv_t actv;
     /** exclusive access to dp */
     MUTEX_HANDLE mutex;
     /** count of dp */
     uint8_t num;
+    /** dp id -> node index + 1, 0 means dp id not exist */
+    uint8_t index[DP_ID_INDEX_NUM];
     /** dp info */
     dp_node_t node[0];
 } dp_schema_t;
@@ -484,6 +490,26 @@ int dp_rept_valid_check(dp_schema_t *schema, dp_rept_in_t *dpin, dp_rept_valid_t
  */
 int dp_rept_json_output(dp_schema_t *schema, dp_rept_in_t *dpin, dp_rept_valid_t *dpvalid, dp_rept_out_t *dpout);
 
+/**
+ * @brief Serializes the valid DPs of a report into a caller provided buffer.
+ *
+ * The JSON text is written directly into buf without building a cJSON tree.
+ * Call it once with buf set to NULL to get the exact length, then again with
+ * a buffer of at least that length plus one.
+ *
+ * @param schema The DP schema structure.
+ * @param dpin The input data for the DP report.
+ * @param dpvalid The validation information for the DP report.
+ * @param flags DP_APPEND_HEADER_FLAG to wrap the dps into the devId envelope.
+ * @param buf The output buffer, NULL to only compute the length.
+ * @param size The size of buf.
+ * @param out_len The length of the JSON text, without the terminating NUL.
+ * @return OPRT_OK on success, OPRT_BUFFER_NOT_ENOUGH if buf is too small, or
+ * another error code on failure.
+ */
+int dp_rept_json_write(dp_schema_t *schema, dp_rept_in_t *dpin, dp_rept_valid_t *dpvalid, int flags, char *buf,
+                       uint32_t size, uint32_t *out_len);
+
 /**
  * Appends a JSON string to the given data point schema.
  *
@@ -511,6 +537,45 @@ int dp_rept_json_append(dp_schema_t *schema, char *data, char *time, char *type,
  * @return Returns 0 on success, or a negative error code on failure.
  */
 int dp_schema_create(char *devid, char *schema_json, dp_schema_t **dp_schema_out);
+/**
+ * @brief Saves the parsed data point schema as a compact, versioned binary
+ * blob in kv, so the next boot can skip JSON parsing.
+ *
+ * Only available when ENABLE_DP_SCHEMA_CACHE is enabled.
+ *
+ * @param schema The parsed data point schema.
+ * @param schema_id The cloud schema id the schema was parsed from.
+ *
+ * @return Returns 0 on success, or a negative error code on failure.
+ */
+int dp_schema_cache_save(dp_schema_t *schema, const char *schema_id);
+
+/**
+ * @brief Creates a data point schema from the binary blob saved by
+ * dp_schema_cache_save(). The blob is validated by version and CRC.
+ *
+ * Only available when ENABLE_DP_SCHEMA_CACHE is enabled.
+ *
+ * @param devid The device ID for which the schema is being created.
+ * @param schema_id The cloud schema id the cache was saved with.
+ * @param dp_schema_out A pointer to a variable that will hold the created data
+ * point schema.
+ *
+ * @return Returns 0 on success, or a negative error code on failure.
+ */
+int dp_schema_cache_load(char *devid, const char *schema_id, dp_schema_t **dp_schema_out);
+
+/**
+ * @brief Removes the binary schema cache saved for a cloud schema id.
+ *
+ * Only available when ENABLE_DP_SCHEMA_CACHE is enabled.
+ *
+ * @param schema_id The cloud schema id.
+ *
+ * @return Returns 0 on success, or a negative error code on failure.
+ */
+int dp_schema_cache_delete(const char *schema_id);
+
 /**
  * @brief Deletes the data point schema for a specific device.
  *
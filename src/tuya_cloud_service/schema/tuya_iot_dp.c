@@ -30,6 +30,9 @@
 #include "ble_dp.h"
 #endif
 
+// reports up to this size are built on the stack, larger ones are allocated
+#define DP_REPT_STACK_BUF_LEN 256
+
 static DELAYED_WORK_HANDLE s_tmm_dp_sync = NULL;
 
 int tuya_iot_dp_sync_start(tuya_iot_client_t *client, uint32_t timeout_s);
@@ -71,15 +74,26 @@ void tuya_iot_dp_sync_process(void *data)
     dp_rept_valid_t *dpvalid = NULL;
     char *dpsjson = NULL;
 
-    int ret = dp_obj_dump_stat_local_json(client->activate.devid, &dpvalid, &dpsjson, 0);
+    int ret = dp_obj_dump_stat_local_json(client->activate.devid, &dpvalid, &dpsjson, DP_APPEND_HEADER_FLAG);
     if (OPRT_OK != ret) {
         PR_ERR("dp sync stat local failed %d", ret);
         tal_workq_start_delayed(s_tmm_dp_sync, 5000, LOOP_ONCE);
         return;
     }
 
-    tuya_iot_dp_report_json_async(client, dpsjson, NULL, dp_sync_cb, dpvalid, 5000);
+    if (NULL == dpsjson) {
+        tal_free(dpvalid);
+        return;
+    }
+
+    ret = tuya_mqtt_protocol_data_publish_common(&client->mqctx, PRO_DATA_PUSH, (const uint8_t *)dpsjson,
+                                                 (uint16_t)strlen(dpsjson), dp_sync_cb, dpvalid, 5000, true);
     tal_free(dpsjson);
+    if (OPRT_OK != ret) {
+        //! not queued, dp_sync_cb will not run
+        tal_free(dpvalid);
+        tal_workq_start_delayed(s_tmm_dp_sync, 5000, LOOP_ONCE);
+    }
 }
 
 /**
@@ -195,7 +209,8 @@ int tuya_iot_dp_parse(tuya_iot_client_t *client, dp_cmd_type_t cmd_tp, cJSON *cm
     msg->data_js = cmd_js;
     msg->user_data = client;
 
-    return tal_workq_schedule(WORKQ_HIGHTPRI, tuya_iot_dp_parse_on_worq, msg);
+    // commands of one device must be handled in order, even with several workers, and ahead of normal work
+    return tal_workq_schedule_key(WORKQ_HIGHTPRI, WORK_PRIO_HIGH, mm_str_hash(devId), tuya_iot_dp_parse_on_worq, msg);
 }
 
 /**
@@ -234,7 +249,7 @@ int tuya_iot_dp_obj_report(tuya_iot_client_t *client, const char *devid, dp_obj_
     if (NULL == dpvalid) {
         return OPRT_MALLOC_FAILED;
     }
-    memset(dpvalid, 0, sizeof(sizeof(dp_rept_valid_t) + sizeof(uint8_t) * dpscnt));
+    memset(dpvalid, 0, sizeof(dp_rept_valid_t) + sizeof(uint8_t) * dpscnt);
 
     PR_DEBUG("dp report: devid %s, dps 0x%08x, dpscnt %d, flags %d", devid ? devid : "null", dps, dpscnt, flags);
 
@@ -285,36 +300,51 @@ int tuya_iot_dp_obj_report(tuya_iot_client_t *client, const char *devid, dp_obj_
     }
 #endif
 
-    dp_rept_out_t dpout;
-
-    memset(&dpout, 0, sizeof(dpout));
+    /* Size the report exactly, then write it with the devId envelope straight into the send buffer */
+    char stack_buf[DP_REPT_STACK_BUF_LEN];
+    char *packet = stack_buf;
+    uint32_t packet_len = 0;
 
-    ret = dp_rept_json_output(schema, &dpin, dpvalid, &dpout);
+    ret = dp_rept_json_write(schema, &dpin, dpvalid, DP_APPEND_HEADER_FLAG, NULL, 0, &packet_len);
+    if (OPRT_OK == ret && packet_len >= sizeof(stack_buf)) {
+        packet = tal_malloc(packet_len + 1);
+        if (NULL == packet) {
+            tal_free(dpvalid);
+            return OPRT_MALLOC_FAILED;
+        }
+    }
+    if (OPRT_OK == ret) {
+        ret = dp_rept_json_write(schema, &dpin, dpvalid, DP_APPEND_HEADER_FLAG, packet, packet_len + 1, NULL);
+    }
     if (OPRT_OK != ret) {
         PR_DEBUG("dp rept json output error %d", ret);
-        return ret;
+        tal_free(dpvalid);
+        goto __exit;
     }
+    PR_DEBUG("dp rept out: %s", packet);
 
     if (tuya_lan_is_connected()) {
-        char *out = NULL;
         PR_DEBUG("lan channel report");
-        dp_rept_json_append(schema, dpout.dpsjson, NULL, NULL, 0, &out);
-        ret = tuya_lan_dp_report(out);
-        tal_free(out);
+        ret = tuya_lan_dp_report(packet);
         tal_free(dpvalid);
         tuya_iot_dp_sync_start(client, 5);
     } else if (tuya_iot_is_connected()) {
         PR_DEBUG("mqtt channel report");
-        ret = tuya_iot_dp_report_json_with_notify(client, dpout.dpsjson, NULL, dp_sync_cb, dpvalid, 5000);
+        ret = tuya_mqtt_protocol_data_publish_common(&client->mqctx, PRO_DATA_PUSH, (const uint8_t *)packet,
+                                                     (uint16_t)packet_len, dp_sync_cb, dpvalid, 5000, false);
+        if (OPRT_OK != ret) {
+            //! not queued, the dps stay local and are synced later
+            tal_free(dpvalid);
+            tuya_iot_dp_sync_start(client, 5);
+        }
     } else {
         PR_ERR("no channel for connect");
+        tal_free(dpvalid);
     }
 
-    if (dpout.dpsjson) {
-        tal_free(dpout.dpsjson);
-    }
-    if (dpout.timejson) {
-        tal_free(dpout.timejson);
+__exit:
+    if (packet != stack_buf) {
+        tal_free(packet);
     }
 
     return ret;
@@ -29,6 +29,7 @@
 #include "tal_api.h"
 #include "tal_kv.h"
 #include "tal_network.h"
+#include "mix_method.h"
 #include "mbedtls/error.h"
 #include "mbedtls/debug.h"
 #include "mbedtls/net_sockets.h"
@@ -158,6 +159,322 @@ static void __tuya_tls_export_keys(void *p_expkey, mbedtls_ssl_key_export_type t
 }
 #endif
 
+/* -------------------------------------------------------------------------- */
+/*                              TLS Session Cache                             */
+/* -------------------------------------------------------------------------- */
+#if defined(ENABLE_TLS_SESSION_CACHE) && (ENABLE_TLS_SESSION_CACHE == 1) && defined(MBEDTLS_SSL_CLI_C)
+#define TLS_SESSION_CACHE_ENABLE 1
+
+#ifndef TLS_SESSION_CACHE_NUM
+#define TLS_SESSION_CACHE_NUM (2)
+#endif
+
+#define TLS_SESSION_KV_KEY "tls_sess_%08x"
+
+typedef struct {
+    char *name;         // "host:port/config hash", NULL if the entry is empty
+    uint32_t last_used; // lru counter, the smallest one is evicted
+    uint8_t *data;      // serialized mbedtls_ssl_session
+    size_t len;
+} tls_session_entry_t;
+
+static MUTEX_HANDLE s_session_mutex = NULL;
+static uint32_t s_session_tick = 0;
+static tls_session_entry_t s_session_cache[TLS_SESSION_CACHE_NUM];
+static tuya_tls_session_stat_t s_session_stat = {0};
+
+static void __tuya_tls_session_entry_free(tls_session_entry_t *entry)
+{
+    if (entry->name) {
+        tal_free(entry->name);
+    }
+    if (entry->data) {
+        tal_free(entry->data);
+    }
+    memset(entry, 0, sizeof(tls_session_entry_t));
+}
+
+static tls_session_entry_t *__tuya_tls_session_find(const char *name)
+{
+    int i;
+
+    for (i = 0; i < TLS_SESSION_CACHE_NUM; i++) {
+        if (s_session_cache[i].name && 0 == strcmp(s_session_cache[i].name, name)) {
+            return &s_session_cache[i];
+        }
+    }
+
+    return NULL;
+}
+
+/* store the serialized session, take the ownership of data */
+static void __tuya_tls_session_store(const char *name, uint8_t *data, size_t len)
+{
+    tls_session_entry_t *entry = __tuya_tls_session_find(name);
+    int i;
+
+    if (NULL == entry) {
+        // use the empty or least recently used one
+        entry = &s_session_cache[0];
+        for (i = 0; i < TLS_SESSION_CACHE_NUM; i++) {
+            if (NULL == s_session_cache[i].name) {
+                entry = &s_session_cache[i];
+                break;
+            }
+            if (s_session_cache[i].last_used < entry->last_used) {
+                entry = &s_session_cache[i];
+            }
+        }
+        __tuya_tls_session_entry_free(entry);
+        entry->name = mm_strdup(name);
+        if (NULL == entry->name) {
+            tal_free(data);
+            return;
+        }
+    } else if (entry->data) {
+        tal_free(entry->data);
+    }
+
+    entry->data = data;
+    entry->len = len;
+    entry->last_used = ++s_session_tick;
+}
+
+static void __tuya_tls_session_kv_key(const char *name, char *key, size_t key_size)
+{
+    snprintf(key, key_size, TLS_SESSION_KV_KEY, mm_str_hash(name));
+}
+
+/**
+ * @brief set the cached session of host to ssl context before handshake
+ *
+ * @param[in] ssl: the ssl context, setup done
+ * @param[in] name: "host:port"
+ * @param[out] master: the master secret of cached session, used to check resumed or not
+ * @return TRUE if a session is offered
+ */
+static BOOL_T __tuya_tls_session_set(mbedtls_ssl_context *ssl, const char *name, unsigned char master[48])
+{
+    BOOL_T offered = FALSE;
+    mbedtls_ssl_session session;
+    tls_session_entry_t *entry = NULL;
+
+    if (NULL == s_session_mutex) {
+        return FALSE;
+    }
+
+    mbedtls_ssl_session_init(&session);
+
+    tal_mutex_lock(s_session_mutex);
+    entry = __tuya_tls_session_find(name);
+#if defined(ENABLE_TLS_SESSION_PERSIST) && (ENABLE_TLS_SESSION_PERSIST == 1)
+    // not in memory, maybe saved before deep sleep or reboot
+    if (NULL == entry) {
+        char key[24];
+        uint8_t *data = NULL;
+        size_t len = 0;
+        __tuya_tls_session_kv_key(name, key, sizeof(key));
+        if (OPRT_OK == tal_kv_get(key, &data, &len)) {
+            uint8_t *copy = tal_malloc(len);
+            if (copy) {
+                memcpy(copy, data, len);
+                __tuya_tls_session_store(name, copy, len);
+                entry = __tuya_tls_session_find(name);
+            }
+            tal_kv_free(data);
+        }
+    }
+#endif
+    if (entry && 0 == mbedtls_ssl_session_load(&session, entry->data, entry->len) &&
+        0 == mbedtls_ssl_set_session(ssl, &session)) {
+        memcpy(master, session.MBEDTLS_PRIVATE(master), 48);
+        entry->last_used = ++s_session_tick;
+        offered = TRUE;
+    }
+    tal_mutex_unlock(s_session_mutex);
+
+    mbedtls_ssl_session_free(&session);
+
+    return offered;
+}
+
+/* save the session after handshake success, and count the hit or miss */
+static void __tuya_tls_session_update(mbedtls_ssl_context *ssl, const char *name, BOOL_T offered,
+                                      const unsigned char master[48])
+{
+    mbedtls_ssl_session session;
+    uint8_t *data = NULL;
+    size_t len = 0;
+    BOOL_T resumed = FALSE;
+
+    if (NULL == s_session_mutex) {
+        return;
+    }
+
+    mbedtls_ssl_session_init(&session);
+    if (0 != mbedtls_ssl_get_session(ssl, &session)) {
+        goto __exit;
+    }
+
+    // resumed handshake keep the master secret of cached session
+    resumed = offered && 0 == memcmp(master, session.MBEDTLS_PRIVATE(master), 48);
+
+    // server gave neither session id nor ticket, nothing can be resumed
+    size_t resume_len = session.MBEDTLS_PRIVATE(id_len);
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+    resume_len += session.MBEDTLS_PRIVATE(ticket_len);
+#endif
+    if (0 == resume_len) {
+        tal_mutex_lock(s_session_mutex);
+        s_session_stat.miss++;
+        tal_mutex_unlock(s_session_mutex);
+        goto __exit;
+    }
+
+    mbedtls_ssl_session_save(&session, NULL, 0, &len);
+    if (0 == len || NULL == (data = tal_malloc(len)) || 0 != mbedtls_ssl_session_save(&session, data, len, &len)) {
+        if (data) {
+            tal_free(data);
+        }
+        goto __exit;
+    }
+
+    tal_mutex_lock(s_session_mutex);
+    if (resumed) {
+        s_session_stat.hit++;
+    } else {
+        s_session_stat.miss++;
+    }
+
+    // server may renew the ticket even if resumed, only save when changed
+    tls_session_entry_t *entry = __tuya_tls_session_find(name);
+    if (entry && entry->len == len && 0 == memcmp(entry->data, data, len)) {
+        entry->last_used = ++s_session_tick;
+        tal_free(data);
+    } else {
+        __tuya_tls_session_store(name, data, len);
+#if defined(ENABLE_TLS_SESSION_PERSIST) && (ENABLE_TLS_SESSION_PERSIST == 1)
+        entry = __tuya_tls_session_find(name);
+        if (entry) {
+            char key[24];
+            __tuya_tls_session_kv_key(name, key, sizeof(key));
+            tal_kv_set(key, entry->data, entry->len);
+        }
+#endif
+    }
+    tal_mutex_unlock(s_session_mutex);
+
+    PR_DEBUG("tls session %s %s, hit:%d miss:%d", name, resumed ? "resumed" : "new", s_session_stat.hit,
+             s_session_stat.miss);
+
+__exit:
+    mbedtls_ssl_session_free(&session);
+}
+
+/**
+ * @brief name of the cached session, the session was verified with the ca and
+ * sent the client cert or psk of its connection, only a connection with the same
+ * ones may resume it
+ *
+ */
+static void __tuya_tls_session_name(const tuya_tls_config_t *config, char *name, size_t size)
+{
+    // mm_hash gives 0 for a NULL cert or psk id
+    uint32_t hash[] = {
+        mm_hash(&config->mode, sizeof(config->mode)),
+        mm_hash(&config->verify, sizeof(config->verify)),
+        mm_hash(config->ca_cert, config->ca_cert_size),
+        mm_hash(config->client_cert, config->client_cert_size),
+        mm_hash(config->psk_id, config->psk_id_size),
+    };
+
+    snprintf(name, size, "%s:%d/%08x", config->hostname, config->port, mm_hash(hash, sizeof(hash)));
+}
+
+/**
+ * @brief the handshake failed in a way the offered session may cause, e.g. the
+ * server refused it or no longer knows the ticket. socket errors, timeouts and
+ * certificate failures are not, the session is kept for the next connect
+ *
+ */
+static BOOL_T __tuya_tls_session_refused(int ret)
+{
+    switch (ret) {
+    case MBEDTLS_ERR_SSL_FATAL_ALERT_MESSAGE:
+    case MBEDTLS_ERR_SSL_HANDSHAKE_FAILURE:
+    case MBEDTLS_ERR_SSL_INVALID_MAC:
+    case MBEDTLS_ERR_SSL_DECODE_ERROR:
+    case MBEDTLS_ERR_SSL_ILLEGAL_PARAMETER:
+    case MBEDTLS_ERR_SSL_UNEXPECTED_MESSAGE:
+    case MBEDTLS_ERR_SSL_BAD_PROTOCOL_VERSION:
+    case MBEDTLS_ERR_SSL_SESSION_TICKET_EXPIRED:
+        return TRUE;
+    default:
+        return FALSE;
+    }
+}
+
+/* drop the cached session of host, the offered session may be the failure reason */
+static void __tuya_tls_session_drop(const char *name)
+{
+    tls_session_entry_t *entry = NULL;
+
+    if (NULL == s_session_mutex) {
+        return;
+    }
+
+    tal_mutex_lock(s_session_mutex);
+    entry = __tuya_tls_session_find(name);
+    if (entry) {
+        __tuya_tls_session_entry_free(entry);
+    }
+#if defined(ENABLE_TLS_SESSION_PERSIST) && (ENABLE_TLS_SESSION_PERSIST == 1)
+    char key[24];
+    __tuya_tls_session_kv_key(name, key, sizeof(key));
+    tal_kv_del(key);
+#endif
+    tal_mutex_unlock(s_session_mutex);
+}
+#endif
+
+void tuya_tls_session_stat_get(tuya_tls_session_stat_t *stat)
+{
+    if (NULL == stat) {
+        return;
+    }
+
+#if defined(TLS_SESSION_CACHE_ENABLE)
+    *stat = s_session_stat;
+#else
+    memset(stat, 0, sizeof(tuya_tls_session_stat_t));
+#endif
+}
+
+void tuya_tls_session_cache_clear(void)
+{
+#if defined(TLS_SESSION_CACHE_ENABLE)
+    int i;
+
+    if (NULL == s_session_mutex) {
+        return;
+    }
+
+    tal_mutex_lock(s_session_mutex);
+    for (i = 0; i < TLS_SESSION_CACHE_NUM; i++) {
+#if defined(ENABLE_TLS_SESSION_PERSIST) && (ENABLE_TLS_SESSION_PERSIST == 1)
+        if (s_session_cache[i].name) {
+            char key[24];
+            __tuya_tls_session_kv_key(s_session_cache[i].name, key, sizeof(key));
+            tal_kv_del(key);
+        }
+#endif
+        __tuya_tls_session_entry_free(&s_session_cache[i]);
+    }
+    memset(&s_session_stat, 0, sizeof(s_session_stat));
+    tal_mutex_unlock(s_session_mutex);
+#endif
+}
+
 /* -------------------------------------------------------------------------- */
 /*                                 TLS Randowm                                */
 /* -------------------------------------------------------------------------- */
@@ -426,6 +743,12 @@ OPERATE_RET tuya_tls_init(void)
     }
     mbedtls_ctr_drbg_set_prediction_resistance(&ty_ctr_drbg, MBEDTLS_CTR_DRBG_PR_OFF);
 
+#if defined(TLS_SESSION_CACHE_ENABLE)
+    if (NULL == s_session_mutex) {
+        tal_mutex_create_init(&s_session_mutex);
+    }
+#endif
+
     PR_NOTICE("tuya_tls_init ok!");
 
     return OPRT_OK;
@@ -572,6 +895,12 @@ OPERATE_RET tuya_tls_connect(tuya_tls_hander p_tls_handler, char *hostname, int
     mbedtls_ssl_context *p_ssl_ctx = &(tls_context->ssl_ctx);
     mbedtls_ssl_config *p_conf_ctx = &(tls_context->conf_ctx);
 
+#if defined(TLS_SESSION_CACHE_ENABLE)
+    char session_name[TLS_URL_LEN] = {0};
+    unsigned char session_master[48];
+    BOOL_T session_offered = FALSE;
+#endif
+
     mbedtls_ssl_init(p_ssl_ctx);
     mbedtls_ssl_config_init(p_conf_ctx);
 
@@ -633,6 +962,14 @@ OPERATE_RET tuya_tls_connect(tuya_tls_hander p_tls_handler, char *hostname, int
         goto tuya_tls_connect_EXIT;
     }
 
+#if defined(TLS_SESSION_CACHE_ENABLE)
+    /* offer the cached session, server decides resume it or do a full handshake */
+    if (hostname) {
+        __tuya_tls_session_name(&tls_context->config, session_name, sizeof(session_name));
+        session_offered = __tuya_tls_session_set(p_ssl_ctx, session_name, session_master);
+    }
+#endif
+
     /* BIO default config */
     tls_context->socket_fd = socket_fd;
     tls_context->overtime_s = overtime_s;
@@ -679,6 +1016,12 @@ OPERATE_RET tuya_tls_connect(tuya_tls_hander p_tls_handler, char *hostname, int
         goto tuya_tls_connect_EXIT;
     }
 
+#if defined(TLS_SESSION_CACHE_ENABLE)
+    if (hostname) {
+        __tuya_tls_session_update(p_ssl_ctx, session_name, session_offered, session_master);
+    }
+#endif
+
     PR_DEBUG("handshake finish for %s. set send/recv to user set", (hostname ? hostname : ""));
     if (tls_context->config.f_send && tls_context->config.f_recv) {
         mbedtls_ssl_set_bio(p_ssl_ctx, tls_context->config.user_data, tls_context->config.f_send,
@@ -692,6 +1035,12 @@ OPERATE_RET tuya_tls_connect(tuya_tls_hander p_tls_handler, char *hostname, int
 
 tuya_tls_connect_EXIT:
 
+#if defined(TLS_SESSION_CACHE_ENABLE)
+    if (session_offered && __tuya_tls_session_refused(op_ret)) {
+        __tuya_tls_session_drop(session_name);
+    }
+#endif
+
     PR_ERR("TUYA_TLS faild Connect %s:%d", (hostname ? hostname : ""), port_num);
 
     return op_ret;
@@ -784,6 +1133,30 @@ int tuya_tls_read(tuya_tls_hander tls_handler, uint8_t *buf, uint32_t len)
     return value;
 }
 
+/**
+ * @brief Checks if the TLS connection has read data buffered.
+ *
+ * A record read from the socket may hold more than the caller asked for, the
+ * rest stays in the TLS context and is not seen by a select on the socket.
+ *
+ * @param[in] tls_handler The TLS handler.
+ *
+ * @return TRUE if decrypted or not yet processed data is buffered.
+ */
+BOOL_T tuya_tls_read_pending(tuya_tls_hander tls_handler)
+{
+    if (tls_handler == NULL) {
+        return FALSE;
+    }
+
+    tuya_mbedtls_context_t *tls_context = (tuya_mbedtls_context_t *)tls_handler;
+    tal_mutex_lock(tls_context->read_mutex);
+    int pending = mbedtls_ssl_check_pending(&(tls_context->ssl_ctx));
+    tal_mutex_unlock(tls_context->read_mutex);
+
+    return pending ? TRUE : FALSE;
+}
+
 /**
  * @brief generated random
  *
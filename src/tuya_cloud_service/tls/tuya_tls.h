@@ -62,6 +62,11 @@ typedef enum {
  */
 typedef void (*tuya_tls_event_cb)(tuya_tls_event_t event, void *p_args);
 
+typedef struct {
+    uint32_t hit;  // handshake resumed from the cached session
+    uint32_t miss; // full handshake, no session cached or server refused it
+} tuya_tls_session_stat_t;
+
 typedef struct {
     tuya_tls_mode_t mode;
     char *hostname;
@@ -198,6 +203,15 @@ int tuya_tls_write(tuya_tls_hander tls_handler, uint8_t *buf, uint32_t len);
  */
 int tuya_tls_read(tuya_tls_hander tls_handler, uint8_t *buf, uint32_t len);
 
+/**
+ * @brief check if tls has read data buffered, the socket does not show it
+ *
+ * @param[in] tls_handler refer to tuya_tls_hander
+ *
+ * @return TRUE if tuya_tls_read can return data without reading the socket
+ */
+BOOL_T tuya_tls_read_pending(tuya_tls_hander tls_handler);
+
 /**
  * @brief generated random
  *
@@ -231,6 +245,25 @@ const tuya_tls_config_t *tuya_tls_psk_mode_config_get(void);
  */
 tuya_tls_event_cb tuya_cert_get_tls_event_cb(void);
 
+/**
+ * Retrieves the counters of the TLS session cache.
+ *
+ * Every successful handshake of tuya_tls_connect is counted as a hit if it
+ * resumed the session cached for the same host and port, or a miss if a full
+ * handshake was done. All zero if the session cache is disabled.
+ *
+ * @param stat Pointer to the structure receiving the counters.
+ */
+void tuya_tls_session_stat_get(tuya_tls_session_stat_t *stat);
+
+/**
+ * Clears the TLS session cache, including the sessions persisted in kv.
+ *
+ * Call it when the cloud endpoint or the device identity changes, the next
+ * connect to every host will do a full handshake.
+ */
+void tuya_tls_session_cache_clear(void);
+
 #ifdef __cplusplus
 }
 
@@ -239,6 +239,11 @@ OPERATE_RET tuya_tls_transporter_ctrl(tuya_transporter_t t, uint32_t cmd, void *
         *s = (void *)config;
         break;
     }
+    case TUYA_TRANSPORTER_GET_READ_PENDING: {
+        BOOL_T *pending = (BOOL_T *)args;
+        *pending = tuya_tls_read_pending(tls_transporter->tls_handler);
+        break;
+    }
 
     default: {
         ret = tuya_transporter_ctrl(tls_transporter->tcp_transporter, cmd, args);
@@ -36,6 +36,7 @@ extern "C" {
 #define TUYA_TRANSPORTER_SET_WEBSOCKET_CONFIG 0x0004
 #define TUYA_TRANSPORTER_SET_TLS_CONFIG       0x0005
 #define TUYA_TRANSPORTER_GET_TLS_CONFIG       0x0006
+#define TUYA_TRANSPORTER_GET_READ_PENDING     0x0007 // BOOL_T *, data buffered above the socket
 
 struct socket_config_t {
     uint8_t isBlock;
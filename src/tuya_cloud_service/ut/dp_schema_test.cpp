@@ -0,0 +1,653 @@
+/**
+ * @file dp_schema_test.cpp
+ * @brief UT of dp schema.
+ *
+ * @copyright Copyright (c) 2021-2024 Tuya Inc. All Rights Reserved.
+ *
+ */
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <string>
+
+#include "dp_schema.h"
+#include "mix_method.h"
+#include "cJSON.h"
+#include "tal_api.h"
+#include "ut_tal_stub.h"
+
+#define UT_DEVID   "ut_devid"
+#define UT_DP_NUM  200
+#define UT_LOOKUPS 1000000
+#define UT_LOADS   200
+#define UT_REPORTS 20000
+
+/**
+ * @brief build a schema of dp_num dps with every type, dp ids spread over 1..255
+ */
+static std::string ut_schema_json(int dp_num)
+{
+    std::string json = "[";
+
+    for (int i = 0; i < dp_num; i++) {
+        std::string id = std::to_string(1 + (i * 7) % 255);
+        if (i) {
+            json += ",";
+        }
+        switch (i % 6) {
+        case 0:
+            json += "{\"mode\":\"rw\",\"property\":{\"type\":\"bool\"},\"id\":" + id + ",\"type\":\"obj\"}";
+            break;
+        case 1:
+            json += "{\"mode\":\"rw\",\"property\":{\"min\":-100,\"max\":1000,\"scale\":1,\"step\":1,\"type\":\"value\"},"
+                    "\"id\":" + id + ",\"type\":\"obj\"}";
+            break;
+        case 2:
+            json += "{\"mode\":\"rw\",\"property\":{\"range\":[\"low\",\"middle\",\"high\"],\"type\":\"enum\"},"
+                    "\"id\":" + id + ",\"type\":\"obj\"}";
+            break;
+        case 3:
+            json += "{\"mode\":\"rw\",\"property\":{\"type\":\"string\",\"maxlen\":255},\"id\":" + id + ",\"type\":\"obj\"}";
+            break;
+        case 4:
+            json += "{\"mode\":\"ro\",\"property\":{\"label\":[\"a\",\"b\"],\"type\":\"bitmap\",\"maxlen\":32},"
+                    "\"id\":" + id + ",\"type\":\"obj\"}";
+            break;
+        default:
+            json += "{\"mode\":\"rw\",\"id\":" + id + ",\"type\":\"raw\"}";
+            break;
+        }
+    }
+    json += "]";
+
+    return json;
+}
+
+/**
+ * @brief the lookup dp_node_find did before the id index, kept as reference
+ */
+static dp_node_t *ut_node_find_linear(dp_schema_t *schema, int id)
+{
+    for (int i = 0; i < schema->num; i++) {
+        if (schema->node[i].desc.id == id) {
+            return &schema->node[i];
+        }
+    }
+    return NULL;
+}
+
+class DpSchemaTest : public ::testing::Test {
+protected:
+    dp_schema_t *schema = NULL;
+
+    void SetUp() override
+    {
+        std::string json = ut_schema_json(UT_DP_NUM);
+        ASSERT_EQ(OPRT_OK, dp_schema_create((char *)UT_DEVID, (char *)json.c_str(), &schema));
+        ASSERT_NE((dp_schema_t *)NULL, schema);
+    }
+
+    void TearDown() override
+    {
+        dp_schema_delete((char *)UT_DEVID);
+    }
+};
+
+TEST_F(DpSchemaTest, create)
+{
+    EXPECT_EQ(UT_DP_NUM, schema->num);
+    EXPECT_EQ(schema, dp_schema_find(UT_DEVID));
+    EXPECT_EQ((dp_schema_t *)NULL, dp_schema_find("ut_unknown"));
+}
+
+TEST_F(DpSchemaTest, node_find_matches_linear)
+{
+    for (int id = -1; id <= DP_ID_INDEX_NUM; id++) {
+        dp_node_t *ref = (id < 0 || id >= DP_ID_INDEX_NUM) ? NULL : ut_node_find_linear(schema, id);
+        EXPECT_EQ(ref, dp_node_find(schema, id)) << "dp id " << id;
+    }
+    EXPECT_EQ(dp_node_find(schema, 8), dp_node_find_by_devid((char *)UT_DEVID, 8));
+    EXPECT_EQ((dp_node_t *)NULL, dp_node_find(NULL, 1));
+}
+
+static void ut_rept_fill(dp_schema_t *schema, int num, dp_obj_t *dps, dp_rept_in_t *dpin, dp_rept_valid_t *dpvalid);
+
+/**
+ * @brief lookup time of both methods, and the latency of a whole report
+ * (dp_rept_valid_check + dp_rept_json_write) with the share spent in lookups
+ */
+TEST_F(DpSchemaTest, node_find_bench)
+{
+    static const int nums[] = {1, 10, 50};
+    volatile uintptr_t sink = 0;
+    dp_obj_t dps[50];
+    uint8_t valid_buf[sizeof(dp_rept_valid_t) + 50];
+    dp_rept_valid_t *dpvalid = (dp_rept_valid_t *)valid_buf;
+    dp_rept_in_t dpin;
+    uint32_t len = 0;
+    char buf[4096];
+
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < UT_LOOKUPS; i++) {
+        sink += (uintptr_t)ut_node_find_linear(schema, i & 0xFF);
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    for (int i = 0; i < UT_LOOKUPS; i++) {
+        sink += (uintptr_t)dp_node_find(schema, i & 0xFF);
+    }
+    auto t2 = std::chrono::steady_clock::now();
+
+    double linear_ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / UT_LOOKUPS;
+    double index_ns = std::chrono::duration<double, std::nano>(t2 - t1).count() / UT_LOOKUPS;
+    printf("[ BENCH    ] %d dps, linear %.2f ns/lookup, index %.2f ns/lookup\n", UT_DP_NUM, linear_ns, index_ns);
+
+    for (int num : nums) {
+        ut_rept_fill(schema, num, dps, &dpin, dpvalid);
+        ASSERT_EQ(num, dpvalid->num);
+        // a repeat report skips the unchanged value filter, every dp is looked up and written each time
+        dpin.rept_type = T_RE_TRANS_REPT;
+
+        auto t3 = std::chrono::steady_clock::now();
+        for (int i = 0; i < UT_REPORTS; i++) {
+            memset(dpvalid, 0, sizeof(dp_rept_valid_t));
+            ASSERT_EQ(OPRT_OK, dp_rept_valid_check(schema, &dpin, dpvalid));
+            ASSERT_EQ(OPRT_OK, dp_rept_json_write(schema, &dpin, dpvalid, DP_APPEND_HEADER_FLAG, buf, sizeof(buf), &len));
+        }
+        auto t4 = std::chrono::steady_clock::now();
+
+        double rept_us = std::chrono::duration<double, std::micro>(t4 - t3).count() / UT_REPORTS;
+        // dp_rept_valid_check and dp_rept_json_write look up every dp once
+        printf("[ BENCH    ] %2d dps/report: report %.2f us, lookups index %.3f us, linear %.3f us\n", num, rept_us,
+               2 * num * index_ns / 1000, 2 * num * linear_ns / 1000);
+    }
+}
+
+/**
+ * @brief fill dps/dpvalid with the first num obj dps of the schema
+ */
+static void ut_rept_fill(dp_schema_t *schema, int num, dp_obj_t *dps, dp_rept_in_t *dpin, dp_rept_valid_t *dpvalid)
+{
+    int n = 0;
+
+    for (int i = 0; i < schema->num && n < num; i++) {
+        dp_node_t *node = &schema->node[i];
+        if (T_OBJ != node->desc.type) {
+            continue;
+        }
+        dp_obj_t *dp = &dps[n];
+        memset(dp, 0, sizeof(dp_obj_t));
+        dp->id = node->desc.id;
+        dp->type = node->desc.prop_tp;
+        switch (dp->type) {
+        case PROP_BOOL:
+            dp->value.dp_bool = true;
+            break;
+        case PROP_VALUE:
+            dp->value.dp_value = -12345;
+            break;
+        case PROP_STR:
+            dp->value.dp_str = (char *)"say \"hello\"\n";
+            break;
+        case PROP_ENUM:
+            dp->value.dp_enum = 1;
+            break;
+        case PROP_BITMAP:
+            dp->value.dp_bitmap = 0x80000001;
+            break;
+        }
+        dpvalid->dpid[n] = dp->id;
+        n++;
+    }
+    memset(dpin, 0, sizeof(dp_rept_in_t));
+    dpin->dpscnt = n;
+    dpin->dps = dps;
+    dpvalid->num = n;
+    dpvalid->schema = schema;
+}
+
+static std::string ut_rept_write(dp_schema_t *schema, dp_rept_in_t *dpin, dp_rept_valid_t *dpvalid)
+{
+    uint32_t len = 0;
+    char buf[4096];
+
+    if (OPRT_OK != dp_rept_json_write(schema, dpin, dpvalid, DP_APPEND_HEADER_FLAG, NULL, 0, &len) ||
+        len >= sizeof(buf) ||
+        OPRT_OK != dp_rept_json_write(schema, dpin, dpvalid, DP_APPEND_HEADER_FLAG, buf, sizeof(buf), &len)) {
+        return "";
+    }
+    return std::string(buf, len);
+}
+
+/**
+ * @brief the report path before the streaming writer: a cJSON tree per report,
+ * printed, then copied into the devId envelope with sprintf
+ */
+static char *ut_rept_write_cjson(dp_schema_t *schema, dp_rept_in_t *dpin)
+{
+    char dpid[10];
+    cJSON *root = cJSON_CreateObject();
+
+    for (int i = 0; i < dpin->dpscnt; i++) {
+        dp_obj_t *dp = &dpin->dps[i];
+        snprintf(dpid, sizeof(dpid), "%d", dp->id);
+        switch (dp->type) {
+        case PROP_BOOL:
+            cJSON_AddBoolToObject(root, dpid, dp->value.dp_bool);
+            break;
+        case PROP_VALUE:
+            cJSON_AddNumberToObject(root, dpid, dp->value.dp_value);
+            break;
+        case PROP_BITMAP:
+            cJSON_AddNumberToObject(root, dpid, dp->value.dp_bitmap);
+            break;
+        case PROP_STR:
+            cJSON_AddStringToObject(root, dpid, dp->value.dp_str);
+            break;
+        case PROP_ENUM:
+            cJSON_AddStringToObject(root, dpid, dp_node_find(schema, dp->id)->prop.prop_enum.pp_enum[dp->value.dp_enum]);
+            break;
+        }
+    }
+    char *dps = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    if (NULL == dps) {
+        return NULL;
+    }
+    char *out = (char *)tal_malloc(strlen(dps) + strlen(schema->devid) + 32);
+    if (out) {
+        sprintf(out, "{\"devId\":\"%s\",\"dps\":%s}", schema->devid, dps);
+    }
+    tal_free(dps);
+    return out;
+}
+
+TEST_F(DpSchemaTest, rept_write)
+{
+    dp_obj_t dps[6];
+    uint8_t valid_buf[sizeof(dp_rept_valid_t) + 6];
+    dp_rept_valid_t *dpvalid = (dp_rept_valid_t *)valid_buf;
+    dp_rept_in_t dpin;
+
+    ut_rept_fill(schema, 5, dps, &dpin, dpvalid);
+    ASSERT_EQ(5, dpvalid->num);
+    EXPECT_EQ("{\"devId\":\"ut_devid\",\"dps\":{\"1\":true,\"8\":-12345,\"15\":\"middle\","
+              "\"22\":\"say \\\"hello\\\"\\n\",\"29\":2147483649}}",
+              ut_rept_write(schema, &dpin, dpvalid));
+}
+
+TEST_F(DpSchemaTest, rept_write_bench)
+{
+    static const int nums[] = {1, 10, 50};
+    dp_obj_t dps[50];
+    uint8_t valid_buf[sizeof(dp_rept_valid_t) + 50];
+    dp_rept_valid_t *dpvalid = (dp_rept_valid_t *)valid_buf;
+    dp_rept_in_t dpin;
+    cJSON_Hooks hooks = {tal_malloc, tal_free};
+
+    cJSON_InitHooks(&hooks);
+    for (int num : nums) {
+        ut_rept_fill(schema, num, dps, &dpin, dpvalid);
+        ASSERT_EQ(num, dpvalid->num);
+
+        auto t0 = std::chrono::steady_clock::now();
+        for (int i = 0; i < UT_REPORTS; i++) {
+            ASSERT_NE(0u, ut_rept_write(schema, &dpin, dpvalid).size());
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        for (int i = 0; i < UT_REPORTS; i++) {
+            tal_free(ut_rept_write_cjson(schema, &dpin));
+        }
+        auto t2 = std::chrono::steady_clock::now();
+
+        double stream_s = std::chrono::duration<double>(t1 - t0).count();
+        double cjson_s = std::chrono::duration<double>(t2 - t1).count();
+        printf("[ BENCH    ] %2d dps/report: streaming %.0f reports/s, cJSON tree %.0f reports/s\n", num,
+               UT_REPORTS / stream_s, UT_REPORTS / cjson_s);
+    }
+    cJSON_InitHooks(NULL);
+}
+
+static dp_schema_t *ut_schema_create(const std::string &json)
+{
+    dp_schema_t *schema = NULL;
+
+    if (OPRT_OK != dp_schema_create((char *)UT_DEVID, (char *)json.c_str(), &schema)) {
+        return NULL;
+    }
+    return schema;
+}
+
+TEST(DpSchemaParseTest, unicode_escape)
+{
+    std::string json = "[{\"mode\":\"rw\",\"property\":{\"range\":[\"caf\\u00e9\",\"\\u4e2d\","
+                       "\"\\ud83d\\ude00\",\"a\\tb\"],\"type\":\"enum\"},\"id\":1,\"type\":\"obj\"}]";
+    dp_schema_t *schema = ut_schema_create(json);
+
+    ASSERT_NE((dp_schema_t *)NULL, schema);
+    dp_prop_enum_t *prop = &dp_node_find(schema, 1)->prop.prop_enum;
+    ASSERT_EQ(4, prop->cnt);
+    EXPECT_STREQ("caf\xc3\xa9", prop->pp_enum[0]);
+    EXPECT_STREQ("\xe4\xb8\xad", prop->pp_enum[1]);
+    EXPECT_STREQ("\xf0\x9f\x98\x80", prop->pp_enum[2]);
+    EXPECT_STREQ("a\tb", prop->pp_enum[3]);
+    dp_schema_delete((char *)UT_DEVID);
+}
+
+TEST(DpSchemaParseTest, unicode_lone_surrogate)
+{
+    const char *bad[] = {"\\ud83d", "\\ud83dx", "\\ud83d\\u0041", "\\ude00", "\\u12g4"};
+
+    for (const char *esc : bad) {
+        std::string json = "[{\"mode\":\"rw\",\"property\":{\"range\":[\"" + std::string(esc) +
+                           "\"],\"type\":\"enum\"},\"id\":1,\"type\":\"obj\"}]";
+        EXPECT_EQ((dp_schema_t *)NULL, ut_schema_create(json)) << esc;
+        dp_schema_delete((char *)UT_DEVID);
+    }
+}
+
+TEST(DpSchemaParseTest, int_clamp)
+{
+    std::string json = "[{\"mode\":\"rw\",\"property\":{\"min\":-99999999999,\"max\":\"4294967296\","
+                       "\"scale\":2147483647,\"type\":\"value\"},\"id\":1,\"type\":\"obj\"},"
+                       "{\"mode\":\"rw\",\"property\":{\"min\":-2147483648,\"max\":2147483647,"
+                       "\"type\":\"value\"},\"id\":2,\"type\":\"obj\"}]";
+    dp_schema_t *schema = ut_schema_create(json);
+
+    ASSERT_NE((dp_schema_t *)NULL, schema);
+    EXPECT_EQ(INT32_MIN, dp_node_find(schema, 1)->prop.prop_int.min);
+    EXPECT_EQ(INT32_MAX, dp_node_find(schema, 1)->prop.prop_int.max);
+    EXPECT_EQ(INT32_MIN, dp_node_find(schema, 2)->prop.prop_int.min);
+    EXPECT_EQ(INT32_MAX, dp_node_find(schema, 2)->prop.prop_int.max);
+    dp_schema_delete((char *)UT_DEVID);
+}
+
+// a string attribute of another json type fails the node before its value is compared
+TEST(DpSchemaParseTest, string_attr_not_string)
+{
+    const char *keys[] = {"mode", "trigger", "stat", "type"};
+
+    for (const char *key : keys) {
+        std::string json = "[{\"mode\":\"rw\",\"property\":{\"type\":\"bool\"},\"id\":1,\"type\":\"obj\",\"" +
+                           std::string(key) + "\":1}]";
+        EXPECT_EQ((dp_schema_t *)NULL, ut_schema_create(json)) << key;
+        dp_schema_delete((char *)UT_DEVID);
+    }
+}
+
+typedef struct {
+    uint16_t start;
+    uint16_t end;
+} ut_node_pos_t;
+
+#define UT_MAX_ITEM_LEN 1024
+
+/**
+ * @brief dp_node_pos_decode before the streaming parser, kept as reference
+ */
+static int ut_node_pos_decode(const char *schema_json, ut_node_pos_t pos[], int pos_num)
+{
+    int i = 0, brace = 0, n = 0;
+
+    while (*schema_json) {
+        if (*schema_json == '{') {
+            if (brace == 0) {
+                pos[n].start = i;
+            }
+            brace++;
+        } else if (*schema_json == '}') {
+            brace--;
+            if (brace == 0) {
+                pos[n++].end = i;
+            }
+            if (n >= pos_num) {
+                return n;
+            }
+        }
+        i++;
+        schema_json++;
+    }
+
+    return n;
+}
+
+/**
+ * @brief dp_node_parse before the streaming parser, kept as reference: every
+ * node is copied into a MAX_ITEM_LEN scratch buffer and parsed into its own
+ * cJSON tree
+ */
+static OPERATE_RET ut_node_parse_cjson(const char *schema_json, ut_node_pos_t *nodepos, uint16_t nodenum,
+                                       dp_node_t *dpnode)
+{
+    OPERATE_RET op_ret = OPRT_OK;
+    cJSON *cjson = NULL;
+    cJSON *item = NULL, *child = NULL;
+    char *pBuf = (char *)tal_malloc(UT_MAX_ITEM_LEN);
+
+    if (NULL == pBuf) {
+        return OPRT_MALLOC_FAILED;
+    }
+
+    for (int i = 0; i < nodenum; i++) {
+        dp_desc_t *dp_desc = &(dpnode[i].desc);
+        dp_prop_vaule_t *prop = &(dpnode[i].prop);
+
+        memset(pBuf, 0, UT_MAX_ITEM_LEN);
+        memcpy(pBuf, schema_json + nodepos[i].start, nodepos[i].end - nodepos[i].start + 1);
+        cjson = cJSON_Parse(pBuf);
+        if (NULL == cjson || NULL == (item = cJSON_GetObjectItem(cjson, "id"))) {
+            op_ret = OPRT_CJSON_PARSE_ERR;
+            goto __exit;
+        }
+        dp_desc->id = (item->type == cJSON_String) ? atoi(item->valuestring) : item->valueint;
+        if (NULL == (item = cJSON_GetObjectItem(cjson, "mode"))) {
+            op_ret = OPRT_CJSON_GET_ERR;
+            goto __exit;
+        }
+        if (!strcmp(item->valuestring, "rw")) {
+            dp_desc->mode = M_RW;
+        } else if (!strcmp(item->valuestring, "ro")) {
+            dp_desc->mode = M_RO;
+        } else {
+            dp_desc->mode = M_WR;
+        }
+        dp_desc->passive = PSV_FALSE;
+        item = cJSON_GetObjectItem(cjson, "trigger");
+        dp_desc->trig = (NULL == item || !strcmp(item->valuestring, "pulse")) ? TRIG_PULSE : TRIG_DIRECT;
+        item = cJSON_GetObjectItem(cjson, "route");
+        if (NULL == item) {
+            dp_desc->route_t = ROUTE_DEFAULT;
+        } else if (item->valueint == 2) {
+            dp_desc->route_t = ROUTE_FORCE_BT;
+        } else if (item->valueint == 1) {
+            dp_desc->route_t = ROUTE_BLE_FIRST;
+        } else {
+            dp_desc->route_t = ROUTE_DEFAULT;
+        }
+        item = cJSON_GetObjectItem(cjson, "stat");
+        if (NULL == item) {
+            dp_desc->stat = DST_NONE;
+        } else {
+            dp_desc->stat = !strcmp(item->valuestring, "total") ? DST_TOTAL : DST_INC;
+        }
+        item = cJSON_GetObjectItem(cjson, "type");
+        if (NULL == item || !strcmp(item->valuestring, "obj")) {
+            dp_desc->type = T_OBJ;
+        } else {
+            dp_desc->type = !strcmp(item->valuestring, "raw") ? T_RAW : T_FILE;
+            cJSON_Delete(cjson);
+            cjson = NULL;
+            continue;
+        }
+        item = cJSON_GetObjectItem(cjson, "property");
+        if (NULL == item || NULL == (child = cJSON_GetObjectItem(item, "type"))) {
+            op_ret = OPRT_CJSON_GET_ERR;
+            goto __exit;
+        }
+        if (!strcmp(child->valuestring, "bool")) {
+            dp_desc->prop_tp = PROP_BOOL;
+        } else if (!strcmp(child->valuestring, "value")) {
+            dp_desc->prop_tp = PROP_VALUE;
+            if (NULL == (child = cJSON_GetObjectItem(item, "max"))) {
+                op_ret = OPRT_CJSON_GET_ERR;
+                goto __exit;
+            }
+            prop->prop_int.max = child->valueint;
+            if (NULL == (child = cJSON_GetObjectItem(item, "min"))) {
+                op_ret = OPRT_CJSON_GET_ERR;
+                goto __exit;
+            }
+            prop->prop_int.min = child->valueint;
+            child = cJSON_GetObjectItem(item, "scale");
+            prop->prop_int.scale = child ? child->valueint : 0;
+        } else if (!strcmp(child->valuestring, "string")) {
+            dp_desc->prop_tp = PROP_STR;
+            if (NULL == (child = cJSON_GetObjectItem(item, "maxlen"))) {
+                op_ret = OPRT_CJSON_GET_ERR;
+                goto __exit;
+            }
+            prop->prop_str.max_len = child->valueint;
+            op_ret = tal_mutex_create_init(&prop->prop_str.dp_str_mutex);
+            if (OPRT_OK != op_ret) {
+                goto __exit;
+            }
+        } else if (!strcmp(child->valuestring, "enum")) {
+            dp_desc->prop_tp = PROP_ENUM;
+            child = cJSON_GetObjectItem(item, "range");
+            int num = child ? cJSON_GetArraySize(child) : 0;
+            if (0 == num) {
+                op_ret = OPRT_CJSON_GET_ERR;
+                goto __exit;
+            }
+            prop->prop_enum.pp_enum = (char **)tal_malloc(num * sizeof(char *));
+            if (NULL == prop->prop_enum.pp_enum) {
+                op_ret = OPRT_MALLOC_FAILED;
+                goto __exit;
+            }
+            prop->prop_enum.cnt = num;
+            for (int j = 0; j < num; j++) {
+                prop->prop_enum.pp_enum[j] = mm_strdup(cJSON_GetArrayItem(child, j)->valuestring);
+            }
+        } else if (!strcmp(child->valuestring, "bitmap")) {
+            dp_desc->prop_tp = PROP_BITMAP;
+            if (NULL == (child = cJSON_GetObjectItem(item, "maxlen"))) {
+                op_ret = OPRT_CJSON_GET_ERR;
+                goto __exit;
+            }
+            prop->prop_bitmap.max_len = child->valueint;
+        } else {
+            op_ret = OPRT_SVC_DEVOS_SCMA_INVALID;
+            goto __exit;
+        }
+        cJSON_Delete(cjson);
+        cjson = NULL;
+    }
+
+__exit:
+    tal_free(pBuf);
+    cJSON_Delete(cjson);
+    return op_ret;
+}
+
+/**
+ * @brief dp_schema_create before the streaming parser, without registering
+ * the schema
+ */
+static dp_schema_t *ut_schema_create_cjson(const char *json)
+{
+    ut_node_pos_t *nodepos = (ut_node_pos_t *)tal_malloc(sizeof(ut_node_pos_t) * 255);
+    dp_schema_t *schema = NULL;
+    int nodenum;
+
+    if (NULL == nodepos) {
+        return NULL;
+    }
+    nodenum = ut_node_pos_decode(json, nodepos, 255);
+    if (0 < nodenum && nodenum < 255) {
+        schema = (dp_schema_t *)tal_malloc(sizeof(dp_schema_t) + nodenum * sizeof(dp_node_t));
+    }
+    if (schema) {
+        memset(schema, 0, sizeof(dp_schema_t) + nodenum * sizeof(dp_node_t));
+        schema->num = nodenum;
+        tal_mutex_create_init(&schema->mutex);
+        if (OPRT_OK != ut_node_parse_cjson(json, nodepos, nodenum, schema->node)) {
+            tal_mutex_release(schema->mutex);
+            tal_free(schema);
+            schema = NULL;
+        }
+    }
+    tal_free(nodepos);
+    return schema;
+}
+
+static void ut_schema_delete_cjson(dp_schema_t *schema)
+{
+    for (int i = 0; i < schema->num; i++) {
+        dp_node_t *node = &schema->node[i];
+        if (T_OBJ == node->desc.type && PROP_STR == node->desc.prop_tp) {
+            tal_mutex_release(node->prop.prop_str.dp_str_mutex);
+        } else if (T_OBJ == node->desc.type && PROP_ENUM == node->desc.prop_tp) {
+            for (int j = 0; j < node->prop.prop_enum.cnt; j++) {
+                tal_free(node->prop.prop_enum.pp_enum[j]);
+            }
+            tal_free(node->prop.prop_enum.pp_enum);
+        }
+    }
+    tal_mutex_release(schema->mutex);
+    tal_free(schema);
+}
+
+/**
+ * @brief create+delete of a 254 dp schema with the streaming parser and with
+ * the cJSON path it replaced, peak heap above the same baseline for both
+ */
+TEST(DpSchemaParseTest, load_bench)
+{
+    std::string json = ut_schema_json(254);
+    cJSON_Hooks hooks = {tal_malloc, tal_free};
+    size_t base, stream_peak, cjson_peak;
+    dp_schema_t *schema = NULL;
+
+    cJSON_InitHooks(&hooks);
+
+    // both paths end with the 254 nodes on the heap, check they parse the same
+    schema = ut_schema_create_cjson(json.c_str());
+    ASSERT_NE((dp_schema_t *)NULL, schema);
+    ASSERT_NE((dp_schema_t *)NULL, ut_schema_create(json));
+    for (int i = 0; i < schema->num; i++) {
+        dp_node_t *node = dp_node_find(dp_schema_find(UT_DEVID), schema->node[i].desc.id);
+        ASSERT_NE((dp_node_t *)NULL, node);
+        EXPECT_EQ(0, memcmp(&schema->node[i].desc, &node->desc, sizeof(dp_desc_t))) << i;
+    }
+    dp_schema_delete((char *)UT_DEVID);
+    ut_schema_delete_cjson(schema);
+
+    base = ut_heap_used();
+    ut_heap_peak_reset();
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < UT_LOADS; i++) {
+        ASSERT_NE((dp_schema_t *)NULL, ut_schema_create(json));
+        dp_schema_delete((char *)UT_DEVID);
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    stream_peak = ut_heap_peak() - base;
+
+    ut_heap_peak_reset();
+    auto t2 = std::chrono::steady_clock::now();
+    for (int i = 0; i < UT_LOADS; i++) {
+        schema = ut_schema_create_cjson(json.c_str());
+        ASSERT_NE((dp_schema_t *)NULL, schema);
+        ut_schema_delete_cjson(schema);
+    }
+    auto t3 = std::chrono::steady_clock::now();
+    cjson_peak = ut_heap_peak() - base;
+    EXPECT_EQ(base, ut_heap_used());
+
+    cJSON_InitHooks(NULL);
+
+    double stream_us = std::chrono::duration<double, std::micro>(t1 - t0).count() / UT_LOADS;
+    double cjson_us = std::chrono::duration<double, std::micro>(t3 - t2).count() / UT_LOADS;
+    printf("[ BENCH    ] %zu bytes schema, 254 dps, create+delete, peak heap with the schema\n", json.size());
+    printf("[ BENCH    ] streaming        %7.1f us, peak heap %zu\n", stream_us, stream_peak);
+    printf("[ BENCH    ] per node cJSON   %7.1f us, peak heap %zu\n", cjson_us, cjson_peak);
+}
@@ -0,0 +1,478 @@
+/**
+ * @file tuya_lan_test.cpp
+ * @brief UT of tuya_lan: simulated app clients connect to the LAN service on
+ * the loopback, run the session key handshake and query the device with
+ * frames sent whole, byte by byte, coalesced and longer than the receive
+ * buffer.
+ *
+ * @copyright Copyright (c) 2021-2024 Tuya Inc. All Rights Reserved.
+ *
+ */
+
+#include <gtest/gtest.h>
+
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tal_api.h"
+#include "tal_hash.h"
+#include "tuya_protocol.h"
+#include "tuya_lan.h"
+#include "lan_sock.h"
+#include "tuya_iot_dp.h"
+#include "netmgr.h"
+#include "uni_random.h"
+#include "ut_tal_stub.h"
+
+#define UT_LAN_PORT   6668
+#define UT_LOCALKEY   "0123456789abcdef"
+#define UT_DP_DUMP    "{\"dps\":{\"1\":true,\"2\":50}}"
+#define UT_APPS       48
+#define UT_ROUNDS     8
+#define UT_TIMEOUT_MS 5000
+#define UT_WAIT_MS    60000 // an app waits this long for a free session
+#define UT_HEARTBEAT  30    // HEART_BEAT_TIMEOUT of tuya_lan.c
+
+static tuya_iot_client_t s_client;
+static std::atomic<int> s_closed; // EVENT_LAN_CLIENT_CLOSE, one per session closed by the device
+
+extern "C" {
+
+// tuya_tls.c is not built in the UT
+int tuya_tls_random(unsigned char *output, size_t output_len)
+{
+    for (size_t i = 0; i < output_len; i++) {
+        output[i] = (unsigned char)rand();
+    }
+    return 0;
+}
+
+OPERATE_RET tal_event_publish(const char *name, void *data)
+{
+    if (0 == strcmp(name, EVENT_LAN_CLIENT_CLOSE)) {
+        s_closed++;
+    }
+    return OPRT_OK;
+}
+
+OPERATE_RET netmgr_conn_get(netmgr_type_e type, netmgr_conn_config_type_e cmd, void *param)
+{
+    return OPRT_NOT_SUPPORTED;
+}
+
+int tuya_iot_dp_parse(tuya_iot_client_t *client, dp_cmd_type_t tp, cJSON *cmd_js)
+{
+    cJSON_Delete(cmd_js);
+    return OPRT_OK;
+}
+
+char *tuya_iot_dp_obj_dump(tuya_iot_client_t *client, char *devid, int flags)
+{
+    char *dump = (char *)tal_malloc(sizeof(UT_DP_DUMP));
+
+    if (dump) {
+        memcpy(dump, UT_DP_DUMP, sizeof(UT_DP_DUMP));
+    }
+    return dump;
+}
+}
+
+/* one plaintext frame sent by the device */
+struct UtLanReply {
+    uint32_t type;
+    uint32_t ret_code;
+    std::string data;
+};
+
+/* an app on the LAN, blocking socket with a receive timeout */
+class UtLanApp {
+public:
+    ~UtLanApp()
+    {
+        close();
+    }
+
+    bool connect()
+    {
+        struct sockaddr_in addr = {0};
+        struct timeval tv = {UT_TIMEOUT_MS / 1000, 0};
+        int one = 1;
+
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(UT_LAN_PORT);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        sequence = 0;
+        rx.clear();
+        return 0 == ::connect(fd, (struct sockaddr *)&addr, sizeof(addr));
+    }
+
+    void close()
+    {
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+
+    std::string frame(uint32_t type, const std::string &data, const uint8_t *key)
+    {
+        lpv35_frame_object_t obj = {++sequence, type, (uint8_t *)data.data(), (uint32_t)data.size()};
+        std::string out(lpv35_frame_buffer_size_get(&obj), '\0');
+        int olen = 0;
+
+        if (OPRT_OK != lpv35_frame_serialize(key, APP_KEY_LEN, &obj, (uint8_t *)&out[0], &olen)) {
+            return "";
+        }
+        out.resize(olen);
+        return out;
+    }
+
+    // step bytes per write, 0 writes it all at once
+    bool send(const std::string &bytes, size_t step = 0)
+    {
+        step = step ? step : bytes.size();
+        for (size_t pos = 0; pos < bytes.size(); pos += step) {
+            size_t len = std::min(step, bytes.size() - pos);
+            if (::send(fd, bytes.data() + pos, len, MSG_NOSIGNAL) != (ssize_t)len) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // length of the frame at the head of rx, which holds at least its fixed head
+    size_t frame_len(void)
+    {
+        uint32_t length = 0;
+
+        memcpy(&length, rx.data() + LPV35_FRAME_HEAD_SIZE + offsetof(lpv35_fixed_head_t, length), sizeof(length));
+        return LPV35_FRAME_HEAD_SIZE + sizeof(lpv35_fixed_head_t) + UNI_NTOHL(length) + LPV35_FRAME_TAIL_SIZE;
+    }
+
+    // false on a timeout, a closed connection or a frame that does not decrypt
+    bool recv(UtLanReply &reply, const uint8_t *key)
+    {
+        const size_t fixed = LPV35_FRAME_HEAD_SIZE + sizeof(lpv35_fixed_head_t);
+        size_t frame_len = fixed;
+
+        while (rx.size() < frame_len) {
+            char buf[1024];
+            ssize_t n = ::recv(fd, buf, sizeof(buf), 0);
+            if (n <= 0) {
+                return false;
+            }
+            rx.append(buf, n);
+            if (rx.size() >= fixed) {
+                frame_len = this->frame_len();
+            }
+        }
+        frame_len = this->frame_len();
+
+        lpv35_frame_object_t obj = {0};
+        OPERATE_RET rt = lpv35_frame_parse(key, APP_KEY_LEN, (const uint8_t *)rx.data(), frame_len, &obj);
+        rx.erase(0, frame_len);
+        if (OPRT_OK != rt || obj.data_len < sizeof(uint32_t)) {
+            tal_free(obj.data);
+            return false;
+        }
+        reply.type = obj.type;
+        reply.ret_code = ((lpv35_plaintext_data_t *)obj.data)->ret_code;
+        reply.data.assign((const char *)obj.data + sizeof(uint32_t), obj.data_len - sizeof(uint32_t));
+        tal_free(obj.data);
+        return true;
+    }
+
+    /**
+     * randA out, randB and hmac(randA) back, hmac(randB) out, both sides then
+     * encrypt randA ^ randB with the local key into the session key
+     */
+    bool handshake()
+    {
+        const uint8_t *localkey = (const uint8_t *)UT_LOCALKEY;
+        uint8_t rand_a[16], hmac[32];
+        UtLanReply reply;
+
+        uni_random_bytes(rand_a, sizeof(rand_a));
+        if (!send(frame(FRM_SECURITY_TYPE3, std::string((const char *)rand_a, 16), localkey)) ||
+            !recv(reply, localkey) || FRM_SECURITY_TYPE4 != reply.type || 48 != reply.data.size()) {
+            return false;
+        }
+        const uint8_t *rand_b = (const uint8_t *)reply.data.data();
+        tal_sha256_mac(localkey, APP_KEY_LEN, rand_a, 16, hmac);
+        if (0 != memcmp(hmac, rand_b + 16, 32)) {
+            return false;
+        }
+        tal_sha256_mac(localkey, APP_KEY_LEN, rand_b, 16, hmac);
+        if (!send(frame(FRM_SECURITY_TYPE5, std::string((const char *)hmac, 32), localkey))) {
+            return false;
+        }
+
+        uint8_t tag[LPV35_FRAME_TAG_SIZE];
+        size_t olen = 0;
+        cipher_params_t params = {0};
+        for (int i = 0; i < 16; i++) {
+            key[i] = rand_a[i] ^ rand_b[i];
+        }
+        params.cipher_type = MBEDTLS_CIPHER_AES_128_GCM;
+        params.key = (unsigned char *)localkey;
+        params.key_len = APP_KEY_LEN;
+        params.nonce = rand_a;
+        params.nonce_len = LPV35_FRAME_NONCE_SIZE;
+        params.data = key;
+        params.data_len = 16;
+        return 0 == mbedtls_cipher_auth_encrypt_wrapper(&params, key, &olen, tag, LPV35_FRAME_TAG_SIZE);
+    }
+
+    /**
+     * connect and get a session key. The device refuses apps while all its
+     * sessions are taken, the session of an app that just left is only freed
+     * by the next loop, so the app tries again. A key starting with 0 reads
+     * as no key on the device, the app starts over then too
+     */
+    bool open()
+    {
+        auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(UT_WAIT_MS);
+
+        while (std::chrono::steady_clock::now() < end) {
+            if (!connect() || !handshake()) {
+                close();
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                continue;
+            }
+            if (key[0]) {
+                return true;
+            }
+            close();
+            retries++;
+        }
+        return false;
+    }
+
+    bool expect_query(void)
+    {
+        UtLanReply reply;
+        return recv(reply, key) && FRM_QUERY_STAT_NEW == reply.type && 0 == reply.ret_code && UT_DP_DUMP == reply.data;
+    }
+
+    bool expect_heartbeat(void)
+    {
+        UtLanReply reply;
+        return recv(reply, key) && FRM_TP_HB == reply.type && reply.data.empty();
+    }
+
+    /* one round of requests, the way they are written depends on round */
+    bool request(int round)
+    {
+        std::string bytes = frame(FRM_QUERY_STAT_NEW, "{}", key);
+
+        switch (round % 4) {
+        case 0: // whole frames
+            return send(bytes) && expect_query() && send(frame(FRM_TP_HB, "", key)) && expect_heartbeat();
+        case 1: // one byte per write, every read ends in the middle of a frame
+            return send(bytes, 1) && expect_query();
+        case 2: // three frames in one write, the last one cut short
+            bytes += frame(FRM_TP_HB, "", key);
+            bytes += frame(FRM_QUERY_STAT_NEW, "{}", key);
+            return send(bytes.substr(0, bytes.size() - 10)) && send(bytes.substr(bytes.size() - 10)) &&
+                   expect_query() && expect_heartbeat() && expect_query();
+        default: // longer than the session receive buffer
+            bytes = frame(FRM_QUERY_STAT_NEW, "{\"pad\":\"" + std::string(2000, 'a') + "\"}", key);
+            return send(bytes, 700) && expect_query();
+        }
+    }
+
+    int fd = -1;
+    uint32_t sequence = 0;
+    uint8_t key[16] = {0};
+    std::string rx;
+    int retries = 0; // sessions given up for a key starting with 0
+};
+
+class TuyaLanTest : public ::testing::Test {
+protected:
+    static size_t heap_base;
+
+    static void SetUpTestSuite()
+    {
+        s_client.is_activated = true;
+        strcpy(s_client.activate.localkey, UT_LOCALKEY);
+        heap_base = ut_heap_used();
+        ASSERT_EQ(OPRT_OK, tuya_lan_init(&s_client));
+    }
+
+    static void TearDownTestSuite()
+    {
+        // the loop quits within a wait, then tears the service down
+        tuya_sock_loop_disable();
+        std::this_thread::sleep_for(std::chrono::milliseconds(2500));
+        EXPECT_EQ(heap_base, ut_heap_used());
+    }
+
+    void SetUp() override
+    {
+        s_closed = 0;
+    }
+
+    // the device sees the apps go and frees their sessions
+    void wait_closed(int sessions)
+    {
+        auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(UT_TIMEOUT_MS);
+        while (s_closed < sessions && std::chrono::steady_clock::now() < end) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        EXPECT_EQ(sessions, s_closed);
+    }
+};
+
+size_t TuyaLanTest::heap_base;
+
+// open fds of the process, the device and the apps share it
+static int ut_fd_count(void)
+{
+    DIR *dir = opendir("/proc/self/fd");
+    int cnt = 0;
+
+    while (dir && readdir(dir)) {
+        cnt++;
+    }
+    if (dir) {
+        closedir(dir);
+    }
+    return cnt;
+}
+
+TEST_F(TuyaLanTest, session)
+{
+    UtLanApp app;
+
+    ASSERT_TRUE(app.open());
+    for (int round = 0; round < 8; round++) {
+        SCOPED_TRACE(round);
+        EXPECT_TRUE(app.request(round));
+    }
+    EXPECT_EQ(1, tuya_lan_get_connect_client_num());
+    app.close();
+    wait_closed(1 + app.retries);
+}
+
+// a frame that is not the next sequence resets the session
+TEST_F(TuyaLanTest, sequence)
+{
+    UtLanApp app;
+    UtLanReply reply;
+
+    ASSERT_TRUE(app.open());
+    std::string first = app.frame(FRM_QUERY_STAT_NEW, "{}", app.key);
+    std::string second = app.frame(FRM_QUERY_STAT_NEW, "{}", app.key);
+    EXPECT_TRUE(app.send(second) && app.expect_query());
+    EXPECT_TRUE(app.send(first));
+    EXPECT_FALSE(app.recv(reply, app.key));
+    wait_closed(1 + app.retries);
+}
+
+// every session is taken, the next app is closed right after accept
+TEST_F(TuyaLanTest, client_limit)
+{
+    std::vector<UtLanApp> apps(tuya_lan_get_client_num());
+    UtLanApp extra;
+    UtLanReply reply;
+    int retries = 0;
+
+    for (auto &app : apps) {
+        ASSERT_TRUE(app.open());
+        retries += app.retries;
+    }
+    ASSERT_TRUE(extra.connect());
+    EXPECT_FALSE(extra.recv(reply, (const uint8_t *)UT_LOCALKEY));
+    for (auto &app : apps) {
+        EXPECT_TRUE(app.request(0));
+        app.close();
+    }
+    wait_closed(apps.size() + retries);
+}
+
+/**
+ * dozens of apps at once, each on its own thread, more than the device has
+ * sessions for: apps wait for a free session, come and go, every reply must
+ * reach the app that asked and the device must not leak
+ */
+TEST_F(TuyaLanTest, load)
+{
+    std::atomic<int> ok(0), sessions(0);
+    std::vector<std::thread> threads;
+
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < UT_APPS; i++) {
+        threads.emplace_back([i, &ok, &sessions]() {
+            UtLanApp app;
+            for (int round = 0; round < UT_ROUNDS; round++) {
+                // a third of the apps reconnect half way through
+                if (0 == round || (i % 3 == 0 && UT_ROUNDS / 2 == round)) {
+                    app.close();
+                    if (!app.open()) {
+                        break;
+                    }
+                    sessions++;
+                }
+                if (!app.request(round + i)) {
+                    break;
+                }
+                ok++;
+            }
+            sessions += app.retries;
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    printf("[ BENCH    ] %d apps on %d sessions, %d rounds each: %.0f rounds/s\n", UT_APPS,
+           (int)tuya_lan_get_client_num(), UT_ROUNDS, ok / s);
+
+    EXPECT_EQ(UT_APPS * UT_ROUNDS, ok);
+    wait_closed(sessions);
+}
+
+/**
+ * every session misses its heartbeat, the loop closes them all in one turn:
+ * each app sees the close and no fd of the device is left open
+ */
+TEST_F(TuyaLanTest, timeout_all)
+{
+    std::vector<UtLanApp> apps(tuya_lan_get_client_num());
+    int fds = ut_fd_count();
+    int retries = 0;
+
+    for (auto &app : apps) {
+        ASSERT_TRUE(app.open());
+        retries += app.retries;
+    }
+    wait_closed(retries);
+    ASSERT_EQ((int)apps.size(), tuya_lan_get_connect_client_num());
+
+    ut_time_forward(UT_HEARTBEAT + 1);
+    wait_closed(apps.size() + retries);
+    for (auto &app : apps) {
+        // a reset if the device closed with bytes of the app unread, a timeout if never closed
+        char buf[1];
+        ssize_t n = ::recv(app.fd, buf, sizeof(buf), 0);
+        EXPECT_TRUE(0 == n || (n < 0 && ECONNRESET == errno)) << n << " " << errno;
+        app.close();
+    }
+    EXPECT_EQ(0, tuya_lan_get_connect_client_num());
+    EXPECT_EQ(fds, ut_fd_count());
+}
@@ -0,0 +1,335 @@
+/**
+ * @file tuya_ota_delta_test.cpp
+ * @brief UT of tuya_ota_delta: a package is applied against a RAM old image
+ * and the rebuilt image is checked against the sha256 in its header, and a
+ * package made by tools/ota_delta/ota_delta.py rebuilds its new image.
+ *
+ * @copyright Copyright (c) 2021-2024 Tuya Inc. All Rights Reserved.
+ *
+ */
+
+#include <gtest/gtest.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "tal_api.h"
+#include "tal_hash.h"
+#include "tal_ota.h"
+#include "tkl_flash.h"
+#include "tuya_ota_delta.h"
+
+#define UT_OLD_ADDR 0x10000
+#define UT_OLD_SIZE (64 * 1024)
+
+//! must match OTA_DELTA_LZ_* of tuya_ota_delta.c and tools/ota_delta
+#define UT_LZ_WINDOW    256
+#define UT_LZ_MIN_MATCH 3
+#define UT_LZ_MAX_MATCH (16 + UT_LZ_MIN_MATCH - 1)
+
+/* the running image in the app partition and the image written by ota */
+static std::string s_flash;
+static std::string s_image;
+static uint32_t s_image_size;
+static uint32_t s_keep; // bytes of every pack the platform leaves for the next one
+static bool s_keep_last;
+
+extern "C" {
+
+OPERATE_RET tkl_flash_get_one_type_info(TUYA_FLASH_TYPE_E type, TUYA_FLASH_BASE_INFO_T *info)
+{
+    if (TUYA_FLASH_TYPE_APP != type) {
+        return OPRT_NOT_SUPPORTED;
+    }
+    info->partition_num = 1;
+    info->partition[0].start_addr = UT_OLD_ADDR;
+    info->partition[0].size = UT_OLD_SIZE;
+    return OPRT_OK;
+}
+
+OPERATE_RET tkl_flash_read(uint32_t addr, uint8_t *dst, uint32_t size)
+{
+    if (addr < UT_OLD_ADDR || addr + size > UT_OLD_ADDR + s_flash.size()) {
+        return OPRT_INVALID_PARM;
+    }
+    memcpy(dst, s_flash.data() + addr - UT_OLD_ADDR, size);
+    return OPRT_OK;
+}
+
+OPERATE_RET tal_ota_start_notify(uint32_t image_size, TUYA_OTA_TYPE_E type, TUYA_OTA_PATH_E path)
+{
+    s_image.clear();
+    s_image_size = image_size;
+    return OPRT_OK;
+}
+
+OPERATE_RET tal_ota_data_process(TUYA_OTA_DATA_T *pack, uint32_t *remain_len)
+{
+    uint32_t keep = pack->len < s_keep ? pack->len : s_keep;
+
+    if (pack->offset != s_image.size() || pack->total_len != s_image_size) {
+        return OPRT_INVALID_PARM;
+    }
+    if (!s_keep_last && pack->offset + pack->len == pack->total_len) {
+        keep = 0;
+    }
+    s_image.append((const char *)pack->data, pack->len - keep);
+    *remain_len = keep;
+    return OPRT_OK;
+}
+}
+
+static std::string ut_read_file(const std::string &path)
+{
+    std::ifstream file(path, std::ios::binary);
+    std::stringstream data;
+
+    data << file.rdbuf();
+    return data.str();
+}
+
+static void ut_varint(std::string &out, uint32_t value)
+{
+    while (value >= 0x80) {
+        out += (char)(value | 0x80);
+        value >>= 7;
+    }
+    out += (char)value;
+}
+
+/* one record: diff_len bytes of old at old_pos become new at new_pos, extra_len new bytes follow */
+static void ut_record(std::string &body, const std::string &old_img, const std::string &new_img, size_t old_pos,
+                      size_t new_pos, size_t diff_len, size_t extra_len, int32_t seek)
+{
+    std::string literal;
+
+    ut_varint(body, diff_len);
+    ut_varint(body, extra_len);
+    ut_varint(body, seek >= 0 ? (uint32_t)seek << 1 : ((uint32_t)-seek << 1) - 1);
+    for (size_t i = 0; i < diff_len;) {
+        size_t j = i;
+        while (j < diff_len && new_img[new_pos + j] == old_img[old_pos + j]) {
+            j++;
+        }
+        if (j - i >= 3) {
+            if (!literal.empty()) {
+                ut_varint(body, literal.size() << 1);
+                body += literal;
+                literal.clear();
+            }
+            ut_varint(body, ((j - i) << 1) | 1);
+            i = j;
+        } else {
+            literal += (char)(new_img[new_pos + i] - old_img[old_pos + i]);
+            i++;
+        }
+    }
+    if (!literal.empty()) {
+        ut_varint(body, literal.size() << 1);
+        body += literal;
+    }
+    body += new_img.substr(new_pos + diff_len, extra_len);
+}
+
+/* greedy lzss, flag 1 + 8 bit literal or flag 0 + 8 bit offset + 4 bit length */
+static std::string ut_lzss(const std::string &data)
+{
+    std::string out;
+    uint32_t bits = 0, bit_cnt = 0;
+
+    for (size_t i = 0; i < data.size();) {
+        size_t best = 0, best_off = 0;
+        for (size_t off = 1; off <= UT_LZ_WINDOW && off <= i; off++) {
+            size_t len = 0;
+            while (len < UT_LZ_MAX_MATCH && i + len < data.size() && data[i + len - off] == data[i + len]) {
+                len++;
+            }
+            if (len > best) {
+                best = len;
+                best_off = off;
+            }
+        }
+        if (best >= UT_LZ_MIN_MATCH) {
+            bits = (bits << 13) | ((best_off - 1) << 4) | (best - UT_LZ_MIN_MATCH);
+            bit_cnt += 13;
+            i += best;
+        } else {
+            bits = (bits << 9) | 0x100 | (uint8_t)data[i];
+            bit_cnt += 9;
+            i++;
+        }
+        while (bit_cnt >= 8) {
+            bit_cnt -= 8;
+            out += (char)(bits >> bit_cnt);
+        }
+        bits &= (1 << bit_cnt) - 1;
+    }
+    if (bit_cnt) {
+        out += (char)(bits << (8 - bit_cnt));
+    }
+    return out;
+}
+
+static void ut_le32(std::string &out, uint32_t value)
+{
+    for (int i = 0; i < 4; i++) {
+        out += (char)(value >> (i * 8));
+    }
+}
+
+static std::string ut_sha256(const std::string &data)
+{
+    uint8_t sha256[32];
+
+    tal_sha256_ret((const uint8_t *)data.data(), data.size(), sha256, 0);
+    return std::string((const char *)sha256, 32);
+}
+
+class OtaDeltaTest : public ::testing::Test {
+protected:
+    std::string old_img;
+    std::string new_img;
+    std::string package;
+
+    /**
+     * new image: the old one with a few patched bytes, 1000 inserted bytes,
+     * a skipped block and the head of the old image moved to the end
+     */
+    void SetUp() override
+    {
+        std::string body;
+
+        old_img.resize(UT_OLD_SIZE);
+        for (size_t i = 0; i < old_img.size(); i++) {
+            old_img[i] = (char)((i * 2654435761u) >> 13);
+        }
+        new_img = old_img.substr(0, 20000);
+        for (size_t i = 100; i < 20000; i += 997) {
+            new_img[i] ^= 0x5a;
+        }
+        for (int i = 0; i < 1000; i++) {
+            new_img += (char)(i % 17);
+        }
+        new_img += old_img.substr(30000, UT_OLD_SIZE - 30000);
+        new_img += old_img.substr(0, 4096);
+
+        ut_record(body, old_img, new_img, 0, 0, 20000, 1000, 10000);
+        ut_record(body, old_img, new_img, 30000, 21000, UT_OLD_SIZE - 30000, 0, -UT_OLD_SIZE);
+        ut_record(body, old_img, new_img, 0, 21000 + UT_OLD_SIZE - 30000, 4096, 0, 0);
+
+        package = TUYA_OTA_DELTA_MAGIC;
+        ut_le32(package, TUYA_OTA_DELTA_VERSION);
+        ut_le32(package, old_img.size());
+        ut_le32(package, new_img.size());
+        package += ut_sha256(old_img) + ut_sha256(new_img) + ut_lzss(body);
+
+        s_flash = old_img;
+        s_image.clear();
+        s_keep = 0;
+        s_keep_last = false;
+    }
+
+    int apply(size_t chunk)
+    {
+        tuya_ota_delta_t *delta = NULL;
+        int rt = OPRT_OK;
+
+        if (OPRT_OK != (rt = tuya_ota_delta_create(&delta))) {
+            return rt;
+        }
+        for (size_t pos = 0; pos < package.size() && OPRT_OK == rt; pos += chunk) {
+            rt = tuya_ota_delta_apply(delta, (const uint8_t *)package.data() + pos,
+                                      std::min(chunk, package.size() - pos));
+        }
+        if (OPRT_OK == rt) {
+            rt = tuya_ota_delta_finish(delta);
+        }
+        tuya_ota_delta_destroy(delta);
+        return rt;
+    }
+};
+
+TEST_F(OtaDeltaTest, apply)
+{
+    ASSERT_TRUE(tuya_ota_delta_is_patch((const uint8_t *)package.data(), package.size()));
+    EXPECT_LT(package.size(), new_img.size() / 4);
+
+    for (size_t chunk : {(size_t)1, (size_t)7, (size_t)1024, (size_t)4096, package.size()}) {
+        SCOPED_TRACE(chunk);
+        s_image.clear();
+        EXPECT_EQ(OPRT_OK, apply(chunk));
+        EXPECT_EQ(new_img.size(), s_image_size);
+        EXPECT_TRUE(new_img == s_image);
+        EXPECT_EQ(ut_sha256(new_img), ut_sha256(s_image));
+    }
+}
+
+// the platform writes whole sectors only and keeps the tail until the last pack
+TEST_F(OtaDeltaTest, platform_keeps_tail)
+{
+    s_keep = 100;
+    EXPECT_EQ(OPRT_OK, apply(1024));
+    EXPECT_TRUE(new_img == s_image);
+}
+
+// a tail kept from the last pack never reaches flash
+TEST_F(OtaDeltaTest, platform_keeps_last_pack)
+{
+    s_keep = 100;
+    s_keep_last = true;
+    EXPECT_NE(OPRT_OK, apply(1024));
+    EXPECT_EQ(new_img.size() - 100, s_image.size());
+}
+
+TEST_F(OtaDeltaTest, old_image_mismatch)
+{
+    s_flash[UT_OLD_SIZE / 2] ^= 1;
+    EXPECT_NE(OPRT_OK, apply(1024));
+    EXPECT_TRUE(s_image.empty());
+}
+
+TEST_F(OtaDeltaTest, new_sha256_mismatch)
+{
+    package[16 + 32] ^= 1;
+    EXPECT_NE(OPRT_OK, apply(1024));
+    EXPECT_TRUE(new_img == s_image);
+}
+
+TEST_F(OtaDeltaTest, truncated)
+{
+    package.resize(package.size() - 10);
+    EXPECT_NE(OPRT_OK, apply(1024));
+}
+
+/**
+ * ota_delta/patch.bin is made by the host tool from the two images next to it:
+ *   tools/ota_delta/ota_delta.py diff old.bin new.bin patch.bin
+ * new.bin inserts a function and a string into old.bin, which moves the
+ * addresses after them. Remake the three files together
+ */
+TEST_F(OtaDeltaTest, host_tool_package)
+{
+    const char *new_sha256 = "371fb2c98974645c216e2cde4c97f27a2ad7402f4bb9eb86beb4a9b52fc8651e";
+    std::string hex;
+
+    old_img = ut_read_file(UT_OTA_DELTA_DIR "/old.bin");
+    new_img = ut_read_file(UT_OTA_DELTA_DIR "/new.bin");
+    package = ut_read_file(UT_OTA_DELTA_DIR "/patch.bin");
+    ASSERT_FALSE(old_img.empty() || new_img.empty() || package.empty());
+    ASSERT_TRUE(tuya_ota_delta_is_patch((const uint8_t *)package.data(), package.size()));
+    s_flash = old_img;
+
+    for (size_t chunk : {(size_t)1, (size_t)1024, package.size()}) {
+        SCOPED_TRACE(chunk);
+        s_image.clear();
+        EXPECT_EQ(OPRT_OK, apply(chunk));
+        EXPECT_TRUE(new_img == s_image);
+    }
+    for (uint8_t byte : ut_sha256(s_image)) {
+        char buf[3];
+        snprintf(buf, sizeof(buf), "%02x", byte);
+        hex += buf;
+    }
+    EXPECT_EQ(new_sha256, hex);
+}
@@ -0,0 +1,279 @@
+#!/usr/bin/python3
+# -*- coding:utf-8 -*-
+
+##
+# @file ota_delta.py
+# @brief Generate and check delta ota packages applied by tuya_ota_delta.c.
+#
+# The old image must be byte for byte what the device runs from its
+# TUYA_FLASH_TYPE_APP partition, the device refuses a package made from
+# anything else.
+#
+# usage:
+#   ota_delta.py diff old.bin new.bin patch.bin
+#   ota_delta.py apply old.bin patch.bin new.bin
+# @version 1.0.0
+# @date 2024-10-18
+import argparse
+import hashlib
+import struct
+import sys
+
+MAGIC = b"TYDF"
+VERSION = 1
+HEADER_FMT = "<4sIII32s32s"
+
+# length of the exact match that starts a diff record
+MATCH_LEN = 16
+# old image positions indexed for the match search
+INDEX_STRIDE = 4
+# how far an approximate match may fall behind its best score
+SCORE_SLACK = 16
+# shorter zero runs are cheaper inside a literal
+ZERO_RUN_MIN = 3
+# lzss of the body, must match OTA_DELTA_LZ_* of tuya_ota_delta.c
+LZ_WINDOW_BITS = 8
+LZ_LENGTH_BITS = 4
+LZ_MIN_MATCH = 3
+
+
+def varint(value):
+    out = bytearray()
+    while True:
+        byte = value & 0x7f
+        value >>= 7
+        if value:
+            out.append(byte | 0x80)
+        else:
+            out.append(byte)
+            return bytes(out)
+
+
+def zigzag(value):
+    return value << 1 if value >= 0 else ((-value) << 1) - 1
+
+
+def unzigzag(value):
+    return (value >> 1) ^ -(value & 1)
+
+
+def read_varint(data, pos):
+    value, shift = 0, 0
+    while True:
+        byte = data[pos]
+        pos += 1
+        value |= (byte & 0x7f) << shift
+        if not byte & 0x80:
+            return value, pos
+        shift += 7
+
+
+def lz_compress(data):
+    data = bytes(data)
+    window = 1 << LZ_WINDOW_BITS
+    max_len = (1 << LZ_LENGTH_BITS) + LZ_MIN_MATCH - 1
+    bits, bit_cnt = 0, 0
+    out = bytearray()
+    chains = {}
+    i = 0
+    while i < len(data):
+        best, best_off = 0, 0
+        for j in reversed(chains.get(data[i:i + LZ_MIN_MATCH], [])[-16:]):
+            if i - j > window:
+                break
+            length = 0
+            while length < max_len and i + length < len(data) and data[j + length] == data[i + length]:
+                length += 1
+            if length > best:
+                best, best_off = length, i - j
+        if best >= LZ_MIN_MATCH:
+            code = ((best_off - 1) << LZ_LENGTH_BITS) | (best - LZ_MIN_MATCH)
+            bits, bit_cnt = (bits << (LZ_WINDOW_BITS + LZ_LENGTH_BITS + 1)) | code, bit_cnt + LZ_WINDOW_BITS + LZ_LENGTH_BITS + 1
+            step = best
+        else:
+            bits, bit_cnt = (bits << 9) | 0x100 | data[i], bit_cnt + 9
+            step = 1
+        for k in range(i, i + step):
+            chains.setdefault(data[k:k + LZ_MIN_MATCH], []).append(k)
+        i += step
+        while bit_cnt >= 8:
+            bit_cnt -= 8
+            out.append((bits >> bit_cnt) & 0xff)
+        bits &= (1 << bit_cnt) - 1
+    if bit_cnt:
+        out.append((bits << (8 - bit_cnt)) & 0xff)
+    return bytes(out)
+
+
+def lz_decompress(data):
+    ref_bits = 1 + LZ_WINDOW_BITS + LZ_LENGTH_BITS
+    out = bytearray()
+    bits, bit_cnt = 0, 0
+    for byte in data:
+        bits, bit_cnt = (bits << 8) | byte, bit_cnt + 8
+        while bit_cnt:
+            if (bits >> (bit_cnt - 1)) & 1:
+                if bit_cnt < 9:
+                    break
+                bit_cnt -= 9
+                out.append((bits >> bit_cnt) & 0xff)
+            else:
+                if bit_cnt < ref_bits:
+                    break
+                bit_cnt -= ref_bits
+                code = (bits >> bit_cnt) & ((1 << (ref_bits - 1)) - 1)
+                offset = (code >> LZ_LENGTH_BITS) + 1
+                for _ in range((code & ((1 << LZ_LENGTH_BITS) - 1)) + LZ_MIN_MATCH):
+                    out.append(out[-offset])
+        bits &= (1 << bit_cnt) - 1
+    return bytes(out)
+
+
+def extend(old, new, n_pos, o_pos):
+    """Extends a match forward while matching bytes outweigh the others, like bsdiff."""
+    best, best_score, score, i = 0, 0, 0, 0
+    limit = min(len(new) - n_pos, len(old) - o_pos)
+    while i < limit:
+        score += 1 if new[n_pos + i] == old[o_pos + i] else -1
+        i += 1
+        if score > best_score:
+            best_score, best = score, i
+        elif score < best_score - SCORE_SLACK:
+            break
+    return best
+
+
+def encode_diff(old, new, n_pos, o_pos, length):
+    diff = bytes((new[n_pos + i] - old[o_pos + i]) & 0xff for i in range(length))
+    out = bytearray()
+    i = 0
+    literal = bytearray()
+    while i < length:
+        j = i
+        while j < length and diff[j] == 0:
+            j += 1
+        if j - i >= ZERO_RUN_MIN:
+            if literal:
+                out += varint(len(literal) << 1) + literal
+                literal = bytearray()
+            out += varint(((j - i) << 1) | 1)
+            i = j
+        else:
+            literal.append(diff[i])
+            i += 1
+    if literal:
+        out += varint(len(literal) << 1) + literal
+    return bytes(out)
+
+
+def make_patch(old, new):
+    index = {}
+    for i in range(0, len(old) - MATCH_LEN + 1, INDEX_STRIDE):
+        index.setdefault(old[i:i + MATCH_LEN], i)
+
+    header = struct.pack(HEADER_FMT, MAGIC, VERSION, len(old), len(new),
+                         hashlib.sha256(old).digest(), hashlib.sha256(new).digest())
+    out = bytearray()
+
+    # pending diff record: new start, old start, length
+    p_new, p_old, p_len = 0, 0, 0
+    disp = 0
+    scan = 0
+    while scan + MATCH_LEN <= len(new):
+        key = new[scan:scan + MATCH_LEN]
+        # prefer the displacement of the previous match, code moves in blocks
+        o_pos = scan + disp
+        if not (0 <= o_pos <= len(old) - MATCH_LEN and old[o_pos:o_pos + MATCH_LEN] == key):
+            o_pos = index.get(key)
+        if o_pos is None:
+            scan += 1
+            continue
+
+        n_pos = scan
+        while n_pos > p_new + p_len and o_pos > 0 and new[n_pos - 1] == old[o_pos - 1]:
+            n_pos -= 1
+            o_pos -= 1
+        length = extend(old, new, n_pos, o_pos)
+
+        out += record(old, new, p_new, p_old, p_len, n_pos, o_pos - (p_old + p_len))
+        p_new, p_old, p_len = n_pos, o_pos, length
+        disp = o_pos - n_pos
+        scan = n_pos + length
+
+    if new:
+        out += record(old, new, p_new, p_old, p_len, len(new), 0)
+    return header + lz_compress(out)
+
+
+def record(old, new, p_new, p_old, p_len, extra_end, seek):
+    extra = new[p_new + p_len:extra_end]
+    return (varint(p_len) + varint(len(extra)) + varint(zigzag(seek)) +
+            encode_diff(old, new, p_new, p_old, p_len) + extra)
+
+
+def apply_patch(old, patch):
+    magic, version, old_size, new_size, old_sha, new_sha = struct.unpack_from(HEADER_FMT, patch)
+    if magic != MAGIC or version != VERSION:
+        raise ValueError("not a delta package")
+    if old_size != len(old) or hashlib.sha256(old).digest() != old_sha:
+        raise ValueError("package was made from another old image")
+
+    new = bytearray()
+    body = lz_decompress(patch[struct.calcsize(HEADER_FMT):])
+    pos = 0
+    o_pos = 0
+    while len(new) < new_size:
+        diff_len, pos = read_varint(body, pos)
+        extra_len, pos = read_varint(body, pos)
+        seek, pos = read_varint(body, pos)
+        while diff_len:
+            token, pos = read_varint(body, pos)
+            count = token >> 1
+            if token & 1:
+                new += old[o_pos:o_pos + count]
+            else:
+                new += bytes((old[o_pos + i] + body[pos + i]) & 0xff for i in range(count))
+                pos += count
+            o_pos += count
+            diff_len -= count
+        new += body[pos:pos + extra_len]
+        pos += extra_len
+        o_pos += unzigzag(seek)
+
+    if pos != len(body) or hashlib.sha256(new).digest() != new_sha:
+        raise ValueError("package is corrupted")
+    return bytes(new)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="tuya delta ota package tool")
+    sub = parser.add_subparsers(dest="cmd", required=True)
+    p = sub.add_parser("diff", help="make a package rebuilding new from old")
+    p.add_argument("old")
+    p.add_argument("new")
+    p.add_argument("patch")
+    p = sub.add_parser("apply", help="rebuild new from old and a package")
+    p.add_argument("old")
+    p.add_argument("patch")
+    p.add_argument("new")
+    args = parser.parse_args()
+
+    if args.cmd == "diff":
+        old = open(args.old, "rb").read()
+        new = open(args.new, "rb").read()
+        patch = make_patch(old, new)
+        if apply_patch(old, patch) != new:
+            print("self check failed")
+            return 1
+        open(args.patch, "wb").write(patch)
+        print("%s: %d bytes, %.1f%% of %d" % (args.patch, len(patch), len(patch) * 100.0 / max(len(new), 1), len(new)))
+    else:
+        old = open(args.old, "rb").read()
+        patch = open(args.patch, "rb").read()
+        open(args.new, "wb").write(apply_patch(old, patch))
+        print("%s rebuilt" % args.new)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
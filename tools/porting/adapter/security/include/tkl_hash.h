@@ -209,6 +209,35 @@ OPERATE_RET tkl_sha1_update_ret(TKL_HASH_HANDLE ctx, const uint8_t *input, size_
  * @return OPRT_OK on success. Others on error, please refer to tuya_error_code.h
  */
 OPERATE_RET tkl_sha1_finish_ret(TKL_HASH_HANDLE ctx, uint8_t output[20]);
+
+/**
+ * @brief This function feeds an input buffer into a crc32 calculation.
+ *
+ * @param[in,out] crc: The running crc, reflected poly 0x04C11DB7 (CRC-32/IEEE).
+ *                 The initial value and final xor 0xFFFFFFFF are applied by
+ *                 the caller, not by this function.
+ * @param[in] input: The buffer holding the input data.
+ * @param[in] ilen: The length of the input data.
+ *
+ * @note This API is used by hash_crc32i_update when ENABLE_PLATFORM_CRC32 is set.
+ *
+ * @return OPRT_OK on success. Others on error, the software crc is used then.
+ */
+OPERATE_RET tkl_crc32_update(uint32_t *crc, const uint8_t *input, size_t ilen);
+
+/**
+ * @brief This function feeds an input buffer into a crc16 calculation.
+ *
+ * @param[in,out] crc: The running crc, reflected poly 0x8005 (CRC-16/MODBUS),
+ *                 the caller starts it at 0xFFFF, no final xor.
+ * @param[in] input: The buffer holding the input data.
+ * @param[in] ilen: The length of the input data.
+ *
+ * @note This API is used by get_crc_16 when ENABLE_PLATFORM_CRC16 is set.
+ *
+ * @return OPRT_OK on success. Others on error, the software crc is used then.
+ */
+OPERATE_RET tkl_crc16_update(uint16_t *crc, const uint8_t *input, size_t ilen);
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -246,7 +246,8 @@ class porting(object):
                         continue
 
                 if f['name'] == "tkl_hash.c":
-                    if 'ENABLE_PLATFORM_SHA256' not in self.abilitys and 'ENABLE_PLATFORM_SHA1' not in self.abilitys and 'ENABLE_PLATFORM_MD5' not in self.abilitys:
+                    if 'ENABLE_PLATFORM_SHA256' not in self.abilitys and 'ENABLE_PLATFORM_SHA1' not in self.abilitys and 'ENABLE_PLATFORM_MD5' not in self.abilitys \
+                        and 'ENABLE_PLATFORM_CRC32' not in self.abilitys and 'ENABLE_PLATFORM_CRC16' not in self.abilitys:
                         continue
 
                 if (f['isnew']):                    
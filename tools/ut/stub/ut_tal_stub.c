@@ -0,0 +1,548 @@
+/**
+ * @file ut_tal_stub.c
+ * @brief TAL os services on top of libc and pthread for UT.
+ *
+ * UT cases build the sources under test together with this file instead of
+ * the platform adapter: memory, mutex, semaphore, queue, thread, time and log of
+ * tal_system and the posix and system time are mapped to the host. Logs of level
+ * UT_LOG_LEVEL and above are printed to stderr. Heap use and semaphore waits
+ * can be read back with the helpers of ut_tal_stub.h.
+ *
+ * @copyright Copyright (c) 2021-2024 Tuya Inc. All Rights Reserved.
+ *
+ */
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "tal_api.h"
+#include "ut_tal_stub.h"
+
+#ifndef UT_LOG_LEVEL
+#define UT_LOG_LEVEL TAL_LOG_LEVEL_WARN
+#endif
+
+/***********************************************************
+*************************memory*****************************
+***********************************************************/
+// every block carries its size so that heap use can be reported by ut_heap_*
+typedef struct {
+    size_t size;
+    size_t pad;
+} UT_HEAP_HDR_T;
+
+static pthread_mutex_t s_heap_mutex = PTHREAD_MUTEX_INITIALIZER;
+static size_t s_heap_used;
+static size_t s_heap_peak;
+
+static void __heap_account(size_t add, size_t sub)
+{
+    pthread_mutex_lock(&s_heap_mutex);
+    s_heap_used = s_heap_used + add - sub;
+    if (s_heap_used > s_heap_peak) {
+        s_heap_peak = s_heap_used;
+    }
+    pthread_mutex_unlock(&s_heap_mutex);
+}
+
+void *tal_malloc(size_t size)
+{
+    UT_HEAP_HDR_T *hdr = malloc(sizeof(UT_HEAP_HDR_T) + size);
+
+    if (NULL == hdr) {
+        return NULL;
+    }
+    hdr->size = size;
+    __heap_account(size, 0);
+
+    return hdr + 1;
+}
+
+void tal_free(void *ptr)
+{
+    UT_HEAP_HDR_T *hdr = (UT_HEAP_HDR_T *)ptr - 1;
+
+    if (NULL == ptr) {
+        return;
+    }
+    __heap_account(0, hdr->size);
+    free(hdr);
+}
+
+void *tal_calloc(size_t nitems, size_t size)
+{
+    void *ptr = tal_malloc(nitems * size);
+
+    if (ptr) {
+        memset(ptr, 0, nitems * size);
+    }
+    return ptr;
+}
+
+void *tal_realloc(void *ptr, size_t size)
+{
+    UT_HEAP_HDR_T *hdr = NULL;
+    size_t old = 0;
+
+    if (ptr) {
+        hdr = (UT_HEAP_HDR_T *)ptr - 1;
+        old = hdr->size;
+    }
+    hdr = realloc(hdr, sizeof(UT_HEAP_HDR_T) + size);
+    if (NULL == hdr) {
+        return NULL;
+    }
+    hdr->size = size;
+    __heap_account(size, old);
+
+    return hdr + 1;
+}
+
+// the platform allocator, used by the crypto adapters
+void *tkl_system_malloc(size_t size)
+{
+    return tal_malloc(size);
+}
+
+void tkl_system_free(void *ptr)
+{
+    tal_free(ptr);
+}
+
+int tal_system_get_free_heap_size(void)
+{
+    return 1024 * 1024;
+}
+
+size_t ut_heap_used(void)
+{
+    return s_heap_used;
+}
+
+size_t ut_heap_peak(void)
+{
+    return s_heap_peak;
+}
+
+void ut_heap_peak_reset(void)
+{
+    pthread_mutex_lock(&s_heap_mutex);
+    s_heap_peak = s_heap_used;
+    pthread_mutex_unlock(&s_heap_mutex);
+}
+
+/***********************************************************
+*************************mutex******************************
+***********************************************************/
+OPERATE_RET tal_mutex_create_init(MUTEX_HANDLE *handle)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutex_t *mutex = malloc(sizeof(pthread_mutex_t));
+
+    if (NULL == mutex) {
+        return OPRT_MALLOC_FAILED;
+    }
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+    *handle = mutex;
+
+    return OPRT_OK;
+}
+
+OPERATE_RET tal_mutex_lock(const MUTEX_HANDLE handle)
+{
+    return pthread_mutex_lock((pthread_mutex_t *)handle) ? OPRT_OS_ADAPTER_MUTEX_LOCK_FAILED : OPRT_OK;
+}
+
+OPERATE_RET tal_mutex_unlock(const MUTEX_HANDLE handle)
+{
+    return pthread_mutex_unlock((pthread_mutex_t *)handle) ? OPRT_OS_ADAPTER_MUTEX_UNLOCK_FAILED : OPRT_OK;
+}
+
+OPERATE_RET tal_mutex_release(const MUTEX_HANDLE handle)
+{
+    pthread_mutex_destroy((pthread_mutex_t *)handle);
+    free(handle);
+    return OPRT_OK;
+}
+
+/***********************************************************
+*************************semaphore**************************
+***********************************************************/
+static void __abs_time(struct timespec *ts, uint32_t timeout)
+{
+    clock_gettime(CLOCK_REALTIME, ts);
+    ts->tv_sec += timeout / 1000;
+    ts->tv_nsec += (timeout % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+typedef struct {
+    sem_t sem;
+    uint32_t max;
+} UT_SEM_T;
+
+OPERATE_RET tal_semaphore_create_init(SEM_HANDLE *handle, uint32_t sem_cnt, uint32_t sem_max)
+{
+    UT_SEM_T *sem = malloc(sizeof(UT_SEM_T));
+
+    if (NULL == sem) {
+        return OPRT_MALLOC_FAILED;
+    }
+    sem_init(&sem->sem, 0, sem_cnt);
+    sem->max = sem_max;
+    *handle = sem;
+
+    return OPRT_OK;
+}
+
+static volatile size_t s_sem_wait_cnt;
+
+OPERATE_RET tal_semaphore_wait(SEM_HANDLE handle, uint32_t timeout)
+{
+    struct timespec ts;
+    int ret;
+
+    __atomic_add_fetch(&s_sem_wait_cnt, 1, __ATOMIC_RELAXED);
+
+    if (SEM_WAIT_FOREVER == timeout) {
+        while ((ret = sem_wait(&((UT_SEM_T *)handle)->sem)) && EINTR == errno)
+            ;
+    } else {
+        __abs_time(&ts, timeout);
+        while ((ret = sem_timedwait(&((UT_SEM_T *)handle)->sem, &ts)) && EINTR == errno)
+            ;
+    }
+
+    return ret ? OPRT_OS_ADAPTER_SEM_WAIT_FAILED : OPRT_OK;
+}
+
+size_t ut_semaphore_wait_count(void)
+{
+    return s_sem_wait_cnt;
+}
+
+OPERATE_RET tal_semaphore_post(SEM_HANDLE handle)
+{
+    UT_SEM_T *sem = (UT_SEM_T *)handle;
+    int value = 0;
+
+    // the count saturates at sem_max like the platform semaphores
+    sem_getvalue(&sem->sem, &value);
+    if (sem->max && (uint32_t)value >= sem->max) {
+        return OPRT_OK;
+    }
+    return sem_post(&sem->sem) ? OPRT_OS_ADAPTER_SEM_POST_FAILED : OPRT_OK;
+}
+
+OPERATE_RET tal_semaphore_release(SEM_HANDLE handle)
+{
+    sem_destroy(&((UT_SEM_T *)handle)->sem);
+    free(handle);
+    return OPRT_OK;
+}
+
+/***********************************************************
+*************************queue******************************
+***********************************************************/
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond; // signaled on both post and fetch, waiters recheck
+    int msgsize;
+    int msgcount;
+    int head;
+    int len;
+    uint8_t buf[0];
+} UT_QUEUE_T;
+
+OPERATE_RET tal_queue_create_init(QUEUE_HANDLE *queue, int msgsize, int msgcount)
+{
+    UT_QUEUE_T *q = malloc(sizeof(UT_QUEUE_T) + msgsize * msgcount);
+
+    if (NULL == q) {
+        return OPRT_MALLOC_FAILED;
+    }
+    pthread_mutex_init(&q->mutex, NULL);
+    pthread_cond_init(&q->cond, NULL);
+    q->msgsize = msgsize;
+    q->msgcount = msgcount;
+    q->head = 0;
+    q->len = 0;
+    *queue = q;
+
+    return OPRT_OK;
+}
+
+// a full queue waits up to timeout for a fetch, 0 fails at once
+OPERATE_RET tal_queue_post(QUEUE_HANDLE queue, void *data, uint32_t timeout)
+{
+    UT_QUEUE_T *q = (UT_QUEUE_T *)queue;
+    struct timespec ts;
+
+    __abs_time(&ts, timeout);
+    pthread_mutex_lock(&q->mutex);
+    while (q->len == q->msgcount) {
+        if (0xFFFFFFFF == timeout) { // TKL_QUEUE_WAIT_FROEVER
+            pthread_cond_wait(&q->cond, &q->mutex);
+        } else if (0 == timeout || ETIMEDOUT == pthread_cond_timedwait(&q->cond, &q->mutex, &ts)) {
+            pthread_mutex_unlock(&q->mutex);
+            return OPRT_OS_ADAPTER_QUEUE_SEND_FAIL;
+        }
+    }
+    memcpy(q->buf + ((q->head + q->len) % q->msgcount) * q->msgsize, data, q->msgsize);
+    q->len++;
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->mutex);
+
+    return OPRT_OK;
+}
+
+OPERATE_RET tal_queue_fetch(QUEUE_HANDLE queue, void *msg, uint32_t timeout)
+{
+    UT_QUEUE_T *q = (UT_QUEUE_T *)queue;
+    struct timespec ts;
+
+    __abs_time(&ts, timeout);
+    pthread_mutex_lock(&q->mutex);
+    while (0 == q->len) {
+        if (0xFFFFFFFF == timeout) { // TKL_QUEUE_WAIT_FROEVER
+            pthread_cond_wait(&q->cond, &q->mutex);
+        } else if (ETIMEDOUT == pthread_cond_timedwait(&q->cond, &q->mutex, &ts)) {
+            pthread_mutex_unlock(&q->mutex);
+            return OPRT_OS_ADAPTER_QUEUE_RECV_FAIL;
+        }
+    }
+    memcpy(msg, q->buf + q->head * q->msgsize, q->msgsize);
+    q->head = (q->head + 1) % q->msgcount;
+    q->len--;
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->mutex);
+
+    return OPRT_OK;
+}
+
+void tal_queue_free(QUEUE_HANDLE queue)
+{
+    UT_QUEUE_T *q = (UT_QUEUE_T *)queue;
+
+    pthread_cond_destroy(&q->cond);
+    pthread_mutex_destroy(&q->mutex);
+    free(q);
+}
+
+/***********************************************************
+*************************thread*****************************
+***********************************************************/
+typedef struct UT_THREAD {
+    struct UT_THREAD *next;
+    pthread_t tid;
+    volatile THREAD_STATE_E state;
+    THREAD_ENTER_CB enter;
+    THREAD_EXIT_CB exit;
+    THREAD_FUNC_CB func;
+    void *args;
+} UT_THREAD_T;
+
+// callers poll the state of a deleted thread, so the handles are only freed at exit
+static pthread_mutex_t s_thread_mutex = PTHREAD_MUTEX_INITIALIZER;
+static UT_THREAD_T *s_thread_list;
+
+__attribute__((destructor)) static void __thread_list_free(void)
+{
+    UT_THREAD_T **pp = &s_thread_list;
+
+    pthread_mutex_lock(&s_thread_mutex);
+    while (*pp) {
+        UT_THREAD_T *thread = *pp;
+        if (THREAD_STATE_DELETE == thread->state) {
+            *pp = thread->next;
+            free(thread);
+        } else {
+            pp = &thread->next;
+        }
+    }
+    pthread_mutex_unlock(&s_thread_mutex);
+}
+
+static void *__thread_entry(void *args)
+{
+    UT_THREAD_T *thread = (UT_THREAD_T *)args;
+
+    if (thread->enter) {
+        thread->enter();
+    }
+    thread->func(thread->args);
+    if (thread->exit) {
+        thread->exit();
+    }
+    thread->state = THREAD_STATE_DELETE;
+
+    return NULL;
+}
+
+OPERATE_RET tal_thread_create_and_start(THREAD_HANDLE *handle, const THREAD_ENTER_CB enter, const THREAD_EXIT_CB exit,
+                                        const THREAD_FUNC_CB func, const void *func_args, const THREAD_CFG_T *cfg)
+{
+    UT_THREAD_T *thread = calloc(1, sizeof(UT_THREAD_T));
+
+    if (NULL == thread) {
+        return OPRT_MALLOC_FAILED;
+    }
+    thread->state = THREAD_STATE_RUNNING;
+    thread->enter = enter;
+    thread->exit = exit;
+    thread->func = func;
+    thread->args = (void *)func_args;
+    *handle = thread;
+    if (pthread_create(&thread->tid, NULL, __thread_entry, thread)) {
+        free(thread);
+        *handle = NULL;
+        return OPRT_OS_ADAPTER_THRD_CREAT_FAILED;
+    }
+    pthread_detach(thread->tid);
+
+    pthread_mutex_lock(&s_thread_mutex);
+    thread->next = s_thread_list;
+    s_thread_list = thread;
+    pthread_mutex_unlock(&s_thread_mutex);
+
+    return OPRT_OK;
+}
+
+OPERATE_RET tal_thread_delete(const THREAD_HANDLE handle)
+{
+    UT_THREAD_T *thread = (UT_THREAD_T *)handle;
+
+    if (THREAD_STATE_RUNNING == thread->state) {
+        thread->state = THREAD_STATE_STOP;
+    }
+    return OPRT_OK;
+}
+
+OPERATE_RET tal_thread_is_self(const THREAD_HANDLE handle, BOOL_T *bl)
+{
+    *bl = pthread_equal(((UT_THREAD_T *)handle)->tid, pthread_self()) ? TRUE : FALSE;
+    return OPRT_OK;
+}
+
+THREAD_STATE_E tal_thread_get_state(const THREAD_HANDLE handle)
+{
+    return ((UT_THREAD_T *)handle)->state;
+}
+
+OPERATE_RET tal_thread_diagnose(const THREAD_HANDLE handle)
+{
+    return OPRT_OK;
+}
+
+/***********************************************************
+*************************system*****************************
+***********************************************************/
+void tal_system_sleep(uint32_t time_ms)
+{
+    usleep(time_ms * 1000);
+}
+
+void tal_system_delay(uint32_t time_ms)
+{
+    usleep(time_ms * 1000);
+}
+
+SYS_TIME_T tal_system_get_millisecond(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (SYS_TIME_T)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+int tal_system_get_random(uint32_t range)
+{
+    return range ? rand() % range : rand();
+}
+
+static volatile uint32_t s_time_offset; // seconds added by ut_time_forward
+
+void ut_time_forward(uint32_t seconds)
+{
+    s_time_offset += seconds;
+}
+
+TIME_T tal_time_get_posix(void)
+{
+    return (TIME_T)time(NULL) + s_time_offset;
+}
+
+SYS_TICK_T tal_time_get_posix_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ((SYS_TICK_T)ts.tv_sec + s_time_offset) * 1000 + ts.tv_nsec / 1000000;
+}
+
+void tal_time_get_system_time(TIME_S *pSecTime, TIME_MS *pMsTime)
+{
+    SYS_TIME_T ms = tal_system_get_millisecond();
+
+    if (pSecTime) {
+        *pSecTime = ms / 1000;
+    }
+    if (pMsTime) {
+        *pMsTime = ms % 1000;
+    }
+}
+
+uint32_t tal_system_enter_critical(void)
+{
+    return 0;
+}
+
+void tal_system_exit_critical(uint32_t irq_mask)
+{
+}
+
+/***********************************************************
+*************************log********************************
+***********************************************************/
+OPERATE_RET tal_log_print(const TAL_LOG_LEVEL_E level, const char *file, const int line, char *fmt, ...)
+{
+    va_list ap;
+
+    if (level > UT_LOG_LEVEL) {
+        return OPRT_OK;
+    }
+    va_start(ap, fmt);
+    fprintf(stderr, "[%s:%d] ", file, line);
+    vfprintf(stderr, fmt, ap);
+    fputc('\n', stderr);
+    va_end(ap);
+
+    return OPRT_OK;
+}
+
+OPERATE_RET tal_log_print_raw(const char *pFmt, ...)
+{
+    va_list ap;
+
+    if (TAL_LOG_LEVEL_DEBUG > UT_LOG_LEVEL) {
+        return OPRT_OK;
+    }
+    va_start(ap, pFmt);
+    vfprintf(stderr, pFmt, ap);
+    va_end(ap);
+
+    return OPRT_OK;
+}
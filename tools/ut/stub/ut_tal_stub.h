@@ -0,0 +1,50 @@
+/**
+ * @file ut_tal_stub.h
+ * @brief Helpers of the UT tal stub.
+ *
+ * @copyright Copyright (c) 2021-2024 Tuya Inc. All Rights Reserved.
+ *
+ */
+
+#ifndef __UT_TAL_STUB_H__
+#define __UT_TAL_STUB_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief bytes currently allocated by tal_malloc/tal_calloc/tal_realloc
+ */
+size_t ut_heap_used(void);
+
+/**
+ * @brief highest ut_heap_used() since the last ut_heap_peak_reset()
+ */
+size_t ut_heap_peak(void);
+
+/**
+ * @brief restart peak tracking from the current heap use
+ */
+void ut_heap_peak_reset(void);
+
+/**
+ * @brief how many times tal_semaphore_wait has been called, i.e. the wakeups
+ * of threads blocking on a semaphore
+ */
+size_t ut_semaphore_wait_count(void);
+
+/**
+ * @brief move the posix time of tal_time_get_posix and tal_time_get_posix_ms
+ * forward, the system tick is not changed
+ */
+void ut_time_forward(uint32_t seconds);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __UT_TAL_STUB_H__ */